@@ -0,0 +1,47 @@
+/**
+ * A function run once on a thread of its own -- see backgroundTask.h
+ */
+
+/*************** Includes *******************/
+#include "backgroundTask.h"
+
+#include <chrono>
+
+using namespace std;
+
+/******************** FUNCTIONS ***********************/
+BackgroundTask::BackgroundTask(): finished(false), seconds(0){
+}
+
+BackgroundTask::~BackgroundTask(){
+    wait();
+    if (thread.joinable())
+        thread.detach();    // exit() called by the task itself
+}
+
+void BackgroundTask::start(const function<void()> &task){
+    if (thread.joinable())
+        thread.join();
+    finished = false;
+    seconds = 0;
+    thread = std::thread([this, task](){
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        task();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        finished.store(true, memory_order_release);
+    });
+}
+
+void BackgroundTask::wait(){
+    // exit() called by the task itself would otherwise join its own thread
+    if (thread.joinable() && thread.get_id() != this_thread::get_id())
+        thread.join();
+}
+
+bool BackgroundTask::isFinished(){
+    if (!finished.load(memory_order_acquire))
+        return false;
+    if (thread.joinable())
+        thread.join();
+    return true;
+}
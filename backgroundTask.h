@@ -0,0 +1,55 @@
+/**
+ * A function run once on a thread of its own
+ *
+ * start() hands the function to a new thread and returns at once. The
+ * thread that started it polls isFinished() -- from a frame loop, say --
+ * and never waits: once isFinished() returns true, everything the function
+ * wrote is visible to the caller and the thread has been joined.
+ *
+ * Destroying a task that is still running waits for it to finish, as does
+ * wait(), for when the task uses something that is torn down first.
+ */
+
+#ifndef BACKGROUNDTASK_H_
+#define BACKGROUNDTASK_H_
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+/*************** Classes *******************/
+class BackgroundTask{
+    std::thread thread;
+    std::atomic<bool> finished;
+    double seconds;     // the function took, set before finished
+
+    // Disallow copying
+    BackgroundTask(const BackgroundTask &);
+    BackgroundTask &operator=(const BackgroundTask &);
+public:
+    BackgroundTask();
+    ~BackgroundTask();
+
+    // Run task on a new thread. Waits for a task started earlier first.
+    void start(const std::function<void()> &task);
+
+    // True once the task has run to the end; joins its thread the first time
+    bool isFinished();
+
+    // Block until the task has finished. Does nothing on the task's own thread.
+    void wait();
+
+    /**
+     * Getters
+     */
+    bool isRunning() const {
+        return thread.joinable() && !finished;
+    }
+
+    // Seconds the task ran for, once it has finished
+    double getSeconds() const {
+        return seconds;
+    }
+};
+
+#endif /* BACKGROUNDTASK_H_ */
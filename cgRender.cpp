@@ -14,33 +14,96 @@
  *  	- CTRL + Left/Right: Rotate clockwise/anti-clockwise or change direction of rotation depending on auto-rotate state
  *  	- M: Cycle material setting
  *  	- T: Toggle texture
- *  	- S: Dump scene parameters to console
- *  	- P: Save scene to screenshot.tga screenshot
+ *  	- V: Toggle between vertex buffers and the display list
+ *  	- L: Toggle automatic level of detail (vertex buffers only)
+ *  	- C: Toggle cluster culling (vertex buffers only)
+ *  	- B: Toggle backface culling
+ *  	- S: Dump scene parameters and frame times to console
+ *  	- P: Save a numbered screenshot (screenshot0000.tga, ...)
+ *  	- F: Start/stop recording numbered frames (frame00000.tga, ...)
+ *  	- O: Toggle the stage timing overlay
+ *  	- X: Write the recorded timings to trace.json (chrome://tracing or Perfetto)
+ *  	- Left click: Place a landmark on the mesh and list the vertices nearest it
+ *  	- U: Remove the last landmark
  *  	- 1,2,3,4: Pre-defined scenes
  */
 
 /*************** Includes *******************/
+#define GL_GLEXT_PROTOTYPES     // vertex buffer objects, see meshBuffers.h
 #include <GL/glut.h>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <cmath>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <sstream>
+#include <chrono>
+#include <thread>
+#include <random>
+
+#include "backgroundTask.h"
+#include "fileWatcher.h"
+#include "frameCapture.h"
+#include "frameScheduler.h"
+#include "imageFile.h"
+#include "matrix4.h"
+#include "meshArena.h"
+#include "meshBuffers.h"
+#include "meshBvh.h"
+#include "meshCache.h"
+#include "meshClusters.h"
+#include "meshGenerator.h"
+#include "meshInstancing.h"
+#include "meshKernels.h"
+#include "meshOptimiser.h"
+#include "meshReduction.h"
+#include "meshSimplifier.h"
+#include "meshWelder.h"
+#include "mipmaps.h"
+#include "polygonList.h"
+#include "profiler.h"
+#include "scene.h"
+#include "softRenderer.h"
+#include "textureCache.h"
+#include "textureCompression.h"
+#include "threadPool.h"
+#include "vertexArrays.h"
+#include "vtkParser.h"
+#include "vtkWriter.h"
 
 using namespace std;
 
 /*************** Macros *******************/
-// Path to VTK file
+// Default VTK file, ASCII or binary legacy or .vtp (see vtkParser.h); --mesh PATH overrides it
 #define VTK_PATH "data/face.vtk"
-// Path to texture file
+// Default texture file; --texture PATH overrides it
 #define TEXTURE_PATH "data/face.ppm"
+// Mip chain of a texture, built on the first launch, next to the texture
+#define TEXTURE_MIPS_SUFFIX ".mips"
+// Block compressed mip chain of a texture, encoded on the first launch
+#define TEXTURE_BC1_SUFFIX ".bc1"
+
+// Upload the texture BC1 compressed when the GL has S3TC, a sixth of the memory of RGB8
+#define COMPRESS_TEXTURE 1
+
+// Vertical field of view in degrees
+#define FIELD_OF_VIEW 27.5
 
 // Rotating angle step
 #define ROTATION_STEP 2.f
 
+// Frames drawn per second at most, while something changes
+#define FRAME_RATE 60
+
+// Auto rotation in degrees per second, ROTATION_STEP a frame at 60 frames a second
+#define ROTATION_SPEED (ROTATION_STEP * 60.f)
+
 // Zooming step
 #define ZOOM_STEP 0.1f
 
@@ -51,6 +114,77 @@ using namespace std;
 #define ROTATION_CLOCKWISE -1.f
 #define ROTATION_ANTICLOCKWISE 1.f
 
+// Weight of each face normal in the vertex normals
+#define NORMAL_WEIGHT_UNIFORM 0     // plain average of the face normals
+#define NORMAL_WEIGHT_AREA 1        // weighted by face area
+#define NORMAL_WEIGHT_ANGLE 2       // weighted by the angle of the face at the vertex
+#define NORMAL_WEIGHTING NORMAL_WEIGHT_AREA
+
+// Reorder a freshly parsed mesh for cache locality before it is cached
+#define OPTIMISE_MESH 1
+
+// Points of a parsed mesh closer than this, in mesh units, are welded into one vertex (--weld-epsilon; 0 keeps them all)
+#define WELD_EPSILON 1e-6f
+// ... unless a texture coordinate differs by more than this, so texture seams stay split
+#define WELD_UV_EPSILON 1e-6f
+
+// Largest simplification error allowed on screen, in pixels, when picking a level of detail
+#define LOD_PIXEL_ERROR 0.5f
+
+// Start with backface culling on ('b' toggles it). The face is an open surface whose inside shows from behind.
+#define CULL_BACKFACES 0
+
+// Window title; the culling counts of the last frame, or the loading progress, are appended
+#define WINDOW_TITLE "Graphics Coursework 1 (ywc110)"
+
+// Geometry uploaded per frame while the window fills in after a background load
+#define UPLOAD_BYTES_PER_FRAME (4 << 20)
+// Polygons compiled into each of the display lists the mesh is split into
+#define DISPLAY_LIST_CHUNK 16384
+
+// How often the mesh and texture files are checked for changes, in ms; reloads in flight are checked every frame
+#define WATCH_INTERVAL 100
+
+// Headless rendering defaults, matching the GLUT window
+#define SOFTWARE_OUTPUT "software.tga"
+#define SOFTWARE_WIDTH 1024
+#define SOFTWARE_HEIGHT 1024
+
+// Screenshots ('p') and recorded frames ('f'), numbered from the first unused name.
+// The extension picks the format: .tga, .png or .raw.
+#define SCREENSHOT_PATTERN "screenshot%04d.tga"
+#define RECORDING_PATTERN "frame%05d.tga"
+
+// Chrome trace of the timings recorded so far, written by 'x' (see profiler.h)
+#define TRACE_PATH "trace.json"
+
+// Seconds between refreshes of the stage timing overlay
+#define STATS_INTERVAL 1.0
+
+// Frames averaged per configuration by --benchmark
+#define BENCHMARK_FRAMES 5
+
+// Synthetic meshes for --bench-suite are written here and removed after use
+#define BENCH_DIRECTORY "bench"
+// Vertex counts --bench-suite runs by default; --vertices overrides them
+#define BENCH_VERTICES "65536,262144,1048576"
+// Seed of the synthetic meshes, so every run measures the same ones
+#define BENCH_SEED 317
+
+// Rays and nearest vertex queries timed per mesh by the bench suite
+#define BENCH_QUERIES 10000
+
+// Compiler flags recorded with the bench results; the Makefile passes them in
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"
+#endif
+
+// Vertices listed around each landmark placed
+#define PICK_NEAREST 8
+
+// Size of the landmark points, in pixels
+#define LANDMARK_SIZE 6.f
+
 /*************** Classes *******************/
 template <typename T=float> class Coordinate{
     T x, y, z;  // Components
@@ -109,6 +243,13 @@ public:
        return Coordinate<T>(x/mag, y/mag, z/mag);
     }
 
+    // Copy components to a flat array
+    void copyTo(T *out) const{
+       out[0] = x;
+       out[1] = y;
+       out[2] = z;
+    }
+
     /**
      * Getters and Setters
      */
@@ -137,94 +278,44 @@ public:
     }
 };
 
-// Vertex Class
-template <typename T=float> class Vertex{
-    Coordinate<T> vertex, texture, averageNormal;
-    vector<Coordinate <T> > normals;
-public:
-    // Constructor
-    Vertex(){}
-    Vertex(T x, T y, T z): vertex(x,y,z){}
-    Vertex(const Vertex<T> &obj): vertex(obj.vertex), texture(obj.texture), averageNormal(obj.averageNormal), normals(obj.normals){}    // Copy constructor
-
-    // Assignment Operator
-    Vertex<T> &operator=(const Vertex<T> &obj){
-       if (this == &obj)
-           return *this;
-
-       vertex = obj.vertex;
-       texture = obj.texture;
-       averageNormal = obj.averageNormal;
-       normals = obj.normals;
-       return *this;
-    }
-
-
-    void pushNormals(Coordinate <T> normal){
-        normals.push_back(normal);
-    }
-
-    void calculateAverageNormal(){
-        T x = 0, y = 0, z = 0;
-        int n = normals.size();
-        for (typename vector<Coordinate <T> >::iterator it = normals.begin(); it < normals.end(); it++){
-            Coordinate<T> current = *it;
-            x += current.getX()/n;
-            y += current.getY()/n;
-            z += current.getZ()/n;
-        }
-        averageNormal.setX(x);
-        averageNormal.setY(y);
-        averageNormal.setZ(z);
-        averageNormal.normalise();
-    }
-
-    /**
-     * Getters and Setters
-     */
-    const Coordinate<T>& getAverageNormal() const {
-        return averageNormal;
-    }
-
-    const Coordinate<T>& getTexture() const {
-        return texture;
-    }
-
-    void setTexture(const Coordinate<T>& texture) {
-        this->texture = texture;
-    }
-
-    void setTexture(const T x, const T y){
-        texture.setX(x);
-        texture.setY(y);
-        texture.setZ(0);
-    }
-
-    const Coordinate<T>& getVertex() const {
-        return vertex;
-    }
-
-    void setVertex(const Coordinate<T>& vertex) {
-        this->vertex = vertex;
-    }
-
-    void setVertex(const T x, const T y, const T z){
-        vertex.setX(x);
-        vertex.setY(y);
-        vertex.setZ(z);
+// Mip chain of the loaded texture ready for upload, RGB or BC1 encoded.
+// The levels point into the mapped file, the caches or the built vectors.
+struct TextureLevels{
+    bool compressed;    // upload blocks rather than levels
+    bool prepared;
+    TextureCache mipCache, bc1Cache;
+    vector< vector<unsigned char> > built, encoded;
+    vector<const unsigned char *> levels, blocks;
+
+    TextureLevels(): compressed(false), prepared(false){}
+
+    void clear(){
+        prepared = false;
+        mipCache.close();
+        bc1Cache.close();
+        vector< vector<unsigned char> >().swap(built);
+        vector< vector<unsigned char> >().swap(encoded);
+        levels.clear();
+        blocks.clear();
     }
+};
 
-    const vector<Coordinate<T> >& getNormals() const {
-        return normals;
-    }
+// A watched input file and its reload, see reloadInputs()
+struct InputReload{
+    BackgroundTask task;
+    bool changed;   // the file changed since the last reload started
+    bool running;   // task has been started and its result not yet taken over
+    chrono::steady_clock::time_point changeSeen, reloadSeen;   // when the pending change, and the one reloading, were noticed
+    string error;   // set by task when the file cannot be read
 
-    vector<Coordinate<T> >& getNormals(){
-            return normals;
-        }
+    InputReload(): changed(false), running(false){}
+};
 
-    void setNormals(const vector<Coordinate<T> >& normals) {
-        this->normals = normals;
-    }
+// CPU time spent in display() with one of the drawing paths
+struct FrameTimes{
+    unsigned frames;
+    double drawSeconds;     // submitting the mesh
+    double frameSeconds;    // all of display(), including the buffer swap
 };
 
 // Overload to allow for e.g. cout << Coordinate
@@ -234,20 +325,73 @@ template <typename T=float> std::ostream& operator<< (std::ostream &output, cons
     return output;
 }
 
-template <typename T=float> std::ostream& operator<< (std::ostream &output, const Vertex<T> &obj){
-    return operator<<(output, obj.getVertex());
-}
-
 /*************** Function Prototypes *******************/
 void init();        // Initialise polygons, lighting, and texture
-void idle();        // Idle rotation animation
+void requestRedraw();   // draw a frame at the next frame time; merges with any request already waiting
+void tick(int value);   // timer: advance the rotation by the time elapsed and draw the frame
 void display();     // Render
+void drawMesh();    // draw the polygons with the current path, level of detail and culling
+void drawStatsOverlay();    // stage timings per frame, refreshed every STATS_INTERVAL
 void reshape (int w, int h);    // Viewport change
 void keyboard(unsigned char key, int x, int y); // respond to keyboard
 void keyboardSpecial (int key, int x, int y);   // ditto
+void mouse(int button, int state, int x, int y);    // respond to mouse clicks
 void loadData();    // load polygon data and texture
-void screendump(short W, short H);  // dump a screenshot
+void loadMeshData(VtkPolyData *parsed = NULL);    // load polygon data and the camera
+void startLoading();    // loadMeshData() and the texture on worker threads; the window fills in as they finish
+void waitForLoaders();  // block until the loader threads are done, for exit()
+bool continueLoading(size_t maxBytes);  // upload what the loaders have finished, about maxBytes of geometry; true once done
+void compileDisplayList(size_t chunk);  // one chunk of polygons of the display list
+void watchInputs();     // watch vtkPath and texturePath for reloadInputs()
+void reloadInputs(int value);   // timer: reload the inputs that changed on disk and take over finished reloads
+void applyMeshReload();     // new positions for the same polygons in place, or the whole mesh loaded again
+void applyTextureReload();  // the reloaded mip chain into the existing texture object
+void loadMesh(VtkPolyData *parsed = NULL);    // load polygon data of vtkPath, from the cache if it is up to date
+void aimCamera();   // camera and translation vectors for camera and centreVertex
+bool loadMeshCache();   // load polygon data from the binary cache if it is up to date
+void loadVtk(VtkPolyData *parsed = NULL);     // polygon data from the VTK file, or from it parsed already
+void weldMesh(VtkPolyData &data, vector<int> &weld);   // weld the coincident points of a parsed mesh and report the savings
+void calculateNormals();    // polygon normals, mean normal and vertex normals
+void optimiseMesh();    // reorder polygons and vertices for cache locality
+void buildLods();       // simplified levels of detail of the mesh
+size_t selectLod();     // level of detail for the current view
+void buildMeshClusters();   // split every level of detail into clusters for culling
+void buildPickingBvh();     // trees over the triangles and vertices of the full mesh for picking
+bool pickRay(int x, int y, float origin[3], float direction[3]);  // ray in mesh coordinates through a window position
+void placeLandmark(int x, int y);   // landmark where the ray through a window position hits the mesh
+void drawLandmarks();   // every landmark as a point over the mesh
+void showCullStats();   // culling counts of the last frame in the window title
+Coordinate<float> vertexCoordinate(int i);  // position of a vertex in vertexArrays
+void saveMeshCache();   // write polygon data to the binary cache
+void loadTexture(); // load the texture
+bool mapTexture(string &error);     // map the texture; false if it cannot be read
+GLuint createTexture();     // texture object with the mip chain of the loaded texture
+GLuint createTexture(const TextureLevels &prepared);  // texture object with a prepared mip chain
+void prepareTexture(TextureLevels &prepared);   // mip chain of the loaded texture, built if it is not cached
+void uploadMipmaps(const TextureLevels &prepared);   // upload a prepared mip chain
+void textureMipLevels(TextureCache &cache, vector< vector<unsigned char> > &built, vector<const unsigned char *> &levels);  // RGB mip chain, cached
+void textureBc1Levels(const vector<const unsigned char *> &rgb, bool useCache, TextureCache &cache,
+        vector< vector<unsigned char> > &encoded, vector<const unsigned char *> &levels);  // BC1 mip chain, cached
+bool compressedTexturesSupported();     // the GL takes BC1 (S3TC) textures
+void drawVertex(int i);     // emit texture coordinate, normal and position of vertex i of vertexArrays
+string nextCapturePath(const char *pattern, int &number);    // first unused numbered capture path from number on
+void captureFrame();    // queue the back buffer for writing if a screenshot or recording wants it
+void retireCaptures(int value);     // timer: write out readbacks a still window will not poll for
 void setMaterial();     // set the material setting on the face
+void viewPoint(Coordinate<float> &eye, Coordinate<float> &lookAt);   // camera position and target for the zoom and translation
+void viewMatrices(Matrix4 &projection, Matrix4 &modelview, int w, int h);   // what reshape() and display() load
+void softwareFrame(SoftFrame &frame, SoftTexture &softTexture, int w, int h);   // what display() draws, for the software renderer
+void parseLoadOptions(int &argc, char **argv);  // take --mesh, --texture and --weld-epsilon out of the arguments, see main()
+int renderSoftware(int argc, char **argv);  // headless rendering, see main()
+int renderBatch(int argc, char **argv);     // headless rendering of a scene file, see main()
+int writeOptimisedMesh(int argc, char **argv);  // write the reordered mesh as VTK, see main()
+int compressTexture(int argc, char **argv);     // encode the texture cache offline, see main()
+int runBenchSuite(int argc, char **argv);   // time loading, normals and rendering of synthetic meshes, see main()
+void clearMesh();   // drop the loaded mesh and everything derived from it
+void applyScene(const Scene &scene);    // set the view settings of a scene
+void loadInstanceScene();   // upload the meshes and textures of the instances once each and frame them
+void drawInstances();   // every instance, with one draw call per mesh and texture
+size_t selectInstanceLod(const InstanceGroup &group, const float eye[3]);    // level of detail for the nearest instance of a group
 
 /****************** Materials Related Declaration and variables ***************************/
 // Material state
@@ -284,13 +428,52 @@ GLfloat materialSpecular[MAX_MATERIAL_STATE+1][3] = {
 
 };
 
+/****************** Scenes ***************************/
+// Scenes for the coursework pictures, keys 1 to 4 and "preset=N" in scene files
+const Scene presetScenes[] = {
+        // zoom, translation, angle, material, texture, width, height
+        {2.7f, 0.083f, 0.f, 0, false, SOFTWARE_WIDTH, SOFTWARE_HEIGHT, ""},     // gouraud-1
+        {2.7f, -0.042f, 32.f, 0, false, SOFTWARE_WIDTH, SOFTWARE_HEIGHT, ""},   // gouraud-2
+        {2.7f, -0.099f, 68.f, 2, false, SOFTWARE_WIDTH, SOFTWARE_HEIGHT, ""},   // gouraud-3
+        {2.7f, -0.099f, 68.f, 2, true, SOFTWARE_WIDTH, SOFTWARE_HEIGHT, ""}     // texture
+};
+#define PRESET_SCENE_COUNT (sizeof(presetScenes) / sizeof(presetScenes[0]))
+
 /******************* GLOBALS **********************************/
 // Global variables
-vector< Vertex<float> > vertices;   // vector of vertices
-vector< vector< int > > polygons;   // vector of indices for the vertices for each polygon
-vector< Coordinate<float> > polygonsNormal; // Normal for each polygon
-
-GLuint texture, displayList;	// OpenGL indices for texture and display list
+MeshArena meshArena;    // arrays of a parsed mesh, freed in one go by clearMesh(); see meshArena.h
+PolygonList polygons;   // indices of the vertices for each polygon, see polygonList.h
+VertexArrays vertexArrays;  // the vertices, one array per attribute, see vertexArrays.h
+float *polygonNormals = NULL;   // normal of each polygon, 3 floats each; in meshArena or the mesh cache
+int *pointVertices = NULL;  // vertex each point of the VTK file was welded into; in meshArena or the mesh cache
+size_t pointCount = 0;      // points of the VTK file, the size of pointVertices
+uint64_t meshTopology = 0;  // topologyHash() of the VTK file the mesh came from
+uint64_t meshFileSize = 0;  // size and modification time of that file as it was parsed, for the mesh cache
+int64_t meshFileMtime = 0, meshFileMtimeNsec = 0;
+
+GLuint texture, displayList;	// OpenGL indices for texture and the first display list
+size_t displayListCount = 0, displayListsBuilt = 0;     // lists of DISPLAY_LIST_CHUNK polygons from displayList on
+MeshBuffers meshBuffers;    // triangulated mesh in vertex buffer objects
+bool useVertexBuffers = true;   // draw meshBuffers instead of displayList
+FrameTimes frameTimes[2];   // indexed by useVertexBuffers
+vector<MeshLod> meshLods;   // levels of detail, meshLods[0] is the full mesh triangulated
+size_t lodLevel = 0;    // level drawn last
+bool useLod = true;     // pick the level from the projected size, otherwise always draw level 0
+vector< vector<MeshCluster> > meshClusters;     // clusters of each level of detail
+bool useCulling = true;     // draw only the clusters that can be seen
+bool cullBackfaces = CULL_BACKFACES;    // GL_CULL_FACE, and reject clusters facing away
+ClusterCullStats cullStats;     // of the last frame drawn with culling
+MeshBvh meshBvh;    // picking and nearest vertex queries, see meshBvh.h
+vector< Coordinate<float> > landmarks;  // placed by clicking, in mesh coordinates
+FrameScheduler frameScheduler(FRAME_RATE);  // paces redraws, see frameScheduler.h
+FrameCapture frameCapture;      // screenshots and recordings, read back and written in the background
+bool screenshotRequested = false;   // capture the next frame drawn
+bool recording = false;     // capture every frame drawn
+int screenshotNumber = 0, recordingNumber = 0;  // next numbers to try
+size_t recordedFrames = 0;  // captured since recording started
+bool showStats = false;     // draw the stage timing overlay
+vector<string> statsLines;  // overlay text
+chrono::steady_clock::time_point statsRefreshed;    // when statsLines was last filled
 //GLfloat lightPosition[] = {0.0f, 0.0f, 0.0f, 1.0f}; // unused
 
 float angle = 0.0f;
@@ -310,15 +493,82 @@ bool rotate = false;
 bool showTexture = true;
 float rotationFactor = ROTATION_ANTICLOCKWISE;
 
+// Mesh and texture loaded by loadData()
+string vtkPath = VTK_PATH;
+string texturePath = TEXTURE_PATH;
+float weldEpsilon = WELD_EPSILON;
+
+// Background loading, see startLoading(). The mesh and texture globals belong
+// to the worker threads until meshLoaded and textureLoaded are set.
+BackgroundTask meshTask, textureTask;
+bool meshLoaded = false, textureLoaded = false;
+bool loadComplete = false;      // everything is on the GPU
+TextureLevels textureLevels;    // prepared by textureTask
+chrono::steady_clock::time_point programStart = chrono::steady_clock::now();
+
+// Hot reload of vtkPath and texturePath, see reloadInputs(). Like the loaders,
+// the reload tasks own what they write until they have finished.
+FileWatcher inputWatcher;
+bool watchingInputs = false;    // the inputs may be rewritten while in use, so the texture is read, not mapped
+InputReload meshReload, textureReload;
+VtkPolyData reloadedMesh;       // parsed by meshReload.task
+uint64_t reloadedTopology = 0;  // topologyHash() of reloadedMesh
+vector<int> reloadedWeld;       // weldPoints() of reloadedMesh
+size_t reloadedVertexCount = 0; // welded vertices of reloadedMesh
+TextureLevels reloadedTexture;  // prepared by textureReload.task
+bool meshReplaced = false;      // meshTask is loading a mesh whose polygons changed, see applyMeshReload()
+
+// Instances of an instance file (see scene.h) drawn in place of the single mesh
+vector<SceneInstance> sceneInstances;
+GeometryStore geometryStore;    // every mesh and texture the instances use, uploaded once each
+InstanceRenderer instanceRenderer;  // see meshInstancing.h
+size_t instanceTriangles = 0;   // drawn in the last frame
+
+// Binary cache of the VTK file. Kept open as polygons may refer to its arrays.
+MeshCache meshCache;
+
 // Texture Data
 int textureWidth, textureHeight;
-char *textureData;
+const unsigned char *textureData;   // RGB, top row first; points into textureFile
+PpmFile textureFile;    // mapped, or read if it is watched, for the life of the program
 
 /******************** FUNCTIONS ***********************/
 
 int main(int argc, char** argv){
-    // Load data to memory
-    loadData();
+    // Mesh and texture to load, in any mode: cgRender [--mesh scan.vtp] [--texture scan.ppm] [--weld-epsilon 1e-6] ...
+    parseLoadOptions(argc, argv);
+
+    // Render on the CPU without a window: cgRender --software [output.tga] [WxH] [--threads N] [--benchmark]
+    if (argc > 1 && string(argv[1]) == "--software")
+        return renderSoftware(argc, argv);
+    // Render every scene in a scene file (see scene.h): cgRender --batch scenes.txt [--threads N]
+    if (argc > 1 && string(argv[1]) == "--batch")
+        return renderBatch(argc, argv);
+    // Write the mesh reordered for cache locality: cgRender --optimise output.vtk
+    if (argc > 1 && string(argv[1]) == "--optimise")
+        return writeOptimisedMesh(argc, argv);
+    // Encode the BC1 texture cache ahead of the first launch and report its quality: cgRender --compress-texture
+    if (argc > 1 && string(argv[1]) == "--compress-texture")
+        return compressTexture(argc, argv);
+    // Time the loaders and renderer on generated meshes: cgRender --bench-suite [results.json] [--vertices N,N,...]
+    if (argc > 1 && string(argv[1]) == "--bench-suite")
+        return runBenchSuite(argc, argv);
+
+    // Draw the instances of an instance file (see scene.h) side by side: cgRender --instances heads.txt
+    if (argc > 2 && string(argv[1]) == "--instances"){
+        string error;
+        if (!loadInstances(argv[2], texturePath, MAX_MATERIAL_STATE, sceneInstances, error)){
+            cerr << error << endl;
+            exit(1);
+        }
+        vtkPath = sceneInstances[0].mesh;
+        if (!sceneInstances[0].texture.empty())
+            texturePath = sceneInstances[0].texture;
+    }
+
+    // Instances load before the window opens; a single mesh loads in the background once it is up
+    if (!sceneInstances.empty())
+        loadData();
 
     // Initialize graphics window
     glutInit(&argc, argv);
@@ -327,25 +577,34 @@ int main(int argc, char** argv){
 
     glutInitWindowSize (1024, 1024);
     glutInitWindowPosition (-1, -1);    // set to -1 to let window manager decide
-    glutCreateWindow ("Graphics Coursework 1 (ywc110)");
+    glutCreateWindow (WINDOW_TITLE);
 
-    // Initialise polygons, lighting, and texture
+    // Initialise lighting, and the texture and polygons if they are loaded
     init();
+    if (!sceneInstances.empty()){
+        loadInstanceScene();
+    }
+    else{
+        watchingInputs = true;
+        startLoading();
+        watchInputs();
+    }
 
     cout << "Initialised" << endl;
 
     // Initialize callback functions
     glutDisplayFunc(display);   // render display
     glutReshapeFunc(reshape);   // window resize
-    glutIdleFunc(idle);     // window idle
     glutKeyboardFunc(keyboard); // keyboard press events
     glutSpecialFunc(keyboardSpecial);   // keyboard special keys
+    glutMouseFunc(mouse);       // mouse clicks
 
     // Start rendering
     glutMainLoop();
 }
 
 void init(){
+    PROFILE_SCOPE("init");
     glClearColor (0.0, 0.0, 0.0, 0.0);
     cout << "Setting up lighting" << endl;
 
@@ -390,16 +649,332 @@ void init(){
     // Enable Z-buffering
     glEnable(GL_DEPTH_TEST);
 
+    if (cullBackfaces)
+        glEnable(GL_CULL_FACE);
+
+    // Whatever loadData() has loaded goes up now; a background load fills in frame by frame
+    continueLoading((size_t) -1);
+}
+
+// Loads the mesh and the texture on threads of their own, so the window
+// draws from the start. continueLoading() takes over what they load.
+void startLoading(){
+    // The loaders use the pool, which is destroyed before them on exit; wait for them first
+    ThreadPool::global();
+    atexit(waitForLoaders);
+    textureLevels.compressed = COMPRESS_TEXTURE && compressedTexturesSupported();   // asks the GL, so here
+    meshTask.start([](){
+        loadMeshData();
+        buildPickingBvh();
+    });
+    textureTask.start([](){
+        loadTexture();
+        prepareTexture(textureLevels);
+    });
+    requestRedraw();
+}
+
+// At exit, before the thread pool the loaders may still be using is destroyed
+void waitForLoaders(){
+    meshTask.wait();
+    textureTask.wait();
+    meshReload.task.wait();
+    textureReload.task.wait();
+}
+
+// Called every frame until it returns true. Takes the mesh and texture
+// over from the loaders as they finish -- never waiting for them -- and
+// uploads the texture in one go and the geometry about maxBytes at a time:
+// the vertex buffers, coarsest level first, then the display list.
+bool continueLoading(size_t maxBytes){
+    if (loadComplete)
+        return true;
+    PROFILE_SCOPE("continue loading");
+    double sinceStart = chrono::duration<double, milli>(chrono::steady_clock::now() - programStart).count();
+
+    if (!textureLoaded && textureTask.isFinished()){
+        textureLoaded = true;
+        cout << "Texture loaded in " << textureTask.getSeconds()*1000 << " ms" << endl;
+    }
+    if (textureLoaded && texture == 0){
+        if (!textureLevels.prepared){
+            textureLevels.compressed = COMPRESS_TEXTURE && compressedTexturesSupported();
+            prepareTexture(textureLevels);
+        }
+        texture = createTexture(textureLevels);
+        textureLevels.clear();
+        cout << "Texture uploaded" << endl;
+    }
+
+    if (!meshLoaded && meshTask.isFinished()){
+        meshLoaded = true;
+        cout << "Mesh loaded in " << meshTask.getSeconds()*1000 << " ms, first drawn " << sinceStart
+                << " ms after the start" << endl;
+    }
+    // Instances are drawn from the geometry store instead, see loadInstanceScene()
+    if (!meshLoaded || !sceneInstances.empty()){
+        loadComplete = meshLoaded && textureLoaded;
+        return loadComplete;
+    }
+
+    // Vertex buffers first, as they are drawn by default
+    size_t spent = 0;
+    if (!meshBuffers.isBuilt() && useVertexBuffers && !meshBuffers.begin(vertexArrays, meshLods)){
+        cout << "Vertex buffers unsupported, using the display list" << endl;
+        useVertexBuffers = false;
+    }
+    if (meshBuffers.isBuilt() && !meshBuffers.isComplete()){
+        double progress = meshBuffers.getProgress();
+        meshBuffers.upload(maxBytes);
+        spent = (meshBuffers.getProgress() - progress) * meshBuffers.getBytes();
+        if (meshBuffers.isComplete()){
+            cout << "Vertex buffers uploaded " << sinceStart << " ms after the start (" << meshLods.size() << " levels, "
+                    << meshBuffers.getBytes()/1024 << " KiB)" << endl;
+        }
+    }
+
+    // Then the display list, a chunk of polygons at a time
+    if (displayListCount == 0){
+        displayListCount = (polygons.size() + DISPLAY_LIST_CHUNK - 1) / DISPLAY_LIST_CHUNK;
+        displayList = glGenLists(displayListCount);
+    }
+    while (displayListsBuilt < displayListCount && spent < maxBytes){
+        compileDisplayList(displayListsBuilt++);
+        spent += DISPLAY_LIST_CHUNK * 3 * sizeof(MeshBufferVertex);    // about as much as a triangle chunk of the buffers
+        if (displayListsBuilt == displayListCount)
+            cout << "Display list built " << sinceStart << " ms after the start" << endl;
+    }
+
+    loadComplete = textureLoaded && displayListsBuilt == displayListCount
+            && (!meshBuffers.isBuilt() || meshBuffers.isComplete());
+    if (loadComplete && meshReplaced){
+        meshReplaced = false;
+        double latency = chrono::duration<double, milli>(chrono::steady_clock::now() - meshReload.reloadSeen).count();
+        cout << vtkPath << " reloaded " << latency << " ms after the change (load " << meshTask.getSeconds()*1000
+                << " ms, the rest uploading)" << endl;
+    }
+    return loadComplete;
+}
+
+// Polygons [chunk * DISPLAY_LIST_CHUNK, (chunk + 1) * DISPLAY_LIST_CHUNK) into list displayList + chunk
+void compileDisplayList(size_t chunk){
+    size_t first = chunk * DISPLAY_LIST_CHUNK, last = min(first + DISPLAY_LIST_CHUNK, polygons.size());
+    glNewList(displayList + chunk, GL_COMPILE);	// compile
+
+    if (polygons.isTriangles()){
+        // Every polygon is a triangle -- draw them all in one batch
+        const int *indices = polygons.getIndices();
+        glBegin(GL_TRIANGLES);
+        for (size_t i = 3*first; i < 3*last; i++){
+            drawVertex(indices[i]);
+        }
+        glEnd();
+    }
+    else{
+        for (size_t i = first; i < last; i++){
+            Polygon polygon = polygons[i];
+            glBegin(GL_POLYGON);    // Begin drawing polygon
+
+            for (const int *j = polygon.begin(); j < polygon.end(); j++){
+                drawVertex(*j);
+            }
+            glEnd();
+        }
+    }
+    glEndList();
+}
+
+// Starts the reloadInputs() timer. Not being able to watch is not fatal.
+void watchInputs(){
+    string error;
+    if (!inputWatcher.add(vtkPath, error) || !inputWatcher.add(texturePath, error)){
+        cerr << error << ", changes will not be reloaded" << endl;
+        inputWatcher.close();
+        return;
+    }
+    cout << "Watching " << vtkPath << " and " << texturePath << " for changes" << endl;
+    glutTimerFunc(WATCH_INTERVAL, reloadInputs, 0);
+}
+
+// Reloads only what changed: a new texture is read and filtered on a worker
+// thread and uploaded into the texture object, without touching the
+// geometry; a new mesh is parsed on a worker thread and then handed to
+// applyMeshReload(). A file that changes again while it reloads is reloaded
+// once more afterwards.
+void reloadInputs(int){
+    vector<string> changed;
+    inputWatcher.poll(changed);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    for (size_t i = 0; i < changed.size(); i++){
+        InputReload &reload = changed[i] == vtkPath ? meshReload : textureReload;
+        if (!reload.changed)
+            reload.changeSeen = now;
+        reload.changed = true;
+    }
+
+    if (textureReload.running && textureReload.task.isFinished())
+        applyTextureReload();
+    if (meshReload.running && meshReload.task.isFinished())
+        applyMeshReload();
+
+    // The texture goes into the texture object the loader made
+    if (textureReload.changed && !textureReload.running && texture != 0){
+        cout << texturePath << " changed, reloading the texture" << endl;
+        textureReload.changed = false;
+        textureReload.running = true;
+        textureReload.reloadSeen = textureReload.changeSeen;
+        reloadedTexture.clear();
+        reloadedTexture.compressed = COMPRESS_TEXTURE && compressedTexturesSupported();  // asks the GL, so here
+        textureReload.task.start([](){
+            textureReload.error.clear();
+            if (mapTexture(textureReload.error))
+                prepareTexture(reloadedTexture);
+        });
+    }
+
+    // A mesh still being loaded is replaced once it is in
+    if (meshReload.changed && !meshReload.running && meshLoaded){
+        cout << vtkPath << " changed, reloading the mesh" << endl;
+        meshReload.changed = false;
+        meshReload.running = true;
+        meshReload.reloadSeen = meshReload.changeSeen;
+        meshReload.task.start([](){
+            PROFILE_SCOPE("parse VTK");
+            VtkParseStats stats;
+            reloadedMesh = VtkPolyData();
+            meshReload.error.clear();
+            // Checked here, so a broken file never replaces the mesh loaded
+            if (!parseVtk(vtkPath, reloadedMesh, ThreadPool::global(), stats, meshReload.error)
+                    || !checkPolyData(reloadedMesh, weldEpsilon > 0, meshReload.error))
+                return;
+            reloadedTopology = topologyHash(reloadedMesh);
+            reloadedVertexCount = weldPoints(reloadedMesh, weldEpsilon, WELD_UV_EPSILON, ThreadPool::global(), reloadedWeld);
+        });
+    }
+
+    bool reloading = textureReload.running || meshReload.running;
+    glutTimerFunc(reloading ? 1000 / FRAME_RATE : WATCH_INTERVAL, reloadInputs, 0);
+}
+
+// Takes over the mesh meshReload.task parsed. When only points moved, and
+// they still weld into the same vertices, the new positions and texture
+// coordinates go into the loaded vertices through pointVertices and just the
+// normals, cluster bounds and picking trees are redone: the polygons, levels
+// of detail and index buffer stay as they are. The view is not re-aimed.
+// Anything else loads the whole mesh again.
+void applyMeshReload(){
+    meshReload.running = false;
+    if (!meshReload.error.empty()){
+        cerr << meshReload.error << ", keeping the mesh loaded before" << endl;
+        return;
+    }
+    PROFILE_SCOPE("reload mesh");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    VtkPolyData &data = reloadedMesh;
+    size_t n = vertexArrays.size();
+
+    // Each new vertex has to be made of the points of exactly one old vertex
+    bool samePolygons = pointVertices != NULL && reloadedTopology == meshTopology && data.pointCount == pointCount
+            && reloadedVertexCount == n;
+    vector<int> oldVertex(samePolygons ? n : 0, -1);
+    for (size_t p = 0; p < pointCount && samePolygons; p++){
+        int &vertex = oldVertex[reloadedWeld[p]];
+        samePolygons = vertex < 0 || vertex == pointVertices[p];
+        vertex = pointVertices[p];
+    }
+    if (!samePolygons){
+        cout << "Polygons of " << vtkPath << " changed, loading the whole mesh" << endl;
+        meshBuffers.release();
+        if (displayListCount > 0)
+            glDeleteLists(displayList, displayListCount);
+        displayListCount = displayListsBuilt = 0;
+        clearMesh();
+        meshLoaded = loadComplete = false;
+        meshReplaced = true;
+        meshTask.start([](){
+            loadMeshData(&reloadedMesh);
+            buildPickingBvh();
+        });
+        requestRedraw();
+        return;
+    }
+
+    float *x = vertexArrays.get(VERTEX_X), *y = vertexArrays.get(VERTEX_Y), *z = vertexArrays.get(VERTEX_Z);
+    float *u = vertexArrays.get(VERTEX_U), *v = vertexArrays.get(VERTEX_V);
+    // Backwards, so the lowest point of each vertex is the one it keeps, as in applyWeld()
+    for (size_t point = pointCount; point-- > 0; ){
+        size_t i = pointVertices[point];
+        x[i] = data.points[3*point];
+        y[i] = data.points[3*point+1];
+        z[i] = data.points[3*point+2];
+        if (point < data.textureCount){
+            u[i] = data.textures[2*point];
+            v[i] = data.textures[2*point+1];
+        }
+    }
+    reloadedMesh = VtkPolyData();
+    calculateNormals();
+    chrono::steady_clock::time_point normalsDone = chrono::steady_clock::now();
+
+    for (size_t level = 0; level < meshLods.size(); level++)
+        refitClusters(vertexArrays, meshLods[level].triangles, meshClusters[level]);
+    buildPickingBvh();
+    chrono::steady_clock::time_point boundsDone = chrono::steady_clock::now();
+
+    // Vertices only; a list not compiled yet picks the new ones up when it is
+    meshBuffers.update(vertexArrays, 0, n);
+    for (size_t chunk = 0; chunk < displayListsBuilt; chunk++)
+        compileDisplayList(chunk);
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    cout << "Vertices of " << vtkPath << " reloaded " << chrono::duration<double, milli>(end - meshReload.reloadSeen).count()
+            << " ms after the change (parse " << meshReload.task.getSeconds()*1000 << " ms, normals "
+            << chrono::duration<double, milli>(normalsDone - start).count() << " ms, clusters and picking "
+            << chrono::duration<double, milli>(boundsDone - normalsDone).count() << " ms, upload "
+            << chrono::duration<double, milli>(end - boundsDone).count() << " ms); index buffers kept" << endl;
+    requestRedraw();
+}
+
+// Uploads the mip chain textureReload.task prepared over the old one
+void applyTextureReload(){
+    textureReload.running = false;
+    if (!textureReload.error.empty()){
+        cerr << textureReload.error << ", keeping the texture loaded before" << endl;
+        return;
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    glBindTexture(GL_TEXTURE_2D, texture);
+    uploadMipmaps(reloadedTexture);
+    reloadedTexture.clear();
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    cout << "Texture " << texturePath << " reloaded " << chrono::duration<double, milli>(end - textureReload.reloadSeen).count()
+            << " ms after the change (read and filter " << textureReload.task.getSeconds()*1000 << " ms, upload "
+            << chrono::duration<double, milli>(end - start).count() << " ms); geometry untouched" << endl;
+    requestRedraw();
+}
+
+// Texture object for the texture loadTexture() mapped, with its mip chain
+GLuint createTexture(){
+    TextureLevels prepared;
+    prepared.compressed = COMPRESS_TEXTURE && compressedTexturesSupported();
+    prepareTexture(prepared);
+    return createTexture(prepared);
+}
+
+// Texture object for a mip chain prepareTexture() made ready
+GLuint createTexture(const TextureLevels &prepared){
+    GLuint name;
     /*
      * Links:
      *  - http://www.opengl.org/wiki/Common_Mistakes#Automatic_mipmap_generation
      *  - http://www.nullterminator.net/gltexture.html
      */
     // Allocate a texture name
-    glGenTextures(1, &texture);
+    glGenTextures(1, &name);
 
     // select our current texture
-    glBindTexture( GL_TEXTURE_2D, texture );
+    glBindTexture( GL_TEXTURE_2D, name );
 
     // select modulate to mix texture with colour for shading
     glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
@@ -414,57 +989,59 @@ void init(){
     glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
     glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
 
-    glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-
-    // assign texture
-    glTexImage2D(GL_TEXTURE_2D, 0, 3, 512, 512, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData);
-
-    //gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB8, textureWidth, textureHeight, GL_RGB, GL_UNSIGNED_BYTE, textureData);
-
-    //glBindTexture(GL_TEXTURE_2D, 0);
-
-    cout << "Texture loaded" << endl;
+    // assign texture, with the mip chain built on the CPU
+    uploadMipmaps(prepared);
 
-    delete[] textureData;   // can now be safely deleted
-
-    // Initialise polygons
-    displayList = glGenLists(1);	// create display list
-    glNewList(displayList, GL_COMPILE);	// compile
-
-    for (vector< vector< int > >::iterator i = polygons.begin(); i < polygons.end(); i++){
-        vector<int> polygon = *i;
-        glBegin(GL_POLYGON);    // Begin drawing polygon
-
-        for (vector<int>::iterator j = polygon.begin(); j < polygon.end(); j++){
-            Vertex<float> vertex = vertices.at(*j);
-
-            // Define texture coordinates of vertex
-            glTexCoord2f(vertex.getTexture().getX(), vertex.getTexture().getY());
-
-            // Define normal of vertex
-            glNormal3f(vertex.getAverageNormal().getX(),vertex.getAverageNormal().getY(), vertex.getAverageNormal().getZ());
+    return name;
+}
 
-            // Define coordinates of vertex
-            glVertex3f(vertex.getVertex().getX(), vertex.getVertex().getY(), vertex.getVertex().getZ());
+void drawVertex(int i){
+    // Define texture coordinates of vertex
+    glTexCoord2f(vertexArrays.get(VERTEX_U)[i], vertexArrays.get(VERTEX_V)[i]);
 
+    // Define normal of vertex
+    glNormal3f(vertexArrays.get(VERTEX_NX)[i], vertexArrays.get(VERTEX_NY)[i], vertexArrays.get(VERTEX_NZ)[i]);
 
+    // Define coordinates of vertex
+    glVertex3f(vertexArrays.get(VERTEX_X)[i], vertexArrays.get(VERTEX_Y)[i], vertexArrays.get(VERTEX_Z)[i]);
+}
 
-        }
-        glEnd();
-    }
-    glEndList();
+// Nothing redraws unless asked to, so a still window sleeps in the event loop
+void requestRedraw(){
+    if (frameScheduler.request())
+        glutTimerFunc(frameScheduler.delayMilliseconds(), tick, 0);
 }
 
-void idle(){
-    if (!rotate) return;
-    angle += rotationFactor*ROTATION_STEP;
+void tick(int){
+    PROFILE_SCOPE("animate");
+    if (!frameScheduler.wake())
+        return;
+    if (rotate)
+        angle += rotationFactor*ROTATION_SPEED*frameScheduler.advance();
     glutPostRedisplay();
 }
 
 // Render the scene
 void display(){
+    PROFILE_SCOPE("frame");
+    chrono::steady_clock::time_point frameStart = chrono::steady_clock::now();
+    frameScheduler.frameStarted();
+    frameCapture.poll();
+    bool loading = !continueLoading(UPLOAD_BYTES_PER_FRAME);
+
     // Clear Color and Depth Buffers
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    {
+        PROFILE_SCOPE("clear");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // Nothing to draw until the mesh is loaded, and its camera with it
+    if (!meshLoaded){
+        glutSwapBuffers();
+        showCullStats();
+        requestRedraw();    // to poll the loaders again
+        return;
+    }
     //cout << "display" << endl;
 
     if (showTexture){
@@ -478,21 +1055,8 @@ void display(){
     // Set the Camera
     // gluLookAt(eyex, eyey, eyez, centerx, centery, centerz, upx, upy, upz);
 
-    Coordinate<float> eye;  // camera position
-    if (zoom != 1.f){
-        eye = centreVertex - cameraVector*(1.f/zoom);           // this is basically a 1/x curve
-    }
-    else{
-        eye = camera;
-    }
-
-    Coordinate<float> lookAt;   // look at position
-    if (translationFactor != 0){
-        lookAt = centreVertex + translationVector * translationFactor;
-    }
-    else{
-        lookAt = centreVertex;
-    }
+    Coordinate<float> eye, lookAt;  // camera position, look at position
+    viewPoint(eye, lookAt);
 
     gluLookAt(eye.getX(), eye.getY(), eye.getZ(),
             lookAt.getX(), lookAt.getY(),  lookAt.getZ(),
@@ -506,12 +1070,125 @@ void display(){
     glRotatef(angle, 0.f, centreVertex.getY(), 0.f);
 
     // Draw polygons
-    glCallList(displayList);
+    chrono::steady_clock::time_point drawStart = chrono::steady_clock::now();
+    drawMesh();
+    chrono::steady_clock::time_point drawEnd = chrono::steady_clock::now();
+    drawLandmarks();
 
     if (showTexture)
         glDisable(GL_TEXTURE_2D);
     //glFlush ();
-    glutSwapBuffers();
+    captureFrame();
+    if (showStats)
+        drawStatsOverlay();
+    {
+        PROFILE_SCOPE("swap");
+        glutSwapBuffers();
+    }
+
+    FrameTimes &times = frameTimes[useVertexBuffers];
+    times.frames++;
+    times.drawSeconds += chrono::duration<double>(drawEnd - drawStart).count();
+    times.frameSeconds += chrono::duration<double>(chrono::steady_clock::now() - frameStart).count();
+
+    showCullStats();
+
+    // The next frame of the rotation, or of the loading
+    if (rotate || loading)
+        requestRedraw();
+}
+
+void drawMesh(){
+    PROFILE_SCOPE("draw");
+    if (!sceneInstances.empty()){
+        drawInstances();
+        return;
+    }
+    if (!useVertexBuffers){
+        for (size_t i = 0; i < displayListsBuilt; i++)
+            glCallList(displayList + i);
+        PROFILE_COUNTER("triangles", polygons.getIndexCount() / 3);
+        return;
+    }
+
+    // While the buffers fill in, the finest level uploaded so far
+    size_t level = max(useLod ? selectLod() : 0, meshBuffers.getReadyLevel());
+    if (level >= meshBuffers.getLevelCount())
+        return;
+    if (level != lodLevel){
+        lodLevel = level;
+        cout << "Level of detail " << level << ": " << meshLods[level].triangles.size()/3 << " triangles" << endl;
+    }
+    if (useCulling){
+        Matrix4 projection, modelview;
+        viewMatrices(projection, modelview, viewportWidth, viewportHeight);
+        ClusterView view;
+        clusterView(projection, modelview, cullBackfaces, view);
+        vector<TriangleRange> visible;
+        {
+            PROFILE_SCOPE("cull");
+            cullClusters(meshClusters[level], view, visible, cullStats);
+        }
+        meshBuffers.draw(level, visible);
+        PROFILE_COUNTER("triangles", cullStats.triangles - cullStats.culledTriangles);
+        PROFILE_COUNTER("culled clusters", cullStats.culledClusters);
+    }
+    else{
+        meshBuffers.draw(level);
+        PROFILE_COUNTER("triangles", meshLods[level].triangles.size() / 3);
+    }
+}
+
+// Text in the top left corner; the lines are rebuilt from the profiler every STATS_INTERVAL
+void drawStatsOverlay(){
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (statsLines.empty() || chrono::duration<double>(now - statsRefreshed).count() >= STATS_INTERVAL){
+        vector<ProfileStage> stages;
+        Profiler::global().stages(stages);
+        size_t frames = 0;
+        for (size_t i = 0; i < stages.size(); i++){
+            if (strcmp(stages[i].name, "frame") == 0)
+                frames = stages[i].calls;
+        }
+
+        statsLines.clear();
+        char line[128];
+        for (size_t i = 0; i < stages.size() && frames > 0; i++){
+            snprintf(line, sizeof(line), "%-16s %8.3f ms/frame %6.1f calls/frame", stages[i].name,
+                    stages[i].seconds * 1000 / frames, (double) stages[i].calls / frames);
+            statsLines.push_back(line);
+        }
+        if (statsLines.empty())
+            statsLines.push_back(PROFILING ? "Collecting timings" : "Profiling is compiled out (PROFILING=0)");
+        statsRefreshed = now;
+    }
+
+    PROFILE_SCOPE("overlay");
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_CULL_FACE);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, viewportWidth, 0, viewportHeight);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glColor3f(1.f, 1.f, 0.f);
+    for (size_t i = 0; i < statsLines.size(); i++){
+        glRasterPos2i(8, viewportHeight - 16 * (i + 1));
+        for (const char *c = statsLines[i].c_str(); *c != '\0'; c++)
+            glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+    }
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
 }
 
 // cf http://www.lighthouse3d.com/tutorials/glut-tutorial/preparing-the-window-for-a-reshape/
@@ -537,7 +1214,7 @@ void reshape (int w, int h)
 
     // Set the correct perspective.
     // fov, aspect ratio, near g planes, far clipping planes
-    gluPerspective(27.5,ratio, 0.0001f, 20.f);
+    gluPerspective(FIELD_OF_VIEW,ratio, 0.0001f, 20.f);
 
     // set the camera view
     // gluLookAt(eyex, eyey, eyez, centerx, centery, centerz, upx, upy, upz);
@@ -556,10 +1233,41 @@ void keyboard(unsigned char key, int x, int y){
             break;
         case 'r':
             rotate = !rotate;
+            if (rotate){
+                frameScheduler.resetAnimation();
+                requestRedraw();
+            }
+            break;
+        case 'o':
+            showStats = !showStats;
+            statsLines.clear();
+            cout << "Stats overlay toggled: " << showStats << endl;
+            requestRedraw();
             break;
+        case 'x':{
+            string error;
+            if (Profiler::global().writeTrace(TRACE_PATH, error))
+                cout << "Trace written to " << TRACE_PATH << endl;
+            else
+                cerr << error << endl;
+            break;
+        }
         case 'p':
-            screendump(viewportWidth, viewportHeight);
-            cout << "Dumped" << endl;
+            screenshotRequested = true;
+            requestRedraw();
+            break;
+        case 'f':
+            recording = !recording;
+            if (recording){
+                recordedFrames = 0;
+                cout << "Recording frames" << endl;
+            }
+            else{
+                frameCapture.retireAll();
+                cout << "Recorded " << recordedFrames << " frames, " << frameCapture.getWriter().getDropped()
+                        << " dropped since the start" << endl;
+            }
+            requestRedraw();
             break;
         case 'm':
             materialState++;
@@ -567,12 +1275,12 @@ void keyboard(unsigned char key, int x, int y){
                 materialState = 0;
             setMaterial();
             cout << "Material toggled: " << materialState << endl;
-            if (!rotate) glutPostRedisplay();
+            requestRedraw();
             break;
         case 't':
             showTexture = !showTexture;
             cout << "Texture toggled: " << showTexture << endl;
-            if (!rotate) glutPostRedisplay();
+            requestRedraw();
             break;
         case 's':   // Output current setting to console
             cout << "Zoom factor: " << zoom << endl;
@@ -580,79 +1288,72 @@ void keyboard(unsigned char key, int x, int y){
             cout << "Rotation angle: " << angle << endl;
             cout << "Material state: " << materialState << endl;
             cout << "Texture state: " << showTexture << endl;
+            for (int i = 0; i < 2; i++){
+                const FrameTimes &times = frameTimes[i];
+                if (times.frames == 0)
+                    continue;
+                cout << (i ? "Vertex buffers: " : "Display list: ") << times.frames << " frames, "
+                        << times.drawSeconds*1000/times.frames << " ms drawing, "
+                        << times.frameSeconds*1000/times.frames << " ms per frame" << endl;
+            }
+            if (useVertexBuffers && useCulling){
+                cout << "Culled " << cullStats.culledClusters << " of " << cullStats.clusters << " clusters, "
+                        << cullStats.culledTriangles << " of " << cullStats.triangles << " triangles" << endl;
+            }
             break;
-
-        case '1':   // Set the scene to take picture for gouraud-1
-            /*
-                Zoom factor: 2.7
-                Translation factor: 0.083
-                Rotation angle: 0
-                Material State: 0
-                Texture State: 0
-             */
-            zoom = 2.7f;
-            translationFactor = 0.083f; // perhaps unnecessary
-            angle = 0.f;
-            materialState = 0;
-            showTexture = false;
-            rotate = false;
-            setMaterial();
-            if (!rotate) glutPostRedisplay();
+        case 'l':
+            useLod = !useLod;
+            cout << "Level of detail toggled: " << useLod << endl;
+            requestRedraw();
             break;
-        case '2': // Set the scene to take picture for gouraud-2
-            /*
-                Zoom factor: 2.7
-                Translation factor: -0.042
-                Rotation angle: 32
-                Material state: 0
-                Texture State: 0
-             */
-            zoom = 2.7f;
-            angle = 32.f;
-            materialState = 0;
-            translationFactor = -0.042f;
-            rotate = false;
-            showTexture = false;
-            setMaterial();
-            if (!rotate) glutPostRedisplay();
+        case 'c':
+            useCulling = !useCulling;
+            cout << "Cluster culling toggled: " << useCulling << endl;
+            requestRedraw();
             break;
-        case '3': // Set the scene to take picture for gouraud-3
-    /*      Zoom factor: 2.7
-            Translation factor: -0.099
-            Rotation angle: 68
-            Texture State: 0
-            Material state: 2*/
-
-            zoom = 2.7f;
-            angle = 68.f;
-            materialState = 2;
-            translationFactor = -0.099f;
-            rotate = false;
-            showTexture = false;
-            setMaterial();
-            if (!rotate) glutPostRedisplay();
+        case 'b':
+            cullBackfaces = !cullBackfaces;
+            if (cullBackfaces)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+            cout << "Backface culling toggled: " << cullBackfaces << endl;
+            requestRedraw();
+            break;
+        case 'u':
+            if (!landmarks.empty()){
+                landmarks.pop_back();
+                cout << "Landmark removed, " << landmarks.size() << " left" << endl;
+                requestRedraw();
+            }
+            break;
+        case 'v':
+            if (meshBuffers.isBuilt())
+                useVertexBuffers = !useVertexBuffers;
+            cout << "Drawing with " << (useVertexBuffers ? "vertex buffers" : "the display list") << endl;
+            requestRedraw();
             break;
-        case '4': // Set the scene to take picture for texture
-    /*      Zoom factor: 2.7
-            Translation factor: -0.099
-            Rotation angle: 68
-            Texture State: 0
-            Material state: 2*/
-
-            zoom = 2.7f;
-            angle = 68.f;
-            materialState = 2;
-            translationFactor = -0.099f;
+
+        case '1':   // Set the scene to take picture for gouraud-1
+        case '2':   // Set the scene to take picture for gouraud-2
+        case '3':   // Set the scene to take picture for gouraud-3
+        case '4':   // Set the scene to take picture for texture
+            applyScene(presetScenes[key - '1']);
             rotate = false;
-            showTexture = true;
             setMaterial();
-            if (!rotate) glutPostRedisplay();
+            requestRedraw();
             break;
     }
 
 
 }
 
+// Mouse clicks: the left button places a landmark
+void mouse(int button, int state, int x, int y){
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && meshLoaded)
+        placeLandmark(x, y);
+}
+
 // Special key presses
 void keyboardSpecial (int key, int x, int y){
     int modifier = glutGetModifiers();
@@ -683,306 +1384,1456 @@ void keyboardSpecial (int key, int x, int y){
             zoom = zoom <= 0.1f ? 0.1f : zoom;  // Max zoom out is at a factor of 0.1
             break;
     }
-    if (!rotate)
-        glutPostRedisplay();
+    requestRedraw();
 }
 
 // Loads the VTK file and texture into memory
 // Also populates some variables
 void loadData(){
-    cout << "Loading VTK" << endl;
-    ifstream vtk(VTK_PATH); // Open the VTK file
-    if (vtk.fail()){    // File opening has failed
-        cerr << "Unable to open VTK file \n";
-        exit(1);
+    PROFILE_SCOPE("load data");
+    loadMeshData();
+    loadTexture();
+    meshLoaded = textureLoaded = true;
+}
+
+// The mesh and the camera looking at it. Only touches the CPU, so
+// startLoading() runs it on a worker thread. See loadVtk() for parsed.
+// The picking trees are left to the callers that pick, see buildPickingBvh().
+void loadMeshData(VtkPolyData *parsed){
+    PROFILE_SCOPE("load mesh data");
+    loadMesh(parsed);
+
+    //Initialise camera position
+//  camera.x = ceil(maxVertex.x);
+//  camera.y = ceil(maxVertex.y);
+//  camera.z = ceil(maxVertex.z);
+
+    camera = maxVertex*10;
+    camera.setY(0.f);       // to "straighten" view
+
+    cout << "Camera: " << camera << endl;
+    aimCamera();
+}
+
+// Loads the mesh at vtkPath, parsing the VTK file only when the cache is missing or stale
+void loadMesh(VtkPolyData *parsed){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Only parse the VTK file when the cache is missing or stale
+    if (parsed == NULL && loadMeshCache()){
+        cout << "Mesh cache loaded" << endl;
+    }
+    else{
+        loadVtk(parsed);
+#if OPTIMISE_MESH
+        optimiseMesh();
+#endif
+        buildLods();
+        buildMeshClusters();
+        saveMeshCache();
     }
 
-    // Initialise variables
-    minVertex = Coordinate<float>(INFINITY, INFINITY, INFINITY);
-    maxVertex = Coordinate<float>(-INFINITY, -INFINITY, -INFINITY);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-    string buffer;  // String buffer
-    stringstream bufferStream;  // StringStream object
+    cout << "Min: " << minVertex << endl;
+    cout << "Max: " << maxVertex << endl;
+    cout << "Centre: " << centreVertex << endl;
+    cout << vertexArrays.size() << " vertices, " << polygons.size() << " polygons loaded in " << elapsed << " ms" << endl;
+}
 
-    // The first four lines are essentially useless. Let's get rid of them
-    getline(vtk, buffer);       // # vtk DataFile Version 3.0
-    getline(vtk, buffer);       // Somebody's face
-    getline(vtk, buffer);       // ASCII
-    getline(vtk, buffer);       // DATASET POLYDATA
+// Points the camera at centreVertex
+void aimCamera(){
+    // Camera vector
+    cameraVector = centreVertex - camera;
+    cout << "Camera vector: " << cameraVector << endl;
 
-    int n;  // Store the number of points
+    // Translation vector
+    translationVector = (cameraVector * Coordinate<float>(0.f,1.f,0.f)).normalise();
+    cout << "Translation vector: " << translationVector << endl;
+}
 
-    // Now let's get the number of points
-    // Loop to ensure that we read correctly.
-    do{
-        getline(vtk, buffer);       // The line with the number of points
-        bufferStream.clear();
-        bufferStream.str(buffer);   // Put line in to a stringstream
+// Loads the mesh and the values derived from it from the binary cache
+// Returns false if there is no up to date cache
+bool loadMeshCache(){
+    PROFILE_SCOPE("load mesh cache");
+    MeshCache &cache = meshCache;
+    if (!cache.open(vtkPath))
+        return false;
+
+    const MeshCacheHeader &header = cache.getHeader();
+    if (header.levelCount == 0 || header.weldEpsilon != weldEpsilon){
+        cache.close();
+        return false;   // nothing to draw with the vertex buffers, or welded differently
+    }
 
-        // Extract the POINTS bit
-        bufferStream >> buffer;
+    // The vertex arrays, polygons and polygon normals are used in place
+    float *arrays[VERTEX_ARRAY_COUNT];
+    for (int i = 0; i < VERTEX_ARRAY_COUNT; i++)
+        arrays[i] = cache.getVertexArray((VertexArray) i);
+    vertexArrays.attach(arrays, header.vertexCount);
+    polygons.attach(cache.getPolygonOffsets(), cache.getIndices(), header.polygonCount, header.indexCount);
+
+    meshLods.resize(header.levelCount);
+    meshClusters.resize(header.levelCount);
+    for (uint32_t i = 0; i < header.levelCount; i++){
+        const int32_t *indices = cache.getLevelIndices(i);
+        meshLods[i].triangles.assign(indices, indices + 3*header.levelTriangleCounts[i]);
+        meshLods[i].error = header.levelErrors[i];
+        const MeshCluster *clusters = cache.getLevelClusters(i);
+        meshClusters[i].assign(clusters, clusters + header.levelClusterCounts[i]);
+    }
 
+    polygonNormals = cache.getPolygonNormals();
+    pointVertices = cache.getPointVertices();
+    pointCount = header.pointCount;
+    meshTopology = header.sourceTopology;
 
-    } while(buffer != "POINTS" && !vtk.eof());
+    minVertex = Coordinate<float>(header.minVertex[0], header.minVertex[1], header.minVertex[2]);
+    maxVertex = Coordinate<float>(header.maxVertex[0], header.maxVertex[1], header.maxVertex[2]);
+    centreVertex = Coordinate<float>(header.centreVertex[0], header.centreVertex[1], header.centreVertex[2]);
+    meanNormal = Coordinate<float>(header.meanNormal[0], header.meanNormal[1], header.meanNormal[2]);
+    return true;
+}
 
-    if (vtk.eof()){
-        cerr << "File ended unexpectedly (POINTS) \n";
-        exit(1);
+// Calculates the normal of every polygon, their mean and the vertex normals
+// on vertexArrays. Vertex normals are accumulated in place, weighted by
+// NORMAL_WEIGHTING, and normalised once at the end.
+void calculateNormals(){
+    PROFILE_SCOPE("normals");
+    const MeshKernels &kernels = meshKernels();
+    size_t n = polygons.size();
+
+    // Cross product of each polygon: its direction is the normal and its length twice the area
+    vector<float> faceX(n), faceY(n), faceZ(n);
+    if (polygons.isTriangles()){
+        kernels.faceNormals(vertexArrays.get(VERTEX_X), vertexArrays.get(VERTEX_Y), vertexArrays.get(VERTEX_Z),
+                polygons.getIndices(), n, faceX.data(), faceY.data(), faceZ.data());
+    }
+    else{
+        for (size_t i = 0; i < n; i++){
+            // Sum over a triangle fan, exact for planar polygons
+            Polygon current = polygons[i];
+            Coordinate<float> origin = vertexCoordinate(current[0]);
+            Coordinate<float> previous = vertexCoordinate(current[1]) - origin;
+            Coordinate<float> sum;
+            for (int j = 2; j < current.size(); j++){
+                Coordinate<float> next = vertexCoordinate(current[j]) - origin;
+                sum = sum + previous*next;
+                previous = next;
+            }
+            faceX[i] = sum.getX();
+            faceY[i] = sum.getY();
+            faceZ[i] = sum.getZ();
+        }
     }
-    // Get the number of points
-    bufferStream >> n;
-    // Now let's load the vertices
-    vertices.reserve(n);
 
-    float centreX = 0, centreY = 0, centreZ = 0;
+    float *normalX = vertexArrays.get(VERTEX_NX), *normalY = vertexArrays.get(VERTEX_NY), *normalZ = vertexArrays.get(VERTEX_NZ);
+    fill(normalX, normalX + vertexArrays.size(), 0.f);
+    fill(normalY, normalY + vertexArrays.size(), 0.f);
+    fill(normalZ, normalZ + vertexArrays.size(), 0.f);
+
+#if NORMAL_WEIGHTING == NORMAL_WEIGHT_AREA
+    accumulateNormals(faceX.data(), faceY.data(), faceZ.data(), polygons.getOffsets(), polygons.getIndices(), n,
+            normalX, normalY, normalZ);
+    kernels.normalise(faceX.data(), faceY.data(), faceZ.data(), n);
+#elif NORMAL_WEIGHTING == NORMAL_WEIGHT_ANGLE
+    kernels.normalise(faceX.data(), faceY.data(), faceZ.data(), n);
+    for (size_t i = 0; i < n; i++){
+        Polygon current = polygons[i];
+        Coordinate<float> normal(faceX[i], faceY[i], faceZ[i]);
+        for (int j = 0; j < current.size(); j++){
+            Coordinate<float> vertex = vertexCoordinate(current[j]);
+            Coordinate<float> previous = vertexCoordinate(current[(j + current.size() - 1) % current.size()]) - vertex;
+            Coordinate<float> next = vertexCoordinate(current[(j + 1) % current.size()]) - vertex;
+
+            float cosine = (previous | next) / (previous.magnitude() * next.magnitude());
+            float angle = acos(max(-1.f, min(1.f, cosine)));
+            if (angle == angle){    // skip NaN from zero length edges
+                normalX[current[j]] += normal.getX() * angle;
+                normalY[current[j]] += normal.getY() * angle;
+                normalZ[current[j]] += normal.getZ() * angle;
+            }
+        }
+    }
+#else
+    kernels.normalise(faceX.data(), faceY.data(), faceZ.data(), n);
+    accumulateNormals(faceX.data(), faceY.data(), faceZ.data(), polygons.getOffsets(), polygons.getIndices(), n,
+            normalX, normalY, normalZ);
+#endif
+
+    // Normalise every vertex normal once
+    kernels.normalise(normalX, normalY, normalZ, vertexArrays.size());
+
+    for (size_t i = 0; i < n; i++){
+        polygonNormals[3*i] = faceX[i];
+        polygonNormals[3*i+1] = faceY[i];
+        polygonNormals[3*i+2] = faceZ[i];
+    }
 
-    for (int i = 0; i < n; i++){
-        if (vtk.eof()){
-            cerr << "File ended unexpectedly (VERTICES) \n";
-            exit(1);
+    ArrayStatistics statistics;
+    {
+        PROFILE_SCOPE("mean normal");
+        reduceArrays(faceX.data(), faceY.data(), faceZ.data(), n, ThreadPool::global(), statistics);
+    }
+    meanNormal = Coordinate<float>(statistics.mean[0], statistics.mean[1], statistics.mean[2]);
+    meanNormal = meanNormal.normalise();
+}
+
+// Reorders the polygons for the post-transform vertex cache and renumbers
+// the vertices in first use order (see meshOptimiser.h). Only all-triangle
+// meshes have their polygons reordered. The renumbering is kept only when it
+// lowers the modelled gather misses of the vertex arrays; otherwise the
+// vertices stay in scan order. Normals are carried along, so the mesh draws
+// exactly as before.
+void optimiseMesh(){
+    PROFILE_SCOPE("optimise mesh");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t n = vertexArrays.size();
+    size_t streamBytes = VertexArrays::paddedSize(n) * sizeof(float);
+
+    vector<int> triangles;
+    polygons.triangulate(triangles);
+    double acmrBefore = averageCacheMissRatio(triangles.data(), triangles.size()/3, ACMR_CACHE_SIZE);
+    size_t missesBefore = gatherCacheMisses(polygons.getIndices(), polygons.getIndexCount(),
+            VERTEX_ARRAY_COUNT, streamBytes, sizeof(float));
+
+    vector<int> order;
+    optimiseTriangleOrder(triangles.data(), triangles.size()/3, n, order);
+    if (!polygons.isTriangles()){
+        // Order of the fan triangles; each polygon goes where its first triangle is drawn
+        vector<int> owner;
+        owner.reserve(triangles.size()/3);
+        for (size_t i = 0; i < polygons.size(); i++)
+            owner.insert(owner.end(), polygons[i].size() - 2, i);
+        vector<bool> placed(polygons.size(), false);
+        vector<int> polygonOrder;
+        polygonOrder.reserve(polygons.size());
+        for (size_t i = 0; i < order.size(); i++){
+            int polygon = owner[order[i]];
+            if (!placed[polygon]){
+                placed[polygon] = true;
+                polygonOrder.push_back(polygon);
+            }
+        }
+        order.swap(polygonOrder);
+    }
+
+    // Polygons in the new order, with the offsets of a mixed list following them
+    vector<int> indices, offsets(1, 0);
+    vector<float> normals(3*polygons.size());
+    indices.reserve(polygons.getIndexCount());
+    offsets.reserve(polygons.size() + 1);
+    for (size_t i = 0; i < order.size(); i++){
+        Polygon polygon = polygons[order[i]];
+        indices.insert(indices.end(), polygon.begin(), polygon.end());
+        offsets.push_back(indices.size());
+        copy(polygonNormals + 3*order[i], polygonNormals + 3*order[i] + 3, normals.begin() + 3*i);
+    }
+    size_t missesScan = gatherCacheMisses(indices.data(), indices.size(), VERTEX_ARRAY_COUNT, streamBytes, sizeof(float));
+
+    // Vertices in the order the polygons first use them, if that gathers better
+    vector<int> remap, renumbered(indices.size());
+    firstUseVertexOrder(indices.data(), indices.size(), n, remap);
+    for (size_t i = 0; i < indices.size(); i++)
+        renumbered[i] = remap[indices[i]];
+    size_t missesFirstUse = gatherCacheMisses(renumbered.data(), renumbered.size(),
+            VERTEX_ARRAY_COUNT, streamBytes, sizeof(float));
+    bool renumber = missesFirstUse < missesScan;
+    if (renumber){
+        indices.swap(renumbered);
+        vector<float> scratch(n);
+        for (int a = 0; a < VERTEX_ARRAY_COUNT; a++){
+            float *array = vertexArrays.get((VertexArray) a);
+            copy(array, array + n, scratch.begin());
+            for (size_t i = 0; i < n; i++)
+                array[remap[i]] = scratch[i];
         }
-        float x,y,z;
-        vtk >> x >> y >> z;
-        Vertex<float> current(x,y,z);
+        for (size_t i = 0; i < pointCount; i++)
+            pointVertices[i] = remap[pointVertices[i]];
+
+        // Keep any levels of detail pointing at the same vertices
+        for (size_t level = 1; level < meshLods.size(); level++){
+            vector<int> &lod = meshLods[level].triangles;
+            for (size_t i = 0; i < lod.size(); i++)
+                lod[i] = remap[lod[i]];
+        }
+    }
 
-        // Determine min coordinates
-        minVertex.setX(min(x,minVertex.getX()));
-        minVertex.setY(min(y,minVertex.getY()));
-        minVertex.setZ(min(z,minVertex.getZ()));
+    // Back into the same arrays
+    copy(indices.begin(), indices.end(), polygons.getIndices());
+    if (!polygons.isTriangles())
+        copy(offsets.begin(), offsets.end(), polygons.getOffsets());
+    copy(normals.begin(), normals.end(), polygonNormals);
+    if (!meshLods.empty())
+        polygons.triangulate(meshLods[0].triangles);
+
+    polygons.triangulate(triangles);
+    double acmrAfter = averageCacheMissRatio(triangles.data(), triangles.size()/3, ACMR_CACHE_SIZE);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << "Mesh reordered in " << elapsed << " ms" << endl;
+    cout << "  ACMR (FIFO " << ACMR_CACHE_SIZE << "): " << acmrBefore << " -> " << acmrAfter << endl;
+    cout << "  Vertex gather misses (" << GATHER_CACHE_BYTES/1024 << " KiB " << GATHER_CACHE_WAYS << " way, "
+            << VERTEX_ARRAY_COUNT << " arrays): " << missesBefore << " -> " << missesScan << " with the polygons reordered";
+    if (renumber)
+        cout << " -> " << missesFirstUse << " with the vertices in first use order" << endl;
+    else
+        cout << ", vertices kept in scan order (" << missesFirstUse << " in first use order)" << endl;
+}
 
-        // Determine max coordinates
-        maxVertex.setX(max(x,maxVertex.getX()));
-        maxVertex.setY(max(y,maxVertex.getY()));
-        maxVertex.setZ(max(z,maxVertex.getZ()));
+// Simplifies the mesh into a chain of levels of detail, see meshSimplifier.h
+void buildLods(){
+    PROFILE_SCOPE("build LODs");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<int> triangles;
+    polygons.triangulate(triangles);
+    buildLodChain(vertexArrays, triangles, meshLods);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << meshLods.size() << " levels of detail built in " << elapsed << " ms:";
+    for (size_t i = 0; i < meshLods.size(); i++)
+        cout << " " << meshLods[i].triangles.size()/3;
+    cout << " triangles" << endl;
+}
 
-        // Centre coordinate
-        centreX += x/n;
-        centreY += y/n;
-        centreZ += z/n;
+// Picks the coarsest level of detail whose error stays within LOD_PIXEL_ERROR
+// pixels, from the projected size of the mesh bounds at the current zoom
+size_t selectLod(){
+    Coordinate<float> eye, lookAt;
+    viewPoint(eye, lookAt);
+
+    // Distance to the nearest point of the bounding sphere
+    float diameter = (maxVertex - minVertex).magnitude();
+    float distance = (centreVertex - eye).magnitude() - diameter/2;
+    distance = distance > diameter * 1e-3f ? distance : diameter * 1e-3f;
+
+    float pixelsPerUnit = viewportHeight / (2 * distance * tan(FIELD_OF_VIEW/2 * M_PI/180));
+    size_t level = 0;
+    while (level + 1 < meshLods.size() && meshLods[level+1].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+        level++;
+    return level;
+}
 
-        vertices.push_back(current);
+// Splits every level of detail into clusters, reordering its triangles, see meshClusters.h
+void buildMeshClusters(){
+    PROFILE_SCOPE("build clusters");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    meshClusters.resize(meshLods.size());
+    size_t clusters = 0;
+    for (size_t i = 0; i < meshLods.size(); i++){
+        buildClusters(vertexArrays, meshLods[i].triangles, meshClusters[i]);
+        clusters += meshClusters[i].size();
     }
-    centreVertex = Coordinate<float>(centreX, centreY, centreZ);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << clusters << " clusters built in " << elapsed << " ms" << endl;
+}
 
-    cout << "Min: " << minVertex << endl;
-    cout << "Max: " << maxVertex << endl;
-    cout << "Centre: " << centreVertex << endl;
-    cout << vertices.size() << " vertices loaded" << endl;
+// Builds the picking trees over the full mesh on every thread. Only the
+// window and the bench queries pick, so the other modes never pay for it.
+void buildPickingBvh(){
+    PROFILE_SCOPE("build bvh");
+    if (meshLods.empty())
+        return;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    meshBvh.build(vertexArrays, meshLods[0].triangles, ThreadPool::global());
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Picking BVH of " << meshBvh.getNodeCount() << " nodes (" << meshBvh.getBytes()/1024 << " KiB) built in "
+            << elapsed << " ms" << endl;
+}
 
-    //Initialise camera position
-//  camera.x = ceil(maxVertex.x);
-//  camera.y = ceil(maxVertex.y);
-//  camera.z = ceil(maxVertex.z);
+// Shows how much culling saved in the last frame, updating the title only when it changes
+void showCullStats(){
+    static string shown = WINDOW_TITLE;
+    ostringstream title;
+    title << WINDOW_TITLE;
+    if (!loadComplete){
+        title << " - loading";
+        if (meshBuffers.isBuilt())
+            title << " " << (int) (meshBuffers.getProgress() * 100) << "%";
+    }
+    else if (!sceneInstances.empty()){
+        title << " - " << sceneInstances.size() << " instances, " << instanceTriangles << " triangles in "
+                << instanceRenderer.getDrawCalls() << " draw calls";
+    }
+    else if (useVertexBuffers && useCulling){
+        title << " - culled " << cullStats.culledClusters << "/" << cullStats.clusters << " clusters, "
+                << cullStats.culledTriangles << "/" << cullStats.triangles << " triangles";
+    }
+    if (title.str() != shown){
+        shown = title.str();
+        glutSetWindowTitle(shown.c_str());
+    }
+}
 
-    camera = maxVertex*10;
-    camera.setY(0.f);       // to "straighten" view
+// Position of vertex i in vertexArrays
+Coordinate<float> vertexCoordinate(int i){
+    return Coordinate<float>(vertexArrays.get(VERTEX_X)[i], vertexArrays.get(VERTEX_Y)[i], vertexArrays.get(VERTEX_Z)[i]);
+}
 
-    cout << "Camera: " << camera << endl;
+// Writes the loaded mesh to the binary cache so that the next launch can skip parsing
+void saveMeshCache(){
+    PROFILE_SCOPE("save mesh cache");
+    MeshCacheData data;
+    data.vertexCount = vertexArrays.size();
+    data.polygonCount = polygons.size();
+    data.indexCount = polygons.getIndexCount();
+    for (int i = 0; i < VERTEX_ARRAY_COUNT; i++)
+        data.vertexArrays[i] = vertexArrays.get((VertexArray) i);
+    data.polygonNormals = polygonNormals;
+    data.polygonOffsets = polygons.getOffsets();
+    data.indices = polygons.getIndices();
+    data.pointCount = pointCount;
+    data.pointVertices = pointVertices;
+    data.weldEpsilon = weldEpsilon;
+    data.sourceTopology = meshTopology;
+    data.sourceSize = meshFileSize;
+    data.sourceMtime = meshFileMtime;
+    data.sourceMtimeNsec = meshFileMtimeNsec;
+
+    data.levelCount = min(meshLods.size(), (size_t) MESH_CACHE_MAX_LEVELS);
+    for (uint32_t i = 0; i < data.levelCount; i++){
+        data.levelIndices[i] = meshLods[i].triangles.data();
+        data.levelTriangleCounts[i] = meshLods[i].triangles.size() / 3;
+        data.levelErrors[i] = meshLods[i].error;
+        data.levelClusters[i] = meshClusters[i].data();
+        data.levelClusterCounts[i] = meshClusters[i].size();
+    }
 
-    // Camera vector
-    cameraVector = centreVertex - camera;
-    cout << "Camera vector: " << cameraVector << endl;
+    minVertex.copyTo(data.minVertex);
+    maxVertex.copyTo(data.maxVertex);
+    centreVertex.copyTo(data.centreVertex);
+    meanNormal.copyTo(data.meanNormal);
 
-    // Translation vector
-    translationVector = (cameraVector * Coordinate<float>(0.f,1.f,0.f)).normalise();
-    cout << "Translation vector: " << translationVector << endl;
+    if (MeshCache::write(vtkPath, data))
+        cout << "Mesh cache written to " << MeshCache::cachePath(vtkPath) << endl;
+    else
+        cerr << "Unable to write mesh cache " << MeshCache::cachePath(vtkPath) << endl;    // not fatal
+}
+
+// Parses the VTK file, unless parsed already holds it; its arrays are taken over
+void loadVtk(VtkPolyData *parsed){
+    PROFILE_SCOPE("parse VTK");
+    cout << "Loading VTK" << endl;
+
+    // Read and parse the whole file on the thread pool
+    VtkPolyData parsedHere;
+    VtkPolyData &data = parsed != NULL ? *parsed : parsedHere;
+    string error;
+    if (parsed == NULL){
+        VtkParseStats stats;
+        if (!parseVtk(vtkPath, data, ThreadPool::global(), stats, error)){
+            cerr << error << endl;
+            exit(1);
+        }
+        printVtkParseStats(stats);
+    }
+
+    // Every index has to refer to a point; welding drops polygons left with fewer than three corners
+    if (!checkPolyData(data, weldEpsilon > 0, error)){
+        cerr << error << endl;
+        exit(1);
+    }
+    meshTopology = topologyHash(data);
+    meshFileSize = data.fileSize;
+    meshFileMtime = data.fileMtime;
+    meshFileMtimeNsec = data.fileMtimeNsec;
+
+    // Coincident points become one vertex, see meshWelder.h
+    vector<int> weld;
+    size_t points = data.pointCount;
+    weldMesh(data, weld);
+
+    size_t n = data.pointCount;  // Store the number of points
+
+    // One arena for every array the mesh keeps, sized from the welded counts.
+    // The parsed vectors are freed as they are copied in.
+    bool triangles;
+    size_t indexCount = PolygonList::cellIndexCount(data.cells.data(), data.polygonCount, triangles);
+    meshArena.reserve(VERTEX_ARRAY_COUNT * MeshArena::bytesFor<float>(n)
+            + (triangles ? 0 : MeshArena::bytesFor<int>(data.polygonCount + 1))
+            + MeshArena::bytesFor<int>(indexCount) + MeshArena::bytesFor<float>(3*data.polygonCount)
+            + MeshArena::bytesFor<int>(points));
+
+    // Now let's load the vertices
+    float *arrays[VERTEX_ARRAY_COUNT];
+    for (int i = 0; i < VERTEX_ARRAY_COUNT; i++)
+        arrays[i] = meshArena.allocate<float>(n);
+    vertexArrays.attach(arrays, n);
+    float *x = vertexArrays.get(VERTEX_X), *y = vertexArrays.get(VERTEX_Y), *z = vertexArrays.get(VERTEX_Z);
+    for (size_t i = 0; i < n; i++){
+        x[i] = data.points[3*i];
+        y[i] = data.points[3*i+1];
+        z[i] = data.points[3*i+2];
+    }
+    vector<float>().swap(data.points);
+
+    pointCount = points;
+    pointVertices = meshArena.allocate<int>(points);
+    copy(weld.begin(), weld.end(), pointVertices);
 
+    // Bounds and centre
+    ArrayStatistics statistics;
+    {
+        PROFILE_SCOPE("bounds");
+        reduceArrays(x, y, z, n, ThreadPool::global(), statistics);
+    }
+    minVertex = Coordinate<float>(statistics.minimum[0], statistics.minimum[1], statistics.minimum[2]);
+    maxVertex = Coordinate<float>(statistics.maximum[0], statistics.maximum[1], statistics.maximum[2]);
+    centreVertex = Coordinate<float>(statistics.mean[0], statistics.mean[1], statistics.mean[2]);
+
+    cout << n << " vertices loaded" << endl;
+
+    // Load polygons -- the cell counts have already been checked by the parser
+    int *offsets = triangles ? NULL : meshArena.allocate<int>(data.polygonCount + 1);
+    polygons.assignCells(data.cells.data(), data.polygonCount, offsets, meshArena.allocate<int>(indexCount));
+    polygonNormals = meshArena.allocate<float>(3*data.polygonCount);
+    vector<int>().swap(data.cells);
+    cout << "Mesh arena of " << meshArena.getCapacity()/1024 << " KiB, " << meshArena.getUsed()/1024 << " KiB used" << endl;
+    cout << polygons.size() << " polygons loaded \n";
+
+    // Get texture data
+    float *u = vertexArrays.get(VERTEX_U), *v = vertexArrays.get(VERTEX_V);
+    for (size_t i = 0; i < data.textureCount; i++){
+        u[i] = data.textures[2*i];
+        v[i] = data.textures[2*i+1];
+    }
+    vector<float>().swap(data.textures);
 
-    // Now we might get some leftover garbage like new line delimiter.
-    // Use a loop to rid fhe buffer of extraneous new line characters, for example
-    do{
-      getline(vtk, buffer);     // The line with the number of points
-      bufferStream.clear();
-      bufferStream.str(buffer); // Put line in to a stringstream
+    cout << data.textureCount << " texture data points loaded.\n";
 
-      // Extract the POLYGONS bit
-      bufferStream >> buffer;
+    calculateNormals();
 
+    cout << "Normals calculated (" << meshKernels().name << " kernels)" << endl;
+    cout << "VTK Load complete" << endl;
+}
 
-    } while(buffer != "POLYGONS" && !vtk.eof());
+// Welds the points of data closer than weldEpsilon, leaving the vertex each point became in weld
+void weldMesh(VtkPolyData &data, vector<int> &weld){
+    PROFILE_SCOPE("weld");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t vertices = weldPoints(data, weldEpsilon, WELD_UV_EPSILON, ThreadPool::global(), weld);
+    if (!(weldEpsilon > 0))
+        return;
+    WeldStats stats;
+    applyWeld(data, weld, vertices, stats);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    // Vertex attributes, polygon indices and polygon normals the mesh no longer needs
+    size_t removed = stats.points - stats.vertices;
+    size_t indices = (stats.cellsBefore - stats.polygons) - (stats.cellsAfter - data.polygonCount);
+    size_t bytes = removed * VERTEX_ARRAY_COUNT * sizeof(float) + indices * sizeof(int)
+            + stats.droppedPolygons * 3 * sizeof(float);
+    cout << "Welded " << stats.points << " points into " << stats.vertices << " vertices (epsilon " << weldEpsilon
+            << ") in " << elapsed << " ms with " << ThreadPool::global().size() << " threads" << endl;
+    cout << "  " << removed << " vertices and " << stats.droppedPolygons << " degenerate polygons removed: " << bytes
+            << " bytes saved, and " << removed * sizeof(MeshBufferVertex) << " in the vertex buffer" << endl;
+}
 
-    if (vtk.eof()){
-        cerr << "File ended unexpectedly (POLYGONS) \n";
+// Maps the PPM texture, exiting if it cannot be read
+void loadTexture(){
+    string error;
+    if (!mapTexture(error)){
+        cerr << error << endl;
         exit(1);
     }
+}
 
-    // Get the number of polygons
-    bufferStream >> n;
+// Maps the PPM texture, or reads it if it is watched; textureData points at its texels
+bool mapTexture(string &error){
+    PROFILE_SCOPE("load texture");
+    // Load texture - cf http://www.nullterminator.net/gltexture.html
+    cout << "Loading ppm texture" << endl;
 
-    // Get the number of cells
-    int cell;
-    bufferStream >> cell;
+    if (!textureFile.open(texturePath, error, watchingInputs))
+        return false;
+    textureWidth = textureFile.getWidth();
+    textureHeight = textureFile.getHeight();
+    textureData = textureFile.getTexels();
 
-    polygonsNormal.reserve(n);
-    int cellCount = 0;  // track and count the number of cells
+    cout << textureWidth << " x " << textureHeight << " texture mapped: " << 3*(size_t) textureWidth*textureHeight
+            << " bytes" << endl;
+    return true;
+}
 
-    centreX = 0;
-    centreY = 0;
-    centreZ = 0;
-    // Load polygons
-    for (int i = 0; i < n; i++){
-        // Get the number of vertices for the current polygon
-        int numVertices;
-        vtk >> numVertices;
-        cellCount++;
-        // Load the vertices for the current polygon
-        vector<int> current;
-        current.reserve(numVertices);
-        for (int j = 0; j < numVertices; j++){
-            int index;  // Index of the vertex
-            vtk >> index;
-            current.push_back(index);
-            cellCount++;
-        }
-        polygons.push_back(current);
+// Level 0 is the mapped file; the other levels come from the mip cache, or
+// are filtered into built and cached when the cache is stale
+void textureMipLevels(TextureCache &cache, vector< vector<unsigned char> > &built, vector<const unsigned char *> &levels){
+    string cachePath = texturePath + TEXTURE_MIPS_SUFFIX;
+    levels.assign(1, textureData);
+    if (cache.open(cachePath, texturePath, TEXTURE_FORMAT_RGB8)
+            && cache.getHeader().width == (uint32_t) textureWidth && cache.getHeader().height == (uint32_t) textureHeight
+            && cache.getHeader().firstLevel == 1
+            && cache.getHeader().levelCount == mipLevelCount(textureWidth, textureHeight) - 1){
+        for (uint32_t i = 0; i < cache.getHeader().levelCount; i++)
+            levels.push_back(cache.getLevel(i));
+        cout << "Mip chain cache loaded" << endl;
+        return;
+    }
 
-        // Calculate the normal for the polygon
-        Coordinate<float> normal, vector1, vector2;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    buildMipChain(textureData, textureWidth, textureHeight, ThreadPool::global(), built);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << built.size() << " mip levels filtered in " << elapsed << " ms with " << ThreadPool::global().size()
+            << " threads" << endl;
+
+    TextureCacheData data;
+    data.format = TEXTURE_FORMAT_RGB8;
+    data.width = textureWidth;
+    data.height = textureHeight;
+    data.firstLevel = 1;
+    data.levelCount = min(built.size(), (size_t) TEXTURE_CACHE_MAX_LEVELS);
+    for (uint32_t i = 0; i < data.levelCount; i++)
+        data.levels[i] = built[i].data();
+    data.sourceSize = textureFile.getFileSize();
+    data.sourceMtime = textureFile.getMtime();
+    data.sourceMtimeNsec = textureFile.getMtimeNsec();
+    if (TextureCache::write(cachePath, data))
+        cout << "Mip chain cache written to " << cachePath << endl;
+    else
+        cerr << "Unable to write mip chain cache " << cachePath << endl;    // not fatal
+
+    for (size_t i = 0; i < built.size(); i++)
+        levels.push_back(built[i].data());
+}
 
-        vector1 = vertices.at(current.at(1)).getVertex() - vertices.at(current.at(0)).getVertex();
-        vector2 = vertices.at(current.at(2)).getVertex() - vertices.at(current.at(0)).getVertex();
+// Every level of the RGB chain in BC1, from the cache unless it is stale or
+// useCache is false. Encoding reports its speed, quality and the memory saved.
+void textureBc1Levels(const vector<const unsigned char *> &rgb, bool useCache, TextureCache &cache,
+        vector< vector<unsigned char> > &encoded, vector<const unsigned char *> &levels){
+    string cachePath = texturePath + TEXTURE_BC1_SUFFIX;
+    levels.clear();
+    if (useCache && cache.open(cachePath, texturePath, TEXTURE_FORMAT_BC1)
+            && cache.getHeader().width == (uint32_t) textureWidth && cache.getHeader().height == (uint32_t) textureHeight
+            && cache.getHeader().firstLevel == 0 && cache.getHeader().levelCount == rgb.size()){
+        for (uint32_t i = 0; i < cache.getHeader().levelCount; i++)
+            levels.push_back(cache.getLevel(i));
+        cout << "BC1 texture cache loaded" << endl;
+        return;
+    }
 
-        normal = (vector1*vector2).normalise();
+    size_t rgbBytes = 0, bc1Total = 0;
+    encoded.resize(rgb.size());
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t level = 0; level < rgb.size(); level++){
+        unsigned w = mipSize(textureWidth, level), h = mipSize(textureHeight, level);
+        encoded[level].resize(bc1Bytes(w, h));
+        encodeBc1(rgb[level], w, h, encoded[level].data(), ThreadPool::global());
+        rgbBytes += 3 * (size_t) w * h;
+        bc1Total += encoded[level].size();
+    }
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    // Quality of the level seen up close
+    vector<unsigned char> decoded(3 * (size_t) textureWidth * textureHeight);
+    decodeBc1(encoded[0].data(), textureWidth, textureHeight, decoded.data());
+    double psnr = psnrRgb(textureData, decoded.data(), (size_t) textureWidth * textureHeight);
+
+    cout << rgb.size() << " levels BC1 encoded in " << elapsed << " ms with " << ThreadPool::global().size()
+            << " threads (" << rgbBytes / (elapsed * 1000) << " MB/s), level 0 PSNR " << psnr << " dB" << endl;
+    cout << "BC1 chain " << bc1Total << " bytes against " << rgbBytes << " as RGB8 and " << rgbBytes / 3 * 4
+            << " as RGBA8: " << rgbBytes / 3 * 4 - bc1Total << " bytes saved on the GPU" << endl;
+
+    TextureCacheData data;
+    data.format = TEXTURE_FORMAT_BC1;
+    data.width = textureWidth;
+    data.height = textureHeight;
+    data.firstLevel = 0;
+    data.levelCount = min(encoded.size(), (size_t) TEXTURE_CACHE_MAX_LEVELS);
+    for (uint32_t i = 0; i < data.levelCount; i++)
+        data.levels[i] = encoded[i].data();
+    data.sourceSize = textureFile.getFileSize();
+    data.sourceMtime = textureFile.getMtime();
+    data.sourceMtimeNsec = textureFile.getMtimeNsec();
+    if (TextureCache::write(cachePath, data))
+        cout << "BC1 texture cache written to " << cachePath << endl;
+    else
+        cerr << "Unable to write BC1 texture cache " << cachePath << endl;    // not fatal
+
+    for (size_t i = 0; i < encoded.size(); i++)
+        levels.push_back(encoded[i].data());
+}
 
-        centreX += normal.getX()/n;
-        centreY += normal.getY()/n;
-        centreZ += normal.getZ()/n;
+bool compressedTexturesSupported(){
+    const char *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    return extensions != NULL && (strstr(extensions, "GL_EXT_texture_compression_s3tc") != NULL
+            || strstr(extensions, "GL_EXT_texture_compression_dxt1") != NULL);
+}
 
-        polygonsNormal.push_back(normal);
+// The mip chain of the mapped texture, BC1 encoded if prepared.compressed
+// is set. Only touches the CPU, so it may run on any thread.
+void prepareTexture(TextureLevels &prepared){
+    PROFILE_SCOPE("prepare texture");
+    textureMipLevels(prepared.mipCache, prepared.built, prepared.levels);
+    if (prepared.compressed)
+        textureBc1Levels(prepared.levels, true, prepared.bc1Cache, prepared.encoded, prepared.blocks);
+    prepared.prepared = true;
+}
 
-        // Add normal to all the vertex
-        for (vector<int>::iterator it = current.begin(); it < current.end(); it++){
-            int i = *it;
-            vertices.at(i).pushNormals(normal);
+// Uploads the mip chain, BC1 compressed when it was prepared that way.
+// Uncompressed level 0 comes straight from the mapped file.
+void uploadMipmaps(const TextureLevels &prepared){
+    PROFILE_SCOPE("upload texture");
+    if (prepared.compressed){
+        const vector<const unsigned char *> &blocks = prepared.blocks;
+        for (size_t level = 0; level < blocks.size(); level++){
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                    mipSize(textureWidth, level), mipSize(textureHeight, level), 0,
+                    textureLevelBytes(TEXTURE_FORMAT_BC1, textureWidth, textureHeight, level), blocks[level]);
         }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, blocks.size() - 1);
+        return;
+    }
 
+    // Rows of odd widths are not padded to 4 bytes
+    const vector<const unsigned char *> &levels = prepared.levels;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < levels.size(); level++){
+        glTexImage2D(GL_TEXTURE_2D, level, 3, mipSize(textureWidth, level), mipSize(textureHeight, level), 0,
+                GL_RGB, GL_UNSIGNED_BYTE, levels[level]);
     }
-    meanNormal = Coordinate<float>(centreX, centreY, centreZ);
-    meanNormal = meanNormal.normalise();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
 
-    // Calculate average normals for all the vertices
-    for(vector< Vertex<float> >::iterator it = vertices.begin(); it < vertices.end(); it++){
-        it -> calculateAverageNormal();
+string nextCapturePath(const char *pattern, int &number){
+    char path[256];
+    for (;; number++){
+        snprintf(path, sizeof(path), pattern, number);
+        if (access(path, F_OK) != 0)
+            break;
     }
-    if (cellCount != cell){
-        cerr << "Cell count mismatch " << cell << " vs " << cellCount << endl;
-        exit(1);
+    number++;
+    return path;
+}
+
+// Reads the back buffer before the swap, so the capture is exactly the frame
+// drawn whatever covers the window. The readback finishes in the background
+// (see frameCapture.h).
+void captureFrame(){
+    PROFILE_SCOPE("capture");
+    if (screenshotRequested){
+        screenshotRequested = false;
+        string path = nextCapturePath(SCREENSHOT_PATTERN, screenshotNumber);
+        frameCapture.capture(path, viewportWidth, viewportHeight);
+        cout << "Saving " << path << endl;
+    }
+    if (recording){
+        frameCapture.capture(nextCapturePath(RECORDING_PATTERN, recordingNumber), viewportWidth, viewportHeight);
+        recordedFrames++;
     }
 
-    cout << polygons.size() << " polygons loaded \n";
+    // A still window draws no more frames to poll() the readback from
+    if (frameCapture.hasPending() && !rotate)
+        glutTimerFunc(0, retireCaptures, 0);
 
-    // Get texture data
-    do{
-      getline(vtk, buffer);     // The line with the number of points
-      bufferStream.clear();
-      bufferStream.str(buffer); // Put line in to a stringstream
+    vector<string> failures = frameCapture.getWriter().takeFailures();
+    for (size_t i = 0; i < failures.size(); i++)
+        cerr << "Unable to write " << failures[i] << endl;
+}
 
-      // Extract the POINT_DATA bit
-      bufferStream >> buffer;
+void retireCaptures(int){
+    frameCapture.retireAll();
+}
 
+void setMaterial(){
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT,  materialAmbient[materialState]);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE,  materialDiffuse[materialState]);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, materialSpecular[materialState]);
 
-    } while(buffer != "POINT_DATA" && !vtk.eof());
+    GLfloat materialShininess[] = { 5.0f };
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, materialShininess);
+}
 
-    if (vtk.eof()){
-        cerr << "File ended unexpectedly (POINT_DATA) \n";
-        exit(1);
+// Camera position and look at position for the current zoom and translation
+void viewPoint(Coordinate<float> &eye, Coordinate<float> &lookAt){
+    if (zoom != 1.f){
+        eye = centreVertex - cameraVector*(1.f/zoom);           // this is basically a 1/x curve
+    }
+    else{
+        eye = camera;
+    }
+
+    if (translationFactor != 0){
+        lookAt = centreVertex + translationVector * translationFactor;
+    }
+    else{
+        lookAt = centreVertex;
     }
+}
 
-    // Get number of data points
-    bufferStream >> n;
-    // Next line can be discarded
-    getline(vtk, buffer);
+// The projection reshape() sets up and the modelview display() builds, for a w x h viewport
+void viewMatrices(Matrix4 &projection, Matrix4 &modelview, int w, int h){
+    Coordinate<float> eye, lookAt;
+    viewPoint(eye, lookAt);
+    projection = Matrix4::perspective(FIELD_OF_VIEW, 1.0 * w / (h == 0 ? 1 : h), 0.0001f, 20.f);
+    modelview = Matrix4::lookAt(eye.getX(), eye.getY(), eye.getZ(),
+            lookAt.getX(), lookAt.getY(), lookAt.getZ(), 0.0f, 1.0f, 0.0f)
+            * Matrix4::rotation(angle, 0.f, centreVertex.getY(), 0.f);
+}
 
-    for (int i = 0; i < n; i++){
-        float x, y;
-        vtk >> x >> y;
-        vertices.at(i).setTexture(x,y);
+// The ray from the eye through window position (x, y), GLUT's origin top left,
+// taken back through the view display() draws into mesh coordinates
+bool pickRay(int x, int y, float origin[3], float direction[3]){
+    Matrix4 projection, modelview, inverse;
+    viewMatrices(projection, modelview, viewportWidth, viewportHeight);
+    if (viewportWidth <= 0 || viewportHeight <= 0 || !modelview.inverse(inverse))
+        return false;
+
+    // Through the pixel centre, on the plane one unit in front of the eye
+    float ndcX = 2.f * (x + 0.5f) / viewportWidth - 1.f;
+    float ndcY = 1.f - 2.f * (y + 0.5f) / viewportHeight;
+    float eye[4] = {0.f, 0.f, 0.f, 1.f}, ahead[4] = {ndcX / projection.m[0], ndcY / projection.m[5], -1.f, 0.f};
+    float eyeMesh[4], aheadMesh[4];
+    inverse.transform(eye, eyeMesh);
+    inverse.transform(ahead, aheadMesh);
+    for (int k = 0; k < 3; k++){
+        origin[k] = eyeMesh[k] / eyeMesh[3];
+        direction[k] = aheadMesh[k];
     }
+    return true;
+}
 
-    cout << n << " texture data points loaded.\n";
+// Picks the mesh under window position (x, y) and lists the vertices nearest the hit
+void placeLandmark(int x, int y){
+    if (!sceneInstances.empty() || !meshBvh.isBuilt())
+        return;
+    float origin[3], direction[3];
+    if (!pickRay(x, y, origin, direction))
+        return;
+
+    BvhHit hit;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool found = meshBvh.pick(origin, direction, hit);
+    double pickMicroseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    if (!found){
+        cout << "Missed the mesh (" << pickMicroseconds << " us)" << endl;
+        return;
+    }
 
-    cout << "VTK Load complete" << endl;
+    vector<BvhNeighbour> nearest;
+    start = chrono::steady_clock::now();
+    meshBvh.nearestVertices(hit.point, PICK_NEAREST, nearest);
+    double nearestMicroseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+    landmarks.push_back(Coordinate<float>(hit.point[0], hit.point[1], hit.point[2]));
+    cout << "Landmark " << landmarks.size() << ": " << landmarks.back() << " on triangle " << hit.triangle
+            << " (picked in " << pickMicroseconds << " us)" << endl;
+    cout << "Nearest vertices (" << nearestMicroseconds << " us):";
+    for (size_t i = 0; i < nearest.size(); i++)
+        cout << " " << nearest[i].vertex << " (" << nearest[i].distance << ")";
+    cout << endl;
+    requestRedraw();
+}
 
-    // Load texture - cf http://www.nullterminator.net/gltexture.html
-    cout << "Loading ppm texture" << endl;
+// Unlit points on top of the mesh, in the modelview display() set up for it
+void drawLandmarks(){
+    if (landmarks.empty())
+        return;
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_POINT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_DEPTH_TEST);
+    glPointSize(LANDMARK_SIZE);
+    glColor3f(1.f, 0.f, 0.f);
+    glBegin(GL_POINTS);
+    for (size_t i = 0; i < landmarks.size(); i++)
+        glVertex3f(landmarks[i].getX(), landmarks[i].getY(), landmarks[i].getZ());
+    glEnd();
+    glPopAttrib();
+}
 
-    ifstream ppm(TEXTURE_PATH);
-    if (ppm.fail()){    // File opening has failed
-        cerr << "Unable to open PPM file \n";
-        exit(1);
+// The state init(), reshape(), display() and setMaterial() hand to OpenGL
+void softwareFrame(SoftFrame &frame, SoftTexture &softTexture, int w, int h){
+    viewMatrices(frame.projection, frame.modelview, w, h);
+
+    // GL_LIGHT0 as set up in init(), at its default position
+    SoftLight light = {
+        {0.f, 0.f, 0.f, 1.f}, {0.7f, 0.7f, 0.7f, 1.f}, {0.9f, 0.9f, 0.9f, 1.f}, {0.f, 0.f, 1.f, 0.f}
+    };
+    frame.light = light;
+
+    // Default GL_LIGHT_MODEL_AMBIENT
+    for (int c = 0; c < 3; c++)
+        frame.lightModelAmbient[c] = 0.2f;
+    frame.lightModelAmbient[3] = 1.f;
+
+    for (int c = 0; c < 3; c++){
+        frame.material.ambient[c] = materialAmbient[materialState][c];
+        frame.material.diffuse[c] = materialDiffuse[materialState][c];
+        frame.material.specular[c] = materialSpecular[materialState][c];
+        frame.material.emission[c] = 0.f;
     }
+    frame.material.ambient[3] = frame.material.diffuse[3] = frame.material.specular[3] = 1.f;
+    frame.material.emission[3] = 1.f;
+    frame.material.shininess = 5.f;
 
-    // Check "magic number"
-    ppm >> buffer;
-    if (buffer != "P6"){
-        cerr << "Invalid magic number" << endl;
-        exit(1);
+    softTexture.texels = textureData;
+    softTexture.width = textureWidth;
+    softTexture.height = textureHeight;
+    frame.texture = showTexture ? &softTexture : NULL;
+
+    for (int c = 0; c < 4; c++)
+        frame.clearColour[c] = 0.f;
+}
+
+// Set vtkPath and texturePath from --mesh PATH and --texture PATH, wherever
+// they are, and remove them so that the modes see only their own arguments
+void parseLoadOptions(int &argc, char **argv){
+    int kept = 1;
+    for (int i = 1; i < argc; i++){
+        string argument = argv[i];
+        if (argument == "--mesh" && i + 1 < argc)
+            vtkPath = argv[++i];
+        else if (argument == "--texture" && i + 1 < argc)
+            texturePath = argv[++i];
+        else if (argument == "--weld-epsilon" && i + 1 < argc)
+            weldEpsilon = atof(argv[++i]);
+        else if (argument == "--mesh" || argument == "--texture" || argument == "--weld-epsilon"){
+            cerr << "Usage: " << argv[0] << " [--mesh file.vtk|file.vtp] [--texture file.ppm] [--weld-epsilon distance] ..."
+                    << endl;
+            exit(1);
+        }
+        else
+            argv[kept++] = argv[i];
     }
+    argc = kept;
+    argv[argc] = NULL;
+}
 
-    // Height and width
-    ppm >> textureWidth >> textureHeight;
+// Render the default view into a TGA file, or time the renderer over a
+// range of resolutions and thread counts with --benchmark
+int renderSoftware(int argc, char **argv){
+    string output = SOFTWARE_OUTPUT;
+    int width = SOFTWARE_WIDTH, height = SOFTWARE_HEIGHT;
+    unsigned threads = 0;
+    bool benchmark = false;
+    for (int i = 2; i < argc; i++){
+        string argument = argv[i];
+        int w, h;
+        char end;
+        if (argument == "--benchmark"){
+            benchmark = true;
+        }
+        else if (argument == "--threads" && i + 1 < argc){
+            threads = atoi(argv[++i]);
+        }
+        else if (sscanf(argument.c_str(), "%dx%d%c", &w, &h, &end) == 2 && w > 0 && h > 0){
+            width = w;
+            height = h;
+        }
+        else if (argument.size() > 0 && argument[0] == '-'){
+            cerr << "Unknown option " << argument << endl;
+            cerr << "Usage: " << argv[0] << " --software [output.tga] [WIDTHxHEIGHT] [--threads N] [--benchmark]" << endl;
+            return 1;
+        }
+        else{
+            output = argument;
+        }
+    }
 
-    cout << textureWidth << " x " << textureHeight << " texture found" << endl;
+    loadData();
 
-    int maxVal;
-    ppm >> maxVal;
+    vector<int> triangulated;
+    polygons.triangulate(triangulated);
+    SoftMesh mesh = {&vertexArrays, triangulated.data(), triangulated.size() / 3};
+
+    SoftFrame frame;
+    SoftTexture softTexture;
+
+    if (!benchmark){
+        ThreadPool pool(threads);
+        SoftRenderer renderer(pool);
+        renderer.setSize(width, height);
+        softwareFrame(frame, softTexture, width, height);
+        renderer.render(mesh, frame);
+
+        const SoftRenderStats &stats = renderer.getStats();
+        cout << "Rendered " << width << " x " << height << " with " << stats.threads << " threads in "
+                << stats.totalSeconds()*1000 << " ms (vertex " << stats.vertexSeconds*1000
+                << " ms, setup " << stats.setupSeconds*1000 << " ms, raster " << stats.rasterSeconds*1000 << " ms)" << endl;
+
+        vector<unsigned char> pixels((size_t) width * height * 3);
+        renderer.readPixels(pixels.data());
+        if (!writeImage(output, imageFormat(output), width, height, pixels.data())){
+            cerr << "Unable to write " << output << endl;
+            return 1;
+        }
+        cout << "Saved " << output << endl;
+        return 0;
+    }
 
-    cout << "MaxVal: " << maxVal << endl;
+    // Thread counts: powers of two up to the number of cores, and the number of cores
+    unsigned cores = threads != 0 ? threads : thread::hardware_concurrency();
+    cores = cores == 0 ? 1 : cores;
+    vector<unsigned> threadCounts;
+    for (unsigned count = 1; count < cores; count *= 2)
+        threadCounts.push_back(count);
+    threadCounts.push_back(cores);
+
+    const int sizes[] = {256, 512, 1024, 2048};
+    cout << "size\tthreads\tms/frame\tvertex\tsetup\traster" << endl;
+    for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+        for (size_t t = 0; t < threadCounts.size(); t++){
+            ThreadPool pool(threadCounts[t]);
+            SoftRenderer renderer(pool);
+            renderer.setSize(sizes[s], sizes[s]);
+            softwareFrame(frame, softTexture, sizes[s], sizes[s]);
+            renderer.render(mesh, frame);   // warm up the buffers
+
+            double total = 0, vertex = 0, setup = 0, raster = 0;
+            for (int i = 0; i < BENCHMARK_FRAMES; i++){
+                renderer.render(mesh, frame);
+                const SoftRenderStats &stats = renderer.getStats();
+                total += stats.totalSeconds();
+                vertex += stats.vertexSeconds;
+                setup += stats.setupSeconds;
+                raster += stats.rasterSeconds;
+            }
+            cout << sizes[s] << "\t" << threadCounts[t] << "\t" << total*1000/BENCHMARK_FRAMES << "\t"
+                    << vertex*1000/BENCHMARK_FRAMES << "\t" << setup*1000/BENCHMARK_FRAMES << "\t"
+                    << raster*1000/BENCHMARK_FRAMES << endl;
+        }
+    }
+    return 0;
+}
 
-    if (maxVal > 255){
-        cerr << "Only maxval of up to 255 is supported \n";
-        exit(1);
+// Load the mesh once and render each scene of a scene file to its image file
+int renderBatch(int argc, char **argv){
+    string path;
+    unsigned threads = 0;
+    for (int i = 2; i < argc; i++){
+        string argument = argv[i];
+        if (argument == "--threads" && i + 1 < argc){
+            threads = atoi(argv[++i]);
+        }
+        else if (path.empty() && argument.size() > 0 && argument[0] != '-'){
+            path = argument;
+        }
+        else{
+            cerr << "Usage: " << argv[0] << " --batch scenes.txt [--threads N]" << endl;
+            return 1;
+        }
+    }
+    if (path.empty()){
+        cerr << "Usage: " << argv[0] << " --batch scenes.txt [--threads N]" << endl;
+        return 1;
     }
 
-    // Read away the next whitespace (one byte or a char)
-    ppm.get();
+    // Settings of a freshly started window
+    Scene defaults = {zoom, translationFactor, angle, materialState, showTexture, SOFTWARE_WIDTH, SOFTWARE_HEIGHT, ""};
+    vector<Scene> scenes;
+    string error;
+    if (!loadScenes(path, defaults, presetScenes, PRESET_SCENE_COUNT, MAX_MATERIAL_STATE, scenes, error)){
+        cerr << error << endl;
+        return 1;
+    }
 
-    if (ppm.fail() || ppm.eof()){
-        cerr << "Texture loading failed" << endl;
-        exit(1);
+    loadData();
+
+    vector<int> triangulated;
+    polygons.triangulate(triangulated);
+    SoftMesh mesh = {&vertexArrays, triangulated.data(), triangulated.size() / 3};
+
+    ThreadPool pool(threads);
+    SoftRenderer renderer(pool);
+    SoftFrame frame;
+    SoftTexture softTexture;
+    vector<unsigned char> pixels;
+    FrameWriter writer;     // encodes and writes one scene while the next renders
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < scenes.size(); i++){
+        const Scene &scene = scenes[i];
+        applyScene(scene);
+        renderer.setSize(scene.width, scene.height);
+        softwareFrame(frame, softTexture, scene.width, scene.height);
+        renderer.render(mesh, frame);
+
+        pixels.resize((size_t) scene.width * scene.height * 3);
+        renderer.readPixels(pixels.data());
+        writer.submit(scene.output, imageFormat(scene.output), scene.width, scene.height, pixels, true);
+        cout << scene.output << ": " << scene.width << " x " << scene.height << " in "
+                << renderer.getStats().totalSeconds()*1000 << " ms" << endl;
     }
+    writer.flush();
 
-    int size = textureHeight*textureWidth*3;
-    textureData = new char[size];
-    ppm.read(textureData, size);
+    vector<string> failures = writer.takeFailures();
+    for (size_t i = 0; i < failures.size(); i++)
+        cerr << "Unable to write " << failures[i] << endl;
+    size_t failed = failures.size();
 
-    if (ppm.fail()){
-            cerr << "Texture loading failed" << endl;
-            exit(1);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Rendered " << scenes.size() - failed << " of " << scenes.size() << " scenes in " << seconds*1000
+            << " ms with " << pool.size() << " threads" << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+void applyScene(const Scene &scene){
+    zoom = scene.zoom;
+    translationFactor = scene.translationFactor;
+    angle = scene.angle;
+    materialState = scene.materialState;
+    showTexture = scene.showTexture;
+}
+
+// Parse and reorder the mesh and write it out as a VTK file. The cache,
+// levels of detail and clusters are skipped: only the polygons are written.
+int writeOptimisedMesh(int argc, char **argv){
+    if (argc != 3){
+        cerr << "Usage: " << argv[0] << " --optimise output.vtk" << endl;
+        return 1;
+    }
+
+    loadVtk();
+    optimiseMesh();
+
+    string error;
+    if (!writeVtk(argv[2], "Somebody's face, reordered for cache locality", vertexArrays, polygons, error)){
+        cerr << error << endl;
+        return 1;
+    }
+    cout << "Saved " << argv[2] << endl;
+    return 0;
+}
+
+int compressTexture(int argc, char **argv){
+    if (argc != 2){
+        cerr << "Usage: " << argv[0] << " --compress-texture" << endl;
+        return 1;
+    }
+
+    loadTexture();
+    TextureCache mipCache, bc1Cache;
+    vector< vector<unsigned char> > built, encoded;
+    vector<const unsigned char *> levels, blocks;
+    textureMipLevels(mipCache, built, levels);
+    textureBc1Levels(levels, false, bc1Cache, encoded, blocks);
+    return 0;
+}
+
+void clearMesh(){
+    polygons.clear();
+    vertexArrays.clear();
+    polygonNormals = NULL;
+    pointVertices = NULL;
+    pointCount = 0;
+    meshTopology = meshFileSize = 0;
+    meshFileMtime = meshFileMtimeNsec = 0;
+    meshLods.clear();
+    meshClusters.clear();
+    meshBvh.clear();
+    landmarks.clear();
+    meshArena.release();    // every array of a parsed mesh in one free
+    meshCache.close();      // after everything that may point into it
+}
+
+// For each size and kind of synthetic mesh: write it as VTK, then time a
+// fresh loadMeshData() (parse, normals, optimise, LODs, clusters, cache
+// write), the normal pass alone, a loadMeshData() from the cache and software
+// rendered frames of the default view. The texture is loaded once, outside
+// the timings. Results go to a JSON file.
+int runBenchSuite(int argc, char **argv){
+    string output = "bench.json", sizeList = BENCH_VERTICES;
+    for (int i = 2; i < argc; i++){
+        string argument = argv[i];
+        if (argument == "--vertices" && i + 1 < argc){
+            sizeList = argv[++i];
+        }
+        else if (argument.size() > 0 && argument[0] != '-'){
+            output = argument;
+        }
+        else{
+            cerr << "Usage: " << argv[0] << " --bench-suite [results.json] [--vertices N,N,...]" << endl;
+            return 1;
+        }
     }
 
-    cout << "Texture read: " << size << " bytes" << endl;
+    vector<size_t> sizes;
+    stringstream list(sizeList);
+    string item;
+    while (getline(list, item, ',')){
+        size_t count = strtoull(item.c_str(), NULL, 10);
+        if (count < 4){
+            cerr << "Invalid vertex count " << item << endl;
+            return 1;
+        }
+        sizes.push_back(count);
+    }
 
+    FILE *out = fopen(output.c_str(), "w");
+    if (out == NULL){
+        cerr << "Unable to open " << output << endl;
+        return 1;
+    }
+    mkdir(BENCH_DIRECTORY, 0777);
+
+    SoftRenderer renderer(ThreadPool::global());
+    renderer.setSize(SOFTWARE_WIDTH, SOFTWARE_HEIGHT);
+    SoftFrame frame;
+    SoftTexture softTexture;
+    vector<ProfileStage> stages;
+
+    loadTexture();
+    textureLoaded = true;
+
+    fprintf(out, "{\n  \"version\": 1,\n  \"buildFlags\": \"%s\",\n  \"kernels\": \"%s\",\n  \"threads\": %u,\n"
+            "  \"profiling\": %d,\n  \"renderSize\": [%d, %d],\n  \"results\": [", BUILD_FLAGS, meshKernels().name,
+            ThreadPool::global().size(), PROFILING, SOFTWARE_WIDTH, SOFTWARE_HEIGHT);
+    const char *separator = "\n";
+    for (size_t s = 0; s < sizes.size(); s++){
+        for (unsigned kind = 0; kind < SYNTHETIC_KIND_COUNT; kind++){
+            size_t side = (size_t) sqrt((double) sizes[s]);
+            string name = syntheticMeshName(kind);
+            string path = string(BENCH_DIRECTORY "/") + name + "-" + to_string(side * side) + ".vtk";
+
+            // Generate and write the mesh
+            clearMesh();
+            generateMesh(kind, side, side, BENCH_SEED, vertexArrays, polygons);
+            string error;
+            if (!writeVtk(path, "Synthetic " + name + " mesh", vertexArrays, polygons, error)){
+                cerr << error << endl;
+                fclose(out);
+                return 1;
+            }
+            clearMesh();
+            struct stat file;
+            uint64_t fileBytes = stat(path.c_str(), &file) == 0 ? file.st_size : 0;
+            remove(MeshCache::cachePath(path).c_str());
+            vtkPath = path;
+
+            Profiler::global().stages(stages);      // only the stages of the fresh load below
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            loadMeshData();
+            double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            Profiler::global().stages(stages);
+
+            start = chrono::steady_clock::now();
+            calculateNormals();
+            double normalSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            size_t vertexCount = vertexArrays.size(), polygonCount = polygons.size();
+            size_t triangleCount = meshLods.empty() ? 0 : meshLods[0].triangles.size() / 3;
+
+            clearMesh();
+            start = chrono::steady_clock::now();
+            loadMeshData();
+            double cachedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            buildPickingBvh();
+            vector<int> triangulated;
+            polygons.triangulate(triangulated);
+            SoftMesh mesh = {&vertexArrays, triangulated.data(), triangulated.size() / 3};
+            softwareFrame(frame, softTexture, SOFTWARE_WIDTH, SOFTWARE_HEIGHT);
+            renderer.render(mesh, frame);   // warm up the buffers
+            double renderSeconds = 0;
+            for (int i = 0; i < BENCHMARK_FRAMES; i++){
+                renderer.render(mesh, frame);
+                renderSeconds += renderer.getStats().totalSeconds() / BENCHMARK_FRAMES;
+            }
 
-    //GLenum error = glGetError();
-    //cerr << error << endl;
+            // Rays from outside the bounds at points inside them, and nearest vertices of points inside them
+            mt19937 random(BENCH_SEED);
+            uniform_real_distribution<float> unit(0.f, 1.f);
+            float low[3] = {minVertex.getX(), minVertex.getY(), minVertex.getZ()};
+            float high[3] = {maxVertex.getX(), maxVertex.getY(), maxVertex.getZ()};
+            float reach = 2.f * (maxVertex - minVertex).magnitude() + 1.f;
+            vector<float> targets(6 * BENCH_QUERIES);
+            for (size_t i = 0; i < targets.size(); i += 6){
+                float axis[3] = {unit(random) - .5f, unit(random) - .5f, unit(random) - .5f};
+                float length = sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]) + 1e-6f;
+                for (int k = 0; k < 3; k++){
+                    targets[i + k] = low[k] + (high[k] - low[k]) * unit(random);
+                    targets[i + 3 + k] = targets[i + k] + reach * axis[k] / length;
+                }
+            }
+            size_t hits = 0;
+            BvhHit hit;
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < targets.size(); i += 6){
+                float direction[3] = {targets[i] - targets[i + 3], targets[i + 1] - targets[i + 4],
+                        targets[i + 2] - targets[i + 5]};
+                hits += meshBvh.pick(&targets[i + 3], direction, hit);
+            }
+            double pickMicroseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count()
+                    / BENCH_QUERIES;
+            vector<BvhNeighbour> nearest;
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < targets.size(); i += 6)
+                meshBvh.nearestVertices(&targets[i], PICK_NEAREST, nearest);
+            double nearestMicroseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count()
+                    / BENCH_QUERIES;
+
+            cout << name << " " << vertexCount << " vertices: load " << loadSeconds*1000 << " ms, normals "
+                    << normalSeconds*1000 << " ms, cached load " << cachedSeconds*1000 << " ms, render "
+                    << renderSeconds*1000 << " ms, pick " << pickMicroseconds << " us, " << PICK_NEAREST
+                    << " nearest " << nearestMicroseconds << " us" << endl;
+            fprintf(out, "%s    {\"mesh\": \"%s\", \"vertices\": %zu, \"polygons\": %zu, \"triangles\": %zu, "
+                    "\"fileBytes\": %llu,\n     \"loadSeconds\": %.6f, \"normalSeconds\": %.6f, "
+                    "\"cachedLoadSeconds\": %.6f, \"renderSeconds\": %.6f,\n     \"pickMicroseconds\": %.3f, "
+                    "\"pickHits\": %zu, \"nearestMicroseconds\": %.3f,\n     \"stages\": {",
+                    separator, name.c_str(), vertexCount, polygonCount, triangleCount,
+                    (unsigned long long) fileBytes, loadSeconds, normalSeconds, cachedSeconds, renderSeconds,
+                    pickMicroseconds, hits, nearestMicroseconds);
+            for (size_t i = 0; i < stages.size(); i++)
+                fprintf(out, "%s\"%s\": %.6f", i ? ", " : "", stages[i].name, stages[i].seconds);
+            fprintf(out, "}}");
+            separator = ",\n";
+
+            clearMesh();
+            remove(MeshCache::cachePath(path).c_str());
+            remove(path.c_str());
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    rmdir(BENCH_DIRECTORY);
 
-    //delete[] textureData;
+    bool ok = !ferror(out);
+    if (fclose(out) != 0 || !ok){
+        cerr << "Unable to write " << output << endl;
+        return 1;
+    }
+    cout << "Results written to " << output << endl;
+    return 0;
 }
 
-// Save file as TGA
-// from http://www.opengl.org/discussion_boards/showthread.php/161499-Output-Image-to-file
-// doesn't seem to work well with textures.
-void screendump(short W, short H){
-    FILE   *out = fopen("screenshot.tga","wb");
-    char   *pixel_data = new char[3*W*H];
-    short  TGAhead[] = { 0, 2, 0, 0, 0, 0, W, H, 24 };
+// The first mesh and texture are the ones loadData() and init() loaded; the
+// others are loaded in turn into the same globals and uploaded. Instances
+// without a position are laid out in a grid, facing the camera, and the
+// camera is moved back to see all of them.
+void loadInstanceScene(){
+    PROFILE_SCOPE("load instances");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    string error;
+    if (!instanceRenderer.init(error))
+        cerr << error << endl;  // not fatal, drawn one by one
+
+    geometryStore.addTexture(texturePath, texture);
+    vector<InstanceDraw> draws(sceneInstances.size());
+    float spacing = 0;
+    size_t unplaced = 0;
+    for (size_t i = 0; i < sceneInstances.size(); i++){
+        const SceneInstance &instance = sceneInstances[i];
+        int mesh = geometryStore.findMesh(instance.mesh);
+        if (mesh < 0){
+            if (instance.mesh != vtkPath){
+                clearMesh();
+                vtkPath = instance.mesh;
+                loadMesh();
+            }
+            mesh = geometryStore.addMesh(vtkPath, vertexArrays, meshLods);
+            if (mesh < 0){
+                cerr << "Vertex buffers unsupported, unable to draw instances" << endl;
+                exit(1);
+            }
+        }
+        int image = instance.texture.empty() ? -1 : geometryStore.findTexture(instance.texture);
+        if (!instance.texture.empty() && image < 0){
+            texturePath = instance.texture;
+            loadTexture();
+            image = geometryStore.addTexture(texturePath, createTexture());
+        }
+        draws[i].mesh = mesh;
+        draws[i].texture = image < 0 ? INSTANCE_NO_TEXTURE : image;
+
+        spacing = max(spacing, 2 * geometryStore.getMesh(mesh).radius * instance.scale);
+        unplaced += instance.placed ? 0 : 1;
+    }
 
-    glReadBuffer(GL_FRONT);
-    glReadPixels(0, 0, W, H, GL_BGR, GL_UNSIGNED_BYTE, pixel_data);
+    // Grid rows go down and columns to the right as seen from the camera
+    size_t columns = ceil(sqrt((double) unplaced)), slot = 0;
+    Coordinate<float> minimum, maximum;
+    for (size_t i = 0; i < sceneInstances.size(); i++){
+        const SceneInstance &instance = sceneInstances[i];
+        const StoredMesh &mesh = geometryStore.getMesh(draws[i].mesh);
+        const float *c = mesh.centre;
+        float offset[3] = {instance.position[0], instance.position[1], instance.position[2]};
+        if (!instance.placed){
+            offset[1] = -spacing * (slot / columns);
+            offset[2] = -spacing * (slot % columns);
+            slot++;
+        }
 
-    fwrite(TGAhead,sizeof(TGAhead),1,out);
-    fwrite(pixel_data, 3*W*H, 1, out);
-    fclose(out);
+        // Turned and scaled about its own centre
+        Matrix4 model = Matrix4::translation(c[0] + offset[0], c[1] + offset[1], c[2] + offset[2])
+                * Matrix4::rotation(instance.angle, 0.f, 1.f, 0.f)
+                * Matrix4::scaling(instance.scale, instance.scale, instance.scale)
+                * Matrix4::translation(-c[0], -c[1], -c[2]);
+        InstanceAttributes &attributes = draws[i].attributes;
+        memcpy(attributes.model, model.m, sizeof(attributes.model));
+        memcpy(attributes.ambient, materialAmbient[instance.materialState], sizeof(attributes.ambient));
+        memcpy(attributes.diffuse, materialDiffuse[instance.materialState], sizeof(attributes.diffuse));
+        memcpy(attributes.specular, materialSpecular[instance.materialState], sizeof(attributes.specular));
+
+        float radius = mesh.radius * instance.scale;
+        Coordinate<float> centre(c[0] + offset[0], c[1] + offset[1], c[2] + offset[2]);
+        Coordinate<float> low = centre - Coordinate<float>(radius, radius, radius);
+        Coordinate<float> high = centre + Coordinate<float>(radius, radius, radius);
+        if (i == 0){
+            minimum = low;
+            maximum = high;
+        }
+        minimum = Coordinate<float>(min(minimum.getX(), low.getX()), min(minimum.getY(), low.getY()),
+                min(minimum.getZ(), low.getZ()));
+        maximum = Coordinate<float>(max(maximum.getX(), high.getX()), max(maximum.getY(), high.getY()),
+                max(maximum.getZ(), high.getZ()));
+    }
+    instanceRenderer.build(draws);
+
+    // Far enough along +x for the bounding sphere of everything to fit the field of view
+    minVertex = minimum;
+    maxVertex = maximum;
+    centreVertex = (minimum + maximum) * 0.5f;
+    float distance = (maximum - minimum).magnitude() / 2 / sin(FIELD_OF_VIEW/2 * M_PI/180);
+    camera = centreVertex + Coordinate<float>(distance, 0.f, 0.f);
+    cout << "Camera: " << camera << endl;
+    aimCamera();
+
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << sceneInstances.size() << " instances of " << geometryStore.getMeshCount() << " meshes and "
+            << geometryStore.getTextureCount() << " textures loaded in " << elapsed << " ms ("
+            << geometryStore.getBytes()/1024 << " KiB of vertex buffers), drawn "
+            << (instanceRenderer.isInstanced() ? "instanced" : "one by one") << " in "
+            << instanceRenderer.getDrawCalls() << " draw calls" << endl;
+}
 
-    delete[] pixel_data;
+void drawInstances(){
+    Matrix4 projection, modelview, inverse;
+    viewMatrices(projection, modelview, viewportWidth, viewportHeight);
+    const float origin[4] = {0.f, 0.f, 0.f, 1.f};
+    float eye[4] = {0.f, 0.f, 0.f, 1.f};
+    if (modelview.inverse(inverse))
+        inverse.transform(origin, eye);
+
+    const vector<InstanceGroup> &groups = instanceRenderer.getGroups();
+    vector<size_t> levels(groups.size(), 0);
+    for (size_t i = 0; i < groups.size() && useLod; i++)
+        levels[i] = selectInstanceLod(groups[i], eye);
+    instanceTriangles = instanceRenderer.draw(geometryStore, levels, showTexture);
+    PROFILE_COUNTER("triangles", instanceTriangles);
+    PROFILE_COUNTER("draw calls", instanceRenderer.getDrawCalls());
 }
 
-void setMaterial(){
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT,  materialAmbient[materialState]);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE,  materialDiffuse[materialState]);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, materialSpecular[materialState]);
+// As selectLod(), for the instance of the group nearest the eye relative to its scale
+size_t selectInstanceLod(const InstanceGroup &group, const float eye[3]){
+    const StoredMesh &mesh = geometryStore.getMesh(group.mesh);
+    const vector<InstanceAttributes> &instances = instanceRenderer.getInstances();
+    float nearest = -1;
+    for (size_t i = group.first; i < group.first + group.count; i++){
+        Matrix4 model;
+        memcpy(model.m, instances[i].model, sizeof(model.m));
+        float centre[4], local[4] = {mesh.centre[0], mesh.centre[1], mesh.centre[2], 1.f};
+        model.transform(local, centre);
+        float scale = sqrt(model.m[0]*model.m[0] + model.m[1]*model.m[1] + model.m[2]*model.m[2]);
+
+        // In mesh units, where the errors of the levels are
+        float dx = centre[0] - eye[0], dy = centre[1] - eye[1], dz = centre[2] - eye[2];
+        float distance = sqrt(dx*dx + dy*dy + dz*dz) / scale - mesh.radius;
+        distance = distance > mesh.radius * 2e-3f ? distance : mesh.radius * 2e-3f;
+        nearest = nearest < 0 || distance < nearest ? distance : nearest;
+    }
 
-    GLfloat materialShininess[] = { 5.0f };
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, materialShininess);
+    float pixelsPerUnit = viewportHeight / (2 * nearest * tan(FIELD_OF_VIEW/2 * M_PI/180));
+    size_t level = 0;
+    while (level + 1 < mesh.errors.size() && mesh.errors[level+1] * pixelsPerUnit <= LOD_PIXEL_ERROR)
+        level++;
+    return level;
 }
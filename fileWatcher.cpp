@@ -0,0 +1,85 @@
+/**
+ * Notices when files are rewritten -- see fileWatcher.h
+ */
+
+/*************** Includes *******************/
+#include "fileWatcher.h"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Events that mean a file has its new contents
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/******************** FUNCTIONS ***********************/
+FileWatcher::FileWatcher(): fd(-1){
+}
+
+FileWatcher::~FileWatcher(){
+    close();
+}
+
+bool FileWatcher::add(const string &path, string &error){
+    if (fd < 0){
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0){
+            error = string("Unable to start watching files: ") + strerror(errno);
+            return false;
+        }
+    }
+
+    size_t slash = path.rfind('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    Watch watch;
+    watch.name = slash == string::npos ? path : path.substr(slash + 1);
+    watch.path = path;
+
+    // Watching a directory twice returns the same descriptor
+    watch.descriptor = inotify_add_watch(fd, directory.c_str(), WATCH_EVENTS);
+    if (watch.descriptor < 0){
+        error = "Unable to watch " + directory + ": " + strerror(errno);
+        return false;
+    }
+    watches.push_back(watch);
+    return true;
+}
+
+void FileWatcher::poll(vector<string> &changed){
+    changed.clear();
+    if (fd < 0)
+        return;
+
+    // Aligned for the inotify_event structs read into it
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;){
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;      // EAGAIN: nothing more queued
+
+        for (char *p = buffer; p < buffer + length; ){
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0 || !(event->mask & WATCH_EVENTS))
+                continue;
+            for (size_t i = 0; i < watches.size(); i++){
+                if (watches[i].descriptor == event->wd && watches[i].name == event->name
+                        && find(changed.begin(), changed.end(), watches[i].path) == changed.end())
+                    changed.push_back(watches[i].path);
+            }
+        }
+    }
+}
+
+void FileWatcher::close(){
+    if (fd >= 0)
+        ::close(fd);    // drops every watch with it
+    fd = -1;
+    watches.clear();
+}
@@ -0,0 +1,54 @@
+/**
+ * Notices when files are rewritten, with inotify
+ *
+ * The directory of each file is watched rather than the file itself: editors
+ * and exporters often write a new file and rename it over the old one, which
+ * would leave a watch on the file pointing at the replaced inode. A file
+ * counts as changed once its writer has closed it or the new file has been
+ * moved into place, so a half written file is never reported.
+ *
+ * poll() never blocks, so it can be called from a timer of the frame loop.
+ */
+
+#ifndef FILEWATCHER_H_
+#define FILEWATCHER_H_
+
+#include <string>
+#include <vector>
+
+/*************** Classes *******************/
+class FileWatcher{
+    struct Watch{
+        int descriptor;     // inotify watch of the directory
+        std::string name;   // file name within it
+        std::string path;   // as passed to add()
+    };
+
+    int fd;     // inotify instance, -1 until the first add()
+    std::vector<Watch> watches;
+
+    // Disallow copying -- the descriptor is owned
+    FileWatcher(const FileWatcher &);
+    FileWatcher &operator=(const FileWatcher &);
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // Watch path for changes. On failure returns false and describes the problem in error.
+    bool add(const std::string &path, std::string &error);
+
+    // Paths passed to add() that changed since the last call, each once
+    void poll(std::vector<std::string> &changed);
+
+    // Stop watching everything
+    void close();
+
+    /**
+     * Getters
+     */
+    bool isWatching() const {
+        return !watches.empty();
+    }
+};
+
+#endif /* FILEWATCHER_H_ */
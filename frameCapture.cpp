@@ -0,0 +1,208 @@
+/**
+ * Capturing frames to disk without stalling the render loop -- see frameCapture.h
+ */
+
+/*************** Includes *******************/
+#include "frameCapture.h"
+#include "glVersion.h"
+#include "imageFile.h"
+
+#include <cstring>
+
+using namespace std;
+
+/******************** FUNCTIONS ***********************/
+FrameWriter::FrameWriter(): busy(0), stopping(false), written(0), dropped(0){}
+
+FrameWriter::~FrameWriter(){
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (vector<thread>::iterator it = workers.begin(); it < workers.end(); it++)
+        it->join();
+}
+
+void FrameWriter::workerLoop(){
+    for (;;){
+        Frame frame;
+        {
+            unique_lock<std::mutex> lock(queueMutex);
+            while (!stopping && queue.empty())
+                wake.wait(lock);
+            if (queue.empty())
+                return;     // stopping, and everything is written
+            frame.path.swap(queue.front().path);
+            frame.format = queue.front().format;
+            frame.width = queue.front().width;
+            frame.height = queue.front().height;
+            frame.pixels.swap(queue.front().pixels);
+            queue.pop_front();
+            busy++;
+        }
+        progress.notify_all();  // a place in the queue is free
+
+        bool ok = writeImage(frame.path, frame.format, frame.width, frame.height, frame.pixels.data());
+
+        {
+            lock_guard<std::mutex> lock(queueMutex);
+            busy--;
+            if (ok)
+                written++;
+            else
+                failures.push_back(frame.path);
+        }
+        progress.notify_all();
+    }
+}
+
+bool FrameWriter::submit(const string &path, unsigned format, int width, int height, vector<unsigned char> &pixels,
+        bool wait){
+    unique_lock<std::mutex> lock(queueMutex);
+    if (workers.empty()){
+        for (unsigned i = 0; i < FRAME_WRITER_THREADS; i++)
+            workers.push_back(thread(&FrameWriter::workerLoop, this));
+    }
+    while (wait && queue.size() >= FRAME_WRITER_QUEUE)
+        progress.wait(lock);
+    if (queue.size() >= FRAME_WRITER_QUEUE){
+        dropped++;
+        return false;
+    }
+
+    queue.push_back(Frame());
+    Frame &frame = queue.back();
+    frame.path = path;
+    frame.format = format;
+    frame.width = width;
+    frame.height = height;
+    frame.pixels.swap(pixels);
+    lock.unlock();
+    wake.notify_one();
+    return true;
+}
+
+void FrameWriter::flush(){
+    unique_lock<std::mutex> lock(queueMutex);
+    while (!queue.empty() || busy > 0)
+        progress.wait(lock);
+}
+
+vector<string> FrameWriter::takeFailures(){
+    lock_guard<std::mutex> lock(queueMutex);
+    vector<string> taken;
+    taken.swap(failures);
+    return taken;
+}
+
+size_t FrameWriter::getWritten(){
+    lock_guard<std::mutex> lock(queueMutex);
+    return written;
+}
+
+size_t FrameWriter::getDropped(){
+    lock_guard<std::mutex> lock(queueMutex);
+    return dropped;
+}
+
+FrameCapture::FrameCapture(): next(0), frame(0){
+    for (size_t i = 0; i < FRAME_CAPTURE_BUFFERS; i++){
+        buffers[i] = 0;
+        bufferBytes[i] = 0;
+        slots[i].pending = false;
+    }
+}
+
+bool FrameCapture::supported(){
+    return glVersionAtLeast(2, 1);
+}
+
+void FrameCapture::capture(const string &path, int width, int height){
+    // Capturing faster than the ring turns over: make room
+    if (slots[next].pending)
+        retire(next);
+
+    Slot &slot = slots[next];
+    slot.path = path;
+    slot.format = imageFormat(path);
+    slot.width = width;
+    slot.height = height;
+    slot.frame = frame;
+    size_t bytes = (size_t) width * height * 3;
+
+    // Rows of odd widths are not padded to 4 bytes
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_BACK);
+    if (supported()){
+        if (buffers[next] == 0)
+            glGenBuffers(1, &buffers[next]);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[next]);
+        if (bufferBytes[next] != bytes){
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+            bufferBytes[next] = bytes;
+        }
+        glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.pending = true;
+    }
+    else{
+        vector<unsigned char> pixels(bytes);
+        glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, pixels.data());
+        writer.submit(slot.path, slot.format, width, height, pixels);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    next = (next + 1) % FRAME_CAPTURE_BUFFERS;
+}
+
+void FrameCapture::retire(size_t i){
+    Slot &slot = slots[i];
+    slot.pending = false;
+
+    vector<unsigned char> pixels((size_t) slot.width * slot.height * 3);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+    const void *mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mapped != NULL){
+        memcpy(pixels.data(), mapped, pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (mapped != NULL)
+        writer.submit(slot.path, slot.format, slot.width, slot.height, pixels);
+}
+
+void FrameCapture::poll(){
+    frame++;
+    for (size_t i = 0; i < FRAME_CAPTURE_BUFFERS; i++){
+        if (slots[i].pending && frame - slots[i].frame >= FRAME_CAPTURE_BUFFERS - 1)
+            retire(i);
+    }
+}
+
+void FrameCapture::retireAll(){
+    // Oldest first, so numbered frames are queued in order
+    for (size_t k = 0; k < FRAME_CAPTURE_BUFFERS; k++){
+        size_t i = (next + k) % FRAME_CAPTURE_BUFFERS;
+        if (slots[i].pending)
+            retire(i);
+    }
+}
+
+void FrameCapture::release(){
+    for (size_t i = 0; i < FRAME_CAPTURE_BUFFERS; i++){
+        if (buffers[i] != 0)
+            glDeleteBuffers(1, &buffers[i]);
+        buffers[i] = 0;
+        bufferBytes[i] = 0;
+        slots[i].pending = false;
+    }
+}
+
+bool FrameCapture::hasPending() const{
+    for (size_t i = 0; i < FRAME_CAPTURE_BUFFERS; i++){
+        if (slots[i].pending)
+            return true;
+    }
+    return false;
+}
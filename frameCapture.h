@@ -0,0 +1,141 @@
+/**
+ * Capturing frames to disk without stalling the render loop
+ *
+ * FrameWriter encodes and writes frames (see writeImage() in imageFile.h) on
+ * its own worker threads, so handing a frame over costs no more than moving
+ * its pixels. A frame arriving while FRAME_WRITER_QUEUE others wait is
+ * dropped and counted rather than blocking the caller, unless it asks to
+ * wait, as the batch renderer does.
+ *
+ * FrameCapture reads the GL back buffer into a ring of FRAME_CAPTURE_BUFFERS
+ * pixel buffer objects. glReadPixels() into a buffer object returns at once;
+ * the buffer is only mapped FRAME_CAPTURE_BUFFERS - 1 frames later, once the
+ * copy is long finished, and its pixels go to the writer. Without pixel
+ * buffer objects (before OpenGL 2.1) the read is synchronous but the writing
+ * still happens in the background.
+ */
+
+#ifndef FRAMECAPTURE_H_
+#define FRAMECAPTURE_H_
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*************** Macros *******************/
+// Threads encoding and writing frames
+#define FRAME_WRITER_THREADS 2
+
+// Frames waiting to be written before more are dropped
+#define FRAME_WRITER_QUEUE 16
+
+// Pixel buffer objects in the readback ring
+#define FRAME_CAPTURE_BUFFERS 3
+
+/*************** Classes *******************/
+class FrameWriter{
+    // Bottom-up BGR rows and where they go
+    struct Frame{
+        std::string path;
+        unsigned format;    // IMAGE_FORMAT_*
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+
+    std::vector<std::thread> workers;   // started by the first submit()
+    std::mutex queueMutex;
+    std::condition_variable wake, progress;
+    std::deque<Frame> queue;
+    unsigned busy;          // frames being written
+    bool stopping;
+    size_t written, dropped;
+    std::vector<std::string> failures;  // paths that could not be written
+
+    // Disallow copying
+    FrameWriter(const FrameWriter &);
+    FrameWriter &operator=(const FrameWriter &);
+
+    void workerLoop();
+public:
+    FrameWriter();
+    ~FrameWriter();     // writes everything still queued
+
+    // Queue a frame, taking the contents of pixels. Returns false if it was dropped.
+    bool submit(const std::string &path, unsigned format, int width, int height, std::vector<unsigned char> &pixels,
+            bool wait = false);
+
+    // Wait until every queued frame is written
+    void flush();
+
+    // Paths that failed since the last call
+    std::vector<std::string> takeFailures();
+
+    /**
+     * Getters
+     */
+    size_t getWritten();
+    size_t getDropped();
+};
+
+class FrameCapture{
+    // A readback in flight
+    struct Slot{
+        std::string path;
+        unsigned format;
+        int width, height;
+        unsigned long frame;    // frame it was read in
+        bool pending;
+    };
+
+    GLuint buffers[FRAME_CAPTURE_BUFFERS];  // all 0 without pixel buffer objects
+    size_t bufferBytes[FRAME_CAPTURE_BUFFERS];
+    Slot slots[FRAME_CAPTURE_BUFFERS];
+    size_t next;            // slot of the next capture
+    unsigned long frame;    // frames seen by poll()
+    FrameWriter writer;
+
+    // Disallow copying -- the buffer names are owned
+    FrameCapture(const FrameCapture &);
+    FrameCapture &operator=(const FrameCapture &);
+
+    // Map a slot's buffer and hand its pixels to the writer
+    void retire(size_t slot);
+public:
+    FrameCapture();
+
+    // True if the current context has pixel buffer objects
+    static bool supported();
+
+    // Read the width x height back buffer for path, format from its extension. Call before swapping.
+    void capture(const std::string &path, int width, int height);
+
+    // Start of a frame: hand readbacks old enough to be finished to the writer
+    void poll();
+
+    // Hand every readback to the writer now, waiting for the GL if need be
+    void retireAll();
+
+    // Delete the buffers. The context must still be current.
+    void release();
+
+    /**
+     * Getters
+     */
+    bool hasPending() const;
+
+    FrameWriter &getWriter(){
+        return writer;
+    }
+};
+
+#endif /* FRAMECAPTURE_H_ */
@@ -0,0 +1,59 @@
+/**
+ * Paces redraws at a target frame rate -- see frameScheduler.h
+ */
+
+/*************** Includes *******************/
+#include "frameScheduler.h"
+
+using namespace std;
+
+/******************** FUNCTIONS ***********************/
+FrameScheduler::FrameScheduler(double framesPerSecond): nextFrame(Clock::now()), lastStep(Clock::now()),
+        pending(false), armed(false){
+    setFrameRate(framesPerSecond);
+}
+
+void FrameScheduler::setFrameRate(double framesPerSecond){
+    framesPerSecond = framesPerSecond < 1.0 ? 1.0 : framesPerSecond;
+    interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / framesPerSecond));
+}
+
+bool FrameScheduler::request(){
+    pending = true;
+    if (armed)
+        return false;
+    armed = true;
+    return true;
+}
+
+unsigned FrameScheduler::delayMilliseconds() const{
+    Clock::time_point now = Clock::now();
+    if (nextFrame <= now)
+        return 0;
+    chrono::microseconds wait = chrono::duration_cast<chrono::microseconds>(nextFrame - now);
+    return (wait.count() + 999) / 1000;
+}
+
+bool FrameScheduler::wake(){
+    armed = false;
+    bool draw = pending;
+    pending = false;
+    return draw;
+}
+
+void FrameScheduler::frameStarted(){
+    Clock::time_point now = Clock::now();
+    // Keep to the frame grid, but never owe frames after a slow one
+    nextFrame = nextFrame + interval > now ? nextFrame + interval : now + interval;
+}
+
+double FrameScheduler::advance(){
+    Clock::time_point now = Clock::now();
+    double seconds = chrono::duration<double>(now - lastStep).count();
+    lastStep = now;
+    return seconds < FRAME_SCHEDULER_MAX_STEP ? seconds : FRAME_SCHEDULER_MAX_STEP;
+}
+
+void FrameScheduler::resetAnimation(){
+    lastStep = Clock::now();
+}
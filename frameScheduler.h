@@ -0,0 +1,66 @@
+/**
+ * Paces redraws at a target frame rate
+ *
+ * Instead of redrawing from an idle callback as fast as the machine allows,
+ * every reason to redraw calls request(). Requests made before the next
+ * frame is due are merged into that frame, and the caller only schedules a
+ * wake up (a GLUT timer, say) when request() says none is armed yet. With
+ * nothing requested there is nothing to wake up for, so the event loop can
+ * sleep.
+ *
+ * Animation advances by advance(), the real time since the last step,
+ * rather than by a fixed step per frame, so it runs at the same speed
+ * whatever the frame rate.
+ */
+
+#ifndef FRAMESCHEDULER_H_
+#define FRAMESCHEDULER_H_
+
+#include <chrono>
+
+/*************** Macros *******************/
+// Longest animation step, so a stall (a drag, a breakpoint) does not jump the scene
+#define FRAME_SCHEDULER_MAX_STEP 0.25
+
+/*************** Classes *******************/
+class FrameScheduler{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration interval;       // between frame starts
+    Clock::time_point nextFrame;    // earliest start of the next frame
+    Clock::time_point lastStep;     // last advance()
+    bool pending;   // a frame was requested
+    bool armed;     // a wake up is scheduled
+public:
+    explicit FrameScheduler(double framesPerSecond);
+
+    void setFrameRate(double framesPerSecond);
+
+    // Ask for a frame. Returns true if the caller has to schedule a wake up in
+    // delayMilliseconds(); false if one is already on its way.
+    bool request();
+
+    // Milliseconds until the next frame is due, rounded up
+    unsigned delayMilliseconds() const;
+
+    // The wake up fired. Returns true if a frame was requested and should be drawn now.
+    bool wake();
+
+    // A frame starts now; the next one is due an interval later
+    void frameStarted();
+
+    // Seconds of animation since the last call, at most FRAME_SCHEDULER_MAX_STEP
+    double advance();
+
+    // Forget the time elapsed so far, e.g. when an animation starts
+    void resetAnimation();
+
+    /**
+     * Getters
+     */
+    double getFrameRate() const {
+        return 1.0 / std::chrono::duration<double>(interval).count();
+    }
+};
+
+#endif /* FRAMESCHEDULER_H_ */
@@ -0,0 +1,24 @@
+/**
+ * OpenGL version of the current context -- see glVersion.h
+ */
+
+/*************** Includes *******************/
+#include "glVersion.h"
+
+#include <GL/gl.h>
+
+#include <cstdio>
+
+/******************** FUNCTIONS ***********************/
+bool glVersionAtLeast(int major, int minor){
+    static int contextMajor = -1, contextMinor = -1;  // parsed once a context is current
+    if (contextMajor < 0){
+        const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+        int parsedMajor = 0, parsedMinor = 0;
+        if (version == NULL || sscanf(version, "%d.%d", &parsedMajor, &parsedMinor) != 2)
+            return false;
+        contextMajor = parsedMajor;
+        contextMinor = parsedMinor;
+    }
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
@@ -0,0 +1,17 @@
+/**
+ * OpenGL version of the current context
+ *
+ * glGetString(GL_VERSION) starts with "major.minor" on every implementation.
+ * It is parsed once, on the first call made with a context current, as the
+ * program only ever has the one context; later calls compare the cached
+ * numbers.
+ */
+
+#ifndef GLVERSION_H_
+#define GLVERSION_H_
+
+/*************** Function Prototypes *******************/
+// The current context is at least OpenGL major.minor; false without a context
+bool glVersionAtLeast(int major, int minor);
+
+#endif /* GLVERSION_H_ */
@@ -0,0 +1,287 @@
+/**
+ * Reading and writing images on disk -- see imageFile.h
+ */
+
+/*************** Includes *******************/
+#include "imageFile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <cctype>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+// Skip whitespace and # comments in a PPM header
+const char *skipSpace(const char *p, const char *end){
+    while (p < end && (isspace((unsigned char) *p) || *p == '#')){
+        if (*p == '#'){
+            while (p < end && *p != '\n')
+                p++;
+        }
+        else{
+            p++;
+        }
+    }
+    return p;
+}
+
+// Parse a positive decimal header field
+const char *parseField(const char *p, const char *end, int &value){
+    p = skipSpace(p, end);
+    value = 0;
+    const char *start = p;
+    while (p < end && *p >= '0' && *p <= '9' && value < 1000000)
+        value = value*10 + (*p++ - '0');
+    return p == start ? NULL : p;
+}
+
+// Append a big endian 32 bit value
+void putBigEndian(vector<unsigned char> &out, uint32_t value){
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((value >> shift) & 0xff);
+}
+
+// CRC-32 of PNG chunks
+struct CrcTable{
+    uint32_t entries[256];
+
+    CrcTable(){
+        for (uint32_t n = 0; n < 256; n++){
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+uint32_t crc32(const unsigned char *data, size_t size){
+    static const CrcTable table;    // built once, by whichever writer thread gets here first
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < size; i++)
+        c = table.entries[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+// Length, type, data and CRC of one PNG chunk
+bool writeChunk(FILE *out, const char *type, const vector<unsigned char> &data){
+    vector<unsigned char> chunk;
+    chunk.reserve(data.size() + 12);
+    putBigEndian(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc32(&chunk[4], chunk.size() - 4));
+    return fwrite(chunk.data(), chunk.size(), 1, out) == 1;
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+PpmFile::PpmFile(): mapping(NULL), mappingSize(0), texels(NULL), width(0), height(0), fileSize(0), mtime(0), mtimeNsec(0){}
+
+PpmFile::~PpmFile(){
+    close();
+}
+
+bool PpmFile::open(const string &path, string &error, bool read){
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        error = "Unable to open PPM file " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0){
+        ::close(fd);
+        error = "Unable to read PPM file " + path;
+        return false;
+    }
+    fileSize = info.st_size;
+    mtime = info.st_mtim.tv_sec;
+    mtimeNsec = info.st_mtim.tv_nsec;
+
+    // A copy cannot fault if the file is truncated while the texels are in use
+    if (read){
+        contents.resize(info.st_size);
+        size_t done = 0;
+        while (done < contents.size()){
+            ssize_t got = ::read(fd, &contents[done], contents.size() - done);
+            if (got <= 0)
+                break;
+            done += got;
+        }
+        ::close(fd);
+        contents.resize(done);
+        if (parse(contents.data(), contents.size(), error))
+            return true;
+        close();
+        return false;
+    }
+
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // the mapping keeps its own reference
+    if (map == MAP_FAILED){
+        close();
+        error = "Unable to map PPM file " + path;
+        return false;
+    }
+    mapping = map;
+    mappingSize = info.st_size;
+    if (parse(static_cast<const char *>(map), mappingSize, error)){
+        madvise(map, mappingSize, MADV_WILLNEED);
+        return true;
+    }
+    close();
+    return false;
+}
+
+bool PpmFile::parse(const char *data, size_t size, string &error){
+    // "P6" width height maxval, then exactly one whitespace byte before the texels
+    const char *p = data, *end = data + size;
+    int maxVal = 0;
+    if (size < 2 || p[0] != 'P' || p[1] != '6'){
+        error = "Invalid magic number";
+    }
+    else if ((p = parseField(p + 2, end, width)) == NULL || (p = parseField(p, end, height)) == NULL
+            || (p = parseField(p, end, maxVal)) == NULL || p == end || !isspace((unsigned char) *p)
+            || width <= 0 || height <= 0){
+        error = "Invalid PPM header";
+    }
+    else if (maxVal > 255){
+        error = "Only maxval of up to 255 is supported";
+    }
+    else if ((size_t) (end - p - 1) < (size_t) width * height * 3){
+        error = "Texture loading failed: the PPM file is truncated";
+    }
+    else{
+        texels = reinterpret_cast<const unsigned char *>(p + 1);
+        return true;
+    }
+    return false;
+}
+
+void PpmFile::close(){
+    if (mapping != NULL)
+        munmap(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+    vector<char>().swap(contents);
+    texels = NULL;
+    width = height = 0;
+    fileSize = 0;
+    mtime = mtimeNsec = 0;
+}
+
+bool writeTga(const string &path, int width, int height, const unsigned char *bgr){
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out == NULL)
+        return false;
+
+    // Uncompressed true colour, origin at the bottom left
+    unsigned char header[18] = {0};
+    header[2] = 2;
+    header[12] = width & 0xff;
+    header[13] = (width >> 8) & 0xff;
+    header[14] = height & 0xff;
+    header[15] = (height >> 8) & 0xff;
+    header[16] = 24;
+
+    size_t size = (size_t) width * height * 3;
+    bool ok = fwrite(header, sizeof(header), 1, out) == 1 && (size == 0 || fwrite(bgr, size, 1, out) == 1);
+    return fclose(out) == 0 && ok;
+}
+
+bool writePng(const string &path, int width, int height, const unsigned char *bgr){
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out == NULL)
+        return false;
+
+    vector<unsigned char> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    const unsigned char settings[5] = {8, 2, 0, 0, 0};     // 8 bit RGB, deflate, adaptive filters, no interlace
+    header.insert(header.end(), settings, settings + 5);
+
+    // Filter type 0 and RGB for each row, top row first
+    size_t rowBytes = 3 * (size_t) width + 1;
+    vector<unsigned char> scanlines(rowBytes * height);
+    for (int y = 0; y < height; y++){
+        unsigned char *row = &scanlines[rowBytes * y];
+        const unsigned char *source = bgr + 3 * (size_t) width * (height - 1 - y);
+        row[0] = 0;
+        for (int x = 0; x < width; x++){
+            row[1 + 3*x] = source[3*x + 2];
+            row[2 + 3*x] = source[3*x + 1];
+            row[3 + 3*x] = source[3*x];
+        }
+    }
+
+    // zlib stream of stored blocks of up to 65535 bytes
+    vector<unsigned char> compressed;
+    compressed.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+    size_t position = 0;
+    do{
+        size_t size = scanlines.size() - position < 65535 ? scanlines.size() - position : 65535;
+        compressed.push_back(position + size == scanlines.size() ? 1 : 0);
+        compressed.push_back(size & 0xff);
+        compressed.push_back(size >> 8);
+        compressed.push_back(~size & 0xff);
+        compressed.push_back((~size >> 8) & 0xff);
+        compressed.insert(compressed.end(), scanlines.begin() + position, scanlines.begin() + position + size);
+        position += size;
+    } while (position < scanlines.size());
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < scanlines.size(); i++){
+        a = (a + scanlines[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(compressed, (b << 16) | a);
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    bool ok = fwrite(signature, sizeof(signature), 1, out) == 1 && writeChunk(out, "IHDR", header)
+            && writeChunk(out, "IDAT", compressed) && writeChunk(out, "IEND", vector<unsigned char>());
+    return fclose(out) == 0 && ok;
+}
+
+bool writeRaw(const string &path, int width, int height, const unsigned char *bgr){
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out == NULL)
+        return false;
+    size_t size = (size_t) width * height * 3;
+    bool ok = size == 0 || fwrite(bgr, size, 1, out) == 1;
+    return fclose(out) == 0 && ok;
+}
+
+bool writeImage(const string &path, unsigned format, int width, int height, const unsigned char *bgr){
+    switch (format){
+        case IMAGE_FORMAT_PNG:
+            return writePng(path, width, height, bgr);
+        case IMAGE_FORMAT_RAW:
+            return writeRaw(path, width, height, bgr);
+    }
+    return writeTga(path, width, height, bgr);
+}
+
+unsigned imageFormat(const string &path){
+    size_t dot = path.rfind('.');
+    string extension = dot == string::npos ? "" : path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); i++)
+        extension[i] = tolower((unsigned char) extension[i]);
+    if (extension == "png")
+        return IMAGE_FORMAT_PNG;
+    if (extension == "raw")
+        return IMAGE_FORMAT_RAW;
+    return IMAGE_FORMAT_TGA;
+}
@@ -0,0 +1,103 @@
+/**
+ * Reading and writing images on disk
+ *
+ * PPM textures are mapped rather than read: the texels of a binary (P6)
+ * file are used in place, straight from the page cache. A file that may be
+ * rewritten while it is in use is read into memory instead, as touching a
+ * mapping whose file was truncated raises SIGBUS.
+ *
+ * Frames are written from bottom-up BGR rows, as glReadPixels(GL_BGR) and
+ * SoftRenderer::readPixels() return them, as TGA, PNG or the raw rows. PNG
+ * output is stored uncompressed (deflate "stored" blocks) so that writing a
+ * frame costs no more than copying it.
+ */
+
+#ifndef IMAGEFILE_H_
+#define IMAGEFILE_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*************** Macros *******************/
+// Formats of writeImage()
+#define IMAGE_FORMAT_TGA 0u
+#define IMAGE_FORMAT_PNG 1u
+#define IMAGE_FORMAT_RAW 2u     // the BGR rows alone, bottom row first
+
+/*************** Classes *******************/
+// A binary PPM file mapped read only, or read. Texels are RGB with the top row first.
+class PpmFile{
+    void *mapping;
+    size_t mappingSize;
+    std::vector<char> contents;     // the file when it is read rather than mapped
+    const unsigned char *texels;
+    int width, height;
+    uint64_t fileSize;      // size and modification time when it was opened
+    int64_t mtime, mtimeNsec;
+
+    // Check the header of the file in [data, data+size) and point texels past it
+    bool parse(const char *data, size_t size, std::string &error);
+
+    // Disallow copying -- the mapping is owned
+    PpmFile(const PpmFile &);
+    PpmFile &operator=(const PpmFile &);
+public:
+    PpmFile();
+    ~PpmFile();
+
+    // Map path, or read it if it may change while in use, and check its header.
+    // On failure returns false and describes the problem in error.
+    bool open(const std::string &path, std::string &error, bool read = false);
+    void close();
+
+    /**
+     * Getters
+     */
+    bool isOpen() const {
+        return texels != NULL;
+    }
+
+    const unsigned char *getTexels() const {
+        return texels;
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    uint64_t getFileSize() const {
+        return fileSize;
+    }
+
+    int64_t getMtime() const {
+        return mtime;
+    }
+
+    int64_t getMtimeNsec() const {
+        return mtimeNsec;
+    }
+};
+
+/*************** Function Prototypes *******************/
+// Write an uncompressed 24 bit TGA from bottom-up BGR rows, as read by glReadPixels(GL_BGR)
+bool writeTga(const std::string &path, int width, int height, const unsigned char *bgr);
+
+// Write a 24 bit PNG from bottom-up BGR rows
+bool writePng(const std::string &path, int width, int height, const unsigned char *bgr);
+
+// Write the bottom-up BGR rows with no header
+bool writeRaw(const std::string &path, int width, int height, const unsigned char *bgr);
+
+// Write bottom-up BGR rows in one of the IMAGE_FORMAT_* formats
+bool writeImage(const std::string &path, unsigned format, int width, int height, const unsigned char *bgr);
+
+// Format for the extension of path: .png, .raw, and TGA for anything else
+unsigned imageFormat(const std::string &path);
+
+#endif /* IMAGEFILE_H_ */
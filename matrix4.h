@@ -0,0 +1,184 @@
+/**
+ * 4x4 matrices in OpenGL's column major layout
+ *
+ * lookAt(), perspective() and rotation() build the same matrices as
+ * gluLookAt(), gluPerspective() and glRotatef(), so code running without a
+ * GL context (the software renderer, culling, picking) sees exactly what the
+ * fixed function pipeline does.
+ */
+
+#ifndef MATRIX4_H_
+#define MATRIX4_H_
+
+#include <cmath>
+#include <cstring>
+
+/*************** Classes *******************/
+struct Matrix4{
+    float m[16];    // m[column*4 + row]
+
+    Matrix4(){
+        setIdentity();
+    }
+
+    void setIdentity(){
+        memset(m, 0, sizeof(m));
+        m[0] = m[5] = m[10] = m[15] = 1.f;
+    }
+
+    float &at(int row, int column){
+        return m[column*4 + row];
+    }
+
+    float at(int row, int column) const {
+        return m[column*4 + row];
+    }
+
+    // this * obj
+    Matrix4 operator*(const Matrix4 &obj) const{
+        Matrix4 result;
+        for (int row = 0; row < 4; row++){
+            for (int column = 0; column < 4; column++){
+                float sum = 0;
+                for (int k = 0; k < 4; k++)
+                    sum += at(row, k) * obj.at(k, column);
+                result.at(row, column) = sum;
+            }
+        }
+        return result;
+    }
+
+    // this * (x, y, z, w)
+    void transform(const float in[4], float out[4]) const{
+        for (int row = 0; row < 4; row++)
+            out[row] = at(row, 0)*in[0] + at(row, 1)*in[1] + at(row, 2)*in[2] + at(row, 3)*in[3];
+    }
+
+    // General inverse by cofactors. Returns false if the matrix is singular.
+    bool inverse(Matrix4 &result) const{
+        double inv[16], det;
+        const float *a = m;
+        inv[0] = a[5]*a[10]*a[15] - a[5]*a[11]*a[14] - a[9]*a[6]*a[15] + a[9]*a[7]*a[14] + a[13]*a[6]*a[11] - a[13]*a[7]*a[10];
+        inv[4] = -a[4]*a[10]*a[15] + a[4]*a[11]*a[14] + a[8]*a[6]*a[15] - a[8]*a[7]*a[14] - a[12]*a[6]*a[11] + a[12]*a[7]*a[10];
+        inv[8] = a[4]*a[9]*a[15] - a[4]*a[11]*a[13] - a[8]*a[5]*a[15] + a[8]*a[7]*a[13] + a[12]*a[5]*a[11] - a[12]*a[7]*a[9];
+        inv[12] = -a[4]*a[9]*a[14] + a[4]*a[10]*a[13] + a[8]*a[5]*a[14] - a[8]*a[6]*a[13] - a[12]*a[5]*a[10] + a[12]*a[6]*a[9];
+        inv[1] = -a[1]*a[10]*a[15] + a[1]*a[11]*a[14] + a[9]*a[2]*a[15] - a[9]*a[3]*a[14] - a[13]*a[2]*a[11] + a[13]*a[3]*a[10];
+        inv[5] = a[0]*a[10]*a[15] - a[0]*a[11]*a[14] - a[8]*a[2]*a[15] + a[8]*a[3]*a[14] + a[12]*a[2]*a[11] - a[12]*a[3]*a[10];
+        inv[9] = -a[0]*a[9]*a[15] + a[0]*a[11]*a[13] + a[8]*a[1]*a[15] - a[8]*a[3]*a[13] - a[12]*a[1]*a[11] + a[12]*a[3]*a[9];
+        inv[13] = a[0]*a[9]*a[14] - a[0]*a[10]*a[13] - a[8]*a[1]*a[14] + a[8]*a[2]*a[13] + a[12]*a[1]*a[10] - a[12]*a[2]*a[9];
+        inv[2] = a[1]*a[6]*a[15] - a[1]*a[7]*a[14] - a[5]*a[2]*a[15] + a[5]*a[3]*a[14] + a[13]*a[2]*a[7] - a[13]*a[3]*a[6];
+        inv[6] = -a[0]*a[6]*a[15] + a[0]*a[7]*a[14] + a[4]*a[2]*a[15] - a[4]*a[3]*a[14] - a[12]*a[2]*a[7] + a[12]*a[3]*a[6];
+        inv[10] = a[0]*a[5]*a[15] - a[0]*a[7]*a[13] - a[4]*a[1]*a[15] + a[4]*a[3]*a[13] + a[12]*a[1]*a[7] - a[12]*a[3]*a[5];
+        inv[14] = -a[0]*a[5]*a[14] + a[0]*a[6]*a[13] + a[4]*a[1]*a[14] - a[4]*a[2]*a[13] - a[12]*a[1]*a[6] + a[12]*a[2]*a[5];
+        inv[3] = -a[1]*a[6]*a[11] + a[1]*a[7]*a[10] + a[5]*a[2]*a[11] - a[5]*a[3]*a[10] - a[9]*a[2]*a[7] + a[9]*a[3]*a[6];
+        inv[7] = a[0]*a[6]*a[11] - a[0]*a[7]*a[10] - a[4]*a[2]*a[11] + a[4]*a[3]*a[10] + a[8]*a[2]*a[7] - a[8]*a[3]*a[6];
+        inv[11] = -a[0]*a[5]*a[11] + a[0]*a[7]*a[9] + a[4]*a[1]*a[11] - a[4]*a[3]*a[9] - a[8]*a[1]*a[7] + a[8]*a[3]*a[5];
+        inv[15] = a[0]*a[5]*a[10] - a[0]*a[6]*a[9] - a[4]*a[1]*a[10] + a[4]*a[2]*a[9] + a[8]*a[1]*a[6] - a[8]*a[2]*a[5];
+
+        det = a[0]*inv[0] + a[1]*inv[4] + a[2]*inv[8] + a[3]*inv[12];
+        if (det == 0)
+            return false;
+        for (int i = 0; i < 16; i++)
+            result.m[i] = inv[i] / det;
+        return true;
+    }
+
+    // As gluPerspective()
+    static Matrix4 perspective(double fovy, double aspect, double zNear, double zFar){
+        double radians = fovy / 2 * M_PI / 180;
+        double cotangent = cos(radians) / sin(radians);
+        double deltaZ = zFar - zNear;
+
+        Matrix4 result;
+        result.at(0, 0) = cotangent / aspect;
+        result.at(1, 1) = cotangent;
+        result.at(2, 2) = -(zFar + zNear) / deltaZ;
+        result.at(3, 2) = -1;
+        result.at(2, 3) = -2 * zNear * zFar / deltaZ;
+        result.at(3, 3) = 0;
+        return result;
+    }
+
+    // As gluLookAt()
+    static Matrix4 lookAt(float eyeX, float eyeY, float eyeZ, float centreX, float centreY, float centreZ,
+            float upX, float upY, float upZ){
+        float forward[3] = {centreX - eyeX, centreY - eyeY, centreZ - eyeZ};
+        float up[3] = {upX, upY, upZ};
+        normalise(forward);
+
+        float side[3];
+        cross(forward, up, side);
+        normalise(side);
+        cross(side, forward, up);
+
+        Matrix4 result;
+        for (int i = 0; i < 3; i++){
+            result.at(0, i) = side[i];
+            result.at(1, i) = up[i];
+            result.at(2, i) = -forward[i];
+        }
+        return result * translation(-eyeX, -eyeY, -eyeZ);
+    }
+
+    // As glRotatef(); angle in degrees about the (normalised) axis
+    static Matrix4 rotation(float angle, float x, float y, float z){
+        Matrix4 result;
+        float magnitude = sqrtf(x*x + y*y + z*z);
+        if (magnitude == 0)
+            return result;
+        x /= magnitude;
+        y /= magnitude;
+        z /= magnitude;
+
+        float s = sinf(angle * (float) M_PI / 180.f), c = cosf(angle * (float) M_PI / 180.f), t = 1 - c;
+        result.at(0, 0) = x*x*t + c;
+        result.at(0, 1) = x*y*t - z*s;
+        result.at(0, 2) = x*z*t + y*s;
+        result.at(1, 0) = y*x*t + z*s;
+        result.at(1, 1) = y*y*t + c;
+        result.at(1, 2) = y*z*t - x*s;
+        result.at(2, 0) = z*x*t - y*s;
+        result.at(2, 1) = z*y*t + x*s;
+        result.at(2, 2) = z*z*t + c;
+        return result;
+    }
+
+    // As glTranslatef()
+    static Matrix4 translation(float x, float y, float z){
+        Matrix4 result;
+        result.at(0, 3) = x;
+        result.at(1, 3) = y;
+        result.at(2, 3) = z;
+        return result;
+    }
+
+    // As glScalef()
+    static Matrix4 scaling(float x, float y, float z){
+        Matrix4 result;
+        result.at(0, 0) = x;
+        result.at(1, 1) = y;
+        result.at(2, 2) = z;
+        return result;
+    }
+
+private:
+    static void cross(const float a[3], const float b[3], float out[3]){
+        float x = a[1]*b[2] - a[2]*b[1];
+        float y = a[2]*b[0] - a[0]*b[2];
+        float z = a[0]*b[1] - a[1]*b[0];
+        out[0] = x;
+        out[1] = y;
+        out[2] = z;
+    }
+
+    static void normalise(float v[3]){
+        float magnitude = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        if (magnitude == 0)
+            return;
+        v[0] /= magnitude;
+        v[1] /= magnitude;
+        v[2] /= magnitude;
+    }
+};
+
+#endif /* MATRIX4_H_ */
@@ -0,0 +1,89 @@
+/**
+ * One block of memory for all the arrays of a mesh
+ *
+ * A MeshArena is sized once, from the counts of the parsed and welded mesh,
+ * to hold every array the loaded mesh keeps: the vertex arrays, the polygon
+ * offsets and indices, the polygon normals and the vertex of each point. The
+ * parser still reads into vectors of its own, which are copied into the
+ * arena and freed, so a load briefly needs room for both. allocate() hands
+ * out aligned pieces of the block in turn and release() frees all of them
+ * with a single free(), so dropping a mesh of any size is one call and
+ * loading the next one does not leave the heap fragmented. The pieces are
+ * not freed one by one; the arrays built on them only borrow them (see
+ * VertexArrays::attach() and PolygonList::attach()).
+ */
+
+#ifndef MESHARENA_H_
+#define MESHARENA_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/*************** Macros *******************/
+// Alignment of every piece, enough for AVX loads and a cache line
+#define MESH_ARENA_ALIGNMENT 64
+
+/*************** Classes *******************/
+class MeshArena{
+    char *block;
+    size_t capacity, used;
+
+    // Disallow copying -- the block is owned
+    MeshArena(const MeshArena &);
+    MeshArena &operator=(const MeshArena &);
+public:
+    MeshArena(): block(NULL), capacity(0), used(0){}
+
+    ~MeshArena(){
+        release();
+    }
+
+    // Bytes taken by a piece of count Ts, padded to the alignment
+    template <typename T> static size_t bytesFor(size_t count){
+        return (count * sizeof(T) + MESH_ARENA_ALIGNMENT - 1) / MESH_ARENA_ALIGNMENT * MESH_ARENA_ALIGNMENT;
+    }
+
+    // Drop the current block and allocate one of bytes, zeroed
+    void reserve(size_t bytes){
+        release();
+        void *memory = NULL;
+        if (bytes > 0 && posix_memalign(&memory, MESH_ARENA_ALIGNMENT, bytes) != 0)
+            throw std::bad_alloc();
+        block = static_cast<char *>(memory);
+        capacity = bytes;
+        if (block != NULL)
+            memset(block, 0, bytes);
+    }
+
+    // The next count Ts of the block. Throws bad_alloc if the block was sized too small.
+    template <typename T> T *allocate(size_t count){
+        size_t bytes = bytesFor<T>(count);
+        if (bytes > capacity - used)
+            throw std::bad_alloc();
+        T *piece = reinterpret_cast<T *>(block + used);
+        used += bytes;
+        return piece;
+    }
+
+    // Free every piece at once
+    void release(){
+        free(block);
+        block = NULL;
+        capacity = used = 0;
+    }
+
+    /**
+     * Getters
+     */
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    size_t getUsed() const {
+        return used;
+    }
+};
+
+#endif /* MESHARENA_H_ */
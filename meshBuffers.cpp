@@ -0,0 +1,225 @@
+/**
+ * Mesh in OpenGL vertex buffer objects -- see meshBuffers.h
+ */
+
+/*************** Includes *******************/
+#include "meshBuffers.h"
+#include "glVersion.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Byte offset into the bound buffer, as the gl*Pointer() calls take it
+#define BUFFER_OFFSET(offset) (reinterpret_cast<const GLvoid *>(offset))
+
+/*************** Helpers *******************/
+namespace {
+
+void interleave(const VertexArrays &vertices, size_t first, size_t count, vector<MeshBufferVertex> &out){
+    out.resize(count);
+    const float *x = vertices.get(VERTEX_X), *y = vertices.get(VERTEX_Y), *z = vertices.get(VERTEX_Z);
+    const float *u = vertices.get(VERTEX_U), *v = vertices.get(VERTEX_V);
+    const float *nx = vertices.get(VERTEX_NX), *ny = vertices.get(VERTEX_NY), *nz = vertices.get(VERTEX_NZ);
+    for (size_t i = 0; i < count; i++){
+        size_t j = first + i;
+        MeshBufferVertex &vertex = out[i];
+        vertex.position[0] = x[j];
+        vertex.position[1] = y[j];
+        vertex.position[2] = z[j];
+        vertex.normal[0] = nx[j];
+        vertex.normal[1] = ny[j];
+        vertex.normal[2] = nz[j];
+        vertex.texture[0] = u[j];
+        vertex.texture[1] = v[j];
+    }
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+MeshBuffers::MeshBuffers(): vertexBuffer(0), indexBuffer(0), vertexCount(0), indexCount(0), indexType(GL_UNSIGNED_INT),
+        sourceVertices(NULL), sourceLevels(NULL), uploadedVertices(0), readyLevel(0), uploadedIndices(0){
+}
+
+bool MeshBuffers::supported(){
+    return glVersionAtLeast(1, 5);
+}
+
+bool MeshBuffers::build(const VertexArrays &vertices, const vector<MeshLod> &levels){
+    if (!begin(vertices, levels))
+        return false;
+    upload((size_t) -1);
+    return true;
+}
+
+bool MeshBuffers::begin(const VertexArrays &vertices, const vector<MeshLod> &levels){
+    release();
+    if (!supported())
+        return false;
+
+    vertexCount = vertices.size();
+    levelOffsets.assign(1, 0);
+    for (size_t i = 0; i < levels.size(); i++)
+        levelOffsets.push_back(levelOffsets.back() + levels[i].triangles.size());
+    indexCount = levelOffsets.back();
+
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(MeshBufferVertex), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    indexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    sourceVertices = &vertices;
+    sourceLevels = &levels;
+    uploadedVertices = 0;
+    readyLevel = levels.size();
+    uploadedIndices = 0;
+    return true;
+}
+
+bool MeshBuffers::upload(size_t maxBytes){
+    if (sourceVertices == NULL)
+        return isComplete();
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    size_t budget = maxBytes;
+
+    // Every level may refer to any vertex, so the vertices go first
+    if (uploadedVertices < vertexCount){
+        size_t count = min(vertexCount - uploadedVertices, max(budget / sizeof(MeshBufferVertex), (size_t) 1));
+        update(*sourceVertices, uploadedVertices, count);
+        uploadedVertices += count;
+        budget -= min(budget, count * sizeof(MeshBufferVertex));
+        if (uploadedVertices < vertexCount)
+            return false;
+    }
+
+    // Then the levels, coarsest first
+    while (readyLevel > 0 && budget > 0){
+        size_t level = readyLevel - 1;
+        size_t size = (*sourceLevels)[level].triangles.size();
+        size_t count = min(size - uploadedIndices, max(budget / indexSize, (size_t) 1));
+        uploadIndices(level, uploadedIndices, count);
+        uploadedIndices += count;
+        budget -= min(budget, count * indexSize);
+        if (uploadedIndices == size){
+            readyLevel = level;
+            uploadedIndices = 0;
+        }
+    }
+
+    if (readyLevel > 0)
+        return false;
+    sourceVertices = NULL;
+    sourceLevels = NULL;
+    return true;
+}
+
+void MeshBuffers::uploadIndices(size_t level, size_t first, size_t count){
+    if (count == 0)
+        return;
+    const int *triangles = (*sourceLevels)[level].triangles.data() + first;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    GLintptr offset = (levelOffsets[level] + first) * indexSize;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    if (indexType == GL_UNSIGNED_SHORT){
+        vector<GLushort> indices(triangles, triangles + count);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, count * indexSize, indices.data());
+    }
+    else{
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, count * indexSize, triangles);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffers::update(const VertexArrays &vertices, size_t first, size_t count){
+    if (vertexBuffer == 0 || first >= vertexCount)
+        return;
+    if (count > vertexCount - first)
+        count = vertexCount - first;
+
+    vector<MeshBufferVertex> interleaved;
+    interleave(vertices, first, count, interleaved);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(MeshBufferVertex), count * sizeof(MeshBufferVertex),
+            interleaved.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffers::bind() const{
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshBufferVertex), BUFFER_OFFSET(offsetof(MeshBufferVertex, position)));
+    glNormalPointer(GL_FLOAT, sizeof(MeshBufferVertex), BUFFER_OFFSET(offsetof(MeshBufferVertex, normal)));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(MeshBufferVertex), BUFFER_OFFSET(offsetof(MeshBufferVertex, texture)));
+}
+
+void MeshBuffers::unbind() const{
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffers::draw(size_t level) const{
+    if (vertexBuffer == 0 || level >= getLevelCount() || level < readyLevel)
+        return;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    bind();
+    glDrawElements(GL_TRIANGLES, levelOffsets[level+1] - levelOffsets[level], indexType,
+            BUFFER_OFFSET(levelOffsets[level] * indexSize));
+    unbind();
+}
+
+void MeshBuffers::draw(size_t level, const vector<TriangleRange> &ranges) const{
+    if (vertexBuffer == 0 || level >= getLevelCount() || level < readyLevel || ranges.empty())
+        return;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    vector<GLsizei> counts(ranges.size());
+    vector<const GLvoid *> offsets(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++){
+        counts[i] = 3 * ranges[i].count;
+        offsets[i] = BUFFER_OFFSET((levelOffsets[level] + 3 * ranges[i].first) * indexSize);
+    }
+
+    bind();
+    glMultiDrawElements(GL_TRIANGLES, counts.data(), indexType, offsets.data(), ranges.size());
+    unbind();
+}
+
+void MeshBuffers::drawInstanced(size_t level, size_t instanceCount) const{
+    if (vertexBuffer == 0 || level >= getLevelCount() || level < readyLevel || instanceCount == 0)
+        return;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    bind();
+    glDrawElementsInstanced(GL_TRIANGLES, levelOffsets[level+1] - levelOffsets[level], indexType,
+            BUFFER_OFFSET(levelOffsets[level] * indexSize), instanceCount);
+    unbind();
+}
+
+void MeshBuffers::release(){
+    if (vertexBuffer != 0)
+        glDeleteBuffers(1, &vertexBuffer);
+    if (indexBuffer != 0)
+        glDeleteBuffers(1, &indexBuffer);
+    vertexBuffer = indexBuffer = 0;
+    vertexCount = indexCount = 0;
+    levelOffsets.clear();
+    sourceVertices = NULL;
+    sourceLevels = NULL;
+    uploadedVertices = readyLevel = uploadedIndices = 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * Mesh in OpenGL vertex buffer objects
+ *
+ * The vertices are interleaved into one GL_ARRAY_BUFFER and the triangles
+ * of every level of detail (see meshSimplifier.h) stored one after another
+ * in a GL_ELEMENT_ARRAY_BUFFER, with 16 bit indices whenever the vertex
+ * count allows. draw() is then a single glDrawElements() call instead of
+ * several immediate mode calls per vertex, or one glMultiDrawElements() call
+ * for the clusters left after culling (see meshClusters.h), and the vertices
+ * can be updated in part with glBufferSubData().
+ *
+ * The buffers can also be filled over several frames: begin() creates them
+ * empty and each upload() call sends at most a given number of bytes, the
+ * vertices first and then the levels from the coarsest to the finest, so a
+ * coarse mesh can be drawn while the finer levels are still on their way.
+ *
+ * Needs OpenGL 1.5; check supported() with a current context first.
+ * drawInstanced() needs OpenGL 3.1 (see meshInstancing.h).
+ */
+
+#ifndef MESHBUFFERS_H_
+#define MESHBUFFERS_H_
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "meshClusters.h"
+#include "meshSimplifier.h"
+#include "vertexArrays.h"
+
+/*************** Classes *******************/
+// One interleaved vertex in the buffer
+struct MeshBufferVertex{
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLfloat texture[2];
+};
+
+class MeshBuffers{
+    GLuint vertexBuffer, indexBuffer;
+    size_t vertexCount, indexCount;
+    std::vector<size_t> levelOffsets;   // first index of each level, and the total at the end
+    GLenum indexType;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+
+    // Progress of begin() and upload(); the sources are dropped once everything is uploaded
+    const VertexArrays *sourceVertices;
+    const std::vector<MeshLod> *sourceLevels;
+    size_t uploadedVertices;
+    size_t readyLevel;      // levels from here on are uploaded
+    size_t uploadedIndices; // of level readyLevel - 1
+
+    // Disallow copying -- the buffer names are owned
+    MeshBuffers(const MeshBuffers &);
+    MeshBuffers &operator=(const MeshBuffers &);
+
+    // Set up and tear down the client arrays around a draw
+    void bind() const;
+    void unbind() const;
+
+    // Upload triangle indices [first, first + count) of a level
+    void uploadIndices(size_t level, size_t first, size_t count);
+public:
+    MeshBuffers();
+
+    // True if the current context has vertex buffer objects
+    static bool supported();
+
+    // Upload vertices and the triangles of each level. Returns false if buffers are unsupported.
+    bool build(const VertexArrays &vertices, const std::vector<MeshLod> &levels);
+
+    // Create the buffers for vertices and levels, to be filled by upload(); both
+    // must stay as they are until it is done. Returns false if buffers are unsupported.
+    bool begin(const VertexArrays &vertices, const std::vector<MeshLod> &levels);
+
+    // Upload about maxBytes more, at least one vertex or index. Returns true once everything is uploaded.
+    bool upload(size_t maxBytes);
+
+    // Re-upload vertices [first, first + count)
+    void update(const VertexArrays &vertices, size_t first, size_t count);
+
+    // Draw a level of detail with the current state; sets and restores the client arrays.
+    // Levels not uploaded yet are not drawn.
+    void draw(size_t level = 0) const;
+
+    // Draw only the given triangles of a level
+    void draw(size_t level, const std::vector<TriangleRange> &ranges) const;
+
+    // Draw a level instanceCount times, with the instance attributes already set up
+    void drawInstanced(size_t level, size_t instanceCount) const;
+
+    // Delete the buffers. The context must still be current.
+    void release();
+
+    /**
+     * Getters
+     */
+    bool isBuilt() const {
+        return vertexBuffer != 0;
+    }
+
+    size_t getLevelCount() const {
+        return levelOffsets.empty() ? 0 : levelOffsets.size() - 1;
+    }
+
+    // Finest level uploaded so far, getLevelCount() if none is
+    size_t getReadyLevel() const {
+        return readyLevel;
+    }
+
+    bool isComplete() const {
+        return isBuilt() && readyLevel == 0;
+    }
+
+    // Fraction of the bytes uploaded
+    double getProgress() const {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        size_t total = vertexCount * sizeof(MeshBufferVertex) + indexCount * indexSize;
+        size_t done = uploadedVertices * sizeof(MeshBufferVertex)
+                + (indexCount - (readyLevel < getLevelCount() ? levelOffsets[readyLevel] : indexCount) + uploadedIndices) * indexSize;
+        return total == 0 ? 1.0 : (double) done / total;
+    }
+
+    size_t getTriangleCount(size_t level) const {
+        return level < getLevelCount() ? (levelOffsets[level+1] - levelOffsets[level]) / 3 : 0;
+    }
+
+    // Bytes held by the GL
+    size_t getBytes() const {
+        return vertexCount * sizeof(MeshBufferVertex)
+                + indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+    }
+};
+
+#endif /* MESHBUFFERS_H_ */
@@ -0,0 +1,436 @@
+/**
+ * Bounding volume hierarchies for picking and nearest vertex queries -- see meshBvh.h
+ */
+
+/*************** Includes *******************/
+#include "meshBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Primitives per parallel iteration when gathering bounds and copying out
+#define PRIMITIVE_CHUNK 4096
+
+// Subtrees handed to each thread after the serial top levels
+#define SUBTREES_PER_THREAD 8
+
+// Smallest subtree worth a parallel task
+#define MIN_SUBTREE 1024
+
+/*************** Helpers *******************/
+namespace {
+
+struct Bounds{
+    float minimum[3], maximum[3];
+
+    Bounds(){
+        for (int k = 0; k < 3; k++){
+            minimum[k] = numeric_limits<float>::infinity();
+            maximum[k] = -numeric_limits<float>::infinity();
+        }
+    }
+
+    void grow(const float *low, const float *high){
+        for (int k = 0; k < 3; k++){
+            minimum[k] = low[k] < minimum[k] ? low[k] : minimum[k];
+            maximum[k] = high[k] > maximum[k] ? high[k] : maximum[k];
+        }
+    }
+
+    void grow(const Bounds &obj){
+        grow(obj.minimum, obj.maximum);
+    }
+
+    // Half the surface area, which is all the heuristic compares
+    float area() const {
+        float dx = maximum[0] - minimum[0], dy = maximum[1] - minimum[1], dz = maximum[2] - minimum[2];
+        return dx < 0 ? 0.f : dx*dy + dy*dz + dz*dx;
+    }
+};
+
+// Primitives as the builder sees them
+struct Primitives{
+    const float *boxes;         // minimum then maximum, 6 floats per primitive
+    const float *centroids;     // 3 floats per primitive
+    uint32_t *order;            // leaf order, permuted by the build
+};
+
+// A range of order still to be built under node
+struct Subtree{
+    uint32_t node, first, last;
+};
+
+struct Bin{
+    Bounds bounds;
+    uint32_t count;
+};
+
+int binOf(float centroid, float minimum, float scale){
+    int bin = (int) ((centroid - minimum) * scale);
+    return bin < 0 ? 0 : (bin >= BVH_BINS ? BVH_BINS - 1 : bin);
+}
+
+// Binned SAH split of order[first, last). Sets the bounds of the range and
+// returns false when it should stay a leaf.
+bool split(const Primitives &primitives, uint32_t first, uint32_t last, Bounds &bounds, uint32_t &middle){
+    Bounds centres;
+    for (uint32_t i = first; i < last; i++){
+        uint32_t p = primitives.order[i];
+        bounds.grow(primitives.boxes + 6*p, primitives.boxes + 6*p + 3);
+        centres.grow(primitives.centroids + 3*p, primitives.centroids + 3*p);
+    }
+    if (last - first <= BVH_LEAF_SIZE)
+        return false;
+
+    float bestCost = numeric_limits<float>::infinity();
+    int bestAxis = -1, bestBin = 0;
+    for (int axis = 0; axis < 3; axis++){
+        float extent = centres.maximum[axis] - centres.minimum[axis];
+        if (!(extent > 0))
+            continue;
+        float scale = BVH_BINS / extent;
+        Bin bins[BVH_BINS];
+        for (int b = 0; b < BVH_BINS; b++)
+            bins[b].count = 0;
+        for (uint32_t i = first; i < last; i++){
+            uint32_t p = primitives.order[i];
+            Bin &bin = bins[binOf(primitives.centroids[3*p + axis], centres.minimum[axis], scale)];
+            bin.bounds.grow(primitives.boxes + 6*p, primitives.boxes + 6*p + 3);
+            bin.count++;
+        }
+
+        // Cost of splitting after bin b: areas times counts of both sides
+        float leftCost[BVH_BINS];
+        Bounds sweep;
+        uint32_t count = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++){
+            sweep.grow(bins[b].bounds);
+            count += bins[b].count;
+            leftCost[b] = sweep.area() * count;
+        }
+        sweep = Bounds();
+        count = 0;
+        for (int b = BVH_BINS - 1; b > 0; b--){
+            sweep.grow(bins[b].bounds);
+            count += bins[b].count;
+            float cost = leftCost[b-1] + sweep.area() * count;
+            if (cost < bestCost){
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b - 1;
+            }
+        }
+    }
+
+    if (bestAxis >= 0){
+        float scale = BVH_BINS / (centres.maximum[bestAxis] - centres.minimum[bestAxis]);
+        float minimum = centres.minimum[bestAxis];
+        uint32_t *end = partition(primitives.order + first, primitives.order + last, [&](uint32_t p){
+            return binOf(primitives.centroids[3*p + bestAxis], minimum, scale) <= bestBin;
+        });
+        middle = end - primitives.order;
+    }
+    if (bestAxis < 0 || middle == first || middle == last)
+        middle = first + (last - first) / 2;    // every centroid in one place: any halves will do
+    return true;
+}
+
+// Builds the tree of order[first, last) into nodes[node]. With subtrees, ranges
+// of at most grain primitives are left there for later instead.
+void buildNode(const Primitives &primitives, vector<BvhNode> &nodes, uint32_t node, uint32_t first, uint32_t last,
+        vector<Subtree> *subtrees, uint32_t grain){
+    Bounds bounds;
+    uint32_t middle = first;
+    bool inner = split(primitives, first, last, bounds, middle);
+    for (int k = 0; k < 3; k++){
+        nodes[node].minimum[k] = bounds.minimum[k];
+        nodes[node].maximum[k] = bounds.maximum[k];
+    }
+    if (!inner){
+        nodes[node].first = first;
+        nodes[node].count = last - first;
+        return;
+    }
+
+    uint32_t left = nodes.size();
+    nodes.resize(left + 2);
+    nodes[node].first = left;
+    nodes[node].count = 0;
+    uint32_t ranges[2][2] = {{first, middle}, {middle, last}};
+    for (int child = 0; child < 2; child++){
+        if (subtrees != NULL && ranges[child][1] - ranges[child][0] <= grain){
+            Subtree subtree = {left + child, ranges[child][0], ranges[child][1]};
+            subtrees->push_back(subtree);
+        }
+        else{
+            buildNode(primitives, nodes, left + child, ranges[child][0], ranges[child][1], subtrees, grain);
+        }
+    }
+}
+
+// The top levels on this thread, then every subtree below them on the pool
+void buildTree(const Primitives &primitives, uint32_t count, ThreadPool &pool, vector<BvhNode> &nodes){
+    nodes.assign(1, BvhNode());
+    uint32_t grain = max<uint32_t>(MIN_SUBTREE, count / (pool.size() * SUBTREES_PER_THREAD));
+    vector<Subtree> subtrees;
+    buildNode(primitives, nodes, 0, 0, count, count > grain ? &subtrees : NULL, grain);
+    if (subtrees.empty())
+        return;
+
+    vector< vector<BvhNode> > built(subtrees.size());
+    pool.parallelFor(subtrees.size(), [&](size_t i){
+        built[i].assign(1, BvhNode());
+        buildNode(primitives, built[i], 0, subtrees[i].first, subtrees[i].last, NULL, 0);
+    });
+
+    // Local node i > 0 goes to base + i - 1; the local root replaces the placeholder
+    for (size_t i = 0; i < subtrees.size(); i++){
+        uint32_t base = nodes.size();
+        vector<BvhNode> &local = built[i];
+        for (size_t j = 0; j < local.size(); j++){
+            if (local[j].count == 0)
+                local[j].first += base - 1;
+        }
+        nodes[subtrees[i].node] = local[0];
+        nodes.insert(nodes.end(), local.begin() + 1, local.end());
+        vector<BvhNode>().swap(local);
+    }
+}
+
+void chunked(ThreadPool &pool, size_t count, const function<void(size_t, size_t)> &task){
+    size_t chunks = (count + PRIMITIVE_CHUNK - 1) / PRIMITIVE_CHUNK;
+    pool.parallelFor(chunks, [&](size_t chunk){
+        size_t begin = chunk * PRIMITIVE_CHUNK;
+        task(begin, min(count, begin + PRIMITIVE_CHUNK));
+    });
+}
+
+// Distance along the ray to where it enters the box, infinity if it misses it before limit
+float entry(const BvhNode &node, const float origin[3], const float inverse[3], float limit){
+    float near = 0.f, far = limit;
+    for (int k = 0; k < 3; k++){
+        float a = (node.minimum[k] - origin[k]) * inverse[k];
+        float b = (node.maximum[k] - origin[k]) * inverse[k];
+        if (a > b)
+            swap(a, b);
+        near = a > near ? a : near;
+        far = b < far ? b : far;
+    }
+    return near <= far ? near : numeric_limits<float>::infinity();
+}
+
+float distance2(const BvhNode &node, const float point[3]){
+    float sum = 0;
+    for (int k = 0; k < 3; k++){
+        float d = point[k] < node.minimum[k] ? node.minimum[k] - point[k]
+                : (point[k] > node.maximum[k] ? point[k] - node.maximum[k] : 0.f);
+        sum += d*d;
+    }
+    return sum;
+}
+
+// Moller-Trumbore, from both sides
+bool intersect(const float *corner, const float origin[3], const float direction[3], float &t, float &u, float &v){
+    float e1[3] = {corner[3] - corner[0], corner[4] - corner[1], corner[5] - corner[2]};
+    float e2[3] = {corner[6] - corner[0], corner[7] - corner[1], corner[8] - corner[2]};
+    float p[3] = {direction[1]*e2[2] - direction[2]*e2[1], direction[2]*e2[0] - direction[0]*e2[2],
+            direction[0]*e2[1] - direction[1]*e2[0]};
+    float determinant = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if (determinant == 0)
+        return false;
+    float inverse = 1.f / determinant;
+    float s[3] = {origin[0] - corner[0], origin[1] - corner[1], origin[2] - corner[2]};
+    u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2]) * inverse;
+    if (u < 0 || u > 1)
+        return false;
+    float q[3] = {s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0]};
+    v = (direction[0]*q[0] + direction[1]*q[1] + direction[2]*q[2]) * inverse;
+    if (v < 0 || u + v > 1)
+        return false;
+    t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inverse;
+    return t >= 0;
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+void MeshBvh::build(const VertexArrays &vertices, const vector<int> &triangles, ThreadPool &pool){
+    clear();
+    const float *x = vertices.get(VERTEX_X), *y = vertices.get(VERTEX_Y), *z = vertices.get(VERTEX_Z);
+    uint32_t triangleCount = triangles.size() / 3, vertexCount = vertices.size();
+    if (triangleCount == 0)
+        return;
+
+    // Triangles
+    vector<float> boxes(6 * (size_t) triangleCount), centroids(3 * (size_t) triangleCount);
+    triangleIds.resize(triangleCount);
+    chunked(pool, triangleCount, [&](size_t begin, size_t end){
+        for (size_t t = begin; t < end; t++){
+            const int *v = &triangles[3*t];
+            float corner[3][3] = {{x[v[0]], y[v[0]], z[v[0]]}, {x[v[1]], y[v[1]], z[v[1]]}, {x[v[2]], y[v[2]], z[v[2]]}};
+            for (int k = 0; k < 3; k++){
+                boxes[6*t + k] = min(corner[0][k], min(corner[1][k], corner[2][k]));
+                boxes[6*t + 3 + k] = max(corner[0][k], max(corner[1][k], corner[2][k]));
+                centroids[3*t + k] = (corner[0][k] + corner[1][k] + corner[2][k]) / 3;
+            }
+            triangleIds[t] = t;
+        }
+    });
+    Primitives primitives = {boxes.data(), centroids.data(), triangleIds.data()};
+    buildTree(primitives, triangleCount, pool, triangleNodes);
+
+    corners.resize(9 * (size_t) triangleCount);
+    chunked(pool, triangleCount, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            const int *v = &triangles[3 * (size_t) triangleIds[i]];
+            for (int c = 0; c < 3; c++){
+                corners[9*i + 3*c] = x[v[c]];
+                corners[9*i + 3*c + 1] = y[v[c]];
+                corners[9*i + 3*c + 2] = z[v[c]];
+            }
+        }
+    });
+
+    // Vertices, as boxes of no size
+    boxes.resize(6 * (size_t) vertexCount);
+    centroids.resize(3 * (size_t) vertexCount);
+    vertexIds.resize(vertexCount);
+    chunked(pool, vertexCount, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            float p[3] = {x[i], y[i], z[i]};
+            for (int k = 0; k < 3; k++)
+                boxes[6*i + k] = boxes[6*i + 3 + k] = centroids[3*i + k] = p[k];
+            vertexIds[i] = i;
+        }
+    });
+    primitives.order = vertexIds.data();
+    buildTree(primitives, vertexCount, pool, vertexNodes);
+
+    points.resize(3 * (size_t) vertexCount);
+    chunked(pool, vertexCount, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            points[3*i] = x[vertexIds[i]];
+            points[3*i + 1] = y[vertexIds[i]];
+            points[3*i + 2] = z[vertexIds[i]];
+        }
+    });
+}
+
+void MeshBvh::clear(){
+    vector<BvhNode>().swap(triangleNodes);
+    vector<BvhNode>().swap(vertexNodes);
+    vector<float>().swap(corners);
+    vector<float>().swap(points);
+    vector<uint32_t>().swap(triangleIds);
+    vector<uint32_t>().swap(vertexIds);
+}
+
+bool MeshBvh::pick(const float origin[3], const float direction[3], BvhHit &hit) const{
+    if (triangleNodes.empty())
+        return false;
+    float inverse[3];
+    for (int k = 0; k < 3; k++)
+        inverse[k] = 1.f / direction[k];
+
+    float best = numeric_limits<float>::infinity(), bestU = 0, bestV = 0;
+    uint32_t found = 0;
+    bool hitAny = false;
+    vector<uint32_t> stack;
+    stack.reserve(64);
+    if (entry(triangleNodes[0], origin, inverse, best) < best)
+        stack.push_back(0);
+    while (!stack.empty()){
+        const BvhNode &node = triangleNodes[stack.back()];
+        stack.pop_back();
+        if (node.count > 0){
+            for (uint32_t i = node.first; i < node.first + node.count; i++){
+                float t, u, v;
+                if (intersect(&corners[9 * (size_t) i], origin, direction, t, u, v) && t < best){
+                    best = t;
+                    bestU = u;
+                    bestV = v;
+                    found = i;
+                    hitAny = true;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top; boxes entered beyond the best hit are skipped
+        float near = entry(triangleNodes[node.first], origin, inverse, best);
+        float far = entry(triangleNodes[node.first + 1], origin, inverse, best);
+        uint32_t nearChild = node.first, farChild = node.first + 1;
+        if (far < near){
+            swap(near, far);
+            swap(nearChild, farChild);
+        }
+        if (far < best)
+            stack.push_back(farChild);
+        if (near < best)
+            stack.push_back(nearChild);
+    }
+    if (!hitAny)
+        return false;
+
+    hit.triangle = triangleIds[found];
+    hit.distance = best;
+    hit.u = bestU;
+    hit.v = bestV;
+    for (int k = 0; k < 3; k++)
+        hit.point[k] = origin[k] + best * direction[k];
+    return true;
+}
+
+void MeshBvh::nearestVertices(const float point[3], size_t k, vector<BvhNeighbour> &nearest) const{
+    nearest.clear();
+    if (vertexNodes.empty() || k == 0)
+        return;
+
+    // Max heap of the best k so far, on squared distance
+    vector< pair<float, uint32_t> > heap;
+    heap.reserve(k + 1);
+    vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty()){
+        const BvhNode &node = vertexNodes[stack.back()];
+        stack.pop_back();
+        if (heap.size() == k && distance2(node, point) >= heap.front().first)
+            continue;
+
+        if (node.count > 0){
+            for (uint32_t i = node.first; i < node.first + node.count; i++){
+                const float *p = &points[3 * (size_t) i];
+                float dx = p[0] - point[0], dy = p[1] - point[1], dz = p[2] - point[2];
+                float d2 = dx*dx + dy*dy + dz*dz;
+                if (heap.size() < k){
+                    heap.push_back(make_pair(d2, i));
+                    push_heap(heap.begin(), heap.end());
+                }
+                else if (d2 < heap.front().first){
+                    pop_heap(heap.begin(), heap.end());
+                    heap.back() = make_pair(d2, i);
+                    push_heap(heap.begin(), heap.end());
+                }
+            }
+            continue;
+        }
+
+        uint32_t nearChild = node.first, farChild = node.first + 1;
+        if (distance2(vertexNodes[farChild], point) < distance2(vertexNodes[nearChild], point))
+            swap(nearChild, farChild);
+        stack.push_back(farChild);
+        stack.push_back(nearChild);
+    }
+
+    sort_heap(heap.begin(), heap.end());
+    nearest.resize(heap.size());
+    for (size_t i = 0; i < heap.size(); i++){
+        nearest[i].vertex = vertexIds[heap[i].second];
+        nearest[i].distance = sqrt(heap[i].first);
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * Bounding volume hierarchies for picking and nearest vertex queries
+ *
+ * MeshBvh keeps two trees over a triangle mesh: one over the triangles, for
+ * the first triangle a ray hits, and one over the vertices, for the k
+ * vertices nearest a point. Both are built top-down with binned surface area
+ * heuristic splits, the top levels on the calling thread and the subtrees
+ * below them in parallel on a ThreadPool.
+ *
+ * Each tree is a flat array of 32 byte nodes with the two children of a node
+ * next to each other, and the primitives are copied out in leaf order: three
+ * corners per triangle, a position per vertex. A query walks the array and
+ * reads the primitives of a leaf from one contiguous run, without going back
+ * to the mesh.
+ */
+
+#ifndef MESHBVH_H_
+#define MESHBVH_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "threadPool.h"
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+// Most primitives in a leaf
+#define BVH_LEAF_SIZE 4
+
+// Bins per axis of the split search
+#define BVH_BINS 16
+
+/*************** Classes *******************/
+struct BvhNode{
+    float minimum[3], maximum[3];
+    uint32_t first;     // inner: left child, the right one follows; leaf: first primitive in leaf order
+    uint32_t count;     // primitives in a leaf, 0 for inner nodes
+};
+
+// Where a ray first hits the mesh
+struct BvhHit{
+    size_t triangle;    // index into the triangle list the tree was built from
+    float distance;     // along the ray, in units of its direction
+    float u, v;         // barycentric coordinates of point towards the second and third corner
+    float point[3];
+};
+
+struct BvhNeighbour{
+    size_t vertex;
+    float distance;
+};
+
+class MeshBvh{
+    std::vector<BvhNode> triangleNodes, vertexNodes;
+    std::vector<float> corners;         // 9 floats per triangle, in leaf order
+    std::vector<uint32_t> triangleIds;  // original index of each triangle, in leaf order
+    std::vector<float> points;          // 3 floats per vertex, in leaf order
+    std::vector<uint32_t> vertexIds;
+
+    // Disallow copying
+    MeshBvh(const MeshBvh &);
+    MeshBvh &operator=(const MeshBvh &);
+public:
+    MeshBvh(){}
+
+    // Build both trees; triangles are three vertex indices each
+    void build(const VertexArrays &vertices, const std::vector<int> &triangles, ThreadPool &pool);
+
+    void clear();
+
+    // Nearest hit along origin + t * direction, t >= 0. Returns false if the ray misses.
+    bool pick(const float origin[3], const float direction[3], BvhHit &hit) const;
+
+    // The k vertices nearest point, nearest first
+    void nearestVertices(const float point[3], size_t k, std::vector<BvhNeighbour> &nearest) const;
+
+    /**
+     * Getters
+     */
+    bool isBuilt() const {
+        return !triangleNodes.empty();
+    }
+
+    size_t getNodeCount() const {
+        return triangleNodes.size() + vertexNodes.size();
+    }
+
+    size_t getBytes() const {
+        return (triangleNodes.size() + vertexNodes.size()) * sizeof(BvhNode)
+                + (corners.size() + points.size()) * sizeof(float)
+                + (triangleIds.size() + vertexIds.size()) * sizeof(uint32_t);
+    }
+};
+
+#endif /* MESHBVH_H_ */
@@ -0,0 +1,257 @@
+/**
+ * Binary mesh cache -- see meshCache.h for the file layout
+ */
+
+/*************** Includes *******************/
+#include "meshCache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+/*************** Macros *******************/
+#define MESH_CACHE_MAGIC "CGMESH\0\0"
+#define MESH_CACHE_BYTE_ORDER 0x01020304u
+
+/*************** Helpers *******************/
+namespace {
+
+// Round up to the next multiple of MESH_CACHE_ALIGNMENT
+uint64_t alignOffset(uint64_t offset){
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Check that an array of size bytes at offset lies within the file
+bool arrayInFile(uint64_t offset, uint64_t size, uint64_t fileSize){
+    return offset % MESH_CACHE_ALIGNMENT == 0 && offset <= fileSize && size <= fileSize - offset;
+}
+
+// Check that each of count indices names one of vertexCount vertices
+bool indicesInRange(const int32_t *indices, uint64_t count, uint32_t vertexCount){
+    for (uint64_t i = 0; i < count; i++){
+        if (indices[i] < 0 || (uint32_t) indices[i] >= vertexCount)
+            return false;
+    }
+    return true;
+}
+
+// Write size bytes at offset, zero padding the gap from the current position
+bool writeArray(FILE *out, uint64_t &position, uint64_t offset, const void *data, uint64_t size){
+    static const char padding[MESH_CACHE_ALIGNMENT] = {0};
+    if (offset - position > 0 && fwrite(padding, offset - position, 1, out) != 1)
+        return false;
+    position = offset + size;
+    return size == 0 || fwrite(data, size, 1, out) == 1;
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+MeshCache::MeshCache(): mapping(NULL), mappingSize(0), header(NULL){}
+
+MeshCache::~MeshCache(){
+    close();
+}
+
+string MeshCache::cachePath(const string &sourcePath){
+    return sourcePath + MESH_CACHE_SUFFIX;
+}
+
+bool MeshCache::open(const string &sourcePath){
+    close();
+
+    struct stat source;
+    if (stat(sourcePath.c_str(), &source) != 0)
+        return false;
+
+    int fd = ::open(cachePath(sourcePath).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;   // no cache yet
+
+    struct stat cache;
+    if (fstat(fd, &cache) != 0 || (size_t) cache.st_size < sizeof(MeshCacheHeader)){
+        ::close(fd);
+        return false;
+    }
+
+    // Private writable mapping: pages are only copied if they are written to
+    void *map = mmap(NULL, cache.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // the mapping keeps its own reference
+    if (map == MAP_FAILED)
+        return false;
+
+    const MeshCacheHeader *candidate = static_cast<const MeshCacheHeader *>(map);
+    uint64_t fileSize = cache.st_size;
+
+    // Validate the header before trusting any of the offsets
+    bool valid = memcmp(candidate->magic, MESH_CACHE_MAGIC, sizeof(candidate->magic)) == 0
+            && candidate->byteOrder == MESH_CACHE_BYTE_ORDER
+            && candidate->version == MESH_CACHE_VERSION
+            && candidate->headerSize == sizeof(MeshCacheHeader)
+            && candidate->fileSize == fileSize
+            && candidate->sourceSize == (uint64_t) source.st_size
+            && candidate->sourceMtime == (int64_t) source.st_mtim.tv_sec
+            && candidate->sourceMtimeNsec == (int64_t) source.st_mtim.tv_nsec;
+
+    bool triangles = valid && (candidate->flags & MESH_CACHE_TRIANGLES);
+    if (valid){
+        uint64_t vertices = candidate->vertexCount, polygons = candidate->polygonCount;
+        for (int i = 0; i < VERTEX_ARRAY_COUNT; i++)
+            valid = valid && arrayInFile(candidate->vertexArrayOffsets[i], vertices*sizeof(float), fileSize);
+        valid = valid && arrayInFile(candidate->polygonNormalsOffset, 3*polygons*sizeof(float), fileSize)
+                && arrayInFile(candidate->polygonOffsetsOffset, triangles ? 0 : (polygons+1)*sizeof(int32_t), fileSize)
+                && arrayInFile(candidate->indicesOffset, candidate->indexCount*sizeof(int32_t), fileSize)
+                && arrayInFile(candidate->pointVerticesOffset, candidate->pointCount*sizeof(int32_t), fileSize)
+                && candidate->levelCount <= MESH_CACHE_MAX_LEVELS;
+        for (uint32_t i = 0; valid && i < candidate->levelCount; i++){
+            valid = arrayInFile(candidate->levelIndicesOffsets[i], 3*(uint64_t) candidate->levelTriangleCounts[i]*sizeof(int32_t),
+                    fileSize)
+                    && arrayInFile(candidate->levelClustersOffsets[i], candidate->levelClusterCounts[i]*sizeof(MeshCluster),
+                    fileSize);
+
+            // Every cluster has to stay within its level
+            const MeshCluster *clusters = reinterpret_cast<const MeshCluster *>(static_cast<const char *>(map)
+                    + candidate->levelClustersOffsets[i]);
+            for (uint32_t j = 0; valid && j < candidate->levelClusterCounts[i]; j++){
+                valid = clusters[j].firstTriangle <= candidate->levelTriangleCounts[i]
+                        && clusters[j].triangleCount <= candidate->levelTriangleCounts[i] - clusters[j].firstTriangle;
+            }
+        }
+    }
+
+    // Every index is used without further checks: the polygons, the levels and
+    // the point vertices a hot reload writes through
+    const char *base = static_cast<const char *>(map);
+    valid = valid && indicesInRange(reinterpret_cast<const int32_t *>(base + candidate->indicesOffset),
+            candidate->indexCount, candidate->vertexCount)
+            && indicesInRange(reinterpret_cast<const int32_t *>(base + candidate->pointVerticesOffset),
+            candidate->pointCount, candidate->vertexCount);
+    for (uint32_t i = 0; valid && i < candidate->levelCount; i++){
+        valid = indicesInRange(reinterpret_cast<const int32_t *>(base + candidate->levelIndicesOffsets[i]),
+                3*(uint64_t) candidate->levelTriangleCounts[i], candidate->vertexCount);
+    }
+
+    if (valid && triangles){
+        valid = candidate->indexCount == 3*(uint64_t) candidate->polygonCount;
+    }
+    else if (valid){
+        // Offsets run from the first index to the last without going backwards
+        const int32_t *offsets = reinterpret_cast<const int32_t *>(base + candidate->polygonOffsetsOffset);
+        valid = offsets[0] == 0 && (uint32_t) offsets[candidate->polygonCount] == candidate->indexCount;
+        for (uint32_t i = 0; valid && i < candidate->polygonCount; i++)
+            valid = offsets[i] <= offsets[i+1];
+    }
+
+    if (!valid){
+        munmap(map, cache.st_size);
+        return false;
+    }
+
+    // The whole file is about to be walked front to back
+    madvise(map, cache.st_size, MADV_WILLNEED);
+
+    mapping = map;
+    mappingSize = cache.st_size;
+    header = candidate;
+    return true;
+}
+
+void MeshCache::close(){
+    if (mapping != NULL)
+        munmap(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+    header = NULL;
+}
+
+bool MeshCache::write(const string &sourcePath, const MeshCacheData &data){
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.byteOrder = MESH_CACHE_BYTE_ORDER;
+    header.version = MESH_CACHE_VERSION;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.flags = data.polygonOffsets == NULL ? MESH_CACHE_TRIANGLES : 0;
+
+    header.sourceSize = data.sourceSize;
+    header.sourceMtime = data.sourceMtime;
+    header.sourceMtimeNsec = data.sourceMtimeNsec;
+    header.sourceTopology = data.sourceTopology;
+
+    header.vertexCount = data.vertexCount;
+    header.polygonCount = data.polygonCount;
+    header.indexCount = data.indexCount;
+    header.levelCount = data.levelCount < MESH_CACHE_MAX_LEVELS ? data.levelCount : MESH_CACHE_MAX_LEVELS;
+    header.pointCount = data.pointCount;
+    header.weldEpsilon = data.weldEpsilon;
+
+    memcpy(header.minVertex, data.minVertex, sizeof(header.minVertex));
+    memcpy(header.maxVertex, data.maxVertex, sizeof(header.maxVertex));
+    memcpy(header.centreVertex, data.centreVertex, sizeof(header.centreVertex));
+    memcpy(header.meanNormal, data.meanNormal, sizeof(header.meanNormal));
+
+    // Lay the arrays out one after another
+    uint64_t vertices = data.vertexCount, polygons = data.polygonCount;
+    uint64_t vertexArraySize = vertices*sizeof(float);
+    uint64_t polygonNormalsSize = 3*polygons*sizeof(float);
+    uint64_t polygonOffsetsSize = data.polygonOffsets == NULL ? 0 : (polygons+1)*sizeof(int32_t);
+    uint64_t indicesSize = data.indexCount*sizeof(int32_t);
+    uint64_t pointVerticesSize = data.pointCount*sizeof(int32_t);
+
+    uint64_t end = sizeof(MeshCacheHeader);
+    for (int i = 0; i < VERTEX_ARRAY_COUNT; i++){
+        header.vertexArrayOffsets[i] = alignOffset(end);
+        end = header.vertexArrayOffsets[i] + vertexArraySize;
+    }
+    header.polygonNormalsOffset = alignOffset(end);
+    header.polygonOffsetsOffset = alignOffset(header.polygonNormalsOffset + polygonNormalsSize);
+    header.indicesOffset = alignOffset(header.polygonOffsetsOffset + polygonOffsetsSize);
+    header.pointVerticesOffset = alignOffset(header.indicesOffset + indicesSize);
+    end = header.pointVerticesOffset + pointVerticesSize;
+    for (uint32_t i = 0; i < header.levelCount; i++){
+        header.levelTriangleCounts[i] = data.levelTriangleCounts[i];
+        header.levelClusterCounts[i] = data.levelClusterCounts[i];
+        header.levelErrors[i] = data.levelErrors[i];
+        header.levelIndicesOffsets[i] = alignOffset(end);
+        end = header.levelIndicesOffsets[i] + 3*(uint64_t) data.levelTriangleCounts[i]*sizeof(int32_t);
+        header.levelClustersOffsets[i] = alignOffset(end);
+        end = header.levelClustersOffsets[i] + data.levelClusterCounts[i]*sizeof(MeshCluster);
+    }
+    header.fileSize = end;
+
+    // Write to a temporary file and rename it so a reader never sees a partial cache
+    string path = cachePath(sourcePath);
+    string temporary = path + ".tmp";
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (out == NULL)
+        return false;
+
+    uint64_t position = 0;
+    bool ok = writeArray(out, position, 0, &header, sizeof(header));
+    for (int i = 0; i < VERTEX_ARRAY_COUNT; i++)
+        ok = ok && writeArray(out, position, header.vertexArrayOffsets[i], data.vertexArrays[i], vertexArraySize);
+    ok = ok && writeArray(out, position, header.polygonNormalsOffset, data.polygonNormals, polygonNormalsSize)
+            && writeArray(out, position, header.polygonOffsetsOffset, data.polygonOffsets, polygonOffsetsSize)
+            && writeArray(out, position, header.indicesOffset, data.indices, indicesSize)
+            && writeArray(out, position, header.pointVerticesOffset, data.pointVertices, pointVerticesSize);
+    for (uint32_t i = 0; i < header.levelCount; i++){
+        ok = ok && writeArray(out, position, header.levelIndicesOffsets[i], data.levelIndices[i],
+                3*(uint64_t) header.levelTriangleCounts[i]*sizeof(int32_t))
+                && writeArray(out, position, header.levelClustersOffsets[i], data.levelClusters[i],
+                header.levelClusterCounts[i]*sizeof(MeshCluster));
+    }
+
+    ok = (fclose(out) == 0) && ok;
+    if (ok)
+        ok = rename(temporary.c_str(), path.c_str()) == 0;
+    if (!ok)
+        remove(temporary.c_str());
+
+    return ok;
+}
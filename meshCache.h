@@ -0,0 +1,180 @@
+/**
+ * Binary mesh cache
+ *
+ * Parsing the ASCII VTK file is most of the start up time. After the first
+ * load the parsed mesh is written next to the VTK file as a flat binary file
+ * which is mmap'd on later launches so that the arrays can be used in place.
+ *
+ * Layout: MeshCacheHeader followed by the arrays listed in the header, each
+ * starting at a MESH_CACHE_ALIGNMENT aligned offset. Vertex attributes are
+ * stored as separate arrays in the order of VertexArray so that they can be
+ * used as a VertexArrays in place. The levels of detail follow, the full
+ * mesh first, each as a triangle list indexing the same vertices in cluster
+ * order and the clusters themselves (see meshClusters.h).
+ *
+ * The cache is only used when the size and modification time of the VTK file
+ * match those recorded in the header. It holds the mesh after welding (see
+ * meshWelder.h), so the loader also checks the weld epsilon it was made with.
+ */
+
+#ifndef MESHCACHE_H_
+#define MESHCACHE_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#include "meshClusters.h"
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+// Appended to the path of the VTK file
+#define MESH_CACHE_SUFFIX ".cache"
+
+// Bump whenever the layout or the meaning of a stored array changes
+#define MESH_CACHE_VERSION 9
+
+// Alignment of each array in the file
+#define MESH_CACHE_ALIGNMENT 64
+
+// Most levels of detail stored, including the full mesh
+#define MESH_CACHE_MAX_LEVELS 8
+
+// Header flags
+#define MESH_CACHE_TRIANGLES 1u     // every polygon is a triangle, no polygon offsets are stored
+
+/*************** Classes *******************/
+struct MeshCacheHeader{
+    char magic[8];              // "CGMESH\0\0"
+    uint32_t byteOrder;         // MESH_CACHE_BYTE_ORDER when written on this machine
+    uint32_t version;           // MESH_CACHE_VERSION
+    uint32_t headerSize;        // sizeof(MeshCacheHeader)
+    uint32_t flags;             // MESH_CACHE_* flags
+
+    // Source VTK file
+    uint64_t sourceSize;
+    int64_t sourceMtime;        // seconds
+    int64_t sourceMtimeNsec;    // nanoseconds
+    uint64_t sourceTopology;    // topologyHash() of the parsed file
+
+    // Counts
+    uint32_t vertexCount;
+    uint32_t polygonCount;
+    uint32_t indexCount;        // total number of indices over all polygons
+    uint32_t levelCount;        // levels of detail, the full mesh first
+    uint32_t pointCount;        // points of the VTK file, welded into vertexCount vertices
+    float weldEpsilon;          // the points were welded with
+
+    // Derived values computed by loadData()
+    float minVertex[3], maxVertex[3], centreVertex[3], meanNormal[3];
+
+    // Byte offsets from the start of the file
+    uint64_t vertexArrayOffsets[VERTEX_ARRAY_COUNT];  // float[vertexCount] each
+    uint64_t polygonNormalsOffset;  // float[3*polygonCount]
+    uint64_t polygonOffsetsOffset;  // int32_t[polygonCount+1], start of each polygon in indices; empty for triangles
+    uint64_t indicesOffset;         // int32_t[indexCount]
+    uint64_t pointVerticesOffset;   // int32_t[pointCount], vertex each point of the VTK file became
+    uint64_t levelIndicesOffsets[MESH_CACHE_MAX_LEVELS];    // int32_t[3*levelTriangleCounts[i]]
+    uint64_t levelClustersOffsets[MESH_CACHE_MAX_LEVELS];   // MeshCluster[levelClusterCounts[i]]
+    uint32_t levelTriangleCounts[MESH_CACHE_MAX_LEVELS];
+    uint32_t levelClusterCounts[MESH_CACHE_MAX_LEVELS];
+    float levelErrors[MESH_CACHE_MAX_LEVELS];               // see MeshLod
+    uint64_t fileSize;
+};
+
+// Arrays handed to MeshCache::write()
+struct MeshCacheData{
+    uint32_t vertexCount, polygonCount, indexCount, pointCount;
+    float weldEpsilon;
+
+    const float *vertexArrays[VERTEX_ARRAY_COUNT];
+    const float *polygonNormals;
+    const int32_t *polygonOffsets, *indices;    // polygonOffsets is NULL if every polygon is a triangle
+    const int32_t *pointVertices;
+    uint64_t sourceTopology;
+
+    // The source file as it was parsed; it may have changed since
+    uint64_t sourceSize;
+    int64_t sourceMtime, sourceMtimeNsec;
+
+    uint32_t levelCount;
+    const int32_t *levelIndices[MESH_CACHE_MAX_LEVELS];
+    uint32_t levelTriangleCounts[MESH_CACHE_MAX_LEVELS];
+    float levelErrors[MESH_CACHE_MAX_LEVELS];
+    const MeshCluster *levelClusters[MESH_CACHE_MAX_LEVELS];
+    uint32_t levelClusterCounts[MESH_CACHE_MAX_LEVELS];
+
+    float minVertex[3], maxVertex[3], centreVertex[3], meanNormal[3];
+};
+
+// A private (copy on write) mapping of a cache file
+class MeshCache{
+    void *mapping;
+    size_t mappingSize;
+    const MeshCacheHeader *header;
+
+    // Disallow copying -- the mapping is owned
+    MeshCache(const MeshCache &);
+    MeshCache &operator=(const MeshCache &);
+
+    template <typename U> U *array(uint64_t offset) const{
+        return reinterpret_cast<U *>(static_cast<char *>(mapping) + offset);
+    }
+public:
+    MeshCache();
+    ~MeshCache();
+
+    // Map the cache belonging to sourcePath. Returns false if it is missing or stale.
+    bool open(const std::string &sourcePath);
+    void close();
+    bool isOpen() const {
+        return header != NULL;
+    }
+
+    // Write the cache for sourcePath, stamped with the source in data. Returns false on failure.
+    static bool write(const std::string &sourcePath, const MeshCacheData &data);
+
+    static std::string cachePath(const std::string &sourcePath);
+
+    /**
+     * Getters
+     */
+    const MeshCacheHeader &getHeader() const {
+        return *header;
+    }
+
+    // Writable: changes stay private to this process
+    float *getVertexArray(VertexArray vertexArray) const {
+        return array<float>(header->vertexArrayOffsets[vertexArray]);
+    }
+
+    float *getPolygonNormals() const {
+        return array<float>(header->polygonNormalsOffset);
+    }
+
+    // NULL if every polygon is a triangle
+    int32_t *getPolygonOffsets() const {
+        if (header->flags & MESH_CACHE_TRIANGLES)
+            return NULL;
+        return array<int32_t>(header->polygonOffsetsOffset);
+    }
+
+    int32_t *getIndices() const {
+        return array<int32_t>(header->indicesOffset);
+    }
+
+    int32_t *getPointVertices() const {
+        return array<int32_t>(header->pointVerticesOffset);
+    }
+
+    // Triangles of level of detail i, 0 <= i < getHeader().levelCount
+    const int32_t *getLevelIndices(uint32_t i) const {
+        return array<int32_t>(header->levelIndicesOffsets[i]);
+    }
+
+    const MeshCluster *getLevelClusters(uint32_t i) const {
+        return array<MeshCluster>(header->levelClustersOffsets[i]);
+    }
+};
+
+#endif /* MESHCACHE_H_ */
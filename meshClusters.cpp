@@ -0,0 +1,260 @@
+/**
+ * Spatial clusters of triangles for culling -- see meshClusters.h
+ */
+
+/*************** Includes *******************/
+#include "meshClusters.h"
+#include "meshOptimiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+struct Centroids{
+    const float *axis[3];   // centroid coordinates per triangle
+    int split;
+
+    bool operator()(int a, int b) const {
+        return axis[split][a] < axis[split][b];
+    }
+};
+
+// Median splits of order[first, last) until every part fits in a cluster
+void split(Centroids &centroids, vector<int> &order, size_t first, size_t last, vector<size_t> &ends){
+    if (last - first <= CLUSTER_TRIANGLES){
+        ends.push_back(last);
+        return;
+    }
+
+    float minimum[3], maximum[3];
+    for (int k = 0; k < 3; k++)
+        minimum[k] = maximum[k] = centroids.axis[k][order[first]];
+    for (size_t i = first + 1; i < last; i++){
+        for (int k = 0; k < 3; k++){
+            float value = centroids.axis[k][order[i]];
+            minimum[k] = value < minimum[k] ? value : minimum[k];
+            maximum[k] = value > maximum[k] ? value : maximum[k];
+        }
+    }
+    centroids.split = 0;
+    for (int k = 1; k < 3; k++){
+        if (maximum[k] - minimum[k] > maximum[centroids.split] - minimum[centroids.split])
+            centroids.split = k;
+    }
+
+    size_t middle = first + (last - first) / 2;
+    nth_element(order.begin() + first, order.begin() + middle, order.begin() + last, centroids);
+    split(centroids, order, first, middle, ends);
+    split(centroids, order, middle, last, ends);
+}
+
+// Vertex cache order within one cluster, optimised on the cluster's own vertices
+void optimise(int *triangles, size_t triangleCount, vector<int> &local){
+    vector<int> vertices, numbered(3 * triangleCount);
+    for (size_t i = 0; i < 3 * triangleCount; i++){
+        int &number = local[triangles[i]];
+        if (number < 0){
+            number = vertices.size();
+            vertices.push_back(triangles[i]);
+        }
+        numbered[i] = number;
+    }
+
+    vector<int> order;
+    optimiseTriangleOrder(numbered.data(), triangleCount, vertices.size(), order);
+    for (size_t t = 0; t < triangleCount; t++){
+        for (int k = 0; k < 3; k++)
+            triangles[3*t + k] = vertices[numbered[3*order[t] + k]];
+    }
+
+    for (size_t i = 0; i < vertices.size(); i++)
+        local[vertices[i]] = -1;
+}
+
+void bound(const VertexArrays &vertices, const int *triangles, MeshCluster &cluster){
+    const float *x = vertices.get(VERTEX_X), *y = vertices.get(VERTEX_Y), *z = vertices.get(VERTEX_Z);
+    size_t count = 3 * cluster.triangleCount;
+
+    // Sphere around the box of the vertices
+    float minimum[3] = {x[triangles[0]], y[triangles[0]], z[triangles[0]]};
+    float maximum[3] = {minimum[0], minimum[1], minimum[2]};
+    for (size_t i = 1; i < count; i++){
+        float p[3] = {x[triangles[i]], y[triangles[i]], z[triangles[i]]};
+        for (int k = 0; k < 3; k++){
+            minimum[k] = p[k] < minimum[k] ? p[k] : minimum[k];
+            maximum[k] = p[k] > maximum[k] ? p[k] : maximum[k];
+        }
+    }
+    for (int k = 0; k < 3; k++)
+        cluster.centre[k] = (minimum[k] + maximum[k]) / 2;
+    float radius2 = 0;
+    for (size_t i = 0; i < count; i++){
+        float dx = x[triangles[i]] - cluster.centre[0];
+        float dy = y[triangles[i]] - cluster.centre[1];
+        float dz = z[triangles[i]] - cluster.centre[2];
+        float distance2 = dx*dx + dy*dy + dz*dz;
+        radius2 = distance2 > radius2 ? distance2 : radius2;
+    }
+    cluster.radius = sqrt(radius2);
+
+    // Cone around the unit face normals: the mean direction and the widest angle from it
+    vector<float> normals(3 * cluster.triangleCount, 0.f);
+    double axis[3] = {0, 0, 0};
+    for (size_t t = 0; t < cluster.triangleCount; t++){
+        const int *v = triangles + 3*t;
+        float ux = x[v[1]] - x[v[0]], uy = y[v[1]] - y[v[0]], uz = z[v[1]] - z[v[0]];
+        float vx = x[v[2]] - x[v[0]], vy = y[v[2]] - y[v[0]], vz = z[v[2]] - z[v[0]];
+        float n[3] = {uy*vz - uz*vy, uz*vx - ux*vz, ux*vy - uy*vx};
+        float length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length == 0)
+            continue;   // no facing, never drawn
+        for (int k = 0; k < 3; k++){
+            normals[3*t + k] = n[k] / length;
+            axis[k] += n[k] / length;
+        }
+    }
+    double length = sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+    cluster.coneAxis[0] = cluster.coneAxis[1] = cluster.coneAxis[2] = 0.f;
+    cluster.coneCutoff = 2.f;
+    if (length == 0)
+        return;
+    for (int k = 0; k < 3; k++)
+        cluster.coneAxis[k] = axis[k] / length;
+
+    float minimumDot = 1.f;
+    for (size_t t = 0; t < cluster.triangleCount; t++){
+        const float *n = &normals[3*t];
+        if (n[0] == 0 && n[1] == 0 && n[2] == 0)
+            continue;
+        float dot = n[0]*cluster.coneAxis[0] + n[1]*cluster.coneAxis[1] + n[2]*cluster.coneAxis[2];
+        minimumDot = dot < minimumDot ? dot : minimumDot;
+    }
+    // Wider than a hemisphere: some triangle always faces the eye
+    if (minimumDot > 0)
+        cluster.coneCutoff = sqrt(1 - minimumDot*minimumDot);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+void buildClusters(const VertexArrays &vertices, vector<int> &triangles, vector<MeshCluster> &clusters){
+    clusters.clear();
+    size_t count = triangles.size() / 3;
+    if (count == 0)
+        return;
+
+    const float *x = vertices.get(VERTEX_X), *y = vertices.get(VERTEX_Y), *z = vertices.get(VERTEX_Z);
+    vector<float> centroids[3];
+    for (int k = 0; k < 3; k++)
+        centroids[k].resize(count);
+    for (size_t t = 0; t < count; t++){
+        const int *v = &triangles[3*t];
+        centroids[0][t] = (x[v[0]] + x[v[1]] + x[v[2]]) / 3;
+        centroids[1][t] = (y[v[0]] + y[v[1]] + y[v[2]]) / 3;
+        centroids[2][t] = (z[v[0]] + z[v[1]] + z[v[2]]) / 3;
+    }
+
+    vector<int> order(count);
+    for (size_t t = 0; t < count; t++)
+        order[t] = t;
+    Centroids compare = {{centroids[0].data(), centroids[1].data(), centroids[2].data()}, 0};
+    vector<size_t> ends;
+    split(compare, order, 0, count, ends);
+
+    vector<int> reordered(triangles.size());
+    for (size_t t = 0; t < count; t++){
+        for (int k = 0; k < 3; k++)
+            reordered[3*t + k] = triangles[3*order[t] + k];
+    }
+    triangles.swap(reordered);
+
+    clusters.resize(ends.size());
+    vector<int> local(vertices.size(), -1);
+    size_t first = 0;
+    for (size_t i = 0; i < ends.size(); i++){
+        MeshCluster &cluster = clusters[i];
+        cluster.firstTriangle = first;
+        cluster.triangleCount = ends[i] - first;
+        optimise(&triangles[3*first], cluster.triangleCount, local);
+        bound(vertices, &triangles[3*first], cluster);
+        first = ends[i];
+    }
+}
+
+void refitClusters(const VertexArrays &vertices, const vector<int> &triangles, vector<MeshCluster> &clusters){
+    for (size_t i = 0; i < clusters.size(); i++){
+        if (clusters[i].triangleCount > 0)
+            bound(vertices, &triangles[3*clusters[i].firstTriangle], clusters[i]);
+    }
+}
+
+void clusterView(const Matrix4 &projection, const Matrix4 &modelview, bool backfaces, ClusterView &view){
+    // Planes of the clip volume -w <= x, y, z <= w pulled back into mesh coordinates
+    Matrix4 clip = projection * modelview;
+    for (int i = 0; i < 6; i++){
+        int row = i / 2;
+        float sign = i % 2 == 0 ? 1.f : -1.f;
+        float length2 = 0;
+        for (int column = 0; column < 4; column++){
+            view.planes[i][column] = clip.at(3, column) + sign * clip.at(row, column);
+            if (column < 3)
+                length2 += view.planes[i][column] * view.planes[i][column];
+        }
+        float length = sqrt(length2);
+        for (int column = 0; column < 4 && length > 0; column++)
+            view.planes[i][column] /= length;
+    }
+
+    // The eye is the origin of eye space
+    Matrix4 inverse;
+    const float origin[4] = {0.f, 0.f, 0.f, 1.f};
+    float eye[4] = {0.f, 0.f, 0.f, 1.f};
+    if (modelview.inverse(inverse))
+        inverse.transform(origin, eye);
+    for (int k = 0; k < 3; k++)
+        view.eye[k] = eye[k] / eye[3];
+    view.backfaces = backfaces;
+}
+
+void cullClusters(const vector<MeshCluster> &clusters, const ClusterView &view,
+        vector<TriangleRange> &visible, ClusterCullStats &stats){
+    visible.clear();
+    stats.clusters = clusters.size();
+    stats.culledClusters = stats.triangles = stats.culledTriangles = 0;
+
+    for (size_t i = 0; i < clusters.size(); i++){
+        const MeshCluster &cluster = clusters[i];
+        const float *c = cluster.centre;
+        stats.triangles += cluster.triangleCount;
+
+        bool culled = false;
+        for (int p = 0; p < 6 && !culled; p++){
+            const float *plane = view.planes[p];
+            culled = plane[0]*c[0] + plane[1]*c[1] + plane[2]*c[2] + plane[3] < -cluster.radius;
+        }
+
+        // Every point of the sphere sees every normal of the cone from behind
+        if (!culled && view.backfaces){
+            float d[3] = {c[0] - view.eye[0], c[1] - view.eye[1], c[2] - view.eye[2]};
+            float distance = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            float along = d[0]*cluster.coneAxis[0] + d[1]*cluster.coneAxis[1] + d[2]*cluster.coneAxis[2];
+            culled = along >= cluster.coneCutoff * distance + cluster.radius;
+        }
+
+        if (culled){
+            stats.culledClusters++;
+            stats.culledTriangles += cluster.triangleCount;
+        }
+        else if (!visible.empty() && visible.back().first + visible.back().count == cluster.firstTriangle){
+            visible.back().count += cluster.triangleCount;
+        }
+        else{
+            TriangleRange range = {cluster.firstTriangle, cluster.triangleCount};
+            visible.push_back(range);
+        }
+    }
+}
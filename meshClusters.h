@@ -0,0 +1,69 @@
+/**
+ * Spatial clusters of triangles for culling whole groups at a time
+ *
+ * buildClusters() splits a triangle list at the median of the longest axis
+ * of the triangle centroids until no part has more than CLUSTER_TRIANGLES,
+ * and reorders the triangles so that every cluster is one contiguous range.
+ * The triangles of each cluster are then put in vertex cache order again
+ * (see meshOptimiser.h).
+ *
+ * Every cluster has a bounding sphere and a normal cone. cullClusters()
+ * rejects clusters whose sphere is outside the view frustum, and clusters
+ * whose triangles all face away from the eye, which is what
+ * glCullFace(GL_BACK) would do to them one by one.
+ */
+
+#ifndef MESHCLUSTERS_H_
+#define MESHCLUSTERS_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "matrix4.h"
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+// Most triangles in a cluster
+#define CLUSTER_TRIANGLES 256
+
+/*************** Classes *******************/
+// Fixed size fields, as it is stored in the mesh cache
+struct MeshCluster{
+    uint32_t firstTriangle, triangleCount;
+    float centre[3], radius;        // bounding sphere
+    float coneAxis[3], coneCutoff;  // normal cone; coneCutoff >= 1 never culls
+};
+
+// Triangles [first, first + count) of a level
+struct TriangleRange{
+    size_t first, count;
+};
+
+// Where the mesh is seen from, in mesh coordinates
+struct ClusterView{
+    float planes[6][4];     // frustum planes, inside where a*x + b*y + c*z + d >= 0
+    float eye[3];
+    bool backfaces;         // reject clusters facing away from the eye
+};
+
+struct ClusterCullStats{
+    size_t clusters, culledClusters;
+    size_t triangles, culledTriangles;
+};
+
+/*************** Function Prototypes *******************/
+// Reorders triangles (three indices each) into clusters
+void buildClusters(const VertexArrays &vertices, std::vector<int> &triangles, std::vector<MeshCluster> &clusters);
+
+// Recompute the spheres and cones after the vertices moved, keeping the triangle ranges
+void refitClusters(const VertexArrays &vertices, const std::vector<int> &triangles, std::vector<MeshCluster> &clusters);
+
+// View of the mesh drawn with the given projection and modelview matrices
+void clusterView(const Matrix4 &projection, const Matrix4 &modelview, bool backfaces, ClusterView &view);
+
+// Visible clusters as ranges, merging neighbours; stats are for this call only
+void cullClusters(const std::vector<MeshCluster> &clusters, const ClusterView &view,
+        std::vector<TriangleRange> &visible, ClusterCullStats &stats);
+
+#endif /* MESHCLUSTERS_H_ */
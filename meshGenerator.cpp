@@ -0,0 +1,109 @@
+/**
+ * Synthetic meshes for benchmarking -- see meshGenerator.h
+ */
+
+/*************** Includes *******************/
+#include "meshGenerator.h"
+
+#include <vector>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Side of the lattice and the largest height, in mesh units
+#define SYNTHETIC_SIZE 0.2f
+#define SYNTHETIC_HEIGHT 0.1f
+
+// Octaves of value noise in the heights, each half the weight of the last
+#define NOISE_OCTAVES 4
+
+/*************** Helpers *******************/
+namespace {
+
+// Hash of a lattice point to [0, 1)
+float latticeValue(int32_t x, int32_t y, uint32_t seed){
+    uint32_t h = seed ^ ((uint32_t) x * 0x8da6b343u) ^ ((uint32_t) y * 0xd8163841u);
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return (h & 0xffffff) / 16777216.f;
+}
+
+// Smoothly interpolated value noise over octaves, in [0, 1)
+float noise(float x, float y, uint32_t seed){
+    float total = 0, weight = 0.5f, frequency = 4.f;
+    for (int octave = 0; octave < NOISE_OCTAVES; octave++){
+        float fx = x * frequency, fy = y * frequency;
+        int32_t ix = (int32_t) fx, iy = (int32_t) fy;
+        float tx = fx - ix, ty = fy - iy;
+        tx = tx*tx*(3 - 2*tx);
+        ty = ty*ty*(3 - 2*ty);
+        uint32_t octaveSeed = seed + octave * 0x9e3779b9u;
+        float a = latticeValue(ix, iy, octaveSeed), b = latticeValue(ix + 1, iy, octaveSeed);
+        float c = latticeValue(ix, iy + 1, octaveSeed), d = latticeValue(ix + 1, iy + 1, octaveSeed);
+        total += weight * ((a + (b - a)*tx) + ((c + (d - c)*tx) - (a + (b - a)*tx))*ty);
+        weight *= 0.5f;
+        frequency *= 2.f;
+    }
+    return total / (1.f - weight * 2.f);    // the weights summed to 1 - 2 * weight
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+const char *syntheticMeshName(unsigned kind){
+    switch (kind){
+        case SYNTHETIC_GRID:
+            return "grid";
+        case SYNTHETIC_HEIGHTFIELD:
+            return "heightfield";
+        case SYNTHETIC_MIXED:
+            return "mixed";
+    }
+    return "unknown";
+}
+
+void generateMesh(unsigned kind, size_t columns, size_t rows, uint32_t seed, VertexArrays &vertices,
+        PolygonList &polygons){
+    columns = columns < 2 ? 2 : columns;
+    rows = rows < 2 ? 2 : rows;
+
+    vertices.allocate(columns * rows);
+    float *x = vertices.get(VERTEX_X), *y = vertices.get(VERTEX_Y), *z = vertices.get(VERTEX_Z);
+    float *u = vertices.get(VERTEX_U), *v = vertices.get(VERTEX_V);
+    for (size_t r = 0; r < rows; r++){
+        for (size_t c = 0; c < columns; c++){
+            size_t i = r * columns + c;
+            u[i] = (float) c / (columns - 1);
+            v[i] = (float) r / (rows - 1);
+            y[i] = (v[i] - 1.f) * SYNTHETIC_SIZE;
+            z[i] = (u[i] - 1.f) * SYNTHETIC_SIZE;
+            x[i] = kind == SYNTHETIC_GRID ? SYNTHETIC_HEIGHT : SYNTHETIC_HEIGHT * noise(u[i], v[i], seed);
+        }
+    }
+
+    // Counter-clockwise seen from +x, like the face
+    vector<int> offsets(1, 0), indices;
+    size_t cells = (columns - 1) * (rows - 1);
+    offsets.reserve(2*cells + 1);
+    indices.reserve(6*cells);
+    for (size_t r = 0; r + 1 < rows; r++){
+        for (size_t c = 0; c + 1 < columns; c++){
+            int a = r * columns + c, b = a + 1, d = a + columns, e = d + 1;
+            bool quad = kind == SYNTHETIC_GRID || (kind == SYNTHETIC_MIXED && (r + c) % 2 == 0);
+            if (quad){
+                const int cell[4] = {a, d, e, b};
+                indices.insert(indices.end(), cell, cell + 4);
+                offsets.push_back(indices.size());
+            }
+            else{
+                const int first[3] = {a, e, b}, second[3] = {a, d, e};
+                indices.insert(indices.end(), first, first + 3);
+                offsets.push_back(indices.size());
+                indices.insert(indices.end(), second, second + 3);
+                offsets.push_back(indices.size());
+            }
+        }
+    }
+    polygons.assign(offsets, indices);
+}
@@ -0,0 +1,40 @@
+/**
+ * Synthetic meshes for benchmarking at sizes well past the face scan
+ *
+ * Every mesh is a columns x rows lattice of vertices across the y-z plane,
+ * 0.2 units square, with heights of up to 0.1 along x. That is about where
+ * the face lies, so the default camera (see loadData()) frames it the same. Texture coordinates span the
+ * whole texture. The kinds differ in the heights and in the polygons:
+ *
+ *  - SYNTHETIC_GRID: flat, one quad per cell
+ *  - SYNTHETIC_HEIGHTFIELD: value noise heights, two triangles per cell
+ *  - SYNTHETIC_MIXED: value noise heights, quads and triangle pairs in a
+ *    checkerboard, which exercises the mixed polygon paths
+ *
+ * The same seed always gives the same mesh.
+ */
+
+#ifndef MESHGENERATOR_H_
+#define MESHGENERATOR_H_
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "polygonList.h"
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+#define SYNTHETIC_GRID 0u
+#define SYNTHETIC_HEIGHTFIELD 1u
+#define SYNTHETIC_MIXED 2u
+#define SYNTHETIC_KIND_COUNT 3u
+
+/*************** Function Prototypes *******************/
+// Short name of a kind, for file names and reports
+const char *syntheticMeshName(unsigned kind);
+
+// Replace vertices and polygons with a generated mesh; columns and rows are at least 2
+void generateMesh(unsigned kind, size_t columns, size_t rows, uint32_t seed, VertexArrays &vertices,
+        PolygonList &polygons);
+
+#endif /* MESHGENERATOR_H_ */
@@ -0,0 +1,316 @@
+/**
+ * Many instances of a few meshes, drawn with instancing -- see meshInstancing.h
+ */
+
+/*************** Includes *******************/
+#include "meshInstancing.h"
+#include "glVersion.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Byte offset into the bound buffer, as glVertexAttribPointer() takes it
+#define BUFFER_OFFSET(offset) (reinterpret_cast<const GLvoid *>(offset))
+
+// Attribute locations of the instance attributes; the matrix takes four
+#define MODEL_LOCATION 4
+#define AMBIENT_LOCATION 8
+#define DIFFUSE_LOCATION 9
+#define SPECULAR_LOCATION 10
+
+/*************** Helpers *******************/
+namespace {
+
+// GL_LIGHT0 and GL_MODULATE as the fixed function pipeline does them, per vertex,
+// with the instance's transform and material in place of the GL ones
+const char *vertexShader =
+    "#version 120\n"
+    "attribute mat4 instanceModel;\n"
+    "attribute vec3 instanceAmbient, instanceDiffuse, instanceSpecular;\n"
+    "varying vec4 colour;\n"
+    "void main(){\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * (mat3(instanceModel) * gl_Normal));\n"
+    "    vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+    "    float diffuse = max(dot(normal, light), 0.0);\n"
+    "    vec3 halfway = normalize(light + vec3(0.0, 0.0, 1.0));\n"     // viewer at infinity, as GL_LIGHT_MODEL_LOCAL_VIEWER is off
+    "    float specular = diffuse > 0.0 ? pow(max(dot(normal, halfway), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+    "    vec3 lit = (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb) * instanceAmbient\n"
+    "            + diffuse * gl_LightSource[0].diffuse.rgb * instanceDiffuse\n"
+    "            + specular * gl_LightSource[0].specular.rgb * instanceSpecular;\n"
+    "    colour = vec4(clamp(lit, 0.0, 1.0), 1.0);\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * (instanceModel * gl_Vertex);\n"
+    "}\n";
+
+const char *fragmentShader =
+    "#version 120\n"
+    "uniform bool textured;\n"
+    "uniform sampler2D image;\n"
+    "varying vec4 colour;\n"
+    "void main(){\n"
+    "    gl_FragColor = textured ? texture2D(image, gl_TexCoord[0].st) * colour : colour;\n"
+    "}\n";
+
+GLuint compile(GLenum type, const char *source, string &error){
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled)
+        return shader;
+
+    char log[1024] = "";
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    error = string("Unable to compile the instancing shader: ") + log;
+    glDeleteShader(shader);
+    return 0;
+}
+
+bool drawsBefore(const InstanceDraw &a, const InstanceDraw &b){
+    return a.mesh != b.mesh ? a.mesh < b.mesh : a.texture < b.texture;
+}
+
+void bindTexture(const GeometryStore &store, const InstanceGroup &group, bool textured){
+    if (textured && group.texture != INSTANCE_NO_TEXTURE){
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, store.getTexture(group.texture));
+    }
+    else{
+        glDisable(GL_TEXTURE_2D);
+    }
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+int GeometryStore::findMesh(const string &path) const{
+    for (size_t i = 0; i < meshPaths.size(); i++){
+        if (meshPaths[i] == path)
+            return i;
+    }
+    return -1;
+}
+
+int GeometryStore::addMesh(const string &path, const VertexArrays &vertices, const vector<MeshLod> &levels){
+    unique_ptr<MeshBuffers> mesh(new MeshBuffers());
+    if (vertices.size() == 0 || !mesh->build(vertices, levels))
+        return -1;
+
+    StoredMesh stored;
+    const float *axis[3] = {vertices.get(VERTEX_X), vertices.get(VERTEX_Y), vertices.get(VERTEX_Z)};
+    for (int k = 0; k < 3; k++){
+        float minimum = *min_element(axis[k], axis[k] + vertices.size());
+        float maximum = *max_element(axis[k], axis[k] + vertices.size());
+        stored.centre[k] = (minimum + maximum) / 2;
+    }
+    float radius2 = 0;
+    for (size_t i = 0; i < vertices.size(); i++){
+        float dx = axis[0][i] - stored.centre[0], dy = axis[1][i] - stored.centre[1], dz = axis[2][i] - stored.centre[2];
+        radius2 = max(radius2, dx*dx + dy*dy + dz*dz);
+    }
+    stored.radius = sqrt(radius2);
+    for (size_t i = 0; i < levels.size(); i++)
+        stored.errors.push_back(levels[i].error);
+
+    meshPaths.push_back(path);
+    meshes.push_back(stored);
+    buffers.push_back(move(mesh));
+    return meshes.size() - 1;
+}
+
+int GeometryStore::findTexture(const string &path) const{
+    for (size_t i = 0; i < texturePaths.size(); i++){
+        if (texturePaths[i] == path)
+            return i;
+    }
+    return -1;
+}
+
+int GeometryStore::addTexture(const string &path, GLuint name){
+    texturePaths.push_back(path);
+    textures.push_back(name);
+    return textures.size() - 1;
+}
+
+void GeometryStore::release(){
+    for (size_t i = 0; i < buffers.size(); i++)
+        buffers[i]->release();
+    if (!textures.empty())
+        glDeleteTextures(textures.size(), textures.data());
+    meshPaths.clear();
+    texturePaths.clear();
+    meshes.clear();
+    buffers.clear();
+    textures.clear();
+}
+
+size_t GeometryStore::getBytes() const{
+    size_t bytes = 0;
+    for (size_t i = 0; i < buffers.size(); i++)
+        bytes += buffers[i]->getBytes();
+    return bytes;
+}
+
+InstanceRenderer::InstanceRenderer(): program(0), instanceBuffer(0), texturedLocation(-1){
+}
+
+bool InstanceRenderer::supported(){
+    return glVersionAtLeast(3, 3);
+}
+
+bool InstanceRenderer::init(string &error){
+    release();
+    if (!supported())
+        return true;
+
+    GLuint vertex = compile(GL_VERTEX_SHADER, vertexShader, error);
+    GLuint fragment = vertex == 0 ? 0 : compile(GL_FRAGMENT_SHADER, fragmentShader, error);
+    if (fragment == 0){
+        glDeleteShader(vertex);
+        return false;
+    }
+
+    program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glBindAttribLocation(program, MODEL_LOCATION, "instanceModel");
+    glBindAttribLocation(program, AMBIENT_LOCATION, "instanceAmbient");
+    glBindAttribLocation(program, DIFFUSE_LOCATION, "instanceDiffuse");
+    glBindAttribLocation(program, SPECULAR_LOCATION, "instanceSpecular");
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked){
+        char log[1024] = "";
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        error = string("Unable to link the instancing shader: ") + log;
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+    texturedLocation = glGetUniformLocation(program, "textured");
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "image"), 0);
+    glUseProgram(0);
+
+    glGenBuffers(1, &instanceBuffer);
+    return true;
+}
+
+void InstanceRenderer::build(const vector<InstanceDraw> &draws){
+    vector<InstanceDraw> sorted(draws);
+    stable_sort(sorted.begin(), sorted.end(), drawsBefore);
+
+    instances.resize(sorted.size());
+    groups.clear();
+    for (size_t i = 0; i < sorted.size(); i++){
+        instances[i] = sorted[i].attributes;
+        if (groups.empty() || groups.back().mesh != sorted[i].mesh || groups.back().texture != sorted[i].texture){
+            InstanceGroup group = {sorted[i].mesh, sorted[i].texture, i, 0};
+            groups.push_back(group);
+        }
+        groups.back().count++;
+    }
+
+    if (instanceBuffer != 0){
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceAttributes), instances.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+size_t InstanceRenderer::draw(const GeometryStore &store, const vector<size_t> &levels, bool textured) const{
+    glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT | GL_TEXTURE_BIT | GL_TRANSFORM_BIT);
+    if (isInstanced())
+        drawInstanced(store, levels, textured);
+    else
+        drawOneByOne(store, levels, textured);
+    glPopAttrib();
+
+    size_t triangles = 0;
+    for (size_t i = 0; i < groups.size(); i++)
+        triangles += groups[i].count * store.getBuffers(groups[i].mesh).getTriangleCount(levels[i]);
+    return triangles;
+}
+
+void InstanceRenderer::drawInstanced(const GeometryStore &store, const vector<size_t> &levels, bool textured) const{
+    glUseProgram(program);
+    for (int column = 0; column < 4; column++){
+        glEnableVertexAttribArray(MODEL_LOCATION + column);
+        glVertexAttribDivisor(MODEL_LOCATION + column, 1);
+    }
+    glEnableVertexAttribArray(AMBIENT_LOCATION);
+    glEnableVertexAttribArray(DIFFUSE_LOCATION);
+    glEnableVertexAttribArray(SPECULAR_LOCATION);
+    glVertexAttribDivisor(AMBIENT_LOCATION, 1);
+    glVertexAttribDivisor(DIFFUSE_LOCATION, 1);
+    glVertexAttribDivisor(SPECULAR_LOCATION, 1);
+
+    for (size_t i = 0; i < groups.size(); i++){
+        const InstanceGroup &group = groups[i];
+        bindTexture(store, group, textured);
+        glUniform1i(texturedLocation, textured && group.texture != INSTANCE_NO_TEXTURE);
+
+        // Point the attributes at the group's first instance
+        size_t base = group.first * sizeof(InstanceAttributes);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int column = 0; column < 4; column++){
+            glVertexAttribPointer(MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                    BUFFER_OFFSET(base + offsetof(InstanceAttributes, model) + 4 * column * sizeof(GLfloat)));
+        }
+        glVertexAttribPointer(AMBIENT_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                BUFFER_OFFSET(base + offsetof(InstanceAttributes, ambient)));
+        glVertexAttribPointer(DIFFUSE_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                BUFFER_OFFSET(base + offsetof(InstanceAttributes, diffuse)));
+        glVertexAttribPointer(SPECULAR_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                BUFFER_OFFSET(base + offsetof(InstanceAttributes, specular)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        store.getBuffers(group.mesh).drawInstanced(levels[i], group.count);
+    }
+
+    for (int location = MODEL_LOCATION; location <= SPECULAR_LOCATION; location++){
+        glVertexAttribDivisor(location, 0);
+        glDisableVertexAttribArray(location);
+    }
+    glUseProgram(0);
+}
+
+void InstanceRenderer::drawOneByOne(const GeometryStore &store, const vector<size_t> &levels, bool textured) const{
+    glEnable(GL_NORMALIZE);     // instances may be scaled
+    glMatrixMode(GL_MODELVIEW);
+    for (size_t i = 0; i < groups.size(); i++){
+        const InstanceGroup &group = groups[i];
+        bindTexture(store, group, textured);
+        for (size_t j = group.first; j < group.first + group.count; j++){
+            const InstanceAttributes &instance = instances[j];
+            GLfloat ambient[4] = {instance.ambient[0], instance.ambient[1], instance.ambient[2], 1.f};
+            GLfloat diffuse[4] = {instance.diffuse[0], instance.diffuse[1], instance.diffuse[2], 1.f};
+            GLfloat specular[4] = {instance.specular[0], instance.specular[1], instance.specular[2], 1.f};
+            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, specular);
+
+            glPushMatrix();
+            glMultMatrixf(instance.model);
+            store.getBuffers(group.mesh).draw(levels[i]);
+            glPopMatrix();
+        }
+    }
+}
+
+void InstanceRenderer::release(){
+    if (program != 0)
+        glDeleteProgram(program);
+    if (instanceBuffer != 0)
+        glDeleteBuffers(1, &instanceBuffer);
+    program = instanceBuffer = 0;
+    texturedLocation = -1;
+}
@@ -0,0 +1,172 @@
+/**
+ * Many instances of a few meshes, drawn with instancing
+ *
+ * A GeometryStore keeps one set of vertex buffers (see meshBuffers.h) per
+ * mesh file and one texture name per texture file, however many instances
+ * use them. An InstanceRenderer sorts the instances so that those sharing a
+ * mesh and texture are contiguous, uploads the transform and material of
+ * every instance into one buffer, and draws each group with a single
+ * glDrawElementsInstanced() call. The draw calls grow with the number of
+ * distinct meshes and textures, not with the number of instances.
+ *
+ * The per instance attributes are read by a small vertex shader that lights
+ * every vertex as the fixed function pipeline does with the GL_LIGHT0 and
+ * material state of cgRender.cpp, so an instance looks like the single mesh
+ * drawn with the same material. Instancing needs OpenGL 3.3; without it the
+ * instances are drawn one by one with the fixed function pipeline.
+ */
+
+#ifndef MESHINSTANCING_H_
+#define MESHINSTANCING_H_
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "meshBuffers.h"
+#include "meshSimplifier.h"
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+// Texture index of instances drawn without one
+#define INSTANCE_NO_TEXTURE ((size_t) -1)
+
+/*************** Classes *******************/
+// A mesh in the store
+struct StoredMesh{
+    float centre[3], radius;        // bounding sphere, in mesh coordinates
+    std::vector<float> errors;      // of each level of detail, see meshSimplifier.h
+};
+
+class GeometryStore{
+    std::vector<std::string> meshPaths, texturePaths;
+    std::vector<StoredMesh> meshes;
+    std::vector< std::unique_ptr<MeshBuffers> > buffers;   // of each mesh
+    std::vector<GLuint> textures;
+
+    // Disallow copying -- the buffer and texture names are owned
+    GeometryStore(const GeometryStore &);
+    GeometryStore &operator=(const GeometryStore &);
+public:
+    GeometryStore(){}
+
+    // Index of the mesh loaded from path, or -1
+    int findMesh(const std::string &path) const;
+
+    // Upload the levels of a mesh. Returns its index, or -1 if vertex buffers are unsupported.
+    int addMesh(const std::string &path, const VertexArrays &vertices, const std::vector<MeshLod> &levels);
+
+    // Index of the texture loaded from path, or -1
+    int findTexture(const std::string &path) const;
+
+    // Adopt a texture name uploaded from path; returns its index
+    int addTexture(const std::string &path, GLuint name);
+
+    // Delete every buffer and texture. The context must still be current.
+    void release();
+
+    /**
+     * Getters
+     */
+    size_t getMeshCount() const {
+        return meshes.size();
+    }
+
+    const StoredMesh &getMesh(size_t mesh) const {
+        return meshes[mesh];
+    }
+
+    const MeshBuffers &getBuffers(size_t mesh) const {
+        return *buffers[mesh];
+    }
+
+    size_t getTextureCount() const {
+        return textures.size();
+    }
+
+    GLuint getTexture(size_t texture) const {
+        return textures[texture];
+    }
+
+    // Bytes of vertex buffers held by the GL
+    size_t getBytes() const;
+};
+
+// Attributes of one instance as uploaded
+struct InstanceAttributes{
+    GLfloat model[16];      // mesh to world, column major
+    GLfloat ambient[3], diffuse[3], specular[3];
+};
+
+// An instance handed to InstanceRenderer::build()
+struct InstanceDraw{
+    size_t mesh, texture;   // indices into the GeometryStore; texture may be INSTANCE_NO_TEXTURE
+    InstanceAttributes attributes;
+};
+
+// Instances [first, first + count) in draw order share a mesh and texture
+struct InstanceGroup{
+    size_t mesh, texture;
+    size_t first, count;
+};
+
+class InstanceRenderer{
+    GLuint program, instanceBuffer;
+    GLint texturedLocation;
+    std::vector<InstanceAttributes> instances;  // in draw order
+    std::vector<InstanceGroup> groups;
+
+    // Disallow copying -- the program and buffer names are owned
+    InstanceRenderer(const InstanceRenderer &);
+    InstanceRenderer &operator=(const InstanceRenderer &);
+
+    void drawInstanced(const GeometryStore &store, const std::vector<size_t> &levels, bool textured) const;
+    void drawOneByOne(const GeometryStore &store, const std::vector<size_t> &levels, bool textured) const;
+public:
+    InstanceRenderer();
+
+    // True if the current context can draw instanced
+    static bool supported();
+
+    // Compile the shader if instancing is supported. Returns false with a message in error
+    // if it does not compile; the instances are then drawn one by one.
+    bool init(std::string &error);
+
+    // Sort the instances into groups and upload their attributes
+    void build(const std::vector<InstanceDraw> &draws);
+
+    // Draw every group at levels[group] with the current view; textured binds the textures.
+    // Returns the triangles drawn. Sets and restores the GL state it changes.
+    size_t draw(const GeometryStore &store, const std::vector<size_t> &levels, bool textured) const;
+
+    // Delete the program and buffer. The context must still be current.
+    void release();
+
+    /**
+     * Getters
+     */
+    bool isInstanced() const {
+        return program != 0;
+    }
+
+    const std::vector<InstanceGroup> &getGroups() const {
+        return groups;
+    }
+
+    const std::vector<InstanceAttributes> &getInstances() const {
+        return instances;
+    }
+
+    size_t getDrawCalls() const {
+        return isInstanced() ? groups.size() : instances.size();
+    }
+};
+
+#endif /* MESHINSTANCING_H_ */
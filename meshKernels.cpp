@@ -0,0 +1,329 @@
+/**
+ * Batch kernels over structure of arrays vertex data -- see meshKernels.h
+ */
+
+/*************** Includes *******************/
+#include "meshKernels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MESH_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/*************** Scalar *******************/
+namespace {
+
+void faceNormalsScalar(const float *x, const float *y, const float *z, const int *triangles, size_t count,
+        float *nx, float *ny, float *nz){
+    for (size_t i = 0; i < count; i++){
+        int i0 = triangles[3*i], i1 = triangles[3*i+1], i2 = triangles[3*i+2];
+        float ax = x[i1] - x[i0], ay = y[i1] - y[i0], az = z[i1] - z[i0];
+        float bx = x[i2] - x[i0], by = y[i2] - y[i0], bz = z[i2] - z[i0];
+        nx[i] = ay*bz - az*by;
+        ny[i] = bx*az - ax*bz;
+        nz[i] = ax*by - bx*ay;
+    }
+}
+
+void normaliseScalar(float *x, float *y, float *z, size_t count){
+    for (size_t i = 0; i < count; i++){
+        float magnitude = sqrtf(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+        if (magnitude > 0){
+            x[i] /= magnitude;
+            y[i] /= magnitude;
+            z[i] /= magnitude;
+        }
+    }
+}
+
+void boundsScalar(const float *x, const float *y, const float *z, size_t count,
+        float minimum[3], float maximum[3], double sum[3]){
+    const float *arrays[3] = {x, y, z};
+    for (int k = 0; k < 3; k++){
+        float low = INFINITY, high = -INFINITY;
+        double total = 0;
+        for (size_t i = 0; i < count; i++){
+            float value = arrays[k][i];
+            low = value < low ? value : low;
+            high = value > high ? value : high;
+            total += value;
+        }
+        minimum[k] = low;
+        maximum[k] = high;
+        sum[k] = total;
+    }
+}
+
+void transformScalar(const float m[16], const float *x, const float *y, const float *z, size_t count,
+        float *ox, float *oy, float *oz, float *ow){
+    for (size_t i = 0; i < count; i++){
+        ox[i] = m[0]*x[i] + m[4]*y[i] + m[8]*z[i] + m[12];
+        oy[i] = m[1]*x[i] + m[5]*y[i] + m[9]*z[i] + m[13];
+        oz[i] = m[2]*x[i] + m[6]*y[i] + m[10]*z[i] + m[14];
+        ow[i] = m[3]*x[i] + m[7]*y[i] + m[11]*z[i] + m[15];
+    }
+}
+
+const MeshKernels scalarKernels = {"scalar", faceNormalsScalar, normaliseScalar, boundsScalar, transformScalar};
+
+}
+
+#ifdef MESH_KERNELS_X86
+/*************** SSE *******************/
+namespace {
+
+void faceNormalsSse(const float *x, const float *y, const float *z, const int *triangles, size_t count,
+        float *nx, float *ny, float *nz){
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        const int *t = triangles + 3*i;
+        __m128 x0 = _mm_setr_ps(x[t[0]], x[t[3]], x[t[6]], x[t[9]]);
+        __m128 y0 = _mm_setr_ps(y[t[0]], y[t[3]], y[t[6]], y[t[9]]);
+        __m128 z0 = _mm_setr_ps(z[t[0]], z[t[3]], z[t[6]], z[t[9]]);
+        __m128 ax = _mm_sub_ps(_mm_setr_ps(x[t[1]], x[t[4]], x[t[7]], x[t[10]]), x0);
+        __m128 ay = _mm_sub_ps(_mm_setr_ps(y[t[1]], y[t[4]], y[t[7]], y[t[10]]), y0);
+        __m128 az = _mm_sub_ps(_mm_setr_ps(z[t[1]], z[t[4]], z[t[7]], z[t[10]]), z0);
+        __m128 bx = _mm_sub_ps(_mm_setr_ps(x[t[2]], x[t[5]], x[t[8]], x[t[11]]), x0);
+        __m128 by = _mm_sub_ps(_mm_setr_ps(y[t[2]], y[t[5]], y[t[8]], y[t[11]]), y0);
+        __m128 bz = _mm_sub_ps(_mm_setr_ps(z[t[2]], z[t[5]], z[t[8]], z[t[11]]), z0);
+        _mm_storeu_ps(nx + i, _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+        _mm_storeu_ps(ny + i, _mm_sub_ps(_mm_mul_ps(bx, az), _mm_mul_ps(ax, bz)));
+        _mm_storeu_ps(nz + i, _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(bx, ay)));
+    }
+    faceNormalsScalar(x, y, z, triangles + 3*i, count - i, nx + i, ny + i, nz + i);
+}
+
+void normaliseSse(float *x, float *y, float *z, size_t count){
+    size_t i = 0;
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4){
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+        __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+        __m128 mask = _mm_cmpgt_ps(magnitude, zero);
+        // Zero length vectors are left alone
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(vx, magnitude)), _mm_andnot_ps(mask, vx)));
+        _mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(vy, magnitude)), _mm_andnot_ps(mask, vy)));
+        _mm_storeu_ps(z + i, _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(vz, magnitude)), _mm_andnot_ps(mask, vz)));
+    }
+    normaliseScalar(x + i, y + i, z + i, count - i);
+}
+
+void boundsSse(const float *x, const float *y, const float *z, size_t count,
+        float minimum[3], float maximum[3], double sum[3]){
+    const float *arrays[3] = {x, y, z};
+    for (int k = 0; k < 3; k++){
+        const float *a = arrays[k];
+        __m128 low = _mm_set1_ps(INFINITY), high = _mm_set1_ps(-INFINITY);
+        __m128d totalLow = _mm_setzero_pd(), totalHigh = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4){
+            __m128 v = _mm_loadu_ps(a + i);
+            low = _mm_min_ps(low, v);
+            high = _mm_max_ps(high, v);
+            totalLow = _mm_add_pd(totalLow, _mm_cvtps_pd(v));
+            totalHigh = _mm_add_pd(totalHigh, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+
+        float lows[4], highs[4];
+        double totals[2];
+        _mm_storeu_ps(lows, low);
+        _mm_storeu_ps(highs, high);
+        _mm_storeu_pd(totals, _mm_add_pd(totalLow, totalHigh));
+
+        float tailLow[3], tailHigh[3];
+        double tailSum[3];
+        boundsScalar(a + i, a + i, a + i, count - i, tailLow, tailHigh, tailSum);
+
+        minimum[k] = tailLow[0];
+        maximum[k] = tailHigh[0];
+        for (int j = 0; j < 4; j++){
+            minimum[k] = lows[j] < minimum[k] ? lows[j] : minimum[k];
+            maximum[k] = highs[j] > maximum[k] ? highs[j] : maximum[k];
+        }
+        sum[k] = totals[0] + totals[1] + tailSum[0];
+    }
+}
+
+void transformSse(const float m[16], const float *x, const float *y, const float *z, size_t count,
+        float *ox, float *oy, float *oz, float *ow){
+    __m128 c[16];
+    for (int j = 0; j < 16; j++)
+        c[j] = _mm_set1_ps(m[j]);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+        float *out[4] = {ox, oy, oz, ow};
+        for (int row = 0; row < 4; row++){
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c[row], vx), _mm_mul_ps(c[row+4], vy)),
+                    _mm_mul_ps(c[row+8], vz)), c[row+12]);
+            _mm_storeu_ps(out[row] + i, r);
+        }
+    }
+    transformScalar(m, x + i, y + i, z + i, count - i, ox + i, oy + i, oz + i, ow + i);
+}
+
+const MeshKernels sseKernels = {"sse", faceNormalsSse, normaliseSse, boundsSse, transformSse};
+
+}
+
+/*************** AVX2 *******************/
+namespace {
+
+__attribute__((target("avx2")))
+void faceNormalsAvx2(const float *x, const float *y, const float *z, const int *triangles, size_t count,
+        float *nx, float *ny, float *nz){
+    // Offsets of the first corner of 8 consecutive triangles
+    const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        const int *t = triangles + 3*i;
+        __m256i i0 = _mm256_i32gather_epi32(t, stride, 4);
+        __m256i i1 = _mm256_i32gather_epi32(t + 1, stride, 4);
+        __m256i i2 = _mm256_i32gather_epi32(t + 2, stride, 4);
+
+        __m256 x0 = _mm256_i32gather_ps(x, i0, 4), y0 = _mm256_i32gather_ps(y, i0, 4), z0 = _mm256_i32gather_ps(z, i0, 4);
+        __m256 ax = _mm256_sub_ps(_mm256_i32gather_ps(x, i1, 4), x0);
+        __m256 ay = _mm256_sub_ps(_mm256_i32gather_ps(y, i1, 4), y0);
+        __m256 az = _mm256_sub_ps(_mm256_i32gather_ps(z, i1, 4), z0);
+        __m256 bx = _mm256_sub_ps(_mm256_i32gather_ps(x, i2, 4), x0);
+        __m256 by = _mm256_sub_ps(_mm256_i32gather_ps(y, i2, 4), y0);
+        __m256 bz = _mm256_sub_ps(_mm256_i32gather_ps(z, i2, 4), z0);
+
+        _mm256_storeu_ps(nx + i, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+        _mm256_storeu_ps(ny + i, _mm256_sub_ps(_mm256_mul_ps(bx, az), _mm256_mul_ps(ax, bz)));
+        _mm256_storeu_ps(nz + i, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(bx, ay)));
+    }
+    faceNormalsScalar(x, y, z, triangles + 3*i, count - i, nx + i, ny + i, nz + i);
+}
+
+__attribute__((target("avx2")))
+void normaliseAvx2(float *x, float *y, float *z, size_t count){
+    size_t i = 0;
+    __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= count; i += 8){
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz)));
+        __m256 mask = _mm256_cmp_ps(magnitude, zero, _CMP_GT_OQ);
+        // Zero length vectors are left alone
+        _mm256_storeu_ps(x + i, _mm256_blendv_ps(vx, _mm256_div_ps(vx, magnitude), mask));
+        _mm256_storeu_ps(y + i, _mm256_blendv_ps(vy, _mm256_div_ps(vy, magnitude), mask));
+        _mm256_storeu_ps(z + i, _mm256_blendv_ps(vz, _mm256_div_ps(vz, magnitude), mask));
+    }
+    normaliseScalar(x + i, y + i, z + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void boundsAvx2(const float *x, const float *y, const float *z, size_t count,
+        float minimum[3], float maximum[3], double sum[3]){
+    const float *arrays[3] = {x, y, z};
+    for (int k = 0; k < 3; k++){
+        const float *a = arrays[k];
+        __m256 low = _mm256_set1_ps(INFINITY), high = _mm256_set1_ps(-INFINITY);
+        __m256d totalLow = _mm256_setzero_pd(), totalHigh = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8){
+            __m256 v = _mm256_loadu_ps(a + i);
+            low = _mm256_min_ps(low, v);
+            high = _mm256_max_ps(high, v);
+            totalLow = _mm256_add_pd(totalLow, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            totalHigh = _mm256_add_pd(totalHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+        }
+
+        float lows[8], highs[8];
+        double totals[4];
+        _mm256_storeu_ps(lows, low);
+        _mm256_storeu_ps(highs, high);
+        _mm256_storeu_pd(totals, _mm256_add_pd(totalLow, totalHigh));
+
+        float tailLow[3], tailHigh[3];
+        double tailSum[3];
+        boundsScalar(a + i, a + i, a + i, count - i, tailLow, tailHigh, tailSum);
+
+        minimum[k] = tailLow[0];
+        maximum[k] = tailHigh[0];
+        for (int j = 0; j < 8; j++){
+            minimum[k] = lows[j] < minimum[k] ? lows[j] : minimum[k];
+            maximum[k] = highs[j] > maximum[k] ? highs[j] : maximum[k];
+        }
+        sum[k] = (totals[0] + totals[1]) + (totals[2] + totals[3]) + tailSum[0];
+    }
+}
+
+__attribute__((target("avx2")))
+void transformAvx2(const float m[16], const float *x, const float *y, const float *z, size_t count,
+        float *ox, float *oy, float *oz, float *ow){
+    __m256 c[16];
+    for (int j = 0; j < 16; j++)
+        c[j] = _mm256_set1_ps(m[j]);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        float *out[4] = {ox, oy, oz, ow};
+        for (int row = 0; row < 4; row++){
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c[row], vx), _mm256_mul_ps(c[row+4], vy)),
+                    _mm256_mul_ps(c[row+8], vz)), c[row+12]);
+            _mm256_storeu_ps(out[row] + i, r);
+        }
+    }
+    transformScalar(m, x + i, y + i, z + i, count - i, ox + i, oy + i, oz + i, ow + i);
+}
+
+const MeshKernels avx2Kernels = {"avx2", faceNormalsAvx2, normaliseAvx2, boundsAvx2, transformAvx2};
+
+}
+#endif
+
+/******************** FUNCTIONS ***********************/
+const MeshKernels *findMeshKernels(const char *name){
+    if (strcmp(name, "scalar") == 0)
+        return &scalarKernels;
+#ifdef MESH_KERNELS_X86
+    if (strcmp(name, "sse") == 0)
+        return &sseKernels;     // SSE2 is part of x86-64
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        return &avx2Kernels;
+#endif
+    return NULL;
+}
+
+namespace {
+
+const MeshKernels *selectMeshKernels(){
+    const char *forced = getenv("CG_SIMD");
+    if (forced != NULL && findMeshKernels(forced) != NULL)
+        return findMeshKernels(forced);
+
+    const char *preferred[] = {"avx2", "sse", "scalar"};
+    for (int i = 0; ; i++){
+        const MeshKernels *kernels = findMeshKernels(preferred[i]);
+        if (kernels != NULL)
+            return kernels;
+    }
+}
+
+}
+
+const MeshKernels &meshKernels(){
+    static const MeshKernels *selected = selectMeshKernels();
+    return *selected;
+}
+
+void accumulateNormals(const float *fx, const float *fy, const float *fz, const int *offsets, const int *indices,
+        size_t count, float *nx, float *ny, float *nz){
+    for (size_t i = 0; i < count; i++){
+        const int *begin = offsets == NULL ? indices + 3*i : indices + offsets[i];
+        const int *end = offsets == NULL ? begin + 3 : indices + offsets[i+1];
+        for (const int *it = begin; it < end; it++){
+            nx[*it] += fx[i];
+            ny[*it] += fy[i];
+            nz[*it] += fz[i];
+        }
+    }
+}
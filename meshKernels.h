@@ -0,0 +1,58 @@
+/**
+ * Batch kernels over structure of arrays vertex data (see vertexArrays.h)
+ *
+ * Each kernel has a scalar, an SSE and an AVX2 version. meshKernels() picks
+ * the best one the CPU supports the first time it is called; setting the
+ * CG_SIMD environment variable to "scalar", "sse" or "avx2" overrides it.
+ *
+ * The scalar versions do the arithmetic in the same order as Coordinate, so
+ * face normals, normalisation and transforms give the same floats on every
+ * target. Sums in bounds() are accumulated per lane and may differ in the
+ * last bits.
+ */
+
+#ifndef MESHKERNELS_H_
+#define MESHKERNELS_H_
+
+#include <cstddef>
+
+/*************** Classes *******************/
+struct MeshKernels{
+    const char *name;
+
+    // Cross product (v1-v0) x (v2-v0) of count triangles; its length is twice the area
+    void (*faceNormals)(const float *x, const float *y, const float *z, const int *triangles, size_t count,
+            float *nx, float *ny, float *nz);
+
+    // Scale every vector with a non-zero length to unit length
+    void (*normalise)(float *x, float *y, float *z, size_t count);
+
+    // Component wise minimum and maximum, and the sum in double precision
+    void (*bounds)(const float *x, const float *y, const float *z, size_t count,
+            float minimum[3], float maximum[3], double sum[3]);
+
+    // (ox, oy, oz, ow) = matrix * (x, y, z, 1) with a column major (OpenGL) matrix
+    void (*transform)(const float matrix[16], const float *x, const float *y, const float *z, size_t count,
+            float *ox, float *oy, float *oz, float *ow);
+};
+
+/*************** Function Prototypes *******************/
+// Kernels for this CPU
+const MeshKernels &meshKernels();
+
+// Kernels by name ("scalar", "sse", "avx2"), NULL if unknown or not supported by this CPU
+const MeshKernels *findMeshKernels(const char *name);
+
+/**
+ * Add vector i of (fx, fy, fz) to every vertex of polygon i.
+ *
+ * Polygon i is indices[offsets[i]] .. indices[offsets[i+1]-1], or
+ * indices[3*i] .. indices[3*i+2] when offsets is NULL. This is a scatter
+ * with conflicting writes, which AVX2 has no instruction for, so there is
+ * only a scalar version. Vertices are visited in polygon order, making the
+ * sums independent of the kernels in use.
+ */
+void accumulateNormals(const float *fx, const float *fy, const float *fz, const int *offsets, const int *indices,
+        size_t count, float *nx, float *ny, float *nz);
+
+#endif /* MESHKERNELS_H_ */
@@ -0,0 +1,214 @@
+/**
+ * Reordering of triangles and vertices for cache locality -- see meshOptimiser.h
+ */
+
+/*************** Includes *******************/
+#include "meshOptimiser.h"
+
+#include <stdint.h>
+#include <cmath>
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+// Forsyth's scoring constants
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+struct ScoredVertex{
+    int cachePosition;      // -1 when not in the cache
+    int remaining;          // triangles not yet emitted
+    float score;
+};
+
+float vertexScore(const ScoredVertex &vertex){
+    if (vertex.remaining == 0)
+        return -1.f;
+
+    float score = 0.f;
+    if (vertex.cachePosition >= 0){
+        if (vertex.cachePosition < 3){
+            // The triangle just emitted: a fixed score so it is not reused straight away
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else{
+            float scale = 1.f / (VERTEX_CACHE_SIZE - 3);
+            score = powf(1.f - (vertex.cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    return score + VALENCE_BOOST_SCALE * powf((float) vertex.remaining, -VALENCE_BOOST_POWER);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+void optimiseTriangleOrder(const int *triangles, size_t triangleCount, size_t vertexCount, vector<int> &order){
+    order.clear();
+    order.reserve(triangleCount);
+
+    // Triangles of each vertex (CSR)
+    vector<ScoredVertex> vertices(vertexCount);
+    vector<int> adjacencyOffsets(vertexCount + 1, 0), adjacency(3*triangleCount);
+    for (size_t i = 0; i < 3*triangleCount; i++)
+        adjacencyOffsets[triangles[i] + 1]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        adjacencyOffsets[i+1] += adjacencyOffsets[i];
+    vector<int> position(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < 3*triangleCount; i++)
+        adjacency[position[triangles[i]]++] = i / 3;
+
+    for (size_t i = 0; i < vertexCount; i++){
+        vertices[i].cachePosition = -1;
+        vertices[i].remaining = adjacencyOffsets[i+1] - adjacencyOffsets[i];
+        vertices[i].score = vertexScore(vertices[i]);
+    }
+
+    vector<float> triangleScores(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    for (size_t i = 0; i < triangleCount; i++){
+        triangleScores[i] = vertices[triangles[3*i]].score + vertices[triangles[3*i+1]].score
+                + vertices[triangles[3*i+2]].score;
+    }
+
+    // LRU cache with room for the three vertices pushed in by each triangle
+    int cache[VERTEX_CACHE_SIZE + 3], cacheCount = 0;
+    size_t cursor = 0;      // triangles before this one have all been emitted
+    int best = triangleCount > 0 ? 0 : -1;
+
+    while (order.size() < triangleCount){
+        if (best < 0){
+            // Nothing in the cache connects to an unemitted triangle: take the next in input order
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        order.push_back(best);
+        emitted[best] = true;
+
+        // Move the triangle's vertices to the front of the cache
+        int updated[VERTEX_CACHE_SIZE + 3], updatedCount = 0;
+        for (int k = 0; k < 3; k++){
+            int vertex = triangles[3*best + k];
+            updated[updatedCount++] = vertex;
+
+            // One less triangle to go
+            ScoredVertex &scored = vertices[vertex];
+            scored.remaining--;
+            int *begin = &adjacency[adjacencyOffsets[vertex]], *end = begin + scored.remaining + 1;
+            for (int *t = begin; t < end; t++){
+                if (*t == best){
+                    *t = *(end - 1);
+                    *(end - 1) = best;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < cacheCount; i++){
+            int vertex = cache[i];
+            if (vertex != updated[0] && vertex != updated[1] && vertex != updated[2])
+                updated[updatedCount++] = vertex;
+        }
+        for (int i = 0; i < updatedCount; i++){
+            ScoredVertex &scored = vertices[updated[i]];
+            scored.cachePosition = i < VERTEX_CACHE_SIZE ? i : -1;
+        }
+        cacheCount = updatedCount < VERTEX_CACHE_SIZE ? updatedCount : VERTEX_CACHE_SIZE;
+        for (int i = 0; i < cacheCount; i++)
+            cache[i] = updated[i];
+
+        // Rescore everything that moved, and look for the best triangle among them
+        for (int i = 0; i < updatedCount; i++){
+            ScoredVertex &scored = vertices[updated[i]];
+            float delta = vertexScore(scored) - scored.score;
+            scored.score += delta;
+            const int *begin = &adjacency[adjacencyOffsets[updated[i]]];
+            for (const int *t = begin; t < begin + scored.remaining; t++)
+                triangleScores[*t] += delta;
+        }
+
+        best = -1;
+        float bestScore = -1.f;
+        for (int i = 0; i < cacheCount; i++){
+            const ScoredVertex &scored = vertices[cache[i]];
+            const int *begin = &adjacency[adjacencyOffsets[cache[i]]];
+            for (const int *t = begin; t < begin + scored.remaining; t++){
+                if (triangleScores[*t] > bestScore){
+                    bestScore = triangleScores[*t];
+                    best = *t;
+                }
+            }
+        }
+    }
+}
+
+void firstUseVertexOrder(const int *indices, size_t indexCount, size_t vertexCount, vector<int> &remap){
+    remap.assign(vertexCount, -1);
+    int next = 0;
+    for (size_t i = 0; i < indexCount; i++){
+        if (remap[indices[i]] < 0)
+            remap[indices[i]] = next++;
+    }
+    for (size_t i = 0; i < vertexCount; i++){
+        if (remap[i] < 0)
+            remap[i] = next++;
+    }
+}
+
+double averageCacheMissRatio(const int *triangles, size_t triangleCount, unsigned cacheSize){
+    if (triangleCount == 0)
+        return 0;
+
+    vector<int> fifo(cacheSize, -1);
+    size_t head = 0, misses = 0;
+    for (size_t i = 0; i < 3*triangleCount; i++){
+        bool hit = false;
+        for (unsigned j = 0; j < cacheSize && !hit; j++)
+            hit = fifo[j] == triangles[i];
+        if (!hit){
+            fifo[head] = triangles[i];
+            head = (head + 1) % cacheSize;
+            misses++;
+        }
+    }
+    return (double) misses / triangleCount;
+}
+
+size_t gatherCacheMisses(const int *indices, size_t indexCount, size_t streamCount, size_t streamBytes, size_t elementBytes){
+    const size_t sets = GATHER_CACHE_BYTES / (GATHER_CACHE_LINE * GATHER_CACHE_WAYS);
+    vector<uint64_t> tags(sets * GATHER_CACHE_WAYS, UINT64_MAX), used(sets * GATHER_CACHE_WAYS, 0);
+    uint64_t clock = 0;
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++){
+        for (size_t stream = 0; stream < streamCount; stream++){
+            uint64_t address = stream * streamBytes + (uint64_t) indices[i] * elementBytes;
+            uint64_t first = address / GATHER_CACHE_LINE, last = (address + elementBytes - 1) / GATHER_CACHE_LINE;
+            for (uint64_t line = first; line <= last; line++){
+                size_t set = line % sets;
+                uint64_t *setTags = &tags[set * GATHER_CACHE_WAYS], *setUsed = &used[set * GATHER_CACHE_WAYS];
+                clock++;
+
+                int way = -1, oldest = 0;
+                for (int w = 0; w < GATHER_CACHE_WAYS; w++){
+                    if (setTags[w] == line)
+                        way = w;
+                    if (setUsed[w] < setUsed[oldest])
+                        oldest = w;
+                }
+                if (way < 0){
+                    // Miss: evict the least recently used way
+                    misses++;
+                    way = oldest;
+                    setTags[way] = line;
+                }
+                setUsed[way] = clock;
+            }
+        }
+    }
+    return misses;
+}
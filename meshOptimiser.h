@@ -0,0 +1,50 @@
+/**
+ * Reordering of triangles and vertices for cache locality
+ *
+ * optimiseTriangleOrder() is Forsyth's linear speed vertex cache
+ * optimisation: triangles are emitted greedily by a score that favours
+ * vertices recently used (still in a simulated LRU cache) and vertices with
+ * few triangles left. firstUseVertexOrder() then renumbers the vertices in
+ * the order the triangles first touch them, so that gathering vertex data
+ * walks memory mostly forwards.
+ *
+ * averageCacheMissRatio() and gatherCacheMisses() measure the result: the
+ * misses per triangle of a FIFO post-transform cache, and the cache line
+ * misses of fetching each vertex in index order through a set associative
+ * data cache. The vertex data is modelled the way VertexArrays holds it: one
+ * array per attribute, each fetched separately for every vertex.
+ */
+
+#ifndef MESHOPTIMISER_H_
+#define MESHOPTIMISER_H_
+
+#include <cstddef>
+#include <vector>
+
+/*************** Macros *******************/
+// Entries in the LRU cache simulated while scoring
+#define VERTEX_CACHE_SIZE 32
+
+// FIFO post-transform cache used for the ACMR
+#define ACMR_CACHE_SIZE 16
+
+// Data cache used for the gather misses: 32 KiB, 8 way, 64 byte lines
+#define GATHER_CACHE_BYTES (32*1024)
+#define GATHER_CACHE_WAYS 8
+#define GATHER_CACHE_LINE 64
+
+/*************** Function Prototypes *******************/
+// order[i] is the original index of the i-th triangle to draw
+void optimiseTriangleOrder(const int *triangles, size_t triangleCount, size_t vertexCount, std::vector<int> &order);
+
+// remap[old] is the new index of each vertex; unused vertices go last, in their old order
+void firstUseVertexOrder(const int *indices, size_t indexCount, size_t vertexCount, std::vector<int> &remap);
+
+// Post-transform cache misses per triangle with a FIFO of cacheSize entries
+double averageCacheMissRatio(const int *triangles, size_t triangleCount, unsigned cacheSize);
+
+// Cache line misses of reading elementBytes of each of streamCount arrays for every index in turn.
+// Array i starts at byte i*streamBytes.
+size_t gatherCacheMisses(const int *indices, size_t indexCount, size_t streamCount, size_t streamBytes, size_t elementBytes);
+
+#endif /* MESHOPTIMISER_H_ */
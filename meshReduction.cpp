@@ -0,0 +1,61 @@
+/**
+ * Parallel reductions over structure of arrays vectors -- see meshReduction.h
+ */
+
+/*************** Includes *******************/
+#include "meshReduction.h"
+
+#include <cmath>
+#include <vector>
+
+#include "meshKernels.h"
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+struct BlockResult{
+    float minimum[3], maximum[3];
+    double sum[3];
+};
+
+// Sum of component k of blocks [first, last), halved down to single blocks
+double pairwiseSum(const vector<BlockResult> &blocks, int k, size_t first, size_t last){
+    if (last - first == 1)
+        return blocks[first].sum[k];
+    size_t middle = first + (last - first) / 2;
+    return pairwiseSum(blocks, k, first, middle) + pairwiseSum(blocks, k, middle, last);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+void reduceArrays(const float *x, const float *y, const float *z, size_t count, ThreadPool &pool,
+        ArrayStatistics &statistics){
+    for (int k = 0; k < 3; k++){
+        statistics.minimum[k] = INFINITY;
+        statistics.maximum[k] = -INFINITY;
+        statistics.mean[k] = 0;
+    }
+    if (count == 0)
+        return;
+
+    const MeshKernels &kernels = meshKernels();
+    vector<BlockResult> blocks((count + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK);
+    pool.parallelFor(blocks.size(), [&](size_t block){
+        size_t first = block * REDUCTION_BLOCK;
+        size_t length = count - first < REDUCTION_BLOCK ? count - first : REDUCTION_BLOCK;
+        BlockResult &result = blocks[block];
+        kernels.bounds(x + first, y + first, z + first, length, result.minimum, result.maximum, result.sum);
+    });
+
+    for (size_t i = 0; i < blocks.size(); i++){
+        for (int k = 0; k < 3; k++){
+            statistics.minimum[k] = blocks[i].minimum[k] < statistics.minimum[k] ? blocks[i].minimum[k] : statistics.minimum[k];
+            statistics.maximum[k] = blocks[i].maximum[k] > statistics.maximum[k] ? blocks[i].maximum[k] : statistics.maximum[k];
+        }
+    }
+    for (int k = 0; k < 3; k++)
+        statistics.mean[k] = pairwiseSum(blocks, k, 0, blocks.size()) / count;
+}
@@ -0,0 +1,37 @@
+/**
+ * Parallel reductions over structure of arrays vectors
+ *
+ * reduceArrays() gives the component wise minimum, maximum and mean of
+ * count vectors (x[i], y[i], z[i]), such as the vertex positions or the face
+ * normals of a mesh. The arrays are cut into blocks of REDUCTION_BLOCK
+ * elements, each block is reduced by the bounds kernel (see meshKernels.h)
+ * on the thread pool, and the block sums are added pairwise in block order.
+ *
+ * The blocks do not depend on the number of threads, so neither does the
+ * result. Within a block the sum is accumulated in double precision; the
+ * pairwise tree over the blocks keeps the rounding error growing with the
+ * logarithm of the block count rather than with the element count.
+ */
+
+#ifndef MESHREDUCTION_H_
+#define MESHREDUCTION_H_
+
+#include <cstddef>
+
+#include "threadPool.h"
+
+/*************** Macros *******************/
+// Elements reduced by one task; a fixed size keeps the result independent of the thread count
+#define REDUCTION_BLOCK 65536
+
+/*************** Classes *******************/
+struct ArrayStatistics{
+    float minimum[3], maximum[3];   // infinite when count is 0
+    double mean[3];                 // 0 when count is 0
+};
+
+/*************** Function Prototypes *******************/
+void reduceArrays(const float *x, const float *y, const float *z, size_t count, ThreadPool &pool,
+        ArrayStatistics &statistics);
+
+#endif /* MESHREDUCTION_H_ */
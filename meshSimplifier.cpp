@@ -0,0 +1,273 @@
+/**
+ * Quadric error mesh simplification into a chain of levels of detail -- see meshSimplifier.h
+ */
+
+/*************** Includes *******************/
+#include "meshSimplifier.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Smallest cosine between a triangle's normal before and after a collapse
+#define FLIP_COSINE 0.25
+
+/*************** Helpers *******************/
+namespace {
+
+// Symmetric 4x4 matrix of the plane equations, upper triangle only, and the number of planes
+struct Quadric{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double planes;
+
+    void clear(){
+        a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = planes = 0;
+    }
+
+    void addPlane(double a, double b, double c, double d){
+        a2 += a*a; ab += a*b; ac += a*c; ad += a*d;
+        b2 += b*b; bc += b*c; bd += b*d;
+        c2 += c*c; cd += c*d;
+        d2 += d*d;
+        planes += 1;
+    }
+
+    void add(const Quadric &obj){
+        a2 += obj.a2; ab += obj.ab; ac += obj.ac; ad += obj.ad;
+        b2 += obj.b2; bc += obj.bc; bd += obj.bd;
+        c2 += obj.c2; cd += obj.cd;
+        d2 += obj.d2;
+        planes += obj.planes;
+    }
+
+    // Mean squared distance of (x, y, z) to the planes
+    double error(double x, double y, double z) const {
+        double e = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+                + b2*y*y + 2*bc*y*z + 2*bd*y
+                + c2*z*z + 2*cd*z + d2;
+        return e > 0 && planes > 0 ? e / planes : 0;
+    }
+};
+
+// Edge u -> v: u moves onto v
+struct Collapse{
+    int u, v;
+    double cost;
+
+    bool operator<(const Collapse &obj) const {
+        return cost < obj.cost;
+    }
+};
+
+struct Mesh{
+    const float *x, *y, *z;
+
+    void normal(int a, int b, int c, double out[3]) const {
+        double ux = x[b] - x[a], uy = y[b] - y[a], uz = z[b] - z[a];
+        double vx = x[c] - x[a], vy = y[c] - y[a], vz = z[c] - z[a];
+        out[0] = uy*vz - uz*vy;
+        out[1] = uz*vx - ux*vz;
+        out[2] = ux*vy - uy*vx;
+    }
+};
+
+// Would moving u onto v flip or flatten one of u's triangles?
+bool flips(const Mesh &mesh, const vector<int> &triangles, const int *around, int aroundCount, int u, int v){
+    for (int i = 0; i < aroundCount; i++){
+        const int *t = &triangles[3*around[i]];
+        if (t[0] == v || t[1] == v || t[2] == v)
+            continue;   // collapses away
+
+        int moved[3] = {t[0], t[1], t[2]};
+        for (int k = 0; k < 3; k++)
+            moved[k] = moved[k] == u ? v : moved[k];
+
+        double before[3], after[3];
+        mesh.normal(t[0], t[1], t[2], before);
+        mesh.normal(moved[0], moved[1], moved[2], after);
+        double dot = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+        double lengths = sqrt((before[0]*before[0] + before[1]*before[1] + before[2]*before[2])
+                * (after[0]*after[0] + after[1]*after[1] + after[2]*after[2]));
+        if (lengths == 0 || dot < FLIP_COSINE * lengths)
+            return true;
+    }
+    return false;
+}
+
+// Vertices sharing one of the triangles around u, sorted
+void neighbours(const vector<int> &triangles, const int *around, int aroundCount, int u, vector<int> &out){
+    out.clear();
+    for (int i = 0; i < aroundCount; i++){
+        const int *t = &triangles[3*around[i]];
+        for (int k = 0; k < 3; k++){
+            if (t[k] != u)
+                out.push_back(t[k]);
+        }
+    }
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+// Link condition: the ends of an interior edge may only share the two
+// vertices opposite it. Any other shared neighbour would end up on two
+// triangles folded onto each other, pinching the surface.
+bool pinches(const vector<int> &aroundU, const vector<int> &aroundV){
+    size_t shared = 0;
+    for (size_t i = 0, j = 0; i < aroundU.size() && j < aroundV.size(); ){
+        if (aroundU[i] < aroundV[j])
+            i++;
+        else if (aroundV[j] < aroundU[i])
+            j++;
+        else{
+            shared++;
+            i++;
+            j++;
+        }
+    }
+    return shared > 2;
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+void buildLodChain(const VertexArrays &vertices, const vector<int> &triangles, vector<MeshLod> &levels){
+    levels.clear();
+    levels.push_back(MeshLod());
+    levels[0].triangles = triangles;
+    levels[0].error = 0;
+
+    size_t n = vertices.size();
+    Mesh mesh = {vertices.get(VERTEX_X), vertices.get(VERTEX_Y), vertices.get(VERTEX_Z)};
+
+    // One plane per triangle
+    vector<Quadric> quadrics(n);
+    for (size_t i = 0; i < n; i++)
+        quadrics[i].clear();
+    for (size_t i = 0; i < triangles.size(); i += 3){
+        double normal[3];
+        mesh.normal(triangles[i], triangles[i+1], triangles[i+2], normal);
+        double length = sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        if (length == 0)
+            continue;
+        double a = normal[0]/length, b = normal[1]/length, c = normal[2]/length;
+        int p = triangles[i];
+        double d = -(a*mesh.x[p] + b*mesh.y[p] + c*mesh.z[p]);
+        for (int k = 0; k < 3; k++)
+            quadrics[triangles[i+k]].addPlane(a, b, c, d);
+    }
+
+    vector<int> current = triangles;
+    size_t target = current.size() / 3 / 2;
+    double maxCost = 0;
+
+    vector<uint64_t> edges;
+    vector<char> locked(n), touched(n);
+    vector<Collapse> collapses;
+    vector<int> aroundOffsets(n + 1), around, neighboursU, neighboursV;
+
+    while (levels.size() < LOD_MAX_LEVELS && current.size() / 3 >= LOD_MIN_TRIANGLES){
+        size_t triangleCount = current.size() / 3;
+
+        // Edges as (low, high) keys; boundary and non-manifold ones lock their vertices
+        edges.clear();
+        for (size_t i = 0; i < current.size(); i += 3){
+            for (int k = 0; k < 3; k++){
+                uint64_t a = current[i+k], b = current[i + (k+1)%3];
+                edges.push_back(a < b ? (a << 32 | b) : (b << 32 | a));
+            }
+        }
+        sort(edges.begin(), edges.end());
+
+        fill(locked.begin(), locked.end(), 0);
+        collapses.clear();
+        for (size_t i = 0; i < edges.size(); ){
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i])
+                j++;
+            int a = edges[i] >> 32, b = edges[i] & 0xffffffffu;
+            if (j - i != 2){
+                locked[a] = locked[b] = 1;
+            }
+            else{
+                Quadric sum = quadrics[a];
+                sum.add(quadrics[b]);
+                Collapse ab = {a, b, sum.error(mesh.x[b], mesh.y[b], mesh.z[b])};
+                Collapse ba = {b, a, sum.error(mesh.x[a], mesh.y[a], mesh.z[a])};
+                collapses.push_back(ba < ab ? ba : ab);
+                collapses.push_back(ba < ab ? ab : ba);     // used if the cheaper end is locked
+            }
+            i = j;
+        }
+        sort(collapses.begin(), collapses.end());
+
+        // Triangles around each vertex
+        fill(aroundOffsets.begin(), aroundOffsets.end(), 0);
+        for (size_t i = 0; i < current.size(); i++)
+            aroundOffsets[current[i] + 1]++;
+        for (size_t i = 0; i < n; i++)
+            aroundOffsets[i+1] += aroundOffsets[i];
+        around.resize(current.size());
+        vector<int> position(aroundOffsets.begin(), aroundOffsets.end() - 1);
+        for (size_t i = 0; i < current.size(); i++)
+            around[position[current[i]]++] = i / 3;
+
+        // An independent set of the cheapest collapses, about enough to reach the target
+        fill(touched.begin(), touched.end(), 0);
+        vector<int> remap;
+        size_t budget = (triangleCount - target + 1) / 2, done = 0;
+        for (size_t i = 0; i < collapses.size() && done < budget; i++){
+            const Collapse &collapse = collapses[i];
+            int u = collapse.u, v = collapse.v;
+            if (locked[u] || touched[u] || touched[v])
+                continue;
+            const int *aroundU = &around[aroundOffsets[u]];
+            int aroundCount = aroundOffsets[u+1] - aroundOffsets[u];
+            if (flips(mesh, current, aroundU, aroundCount, u, v))
+                continue;
+            neighbours(current, aroundU, aroundCount, u, neighboursU);
+            neighbours(current, &around[aroundOffsets[v]], aroundOffsets[v+1] - aroundOffsets[v], v, neighboursV);
+            if (pinches(neighboursU, neighboursV))
+                continue;
+
+            if (remap.empty()){
+                remap.resize(n);
+                for (size_t j = 0; j < n; j++)
+                    remap[j] = j;
+            }
+            remap[u] = v;
+            quadrics[v].add(quadrics[u]);
+            maxCost = collapse.cost > maxCost ? collapse.cost : maxCost;
+
+            // Everything sharing a triangle with u changes this pass
+            for (int j = 0; j < aroundCount; j++){
+                const int *t = &current[3*aroundU[j]];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = 1;
+            }
+            done++;
+        }
+        if (done == 0)
+            break;      // nothing left that can be collapsed
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t out = 0;
+        for (size_t i = 0; i < current.size(); i += 3){
+            int a = remap[current[i]], b = remap[current[i+1]], c = remap[current[i+2]];
+            if (a == b || b == c || a == c)
+                continue;
+            current[out++] = a;
+            current[out++] = b;
+            current[out++] = c;
+        }
+        current.resize(out);
+
+        if (current.size() / 3 <= target){
+            levels.push_back(MeshLod());
+            levels.back().triangles = current;
+            levels.back().error = sqrt(maxCost);
+            target = current.size() / 3 / 2;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/**
+ * Quadric error mesh simplification into a chain of levels of detail
+ *
+ * Edges are collapsed onto one of their end points (half edge collapses),
+ * cheapest first by the quadric error metric of Garland and Heckbert, so
+ * every level indexes a subset of the original vertices and all levels can
+ * share one vertex buffer. Each pass collapses an independent set of edges;
+ * a level is recorded whenever the triangle count drops below half of the
+ * previous level.
+ *
+ * Vertices on a boundary edge (one triangle) or a non-manifold edge are
+ * never moved. Texture seams in a VTK mesh are duplicated vertices, which
+ * makes them boundaries, so seams and outlines stay exactly in place.
+ * Collapses that would flip or degenerate a triangle are rejected, and so
+ * are those whose ends share more than the two vertices opposite the edge
+ * (the link condition), which would fold the surface onto itself.
+ */
+
+#ifndef MESHSIMPLIFIER_H_
+#define MESHSIMPLIFIER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+// Stop once a level has fewer triangles than this
+#define LOD_MIN_TRIANGLES 256
+
+// Most levels built, including the full mesh
+#define LOD_MAX_LEVELS 8
+
+/*************** Classes *******************/
+struct MeshLod{
+    std::vector<int> triangles;     // three indices per triangle into the original vertices
+    float error;                    // largest collapse error, as an RMS distance to the original planes
+};
+
+/*************** Function Prototypes *******************/
+// levels[0] is triangles itself with no error; each following level has at most half the triangles
+void buildLodChain(const VertexArrays &vertices, const std::vector<int> &triangles, std::vector<MeshLod> &levels);
+
+#endif /* MESHSIMPLIFIER_H_ */
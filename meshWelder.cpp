@@ -0,0 +1,225 @@
+/**
+ * Welding of coincident points into single vertices -- see meshWelder.h
+ */
+
+/*************** Includes *******************/
+#include "meshWelder.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Bits of each cell coordinate in a cell key; grids wider than this wrap around
+#define WELD_CELL_BITS 21
+// Never a cell key, which uses 3*WELD_CELL_BITS bits
+#define EMPTY_CELL (~0ull)
+
+/*************** Helpers *******************/
+namespace {
+
+struct CellPoint{
+    uint64_t cell;
+    int point;
+
+    bool operator<(const CellPoint &other) const {
+        return cell < other.cell || (cell == other.cell && point < other.point);
+    }
+};
+
+// Cells that wrap onto the same key only cost a distance test
+uint64_t cellKey(int64_t x, int64_t y, int64_t z){
+    const uint64_t mask = (1ull << WELD_CELL_BITS) - 1;
+    return (((uint64_t) x & mask) << (2*WELD_CELL_BITS)) | (((uint64_t) y & mask) << WELD_CELL_BITS) | ((uint64_t) z & mask);
+}
+
+// Points [first, last) of the sorted points are in cell key
+struct CellRun{
+    uint64_t key;
+    uint32_t first, last;
+};
+
+// Open addressing table from cell keys to their runs of points
+struct CellTable{
+    vector<CellRun> runs;
+    uint64_t mask;
+    int shift;
+
+    explicit CellTable(size_t cells){
+        size_t size = 2;
+        shift = 63;
+        while (size < 2*cells){
+            size *= 2;
+            shift--;
+        }
+        CellRun empty = {EMPTY_CELL, 0, 0};
+        runs.assign(size, empty);
+        mask = size - 1;
+    }
+
+    CellRun &find(uint64_t key){
+        size_t i = (key * 0x9E3779B97F4A7C15ull) >> shift;
+        while (runs[i].key != key && runs[i].key != EMPTY_CELL)
+            i = (i + 1) & mask;
+        return runs[i];
+    }
+};
+
+// Cell of a position, and along each axis the neighbouring cell nearer to it.
+// Anything not finite goes in cell 0, where it matches nothing.
+void cellOf(const float *position, double inverse, int64_t cell[3], int side[3]){
+    for (int k = 0; k < 3; k++){
+        double scaled = position[k] * inverse, c = floor(scaled);
+        cell[k] = c > -4e18 && c < 4e18 ? (int64_t) c : 0;
+        side[k] = scaled - c < 0.5 ? -1 : 1;
+    }
+}
+
+bool weldable(const VtkPolyData &data, size_t p, size_t q, float epsilon2, float uvEpsilon){
+    const float *a = &data.points[3*p], *b = &data.points[3*q];
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    if (!(dx*dx + dy*dy + dz*dz <= epsilon2))
+        return false;
+
+    bool textured = p < data.textureCount;
+    if (textured != (q < data.textureCount))
+        return false;
+    return !textured || (fabs(data.textures[2*p] - data.textures[2*q]) <= uvEpsilon
+            && fabs(data.textures[2*p+1] - data.textures[2*q+1]) <= uvEpsilon);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+size_t weldPoints(const VtkPolyData &data, float epsilon, float uvEpsilon, ThreadPool &pool, vector<int> &remap){
+    size_t n = data.pointCount;
+    remap.resize(n);
+    if (!(epsilon > 0)){
+        for (size_t i = 0; i < n; i++)
+            remap[i] = i;
+        return n;
+    }
+
+    // Every point in its cell, sorted by cell a block at a time and then merged pairwise.
+    // Cells are twice epsilon wide, so a point only has to look at the 8 cells nearest it.
+    double inverse = 0.5 / epsilon;
+    size_t blocks = (n + WELD_BLOCK - 1) / WELD_BLOCK;
+    vector<CellPoint> sorted(n);
+    pool.parallelFor(blocks, [&](size_t block){
+        size_t first = block * WELD_BLOCK, last = min(first + WELD_BLOCK, n);
+        for (size_t i = first; i < last; i++){
+            int64_t cell[3];
+            int side[3];
+            cellOf(&data.points[3*i], inverse, cell, side);
+            sorted[i].cell = cellKey(cell[0], cell[1], cell[2]);
+            sorted[i].point = i;
+        }
+        sort(sorted.begin() + first, sorted.begin() + last);
+    });
+    for (size_t width = WELD_BLOCK; width < n; width *= 2){
+        pool.parallelFor((n + 2*width - 1) / (2*width), [&](size_t merge){
+            size_t first = merge * 2*width, middle = min(first + width, n), last = min(first + 2*width, n);
+            inplace_merge(sorted.begin() + first, sorted.begin() + middle, sorted.begin() + last);
+        });
+    }
+
+    // Where each cell's points are
+    size_t cells = 0;
+    for (size_t i = 0; i < n; i++)
+        cells += i == 0 || sorted[i].cell != sorted[i-1].cell;
+    CellTable table(cells);
+    for (size_t i = 0; i < n; i++){
+        CellRun &run = table.find(sorted[i].cell);
+        if (run.key == EMPTY_CELL){
+            run.key = sorted[i].cell;
+            run.first = i;
+        }
+        run.last = i + 1;
+    }
+
+    // The lowest numbered point within reach of each point, or the point itself
+    vector<int> lowest(n);
+    float epsilon2 = epsilon * epsilon;
+    pool.parallelFor(blocks, [&](size_t block){
+        size_t first = block * WELD_BLOCK, last = min(first + WELD_BLOCK, n);
+        for (size_t p = first; p < last; p++){
+            int64_t cell[3];
+            int side[3];
+            cellOf(&data.points[3*p], inverse, cell, side);
+            size_t best = p;
+            for (int neighbour = 0; neighbour < 8; neighbour++){
+                const CellRun &run = table.find(cellKey(cell[0] + (neighbour & 1 ? side[0] : 0),
+                        cell[1] + (neighbour & 2 ? side[1] : 0), cell[2] + (neighbour & 4 ? side[2] : 0)));
+                // Points of a cell are sorted, so only those below best need a look
+                for (size_t i = run.first; i < run.last && (size_t) sorted[i].point < best; i++){
+                    if (weldable(data, p, sorted[i].point, epsilon2, uvEpsilon))
+                        best = sorted[i].point;
+                }
+            }
+            lowest[p] = best;
+        }
+    });
+
+    // Following lowest from any point ends at the lowest point of its vertex, which comes first
+    size_t count = 0;
+    for (size_t p = 0; p < n; p++)
+        remap[p] = (size_t) lowest[p] == p ? count++ : remap[lowest[p]];
+    return count;
+}
+
+void applyWeld(VtkPolyData &data, const vector<int> &remap, size_t vertexCount, WeldStats &stats){
+    size_t n = data.pointCount;
+    stats.points = n;
+    stats.vertices = vertexCount;
+    stats.polygons = data.polygonCount;
+    stats.droppedPolygons = 0;
+    stats.cellsBefore = data.cells.size();
+
+    // The lowest point of each vertex stays; vertices are numbered in the order of those
+    if (vertexCount < n){
+        vector<float> points(3*vertexCount), textures(data.textureCount > 0 ? 2*vertexCount : 0, 0.f);
+        size_t kept = 0;
+        for (size_t p = 0; p < n; p++){
+            if ((size_t) remap[p] != kept)
+                continue;
+            copy(&data.points[3*p], &data.points[3*p] + 3, &points[3*kept]);
+            if (p < data.textureCount)
+                copy(&data.textures[2*p], &data.textures[2*p] + 2, &textures[2*kept]);
+            kept++;
+        }
+        data.points.swap(points);
+        data.textures.swap(textures);
+        data.pointCount = vertexCount;
+        data.textureCount = data.textureCount > 0 ? vertexCount : 0;
+    }
+
+    // Renumbered polygons without repeated corners. Invalid indices are left for the loader to report.
+    vector<int> cells;
+    cells.reserve(data.cells.size());
+    for (size_t i = 0; i < data.cells.size(); i += data.cells[i] + 1){
+        size_t start = cells.size();
+        cells.push_back(0);
+        for (int j = 1; j <= data.cells[i]; j++){
+            int index = data.cells[i + j];
+            int vertex = index >= 0 && (size_t) index < n ? remap[index] : index;
+            if (cells.size() == start + 1 || vertex != cells.back())
+                cells.push_back(vertex);
+        }
+        while (cells.size() > start + 2 && cells.back() == cells[start + 1])
+            cells.pop_back();
+
+        size_t corners = cells.size() - start - 1;
+        if (corners < 3){
+            cells.resize(start);
+            stats.droppedPolygons++;
+        }
+        else{
+            cells[start] = corners;
+        }
+    }
+    data.cells.swap(cells);
+    data.polygonCount -= stats.droppedPolygons;
+    stats.cellsAfter = data.cells.size();
+}
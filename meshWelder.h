@@ -0,0 +1,49 @@
+/**
+ * Welding of coincident points into single vertices
+ *
+ * Scanners write each patch of a surface with points of its own, so the
+ * seams between patches have the same position two or more times over. The
+ * copies split the surface for the vertex normal averaging, which shows as a
+ * crease along the seam, and each copy is stored and uploaded separately.
+ *
+ * weldPoints() hashes every point into a grid of cells twice epsilon wide
+ * and sorts the points by cell, in blocks of WELD_BLOCK points on the thread
+ * pool. Each point then looks through the 8 cells nearest to it for the
+ * lowest numbered point within epsilon; the lowest point of a chain
+ * of such points is the one the welded vertex keeps. Points whose texture
+ * coordinates differ by more than uvEpsilon are never welded, so texture
+ * seams stay split. The result does not depend on the number of threads.
+ *
+ * applyWeld() then keeps one point per vertex, renumbers the polygons and
+ * drops those left with fewer than three distinct corners.
+ */
+
+#ifndef MESHWELDER_H_
+#define MESHWELDER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "threadPool.h"
+#include "vtkParser.h"
+
+/*************** Macros *******************/
+// Points hashed, sorted or matched by one task
+#define WELD_BLOCK 16384
+
+/*************** Classes *******************/
+struct WeldStats{
+    size_t points, vertices;                // before and after
+    size_t polygons, droppedPolygons;       // polygons before, and how many were degenerate
+    size_t cellsBefore, cellsAfter;         // size of the POLYGONS section
+};
+
+/*************** Function Prototypes *******************/
+// Vertex of each point in remap, numbered in order of their lowest point; returns the number of vertices.
+// With epsilon <= 0 every point is a vertex of its own.
+size_t weldPoints(const VtkPolyData &data, float epsilon, float uvEpsilon, ThreadPool &pool, std::vector<int> &remap);
+
+// Rewrite data with the vertexCount vertices of remap, see weldPoints()
+void applyWeld(VtkPolyData &data, const std::vector<int> &remap, size_t vertexCount, WeldStats &stats);
+
+#endif /* MESHWELDER_H_ */
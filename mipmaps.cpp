@@ -0,0 +1,131 @@
+/**
+ * Mip chains built on the CPU -- see mipmaps.h
+ */
+
+/*************** Includes *******************/
+#include "mipmaps.h"
+#include "textureCache.h"
+#include "threadPool.h"
+
+#if defined(__SSE2__)
+#define MIPMAPS_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+// Source texels covered by one target texel along an axis, with their weights
+struct Footprint{
+    unsigned first, count;
+    float weights[3];   // a target texel covers at most three source texels when halving or less
+};
+
+void footprints(unsigned sourceSize, unsigned size, vector<Footprint> &out){
+    out.resize(size);
+    double scale = (double) sourceSize / size;
+    for (unsigned i = 0; i < size; i++){
+        double begin = i * scale, end = (i + 1) * scale;
+        Footprint &footprint = out[i];
+        footprint.first = (unsigned) begin;
+        footprint.count = 0;
+        for (unsigned s = footprint.first; s < end && s < sourceSize && footprint.count < 3; s++){
+            double overlap = (s + 1 < end ? s + 1 : end) - (s > begin ? s : begin);
+            footprint.weights[footprint.count++] = overlap / scale;
+        }
+    }
+}
+
+// Exact halving of one row pair: (a + b + c + d + 2) / 4 per channel
+void halveRow(const unsigned char *top, const unsigned char *bottom, unsigned char *target, unsigned width,
+        vector<unsigned short> &sums){
+    size_t bytes = 6 * (size_t) width;     // source bytes used
+    sums.resize(bytes);
+    size_t i = 0;
+#ifdef MIPMAPS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= bytes; i += 16){
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + i));
+        __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&sums[i]), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&sums[i + 8]), high);
+    }
+#endif
+    for (; i < bytes; i++)
+        sums[i] = top[i] + bottom[i];
+
+    for (unsigned x = 0; x < width; x++){
+        const unsigned short *pair = &sums[6*x];
+        for (int c = 0; c < 3; c++)
+            target[3*x + c] = (pair[c] + pair[c + 3] + 2) >> 2;
+    }
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+unsigned mipLevelCount(unsigned width, unsigned height){
+    unsigned levels = 1;
+    while (width > 1 || height > 1){
+        width = mipSize(width, 1);
+        height = mipSize(height, 1);
+        levels++;
+    }
+    return levels;
+}
+
+void downsampleRgb(const unsigned char *source, unsigned sourceWidth, unsigned sourceHeight,
+        unsigned char *target, unsigned width, unsigned height, ThreadPool &pool){
+    size_t sourceStride = 3 * (size_t) sourceWidth, stride = 3 * (size_t) width;
+
+    if (sourceWidth == 2*width && sourceHeight == 2*height){
+        pool.parallelFor(height, [&](size_t y){
+            vector<unsigned short> sums;
+            const unsigned char *top = source + 2*y*sourceStride;
+            halveRow(top, top + sourceStride, target + y*stride, width, sums);
+        });
+        return;
+    }
+
+    // Separable area weights: columns then rows
+    vector<Footprint> columns, rows;
+    footprints(sourceWidth, width, columns);
+    footprints(sourceHeight, height, rows);
+    pool.parallelFor(height, [&](size_t y){
+        const Footprint &row = rows[y];
+        vector<float> sums(3 * (size_t) sourceWidth, 0.f);
+        for (unsigned k = 0; k < row.count; k++){
+            const unsigned char *line = source + (row.first + k)*sourceStride;
+            for (size_t i = 0; i < sourceStride; i++)
+                sums[i] += row.weights[k] * line[i];
+        }
+        unsigned char *out = target + y*stride;
+        for (unsigned x = 0; x < width; x++){
+            const Footprint &column = columns[x];
+            for (int c = 0; c < 3; c++){
+                float value = 0.5f;
+                for (unsigned k = 0; k < column.count; k++)
+                    value += column.weights[k] * sums[3*(column.first + k) + c];
+                out[3*x + c] = value >= 255.f ? 255 : (unsigned char) value;
+            }
+        }
+    });
+}
+
+void buildMipChain(const unsigned char *texels, unsigned width, unsigned height, ThreadPool &pool,
+        vector< vector<unsigned char> > &levels){
+    unsigned count = mipLevelCount(width, height);
+    levels.resize(count - 1);
+    const unsigned char *source = texels;
+    for (unsigned level = 1; level < count; level++){
+        unsigned w = mipSize(width, level), h = mipSize(height, level);
+        vector<unsigned char> &target = levels[level - 1];
+        target.resize(3 * (size_t) w * h);
+        downsampleRgb(source, mipSize(width, level - 1), mipSize(height, level - 1), target.data(), w, h, pool);
+        source = target.data();
+    }
+}
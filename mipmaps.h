@@ -0,0 +1,31 @@
+/**
+ * Mip chains built on the CPU
+ *
+ * Each level is a box filter of the one above it: every texel is the area
+ * weighted mean of the texels it covers, so odd and non power of two sizes
+ * are filtered properly instead of dropping a row or column. When both sizes
+ * halve exactly this is the plain 2x2 mean, whose vertical sums use SSE2.
+ * Rows are filtered in parallel on the thread pool.
+ */
+
+#ifndef MIPMAPS_H_
+#define MIPMAPS_H_
+
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+/*************** Function Prototypes *******************/
+// Levels in a full chain down to 1 x 1, level 0 included
+unsigned mipLevelCount(unsigned width, unsigned height);
+
+// Filter RGB texels of sourceWidth x sourceHeight into width x height, each 1/3 to 1 times the source size
+void downsampleRgb(const unsigned char *source, unsigned sourceWidth, unsigned sourceHeight,
+        unsigned char *target, unsigned width, unsigned height, ThreadPool &pool);
+
+// Levels 1 onwards of the chain of an RGB image; levels[i] is level i + 1
+void buildMipChain(const unsigned char *texels, unsigned width, unsigned height, ThreadPool &pool,
+        std::vector< std::vector<unsigned char> > &levels);
+
+#endif /* MIPMAPS_H_ */
@@ -0,0 +1,220 @@
+/**
+ * Flat (CSR) storage for the polygons of a mesh
+ *
+ * All the vertex indices live in one array, and polygon i is
+ * indices[offsets[i]] .. indices[offsets[i+1]-1]. When every polygon is a
+ * triangle the offsets array is dropped and polygon i starts at 3*i.
+ *
+ * The arrays are either owned by the list or borrowed from elsewhere (e.g.
+ * the mmap'd mesh cache or a MeshArena). Polygons are handed out as views,
+ * so iterating never allocates or copies.
+ */
+
+#ifndef POLYGONLIST_H_
+#define POLYGONLIST_H_
+
+#include <cstddef>
+#include <vector>
+
+/*************** Classes *******************/
+// View of the vertex indices of one polygon
+class Polygon{
+    const int *indices;
+    int count;
+public:
+    Polygon(const int *indices, int count): indices(indices), count(count){}
+
+    const int *begin() const {
+        return indices;
+    }
+
+    const int *end() const {
+        return indices + count;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    int operator[](int i) const {
+        return indices[i];
+    }
+};
+
+class PolygonList{
+    std::vector<int> offsetStorage, indexStorage;   // only used when the arrays are owned
+    int *offsets;   // polygonCount+1 entries, NULL when every polygon is a triangle
+    int *indices;
+    size_t polygonCount, indexCount;
+
+    // Disallow copying -- the pointers may refer to the storage vectors
+    PolygonList(const PolygonList &);
+    PolygonList &operator=(const PolygonList &);
+
+    // Point at the owned storage, dropping the offsets for an all-triangle list
+    void useStorage(){
+        polygonCount = offsetStorage.empty() ? 0 : offsetStorage.size() - 1;
+        indexCount = indexStorage.size();
+
+        bool triangles = indexCount == 3*polygonCount;
+        for (size_t i = 0; triangles && i < polygonCount; i++)
+            triangles = offsetStorage[i+1] - offsetStorage[i] == 3;
+        if (triangles)
+            std::vector<int>().swap(offsetStorage);
+
+        offsets = offsetStorage.empty() ? NULL : offsetStorage.data();
+        indices = indexStorage.data();
+    }
+public:
+    PolygonList(): offsets(NULL), indices(NULL), polygonCount(0), indexCount(0){}
+
+    // Total indices of a VTK POLYGONS section, and whether every polygon in it is a triangle
+    static size_t cellIndexCount(const int *cells, size_t count, bool &triangles){
+        size_t total = 0;
+        triangles = true;
+        for (const int *cell = cells; count > 0; count--){
+            total += *cell;
+            triangles = triangles && *cell == 3;
+            cell += 1 + *cell;
+        }
+        return total;
+    }
+
+    // Build from a VTK POLYGONS section into arrays owned elsewhere, sized by cellIndexCount().
+    // newOffsets takes count+1 entries and may be NULL if every polygon is a triangle.
+    void assignCells(const int *cells, size_t count, int *newOffsets, int *newIndices){
+        std::vector<int>().swap(offsetStorage);
+        std::vector<int>().swap(indexStorage);
+        bool triangles;
+        size_t total = cellIndexCount(cells, count, triangles);
+
+        int *out = newIndices;
+        size_t written = 0;
+        for (size_t i = 0; i < count; i++){
+            if (!triangles)
+                newOffsets[i] = written;
+            int n = *cells++;
+            for (int j = 0; j < n; j++)
+                *out++ = *cells++;
+            written += n;
+        }
+        if (!triangles)
+            newOffsets[count] = written;
+        attach(triangles ? NULL : newOffsets, newIndices, count, total);
+    }
+
+    // Build from a VTK POLYGONS section: n, i0, ..., i(n-1) for each polygon
+    void assignCells(const int *cells, size_t count){
+        offsetStorage.clear();
+        indexStorage.clear();
+        offsetStorage.reserve(count + 1);
+        offsetStorage.push_back(0);
+
+        const int *cell = cells;
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++){
+            total += *cell;
+            offsetStorage.push_back(total);
+            cell += 1 + *cell;
+        }
+
+        indexStorage.resize(total);
+        cell = cells;
+        for (size_t i = 0; i < count; i++){
+            int *out = &indexStorage[offsetStorage[i]];
+            for (int n = *cell++; n > 0; n--)
+                *out++ = *cell++;
+        }
+        useStorage();
+    }
+
+    // Take over prebuilt arrays; offsets holds polygonCount+1 entries starting at 0
+    void assign(std::vector<int> &newOffsets, std::vector<int> &newIndices){
+        offsetStorage.swap(newOffsets);
+        indexStorage.swap(newIndices);
+        useStorage();
+    }
+
+    // Refer to arrays owned elsewhere. offsets may be NULL for an all-triangle list.
+    void attach(int *newOffsets, int *newIndices, size_t count, size_t total){
+        std::vector<int>().swap(offsetStorage);
+        std::vector<int>().swap(indexStorage);
+        offsets = newOffsets;
+        indices = newIndices;
+        polygonCount = count;
+        indexCount = total;
+    }
+
+    void clear(){
+        std::vector<int>().swap(offsetStorage);
+        std::vector<int>().swap(indexStorage);
+        offsets = indices = NULL;
+        polygonCount = indexCount = 0;
+    }
+
+    // Number of polygons
+    size_t size() const {
+        return polygonCount;
+    }
+
+    bool empty() const {
+        return polygonCount == 0;
+    }
+
+    // Total number of indices over all polygons
+    size_t getIndexCount() const {
+        return indexCount;
+    }
+
+    // Every polygon is a triangle and getOffsets() is NULL
+    bool isTriangles() const {
+        return offsets == NULL;
+    }
+
+    // Start of polygon i in getIndices()
+    size_t offset(size_t i) const {
+        return offsets == NULL ? 3*i : offsets[i];
+    }
+
+    Polygon operator[](size_t i) const {
+        if (offsets == NULL)
+            return Polygon(indices + 3*i, 3);
+        return Polygon(indices + offsets[i], offsets[i+1] - offsets[i]);
+    }
+
+    const int *getOffsets() const {
+        return offsets;
+    }
+
+    int *getOffsets(){
+        return offsets;
+    }
+
+    // Split every polygon into a fan of triangles, three indices per triangle
+    void triangulate(std::vector<int> &triangles) const {
+        triangles.clear();
+        if (offsets == NULL){
+            triangles.assign(indices, indices + indexCount);
+            return;
+        }
+        triangles.reserve(3*(indexCount - 2*polygonCount));
+        for (size_t i = 0; i < polygonCount; i++){
+            const int *polygon = indices + offsets[i];
+            for (int j = 2; j < offsets[i+1] - offsets[i]; j++){
+                triangles.push_back(polygon[0]);
+                triangles.push_back(polygon[j-1]);
+                triangles.push_back(polygon[j]);
+            }
+        }
+    }
+
+    const int *getIndices() const {
+        return indices;
+    }
+
+    int *getIndices(){
+        return indices;
+    }
+};
+
+#endif /* POLYGONLIST_H_ */
@@ -0,0 +1,182 @@
+/**
+ * Scoped timers and counters -- see profiler.h
+ */
+
+/*************** Includes *******************/
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+// A name as a JSON string
+void writeName(FILE *out, const char *name){
+    fputc('"', out);
+    for (const char *c = name; *c != '\0'; c++){
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        if ((unsigned char) *c >= 0x20)
+            fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+void Profiler::ThreadBuffer::add(const Event &event){
+    if (events.size() < PROFILE_MAX_EVENTS){
+        events.push_back(event);
+        return;
+    }
+    events[next] = event;
+    next = (next + 1) % events.size();
+    dropped++;
+}
+
+void Profiler::ThreadBuffer::addStage(const char *name, size_t calls, double seconds){
+    // Few names per thread, compared by pointer
+    size_t i = 0;
+    while (i < stages.size() && stages[i].name != name)
+        i++;
+    if (i == stages.size()){
+        ProfileStage stage = {name, 0, 0.0};
+        stages.push_back(stage);
+    }
+    stages[i].calls += calls;
+    stages[i].seconds += seconds;
+}
+
+Profiler::ThreadRegistration::~ThreadRegistration(){
+    if (owner != NULL)
+        owner->retire(buffer);
+}
+
+Profiler::Profiler(): epoch(clock()), threadCount(0){}
+
+Profiler &Profiler::global(){
+    // Never destroyed, as pool threads may still record while statics are torn down
+    static Profiler *profiler = new Profiler();
+    return *profiler;
+}
+
+uint64_t Profiler::clock(){
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::ThreadBuffer &Profiler::threadBuffer(){
+    // One buffer per thread and profiler, handed back by retire() when the thread exits
+    static thread_local ThreadRegistration registration;
+    if (registration.owner != this){
+        if (registration.owner != NULL)
+            registration.owner->retire(registration.buffer);
+        lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+        registration.buffer = buffers.back().get();
+        registration.buffer->id = ++threadCount;
+        registration.owner = this;
+    }
+    return *registration.buffer;
+}
+
+void Profiler::retire(ThreadBuffer *buffer){
+    lock_guard<std::mutex> lock(buffersMutex);
+    size_t b = 0;
+    while (b < buffers.size() && buffers[b].get() != buffer)
+        b++;
+    if (b == buffers.size())
+        return;
+    {
+        lock_guard<std::mutex> finishedLock(finished.mutex);
+        for (size_t i = 0; i < buffer->events.size(); i++)
+            finished.add(buffer->events[(buffer->next + i) % buffer->events.size()]);
+        for (size_t s = 0; s < buffer->stages.size(); s++)
+            finished.addStage(buffer->stages[s].name, buffer->stages[s].calls, buffer->stages[s].seconds);
+        finished.dropped += buffer->dropped;
+    }
+    buffers.erase(buffers.begin() + b);
+}
+
+void Profiler::record(const char *name, uint64_t start, uint64_t end){
+    ThreadBuffer &buffer = threadBuffer();
+    lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.addStage(name, 1, (end - start) * 1e-9);
+    Event event = {name, start, end - start, 0.0, buffer.id, false};
+    buffer.add(event);
+}
+
+void Profiler::counter(const char *name, double value){
+    ThreadBuffer &buffer = threadBuffer();
+    lock_guard<std::mutex> lock(buffer.mutex);
+    Event event = {name, now(), 0, value, buffer.id, true};
+    buffer.add(event);
+}
+
+void Profiler::stages(vector<ProfileStage> &out){
+    out.clear();
+    lock_guard<std::mutex> lock(buffersMutex);
+    for (size_t b = 0; b <= buffers.size(); b++){
+        ThreadBuffer &buffer = b < buffers.size() ? *buffers[b] : finished;
+        lock_guard<std::mutex> bufferLock(buffer.mutex);
+        for (size_t s = 0; s < buffer.stages.size(); s++){
+            const ProfileStage &stage = buffer.stages[s];
+            size_t i = 0;
+            while (i < out.size() && strcmp(out[i].name, stage.name) != 0)
+                i++;
+            if (i == out.size())
+                out.push_back(stage);
+            else{
+                out[i].calls += stage.calls;
+                out[i].seconds += stage.seconds;
+            }
+        }
+        buffer.stages.clear();
+    }
+}
+
+bool Profiler::writeTrace(const string &path, string &error){
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == NULL){
+        error = "Unable to open trace file " + path;
+        return false;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+    bool first = true;
+    size_t dropped = 0;
+    lock_guard<std::mutex> lock(buffersMutex);
+    for (size_t b = 0; b <= buffers.size(); b++){
+        ThreadBuffer &buffer = b < buffers.size() ? *buffers[b] : finished;
+        lock_guard<std::mutex> bufferLock(buffer.mutex);
+        dropped += buffer.dropped;
+        for (size_t i = 0; i < buffer.events.size(); i++){
+            const Event &event = buffer.events[(buffer.next + i) % buffer.events.size()];
+            fputs(first ? "\n" : ",\n", out);
+            first = false;
+            fputs("{\"name\":", out);
+            writeName(out, event.name);
+            // Timestamps are in microseconds
+            if (event.isCounter){
+                fprintf(out, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"value\":%g}}",
+                        event.start * 1e-3, event.thread, event.value);
+            }
+            else{
+                fprintf(out, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                        event.start * 1e-3, event.duration * 1e-3, event.thread);
+            }
+        }
+    }
+    fprintf(out, "\n],\"otherData\":{\"droppedEvents\":%zu}}\n", dropped);
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0 || !ok){
+        error = "Unable to write trace file " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,147 @@
+/**
+ * Scoped timers and counters for the hot paths
+ *
+ * PROFILE_SCOPE("name") times the rest of the enclosing block and
+ * PROFILE_COUNTER("name", value) samples a value. Both record into a buffer
+ * of the calling thread, so timing a worker costs no lock held by anyone
+ * else. Names must be string literals: only the pointer is stored.
+ *
+ * Each buffer is a ring of the most recent events. When its thread exits,
+ * the events and totals move into one ring shared by the finished threads
+ * and the buffer is freed, so short lived threads such as the reload tasks
+ * cost no memory once they are done.
+ *
+ * Building with -DPROFILING=0 turns both macros into nothing. The Profiler
+ * is still there but stays empty.
+ *
+ * The events can be written as a Chrome trace_event JSON file, which
+ * chrome://tracing and Perfetto open, and summed per name for a stats
+ * display.
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*************** Macros *******************/
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+// Events kept per thread, and for all finished threads; older ones are counted and overwritten
+#define PROFILE_MAX_EVENTS (1u << 16)
+
+#if PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::global().counter(name, value)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNTER(name, value) do {} while (0)
+#endif
+
+/*************** Classes *******************/
+// Time spent in one name since the last Profiler::stages() call
+struct ProfileStage{
+    const char *name;
+    size_t calls;
+    double seconds;
+};
+
+class Profiler{
+    struct Event{
+        const char *name;
+        uint64_t start;     // nanoseconds since the profiler started
+        uint64_t duration;  // nanoseconds; unused by counters
+        double value;       // counters only
+        unsigned thread;    // id of the thread that recorded it
+        bool isCounter;
+    };
+
+    // Everything one thread recorded. The mutex is only contended while exporting.
+    struct ThreadBuffer{
+        std::mutex mutex;
+        unsigned id;
+        std::vector<Event> events;  // a ring once full, oldest at next
+        size_t next;
+        std::vector<ProfileStage> stages;
+        size_t dropped;
+
+        ThreadBuffer(): id(0), next(0), dropped(0){}
+
+        // Append, overwriting the oldest event once PROFILE_MAX_EVENTS are kept
+        void add(const Event &event);
+
+        // Add calls and time to the totals of a name
+        void addStage(const char *name, size_t calls, double seconds);
+    };
+
+    // Hands the buffer of the calling thread back when the thread exits
+    struct ThreadRegistration{
+        Profiler *owner;
+        ThreadBuffer *buffer;
+
+        ThreadRegistration(): owner(NULL), buffer(NULL){}
+        ~ThreadRegistration();
+    };
+
+    uint64_t epoch;
+    std::mutex buffersMutex;
+    std::vector< std::unique_ptr<ThreadBuffer> > buffers;
+    ThreadBuffer finished;  // what exited threads recorded
+    unsigned threadCount;
+
+    // Disallow copying
+    Profiler(const Profiler &);
+    Profiler &operator=(const Profiler &);
+
+    ThreadBuffer &threadBuffer();
+    void retire(ThreadBuffer *buffer);  // move a buffer into finished and free it
+    static uint64_t clock();
+public:
+    Profiler();
+
+    // Nanoseconds since the profiler started
+    uint64_t now() const {
+        return clock() - epoch;
+    }
+
+    // A span of the calling thread, as now() values
+    void record(const char *name, uint64_t start, uint64_t end);
+
+    // A sample of a counter, at now()
+    void counter(const char *name, double value);
+
+    // Totals per name over every thread since the last call, which resets them
+    void stages(std::vector<ProfileStage> &out);
+
+    // Write every event recorded so far as Chrome trace_event JSON
+    bool writeTrace(const std::string &path, std::string &error);
+
+    // Shared by the PROFILE_* macros
+    static Profiler &global();
+};
+
+// Records the lifetime of the object as a span
+class ProfileScope{
+    const char *name;
+    uint64_t start;
+
+    // Disallow copying
+    ProfileScope(const ProfileScope &);
+    ProfileScope &operator=(const ProfileScope &);
+public:
+    explicit ProfileScope(const char *name): name(name), start(Profiler::global().now()){}
+    ~ProfileScope(){
+        Profiler::global().record(name, start, Profiler::global().now());
+    }
+};
+
+#endif /* PROFILER_H_ */
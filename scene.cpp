@@ -0,0 +1,149 @@
+/**
+ * View settings and scene files for batch rendering -- see scene.h
+ */
+
+/*************** Includes *******************/
+#include "scene.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+// Whole of text as a number
+bool parseNumber(const string &text, float &value){
+    char end;
+    return sscanf(text.c_str(), "%f%c", &value, &end) == 1;
+}
+
+bool parseInteger(const string &text, int &value){
+    char end;
+    return sscanf(text.c_str(), "%d%c", &value, &end) == 1;
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+bool loadScenes(const string &path, const Scene &defaults, const Scene *presets, size_t presetCount,
+        int maxMaterialState, vector<Scene> &scenes, string &error){
+    ifstream file(path.c_str());
+    if (!file.is_open()){
+        error = "Unable to open scene file " + path;
+        return false;
+    }
+
+    string line;
+    for (int lineNumber = 1; getline(file, line); lineNumber++){
+        istringstream tokens(line);
+        string output;
+        if (!(tokens >> output) || output[0] == '#')
+            continue;
+
+        ostringstream where;
+        where << path << ":" << lineNumber << ": ";
+
+        Scene scene = defaults;
+        scene.output = output;
+        string token;
+        while (tokens >> token){
+            size_t equals = token.find('=');
+            string key = token.substr(0, equals), value = equals == string::npos ? "" : token.substr(equals + 1);
+            float number;
+            int integer, width, height;
+            char end;
+
+            if (key == "preset" && parseInteger(value, integer) && integer >= 1 && (size_t) integer <= presetCount){
+                // Only the view settings; the size and output stay
+                Scene preset = presets[integer - 1];
+                preset.width = scene.width;
+                preset.height = scene.height;
+                preset.output = output;
+                scene = preset;
+            }
+            else if (key == "zoom" && parseNumber(value, number) && number > 0)
+                scene.zoom = number;
+            else if (key == "translation" && parseNumber(value, number))
+                scene.translationFactor = number;
+            else if (key == "angle" && parseNumber(value, number))
+                scene.angle = number;
+            else if (key == "material" && parseInteger(value, integer) && integer >= 0 && integer <= maxMaterialState)
+                scene.materialState = integer;
+            else if (key == "texture" && parseInteger(value, integer) && (integer == 0 || integer == 1))
+                scene.showTexture = integer == 1;
+            else if (key == "size" && sscanf(value.c_str(), "%dx%d%c", &width, &height, &end) == 2
+                    && width > 0 && height > 0){
+                scene.width = width;
+                scene.height = height;
+            }
+            else{
+                error = where.str() + "Invalid setting " + token;
+                return false;
+            }
+        }
+        scenes.push_back(scene);
+    }
+    return true;
+}
+
+bool loadInstances(const string &path, const string &defaultTexture, int maxMaterialState,
+        vector<SceneInstance> &instances, string &error){
+    ifstream file(path.c_str());
+    if (!file.is_open()){
+        error = "Unable to open instance file " + path;
+        return false;
+    }
+
+    string line;
+    for (int lineNumber = 1; getline(file, line); lineNumber++){
+        istringstream tokens(line);
+        string mesh;
+        if (!(tokens >> mesh) || mesh[0] == '#')
+            continue;
+
+        ostringstream where;
+        where << path << ":" << lineNumber << ": ";
+
+        SceneInstance instance;
+        instance.mesh = mesh;
+        instance.texture = defaultTexture;
+        instance.materialState = 0;
+        instance.placed = false;
+        instance.position[0] = instance.position[1] = instance.position[2] = 0.f;
+        instance.angle = 0.f;
+        instance.scale = 1.f;
+        string token;
+        while (tokens >> token){
+            size_t equals = token.find('=');
+            string key = token.substr(0, equals), value = equals == string::npos ? "" : token.substr(equals + 1);
+            float number;
+            int integer;
+            char end;
+
+            if (key == "texture" && !value.empty())
+                instance.texture = value == "none" ? "" : value;
+            else if (key == "material" && parseInteger(value, integer) && integer >= 0 && integer <= maxMaterialState)
+                instance.materialState = integer;
+            else if (key == "position" && sscanf(value.c_str(), "%f,%f,%f%c", &instance.position[0],
+                    &instance.position[1], &instance.position[2], &end) == 3)
+                instance.placed = true;
+            else if (key == "angle" && parseNumber(value, number))
+                instance.angle = number;
+            else if (key == "scale" && parseNumber(value, number) && number > 0)
+                instance.scale = number;
+            else{
+                error = where.str() + "Invalid setting " + token;
+                return false;
+            }
+        }
+        instances.push_back(instance);
+    }
+    if (instances.empty()){
+        error = "No instances in " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+/**
+ * View settings and scene files for batch rendering
+ *
+ * A scene file lists one image per line:
+ *
+ *     <output.tga> [preset=1..4] [zoom=Z] [translation=T] [angle=A]
+ *                  [material=0..3] [texture=0|1] [size=WxH]
+ *
+ * Settings not given come from the preset if there is one, the defaults
+ * otherwise, and are applied in the order written. Blank lines and lines
+ * starting with '#' are ignored.
+ *
+ * An instance file lists the meshes of a scene drawn side by side, one
+ * instance per line and in the same syntax:
+ *
+ *     <mesh.vtk> [texture=path|none] [material=0..3] [position=X,Y,Z]
+ *                [angle=A] [scale=S]
+ *
+ * position moves the instance from where its mesh file puts it; instances
+ * without one are laid out in a grid. angle turns the instance about the
+ * vertical axis through its centre.
+ */
+
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*************** Classes *******************/
+struct Scene{
+    float zoom, translationFactor, angle;
+    int materialState;
+    bool showTexture;
+    int width, height;
+    std::string output;     // image file, only used by scene files
+};
+
+// One line of an instance file
+struct SceneInstance{
+    std::string mesh, texture;  // texture is empty for none
+    int materialState;
+    bool placed;                // position was given
+    float position[3], angle, scale;
+};
+
+/*************** Function Prototypes *******************/
+// Parse a scene file. presets[i] is "preset=i+1". Returns false with a message in error.
+bool loadScenes(const std::string &path, const Scene &defaults, const Scene *presets, size_t presetCount,
+        int maxMaterialState, std::vector<Scene> &scenes, std::string &error);
+
+// Parse an instance file. Returns false with a message in error.
+bool loadInstances(const std::string &path, const std::string &defaultTexture, int maxMaterialState,
+        std::vector<SceneInstance> &instances, std::string &error);
+
+#endif /* SCENE_H_ */
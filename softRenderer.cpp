@@ -0,0 +1,498 @@
+/**
+ * Tile based software rasteriser -- see softRenderer.h
+ */
+
+/*************** Includes *******************/
+#include "softRenderer.h"
+#include "meshKernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#define SOFT_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/*************** Macros *******************/
+// Vertices per task in the vertex pass
+#define VERTEX_CHUNK 4096
+
+// Triangles per task (and per bin list) in the setup pass
+#define TRIANGLE_CHUNK 2048
+
+// Clipping happens in clip space against the near and far planes and a guard
+// band this many viewports wide; everything else is left to the tile bounds
+#define GUARD_BAND_PIXELS 16384.f
+
+// Clip space outcodes
+#define CLIP_NEAR 1
+#define CLIP_FAR 2
+#define CLIP_LEFT 4
+#define CLIP_RIGHT 8
+#define CLIP_BOTTOM 16
+#define CLIP_TOP 32
+#define CLIP_GUARD_LEFT 64
+#define CLIP_GUARD_RIGHT 128
+#define CLIP_GUARD_BOTTOM 256
+#define CLIP_GUARD_TOP 512
+#define CLIP_FRUSTUM (CLIP_NEAR | CLIP_FAR | CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP)
+#define CLIP_NEEDED (CLIP_NEAR | CLIP_FAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP)
+
+// Room for a triangle clipped by all six planes
+#define MAX_CLIP_VERTICES 9
+
+/*************** Helpers *******************/
+namespace {
+
+double secondsSince(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+float clamp01(float value){
+    return value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+}
+
+unsigned char toByte(float value){
+    return (unsigned char) (clamp01(value) * 255.f + 0.5f);
+}
+
+// Clip space position and the attributes interpolated across the triangle
+struct ClipVertex{
+    float position[4];
+    float attributes[5];
+};
+
+// Signed distance to clip plane `plane' (one of the CLIP_NEEDED bits); inside is >= 0
+float planeDistance(const ClipVertex &vertex, int plane, float guard){
+    const float *p = vertex.position;
+    switch (plane){
+        case CLIP_NEAR: return p[2] + p[3];
+        case CLIP_FAR: return p[3] - p[2];
+        case CLIP_GUARD_LEFT: return guard*p[3] + p[0];
+        case CLIP_GUARD_RIGHT: return guard*p[3] - p[0];
+        case CLIP_GUARD_BOTTOM: return guard*p[3] + p[1];
+        default: return guard*p[3] - p[1];
+    }
+}
+
+int outcode(const float *p, float guard){
+    int code = 0;
+    if (p[2] < -p[3]) code |= CLIP_NEAR;
+    if (p[2] > p[3]) code |= CLIP_FAR;
+    if (p[0] < -p[3]) code |= CLIP_LEFT;
+    if (p[0] > p[3]) code |= CLIP_RIGHT;
+    if (p[1] < -p[3]) code |= CLIP_BOTTOM;
+    if (p[1] > p[3]) code |= CLIP_TOP;
+    if (p[0] < -guard*p[3]) code |= CLIP_GUARD_LEFT;
+    if (p[0] > guard*p[3]) code |= CLIP_GUARD_RIGHT;
+    if (p[1] < -guard*p[3]) code |= CLIP_GUARD_BOTTOM;
+    if (p[1] > guard*p[3]) code |= CLIP_GUARD_TOP;
+    return code;
+}
+
+// Sutherland-Hodgman against every plane in planes. Returns the new vertex count.
+int clipPolygon(ClipVertex *polygon, int count, int planes, float guard){
+    ClipVertex scratch[MAX_CLIP_VERTICES];
+    for (int plane = 1; plane <= CLIP_GUARD_TOP && count > 0; plane <<= 1){
+        if (!(planes & plane))
+            continue;
+
+        int outCount = 0;
+        for (int i = 0; i < count; i++){
+            const ClipVertex &a = polygon[i], &b = polygon[(i + 1) % count];
+            float da = planeDistance(a, plane, guard), db = planeDistance(b, plane, guard);
+            if (da >= 0)
+                scratch[outCount++] = a;
+            if ((da >= 0) != (db >= 0)){
+                float t = da / (da - db);
+                ClipVertex &v = scratch[outCount++];
+                for (int k = 0; k < 4; k++)
+                    v.position[k] = a.position[k] + t*(b.position[k] - a.position[k]);
+                for (int k = 0; k < 5; k++)
+                    v.attributes[k] = a.attributes[k] + t*(b.attributes[k] - a.attributes[k]);
+            }
+        }
+        memcpy(polygon, scratch, outCount * sizeof(ClipVertex));
+        count = outCount;
+    }
+    return count;
+}
+
+// Bilinear, clamp to edge sample of an RGB texture
+void sampleTexture(const SoftTexture &texture, float s, float t, float rgb[3]){
+    float u = s*texture.width - 0.5f, v = t*texture.height - 0.5f;
+    float fu = floorf(u), fv = floorf(v);
+    float wu = u - fu, wv = v - fv;
+    int u0 = (int) fu, v0 = (int) fv, u1 = u0 + 1, v1 = v0 + 1;
+    u0 = u0 < 0 ? 0 : (u0 >= texture.width ? texture.width - 1 : u0);
+    u1 = u1 < 0 ? 0 : (u1 >= texture.width ? texture.width - 1 : u1);
+    v0 = v0 < 0 ? 0 : (v0 >= texture.height ? texture.height - 1 : v0);
+    v1 = v1 < 0 ? 0 : (v1 >= texture.height ? texture.height - 1 : v1);
+
+    const unsigned char *t00 = texture.texels + 3*((size_t) v0*texture.width + u0);
+    const unsigned char *t10 = texture.texels + 3*((size_t) v0*texture.width + u1);
+    const unsigned char *t01 = texture.texels + 3*((size_t) v1*texture.width + u0);
+    const unsigned char *t11 = texture.texels + 3*((size_t) v1*texture.width + u1);
+    for (int c = 0; c < 3; c++){
+        float bottom = t00[c] + wu*(t10[c] - t00[c]);
+        float top = t01[c] + wu*(t11[c] - t01[c]);
+        rgb[c] = (bottom + wv*(top - bottom)) * (1.f / 255.f);
+    }
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+SoftRenderer::SoftRenderer(ThreadPool &pool): pool(pool), width(0), height(0), tilesX(0), tilesY(0){
+    memset(&stats, 0, sizeof(stats));
+}
+
+void SoftRenderer::setSize(int newWidth, int newHeight){
+    width = newWidth > 0 ? newWidth : 1;
+    height = newHeight > 0 ? newHeight : 1;
+    tilesX = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    tilesY = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    colour.resize((size_t) width * height * 4);
+    depth.resize((size_t) width * height);
+}
+
+void SoftRenderer::render(const SoftMesh &mesh, const SoftFrame &frame){
+    if (width == 0)
+        setSize(1, 1);
+    stats.threads = pool.size();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    shadeVertices(mesh, frame);
+    stats.vertexSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    setupTriangles(mesh, frame);
+    stats.setupSeconds = secondsSince(start);
+
+    // Clearing is part of the tile pass so each tile stays in one cache
+    start = chrono::steady_clock::now();
+    pool.parallelFor((size_t) tilesX * tilesY, [&](size_t tile){
+        rasteriseTile(tile, frame);
+    });
+    stats.rasterSeconds = secondsSince(start);
+}
+
+// Transform positions and normals, then light every vertex as GL does with
+// GL_LIGHTING, one light, no local viewer and no two sided lighting
+void SoftRenderer::shadeVertices(const SoftMesh &mesh, const SoftFrame &frame){
+    const VertexArrays &vertices = *mesh.vertices;
+    size_t count = vertices.size();
+    for (int i = 0; i < 4; i++)
+        clip[i].resize(count);
+    for (int i = 0; i < 4; i++)
+        eyeNormal[i].resize(count);
+    for (int i = 0; i < 3; i++)
+        lit[i].resize(count);
+
+    Matrix4 mvp = frame.projection * frame.modelview;
+
+    // Normals go through the inverse transpose of the modelview, without translation
+    Matrix4 inverse, normalMatrix;
+    if (!frame.modelview.inverse(inverse))
+        inverse.setIdentity();
+    for (int row = 0; row < 3; row++){
+        for (int column = 0; column < 3; column++)
+            normalMatrix.at(row, column) = inverse.at(column, row);
+    }
+
+    // Colour independent of the normal
+    const SoftMaterial &material = frame.material;
+    const SoftLight &light = frame.light;
+    float base[3], diffuse[3], specular[3];
+    for (int c = 0; c < 3; c++){
+        base[c] = material.emission[c] + material.ambient[c]*frame.lightModelAmbient[c]
+                + material.ambient[c]*light.ambient[c];
+        diffuse[c] = material.diffuse[c]*light.diffuse[c];
+        specular[c] = material.specular[c]*light.specular[c];
+    }
+
+    // Directional light: the half vector is between the light and (0, 0, 1)
+    float direction[3] = {light.position[0], light.position[1], light.position[2]};
+    float length = sqrtf(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+    for (int c = 0; c < 3 && length > 0; c++)
+        direction[c] /= length;
+    float half[3] = {direction[0], direction[1], direction[2] + 1.f};
+    length = sqrtf(half[0]*half[0] + half[1]*half[1] + half[2]*half[2]);
+    for (int c = 0; c < 3 && length > 0; c++)
+        half[c] /= length;
+
+    const MeshKernels &kernels = meshKernels();
+    size_t chunks = (count + VERTEX_CHUNK - 1) / VERTEX_CHUNK;
+    pool.parallelFor(chunks, [&](size_t chunk){
+        size_t begin = chunk * VERTEX_CHUNK;
+        size_t n = count - begin < VERTEX_CHUNK ? count - begin : VERTEX_CHUNK;
+
+        kernels.transform(mvp.m, vertices.get(VERTEX_X) + begin, vertices.get(VERTEX_Y) + begin,
+                vertices.get(VERTEX_Z) + begin, n,
+                &clip[0][begin], &clip[1][begin], &clip[2][begin], &clip[3][begin]);
+        kernels.transform(normalMatrix.m, vertices.get(VERTEX_NX) + begin, vertices.get(VERTEX_NY) + begin,
+                vertices.get(VERTEX_NZ) + begin, n,
+                &eyeNormal[0][begin], &eyeNormal[1][begin], &eyeNormal[2][begin], &eyeNormal[3][begin]);
+
+        for (size_t i = begin; i < begin + n; i++){
+            float nx = eyeNormal[0][i], ny = eyeNormal[1][i], nz = eyeNormal[2][i];
+            float nDotL = nx*direction[0] + ny*direction[1] + nz*direction[2];
+            float nDotH = nx*half[0] + ny*half[1] + nz*half[2];
+            float highlight = 0.f;
+            if (nDotL > 0.f)
+                highlight = nDotH > 0.f ? powf(nDotH, material.shininess) : (material.shininess == 0.f ? 1.f : 0.f);
+            nDotL = nDotL > 0.f ? nDotL : 0.f;
+            for (int c = 0; c < 3; c++)
+                lit[c][i] = clamp01(base[c] + nDotL*diffuse[c] + highlight*specular[c]);
+        }
+    });
+}
+
+// Clip, project and bin every triangle
+void SoftRenderer::setupTriangles(const SoftMesh &mesh, const SoftFrame &frame){
+    size_t chunks = (mesh.triangleCount + TRIANGLE_CHUNK - 1) / TRIANGLE_CHUNK;
+    size_t tileCount = (size_t) tilesX * tilesY;
+    if (bins.size() < chunks)
+        bins.resize(chunks);
+    for (size_t i = 0; i < bins.size(); i++){
+        bins[i].triangles.clear();
+        bins[i].tiles.resize(tileCount);
+        for (size_t j = 0; j < tileCount; j++)
+            bins[i].tiles[j].clear();
+    }
+
+    float guard = GUARD_BAND_PIXELS / (width > height ? width : height);
+    if (guard < 1.f)
+        guard = 1.f;
+    bool textured = frame.texture != NULL;
+
+    pool.parallelFor(chunks, [&](size_t chunk){
+        Bin &bin = bins[chunk];
+        size_t begin = chunk * TRIANGLE_CHUNK;
+        size_t end = begin + TRIANGLE_CHUNK < mesh.triangleCount ? begin + TRIANGLE_CHUNK : mesh.triangleCount;
+
+        ClipVertex polygon[MAX_CLIP_VERTICES];
+        for (size_t i = begin; i < end; i++){
+            int codes = CLIP_FRUSTUM | CLIP_NEEDED, any = 0;
+            for (int k = 0; k < 3; k++){
+                int index = mesh.triangles[3*i + k];
+                ClipVertex &v = polygon[k];
+                for (int c = 0; c < 4; c++)
+                    v.position[c] = clip[c][index];
+                for (int c = 0; c < 3; c++)
+                    v.attributes[c] = lit[c][index];
+                v.attributes[3] = textured ? mesh.vertices->get(VERTEX_U)[index] : 0.f;
+                v.attributes[4] = textured ? mesh.vertices->get(VERTEX_V)[index] : 0.f;
+
+                int code = outcode(v.position, guard);
+                codes &= code;
+                any |= code;
+            }
+            if (codes & CLIP_FRUSTUM)
+                continue;   // entirely outside one plane of the view volume
+
+            int count = 3;
+            if (any & CLIP_NEEDED)
+                count = clipPolygon(polygon, count, any & CLIP_NEEDED, guard);
+
+            // Project the (clipped) polygon
+            double sx[MAX_CLIP_VERTICES], sy[MAX_CLIP_VERTICES];
+            float sz[MAX_CLIP_VERTICES], invW[MAX_CLIP_VERTICES];
+            for (int k = 0; k < count; k++){
+                const float *p = polygon[k].position;
+                invW[k] = 1.f / p[3];
+                sx[k] = floor(((p[0]*invW[k]) * 0.5 + 0.5) * width * SOFT_SUBPIXELS + 0.5) / SOFT_SUBPIXELS;
+                sy[k] = floor(((p[1]*invW[k]) * 0.5 + 0.5) * height * SOFT_SUBPIXELS + 0.5) / SOFT_SUBPIXELS;
+                sz[k] = (p[2]*invW[k]) * 0.5f + 0.5f;
+            }
+
+            // Fan out and bin
+            for (int k = 2; k < count; k++){
+                int corners[3] = {0, k-1, k};
+                double area = (sx[corners[1]] - sx[0]) * (sy[corners[2]] - sy[0])
+                        - (sy[corners[1]] - sy[0]) * (sx[corners[2]] - sx[0]);
+                if (area == 0)
+                    continue;
+                if (area < 0){
+                    // Back facing: no culling in display(), so just flip the winding
+                    corners[1] = k;
+                    corners[2] = k-1;
+                    area = -area;
+                }
+
+                Triangle triangle;
+                triangle.area = area;
+                double minX = 1e30, minY = 1e30, maxX = -1e30, maxY = -1e30;
+                for (int j = 0; j < 3; j++){
+                    int c = corners[j];
+                    triangle.x[j] = sx[c];
+                    triangle.y[j] = sy[c];
+                    triangle.z[j] = sz[c];
+                    triangle.invW[j] = invW[c];
+                    memcpy(triangle.attributes[j], polygon[c].attributes, sizeof(triangle.attributes[j]));
+                    minX = sx[c] < minX ? sx[c] : minX;
+                    maxX = sx[c] > maxX ? sx[c] : maxX;
+                    minY = sy[c] < minY ? sy[c] : minY;
+                    maxY = sy[c] > maxY ? sy[c] : maxY;
+                }
+
+                // Pixels whose centre may be covered
+                triangle.minX = (int) ceil(minX - 0.5);
+                triangle.minY = (int) ceil(minY - 0.5);
+                triangle.maxX = (int) floor(maxX - 0.5);
+                triangle.maxY = (int) floor(maxY - 0.5);
+                triangle.minX = triangle.minX < 0 ? 0 : triangle.minX;
+                triangle.minY = triangle.minY < 0 ? 0 : triangle.minY;
+                triangle.maxX = triangle.maxX >= width ? width - 1 : triangle.maxX;
+                triangle.maxY = triangle.maxY >= height ? height - 1 : triangle.maxY;
+                if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+                    continue;
+
+                unsigned index = bin.triangles.size();
+                bin.triangles.push_back(triangle);
+                for (int ty = triangle.minY / SOFT_TILE_SIZE; ty <= triangle.maxY / SOFT_TILE_SIZE; ty++){
+                    for (int tx = triangle.minX / SOFT_TILE_SIZE; tx <= triangle.maxX / SOFT_TILE_SIZE; tx++)
+                        bin.tiles[(size_t) ty*tilesX + tx].push_back(index);
+                }
+            }
+        }
+    });
+
+    stats.triangles = 0;
+    for (size_t i = 0; i < chunks; i++)
+        stats.triangles += bins[i].triangles.size();
+}
+
+// Clear one tile and draw every triangle binned to it, in submission order
+void SoftRenderer::rasteriseTile(size_t tile, const SoftFrame &frame){
+    int tileX = (tile % tilesX) * SOFT_TILE_SIZE, tileY = (tile / tilesX) * SOFT_TILE_SIZE;
+    int tileRight = tileX + SOFT_TILE_SIZE - 1 < width ? tileX + SOFT_TILE_SIZE - 1 : width - 1;
+    int tileTop = tileY + SOFT_TILE_SIZE - 1 < height ? tileY + SOFT_TILE_SIZE - 1 : height - 1;
+
+    unsigned char clearColour[4];
+    for (int c = 0; c < 4; c++)
+        clearColour[c] = toByte(frame.clearColour[c]);
+    for (int y = tileY; y <= tileTop; y++){
+        for (int x = tileX; x <= tileRight; x++){
+            size_t pixel = (size_t) y*width + x;
+            memcpy(&colour[4*pixel], clearColour, 4);
+            depth[pixel] = 1.f;
+        }
+    }
+
+    // E is a multiple of 1/SOFT_SUBPIXELS^2, so E > 0 is the same as E >= bias
+    const double bias = 1.0 / ((double) SOFT_SUBPIXELS * SOFT_SUBPIXELS);
+
+    for (size_t b = 0; b < bins.size(); b++){
+        const vector<unsigned> &list = bins[b].tiles[tile];
+        for (size_t l = 0; l < list.size(); l++){
+            const Triangle &triangle = bins[b].triangles[list[l]];
+            int minX = triangle.minX > tileX ? triangle.minX : tileX;
+            int maxX = triangle.maxX < tileRight ? triangle.maxX : tileRight;
+            int minY = triangle.minY > tileY ? triangle.minY : tileY;
+            int maxY = triangle.maxY < tileTop ? triangle.maxY : tileTop;
+
+            // Edge i runs from vertex i to i+1; its function is the weight of the opposite vertex.
+            // Top-left rule on a counter-clockwise triangle with y up.
+            double dx[3], dy[3], edgeBias[3];
+            for (int i = 0; i < 3; i++){
+                int j = (i + 1) % 3;
+                dx[i] = triangle.x[j] - triangle.x[i];
+                dy[i] = triangle.y[j] - triangle.y[i];
+                bool topLeft = dy[i] < 0 || (dy[i] == 0 && dx[i] < 0);
+                edgeBias[i] = topLeft ? 0.0 : bias;
+            }
+            float invArea = (float) (1.0 / triangle.area);
+
+            for (int y = minY; y <= maxY; y++){
+                double py = y + 0.5;
+                double row[3];
+                for (int i = 0; i < 3; i++)
+                    row[i] = dx[i] * (py - triangle.y[i]);
+
+                for (int x = minX; x <= maxX; x += 4){
+                    double edges[3][4];
+                    int mask;
+#ifdef SOFT_RENDERER_SSE2
+                    __m128d pxLow = _mm_set_pd(x + 1.5, x + 0.5), pxHigh = _mm_set_pd(x + 3.5, x + 2.5);
+                    __m128d insideLow = _mm_castsi128_pd(_mm_set1_epi32(-1)), insideHigh = insideLow;
+                    for (int i = 0; i < 3; i++){
+                        __m128d r = _mm_set1_pd(row[i]), d = _mm_set1_pd(dy[i]), origin = _mm_set1_pd(triangle.x[i]);
+                        __m128d low = _mm_sub_pd(r, _mm_mul_pd(d, _mm_sub_pd(pxLow, origin)));
+                        __m128d high = _mm_sub_pd(r, _mm_mul_pd(d, _mm_sub_pd(pxHigh, origin)));
+                        __m128d threshold = _mm_set1_pd(edgeBias[i]);
+                        insideLow = _mm_and_pd(insideLow, _mm_cmpge_pd(low, threshold));
+                        insideHigh = _mm_and_pd(insideHigh, _mm_cmpge_pd(high, threshold));
+                        _mm_storeu_pd(edges[i], low);
+                        _mm_storeu_pd(edges[i] + 2, high);
+                    }
+                    mask = _mm_movemask_pd(insideLow) | (_mm_movemask_pd(insideHigh) << 2);
+#else
+                    mask = 0;
+                    for (int k = 0; k < 4; k++){
+                        bool inside = true;
+                        for (int i = 0; i < 3; i++){
+                            edges[i][k] = row[i] - dy[i] * (x + k + 0.5 - triangle.x[i]);
+                            inside = inside && edges[i][k] >= edgeBias[i];
+                        }
+                        mask |= inside << k;
+                    }
+#endif
+                    if (maxX - x < 3)
+                        mask &= (1 << (maxX - x + 1)) - 1;
+
+                    for (int k = 0; mask != 0; k++, mask >>= 1){
+                        if (!(mask & 1))
+                            continue;
+
+                        float l0 = (float) edges[1][k] * invArea;
+                        float l1 = (float) edges[2][k] * invArea;
+                        float l2 = (float) edges[0][k] * invArea;
+                        float z = l0*triangle.z[0] + l1*triangle.z[1] + l2*triangle.z[2];
+                        size_t pixel = (size_t) y*width + x + k;
+                        if (!(z < depth[pixel]))
+                            continue;
+                        depth[pixel] = z;
+
+                        // Perspective correct attributes
+                        float w0 = l0*triangle.invW[0], w1 = l1*triangle.invW[1], w2 = l2*triangle.invW[2];
+                        float normaliser = 1.f / (w0 + w1 + w2);
+                        w0 *= normaliser;
+                        w1 *= normaliser;
+                        w2 *= normaliser;
+                        float value[5];
+                        for (int a = 0; a < 5; a++)
+                            value[a] = w0*triangle.attributes[0][a] + w1*triangle.attributes[1][a]
+                                    + w2*triangle.attributes[2][a];
+
+                        if (frame.texture != NULL){
+                            float texel[3];
+                            sampleTexture(*frame.texture, value[3], value[4], texel);
+                            for (int c = 0; c < 3; c++)
+                                value[c] *= texel[c];
+                        }
+
+                        unsigned char *out = &colour[4*pixel];
+                        out[0] = toByte(value[0]);
+                        out[1] = toByte(value[1]);
+                        out[2] = toByte(value[2]);
+                        out[3] = 255;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SoftRenderer::readPixels(unsigned char *bgr) const{
+    size_t pixels = (size_t) width * height;
+    for (size_t i = 0; i < pixels; i++){
+        bgr[3*i] = colour[4*i + 2];
+        bgr[3*i + 1] = colour[4*i + 1];
+        bgr[3*i + 2] = colour[4*i];
+    }
+}
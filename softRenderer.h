@@ -0,0 +1,146 @@
+/**
+ * Tile based software rasteriser
+ *
+ * Draws the mesh the way init() and display() do with the fixed function
+ * pipeline, without a GL context: Gouraud shading from one directional light,
+ * a material, a modulated texture and the GL_LESS depth test.
+ *
+ * A frame runs in three passes over the thread pool:
+ *  - vertex: transform positions and normals (meshKernels.h) and light them
+ *  - setup: clip, project and bin the triangles into SOFT_TILE_SIZE tiles,
+ *    one bin list per chunk of triangles so that submission order is kept
+ *  - raster: every tile is shaded by one thread, walking the chunks in order
+ *
+ * Coverage uses edge functions in double precision on coordinates snapped
+ * to 1/SOFT_SUBPIXELS of a pixel, which are exact, so shared edges are
+ * watertight. Pixel centres are tested with the top-left rule, four at a
+ * time with SSE2.
+ */
+
+#ifndef SOFTRENDERER_H_
+#define SOFTRENDERER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "matrix4.h"
+#include "threadPool.h"
+#include "vertexArrays.h"
+
+/*************** Macros *******************/
+// Width and height of a tile in pixels
+#define SOFT_TILE_SIZE 64
+
+// Sub-pixel precision of the screen positions
+#define SOFT_SUBPIXELS 256
+
+/*************** Classes *******************/
+// GL_LIGHT0 style light; position is in eye space, w = 0 for a directional light
+struct SoftLight{
+    float ambient[4], diffuse[4], specular[4];
+    float position[4];
+};
+
+// As glMaterialfv()
+struct SoftMaterial{
+    float ambient[4], diffuse[4], specular[4], emission[4];
+    float shininess;
+};
+
+// RGB texels with the first row at t = 0, as handed to glTexImage2D()
+struct SoftTexture{
+    const unsigned char *texels;
+    int width, height;
+};
+
+// What display() sets up for a frame
+struct SoftFrame{
+    Matrix4 modelview, projection;
+    SoftLight light;
+    float lightModelAmbient[4];
+    SoftMaterial material;
+    const SoftTexture *texture;     // NULL to disable texturing
+    float clearColour[4];
+};
+
+// Vertex arrays and counter-clockwise triangles, three indices each
+struct SoftMesh{
+    const VertexArrays *vertices;
+    const int *triangles;
+    size_t triangleCount;
+};
+
+struct SoftRenderStats{
+    double vertexSeconds, setupSeconds, rasterSeconds;
+    size_t triangles;   // triangles left after clipping and culling of empty ones
+    unsigned threads;
+
+    double totalSeconds() const {
+        return vertexSeconds + setupSeconds + rasterSeconds;
+    }
+};
+
+class SoftRenderer{
+    // Screen space triangle ready for rasterisation
+    struct Triangle{
+        double x[3], y[3];          // snapped window coordinates
+        double area;                // twice the signed area, always > 0
+        float z[3], invW[3];        // window depth, 1/w_clip
+        float attributes[3][5];     // r, g, b, s, t
+        int minX, minY, maxX, maxY; // inclusive pixel bounds
+    };
+
+    // Triangles of one chunk of the mesh and the tiles they touch
+    struct Bin{
+        std::vector<Triangle> triangles;
+        std::vector< std::vector<unsigned> > tiles;   // indices into triangles, per tile
+    };
+
+    ThreadPool &pool;
+    int width, height, tilesX, tilesY;
+    std::vector<unsigned char> colour;  // RGBA, bottom row first
+    std::vector<float> depth;
+
+    // Per vertex results of the vertex pass
+    std::vector<float> clip[4], lit[3];
+    std::vector<float> eyeNormal[4];
+
+    std::vector<Bin> bins;
+    SoftRenderStats stats;
+
+    // Disallow copying
+    SoftRenderer(const SoftRenderer &);
+    SoftRenderer &operator=(const SoftRenderer &);
+
+    void shadeVertices(const SoftMesh &mesh, const SoftFrame &frame);
+    void setupTriangles(const SoftMesh &mesh, const SoftFrame &frame);
+    void rasteriseTile(size_t tile, const SoftFrame &frame);
+public:
+    explicit SoftRenderer(ThreadPool &pool);
+
+    // Resize the frame buffer
+    void setSize(int width, int height);
+
+    // Clear and draw one frame
+    void render(const SoftMesh &mesh, const SoftFrame &frame);
+
+    // Bottom-up BGR rows, the layout glReadPixels(GL_BGR) gives
+    void readPixels(unsigned char *bgr) const;
+
+    /**
+     * Getters
+     */
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    const SoftRenderStats &getStats() const {
+        return stats;
+    }
+};
+
+#endif /* SOFTRENDERER_H_ */
@@ -0,0 +1,168 @@
+/**
+ * Binary cache of texture levels -- see textureCache.h for the file layout
+ */
+
+/*************** Includes *******************/
+#include "textureCache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+/*************** Macros *******************/
+#define TEXTURE_CACHE_MAGIC "CGTEX\0\0\0"
+#define TEXTURE_CACHE_BYTE_ORDER 0x01020304u
+
+/*************** Helpers *******************/
+namespace {
+
+// Round up to the next multiple of TEXTURE_CACHE_ALIGNMENT
+uint64_t alignOffset(uint64_t offset){
+    return (offset + TEXTURE_CACHE_ALIGNMENT - 1) & ~(uint64_t)(TEXTURE_CACHE_ALIGNMENT - 1);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+uint32_t mipSize(uint32_t size, uint32_t level){
+    size = level < 32 ? size >> level : 0;
+    return size > 0 ? size : 1;
+}
+
+uint64_t textureLevelBytes(uint32_t format, uint32_t width, uint32_t height, uint32_t level){
+    uint64_t w = mipSize(width, level), h = mipSize(height, level);
+    switch (format){
+        case TEXTURE_FORMAT_RGB8:
+            return w * h * 3;
+        case TEXTURE_FORMAT_BC1:
+            return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+    }
+    return 0;
+}
+
+TextureCache::TextureCache(): mapping(NULL), mappingSize(0), header(NULL){}
+
+TextureCache::~TextureCache(){
+    close();
+}
+
+bool TextureCache::open(const string &cachePath, const string &sourcePath, uint32_t format){
+    close();
+
+    struct stat source;
+    if (stat(sourcePath.c_str(), &source) != 0)
+        return false;
+
+    int fd = ::open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;   // no cache yet
+
+    struct stat cache;
+    if (fstat(fd, &cache) != 0 || (size_t) cache.st_size < sizeof(TextureCacheHeader)){
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, cache.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // the mapping keeps its own reference
+    if (map == MAP_FAILED)
+        return false;
+
+    const TextureCacheHeader *candidate = static_cast<const TextureCacheHeader *>(map);
+    uint64_t fileSize = cache.st_size;
+
+    // Validate the header before trusting any of the offsets
+    bool valid = memcmp(candidate->magic, TEXTURE_CACHE_MAGIC, sizeof(candidate->magic)) == 0
+            && candidate->byteOrder == TEXTURE_CACHE_BYTE_ORDER
+            && candidate->version == TEXTURE_CACHE_VERSION
+            && candidate->headerSize == sizeof(TextureCacheHeader)
+            && candidate->format == format
+            && candidate->fileSize == fileSize
+            && candidate->sourceSize == (uint64_t) source.st_size
+            && candidate->sourceMtime == (int64_t) source.st_mtim.tv_sec
+            && candidate->sourceMtimeNsec == (int64_t) source.st_mtim.tv_nsec
+            && candidate->levelCount <= TEXTURE_CACHE_MAX_LEVELS
+            && candidate->firstLevel < 32;
+    for (uint32_t i = 0; valid && i < candidate->levelCount; i++){
+        uint64_t offset = candidate->levelOffsets[i];
+        uint64_t size = textureLevelBytes(format, candidate->width, candidate->height, candidate->firstLevel + i);
+        valid = offset % TEXTURE_CACHE_ALIGNMENT == 0 && offset <= fileSize && size <= fileSize - offset;
+    }
+
+    if (!valid){
+        munmap(map, cache.st_size);
+        return false;
+    }
+
+    mapping = map;
+    mappingSize = cache.st_size;
+    header = candidate;
+    return true;
+}
+
+void TextureCache::close(){
+    if (mapping != NULL)
+        munmap(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+    header = NULL;
+}
+
+bool TextureCache::write(const string &cachePath, const TextureCacheData &data){
+    if (data.levelCount > TEXTURE_CACHE_MAX_LEVELS)
+        return false;
+
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+    header.byteOrder = TEXTURE_CACHE_BYTE_ORDER;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.headerSize = sizeof(TextureCacheHeader);
+    header.format = data.format;
+
+    header.sourceSize = data.sourceSize;
+    header.sourceMtime = data.sourceMtime;
+    header.sourceMtimeNsec = data.sourceMtimeNsec;
+
+    header.width = data.width;
+    header.height = data.height;
+    header.firstLevel = data.firstLevel;
+    header.levelCount = data.levelCount;
+
+    // Lay the levels out one after another
+    uint64_t end = sizeof(TextureCacheHeader);
+    for (uint32_t i = 0; i < data.levelCount; i++){
+        header.levelOffsets[i] = alignOffset(end);
+        end = header.levelOffsets[i] + textureLevelBytes(data.format, data.width, data.height, data.firstLevel + i);
+    }
+    header.fileSize = end;
+
+    // Write to a temporary file and rename it so a reader never sees a partial cache
+    string temporary = cachePath + ".tmp";
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (out == NULL)
+        return false;
+
+    static const char padding[TEXTURE_CACHE_ALIGNMENT] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    uint64_t position = sizeof(header);
+    for (uint32_t i = 0; ok && i < data.levelCount; i++){
+        uint64_t size = textureLevelBytes(data.format, data.width, data.height, data.firstLevel + i);
+        ok = (header.levelOffsets[i] == position || fwrite(padding, header.levelOffsets[i] - position, 1, out) == 1)
+                && fwrite(data.levels[i], size, 1, out) == 1;
+        position = header.levelOffsets[i] + size;
+    }
+
+    ok = (fclose(out) == 0) && ok;
+    if (ok)
+        ok = rename(temporary.c_str(), cachePath.c_str()) == 0;
+    if (!ok)
+        remove(temporary.c_str());
+
+    return ok;
+}
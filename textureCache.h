@@ -0,0 +1,110 @@
+/**
+ * Binary cache of texture levels derived from an image file
+ *
+ * Filtering a mip chain (see mipmaps.h) takes longer than reading the image,
+ * so the result is written next to the image once and mmap'd on later
+ * launches, like the mesh cache (see meshCache.h).
+ *
+ * Layout: TextureCacheHeader followed by the levels firstLevel to
+ * firstLevel + levelCount - 1, each at a TEXTURE_CACHE_ALIGNMENT aligned
+ * offset and textureLevelBytes() long. The cache is only used when the size
+ * and modification time of the image match those recorded in the header.
+ */
+
+#ifndef TEXTURECACHE_H_
+#define TEXTURECACHE_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+/*************** Macros *******************/
+// Bump whenever the layout or the meaning of the stored levels changes
+#define TEXTURE_CACHE_VERSION 1
+
+// Alignment of each level in the file
+#define TEXTURE_CACHE_ALIGNMENT 64
+
+// Most levels stored, enough for a 32768 x 32768 chain
+#define TEXTURE_CACHE_MAX_LEVELS 16
+
+// Formats of the stored levels
+#define TEXTURE_FORMAT_RGB8 0u      // 3 bytes per texel, rows not padded
+#define TEXTURE_FORMAT_BC1 1u       // 8 bytes per 4x4 block, see textureCompression.h
+
+/*************** Classes *******************/
+struct TextureCacheHeader{
+    char magic[8];              // "CGTEX\0\0\0"
+    uint32_t byteOrder;         // TEXTURE_CACHE_BYTE_ORDER when written on this machine
+    uint32_t version;           // TEXTURE_CACHE_VERSION
+    uint32_t headerSize;        // sizeof(TextureCacheHeader)
+    uint32_t format;            // TEXTURE_FORMAT_*
+
+    // Source image
+    uint64_t sourceSize;
+    int64_t sourceMtime;        // seconds
+    int64_t sourceMtimeNsec;    // nanoseconds
+
+    uint32_t width, height;     // of level 0
+    uint32_t firstLevel, levelCount;
+
+    // Byte offsets from the start of the file, one per stored level
+    uint64_t levelOffsets[TEXTURE_CACHE_MAX_LEVELS];
+    uint64_t fileSize;
+};
+
+// Levels handed to TextureCache::write()
+struct TextureCacheData{
+    uint32_t format, width, height;
+    uint32_t firstLevel, levelCount;
+    const void *levels[TEXTURE_CACHE_MAX_LEVELS];   // levels[i] is level firstLevel + i
+
+    // The source image as it was read; it may have changed since
+    uint64_t sourceSize;
+    int64_t sourceMtime, sourceMtimeNsec;
+};
+
+// A read only mapping of a cache file
+class TextureCache{
+    void *mapping;
+    size_t mappingSize;
+    const TextureCacheHeader *header;
+
+    // Disallow copying -- the mapping is owned
+    TextureCache(const TextureCache &);
+    TextureCache &operator=(const TextureCache &);
+public:
+    TextureCache();
+    ~TextureCache();
+
+    // Map cachePath if it holds levels of format derived from sourcePath as it is now
+    bool open(const std::string &cachePath, const std::string &sourcePath, uint32_t format);
+    void close();
+    bool isOpen() const {
+        return header != NULL;
+    }
+
+    // Write the cache, stamped with the source image in data. Returns false on failure.
+    static bool write(const std::string &cachePath, const TextureCacheData &data);
+
+    /**
+     * Getters
+     */
+    const TextureCacheHeader &getHeader() const {
+        return *header;
+    }
+
+    // Level firstLevel + i, 0 <= i < getHeader().levelCount
+    const unsigned char *getLevel(uint32_t i) const {
+        return static_cast<const unsigned char *>(mapping) + header->levelOffsets[i];
+    }
+};
+
+/*************** Function Prototypes *******************/
+// Width or height of a mip level: halved per level and rounded down, but at least 1
+uint32_t mipSize(uint32_t size, uint32_t level);
+
+// Bytes of one level of a width x height texture
+uint64_t textureLevelBytes(uint32_t format, uint32_t width, uint32_t height, uint32_t level);
+
+#endif /* TEXTURECACHE_H_ */
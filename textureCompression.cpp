@@ -0,0 +1,252 @@
+/**
+ * BC1 (DXT1) texture compression -- see textureCompression.h
+ */
+
+/*************** Includes *******************/
+#include "textureCompression.h"
+#include "threadPool.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+/*************** Helpers *******************/
+namespace {
+
+// 5:6:5 colour from 8 bit channels, rounded
+unsigned pack565(const float colour[3]){
+    int r = (int) (colour[0] * 31.f / 255.f + 0.5f), g = (int) (colour[1] * 63.f / 255.f + 0.5f);
+    int b = (int) (colour[2] * 31.f / 255.f + 0.5f);
+    r = r < 0 ? 0 : (r > 31 ? 31 : r);
+    g = g < 0 ? 0 : (g > 63 ? 63 : g);
+    b = b < 0 ? 0 : (b > 31 ? 31 : b);
+    return (r << 11) | (g << 5) | b;
+}
+
+// 8 bit channels of a 5:6:5 colour, by bit replication as the hardware does
+void unpack565(unsigned packed, int colour[3]){
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    colour[0] = (r << 3) | (r >> 2);
+    colour[1] = (g << 2) | (g >> 4);
+    colour[2] = (b << 3) | (b >> 2);
+}
+
+// The four colours of a block in index order
+void palette(unsigned colour0, unsigned colour1, int colours[4][3]){
+    unpack565(colour0, colours[0]);
+    unpack565(colour1, colours[1]);
+    for (int c = 0; c < 3; c++){
+        colours[2][c] = (2*colours[0][c] + colours[1][c]) / 3;
+        colours[3][c] = (colours[0][c] + 2*colours[1][c]) / 3;
+    }
+}
+
+// Nearest palette entry for each texel; returns the summed squared error
+int chooseIndices(const unsigned char texels[16][3], unsigned colour0, unsigned colour1, int indices[16]){
+    int colours[4][3];
+    palette(colour0, colour1, colours);
+    int total = 0;
+    for (int i = 0; i < 16; i++){
+        int best = numeric_limits<int>::max();
+        for (int p = 0; p < 4; p++){
+            int dr = texels[i][0] - colours[p][0], dg = texels[i][1] - colours[p][1], db = texels[i][2] - colours[p][2];
+            int error = dr*dr + dg*dg + db*db;
+            if (error < best){
+                best = error;
+                indices[i] = p;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// End points by least squares for fixed indices. Returns false if every texel uses the same weight.
+bool refine(const unsigned char texels[16][3], const int indices[16], float end0[3], float end1[3]){
+    static const float weights[4] = {1.f, 0.f, 2.f/3.f, 1.f/3.f};   // of colour 0 for each index
+    float aa = 0, ab = 0, bb = 0, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++){
+        float a = weights[indices[i]], b = 1.f - a;
+        aa += a*a;
+        ab += a*b;
+        bb += b*b;
+        for (int c = 0; c < 3; c++){
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+    float determinant = aa*bb - ab*ab;
+    if (fabs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < 3; c++){
+        end0[c] = (ax[c]*bb - bx[c]*ab) / determinant;
+        end1[c] = (bx[c]*aa - ax[c]*ab) / determinant;
+    }
+    return true;
+}
+
+// Store the end points in four colour order (colour0 > colour1) with their indices
+void writeBlock(unsigned colour0, unsigned colour1, const int indices[16], unsigned char *block){
+    int remapped[16];
+    for (int i = 0; i < 16; i++)
+        remapped[i] = indices[i];
+    if (colour0 < colour1){
+        unsigned swap = colour0;
+        colour0 = colour1;
+        colour1 = swap;
+        static const int swapped[4] = {1, 0, 3, 2};
+        for (int i = 0; i < 16; i++)
+            remapped[i] = swapped[indices[i]];
+    }
+    else if (colour0 == colour1){
+        for (int i = 0; i < 16; i++)
+            remapped[i] = 0;
+    }
+
+    unsigned bits = 0;
+    for (int i = 15; i >= 0; i--)
+        bits = (bits << 2) | remapped[i];
+    block[0] = colour0 & 0xff;
+    block[1] = colour0 >> 8;
+    block[2] = colour1 & 0xff;
+    block[3] = colour1 >> 8;
+    for (int k = 0; k < 4; k++)
+        block[4 + k] = (bits >> (8*k)) & 0xff;
+}
+
+void encodeBlock(const unsigned char texels[16][3], unsigned char *block){
+    // Mean and covariance of the colours
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++){
+        for (int c = 0; c < 3; c++)
+            mean[c] += texels[i][c] / 16.f;
+    }
+    float covariance[6] = {0, 0, 0, 0, 0, 0};     // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++){
+        float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+        covariance[0] += d[0]*d[0];
+        covariance[1] += d[0]*d[1];
+        covariance[2] += d[0]*d[2];
+        covariance[3] += d[1]*d[1];
+        covariance[4] += d[1]*d[2];
+        covariance[5] += d[2]*d[2];
+    }
+
+    // Principal axis by power iteration
+    float axis[3] = {1.f, 1.f, 1.f};
+    for (int iteration = 0; iteration < 8; iteration++){
+        float next[3] = {
+            covariance[0]*axis[0] + covariance[1]*axis[1] + covariance[2]*axis[2],
+            covariance[1]*axis[0] + covariance[3]*axis[1] + covariance[4]*axis[2],
+            covariance[2]*axis[0] + covariance[4]*axis[1] + covariance[5]*axis[2]
+        };
+        float length = sqrt(next[0]*next[0] + next[1]*next[1] + next[2]*next[2]);
+        if (length < 1e-6f)
+            break;      // flat block
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    // Extent along the axis, inset by half a palette step against outliers
+    float low = numeric_limits<float>::max(), high = -low;
+    for (int i = 0; i < 16; i++){
+        float t = (texels[i][0] - mean[0])*axis[0] + (texels[i][1] - mean[1])*axis[1] + (texels[i][2] - mean[2])*axis[2];
+        low = t < low ? t : low;
+        high = t > high ? t : high;
+    }
+    float inset = (high - low) / 16.f;
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++){
+        end0[c] = mean[c] + (high - inset) * axis[c];
+        end1[c] = mean[c] + (low + inset) * axis[c];
+    }
+
+    unsigned colour0 = pack565(end0), colour1 = pack565(end1);
+    int indices[16];
+    int error = chooseIndices(texels, colour0, colour1, indices);
+
+    // One least squares pass over the chosen indices
+    if (error > 0 && refine(texels, indices, end0, end1)){
+        unsigned refined0 = pack565(end0), refined1 = pack565(end1);
+        int refinedIndices[16];
+        int refinedError = chooseIndices(texels, refined0, refined1, refinedIndices);
+        if (refinedError < error){
+            colour0 = refined0;
+            colour1 = refined1;
+            for (int i = 0; i < 16; i++)
+                indices[i] = refinedIndices[i];
+        }
+    }
+
+    // Equal end points in four colour order would lose the block; re-pick against the stored order
+    if (colour0 == colour1 || colour0 < colour1)
+        chooseIndices(texels, colour0, colour1, indices);
+    writeBlock(colour0, colour1, indices, block);
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+size_t bc1Bytes(unsigned width, unsigned height){
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * BC1_BLOCK_BYTES;
+}
+
+void encodeBc1(const unsigned char *rgb, unsigned width, unsigned height, unsigned char *blocks, ThreadPool &pool){
+    unsigned blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    pool.parallelFor(blocksY, [&](size_t by){
+        unsigned char texels[16][3];
+        for (unsigned bx = 0; bx < blocksX; bx++){
+            for (unsigned i = 0; i < 16; i++){
+                unsigned x = 4*bx + i % 4, y = 4*by + i / 4;
+                x = x < width ? x : width - 1;
+                y = y < height ? y : height - 1;
+                const unsigned char *texel = rgb + 3 * ((size_t) y * width + x);
+                for (int c = 0; c < 3; c++)
+                    texels[i][c] = texel[c];
+            }
+            encodeBlock(texels, blocks + (by * blocksX + bx) * BC1_BLOCK_BYTES);
+        }
+    });
+}
+
+void decodeBc1(const unsigned char *blocks, unsigned width, unsigned height, unsigned char *rgb){
+    unsigned blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    for (unsigned by = 0; by < blocksY; by++){
+        for (unsigned bx = 0; bx < blocksX; bx++){
+            const unsigned char *block = blocks + (by * blocksX + bx) * BC1_BLOCK_BYTES;
+            unsigned colour0 = block[0] | (block[1] << 8), colour1 = block[2] | (block[3] << 8);
+            unsigned bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned) block[7] << 24);
+            int colours[4][3];
+            palette(colour0, colour1, colours);
+            if (colour0 <= colour1){
+                // Three colour mode: a half way colour and black
+                for (int c = 0; c < 3; c++){
+                    colours[2][c] = (colours[0][c] + colours[1][c]) / 2;
+                    colours[3][c] = 0;
+                }
+            }
+            for (unsigned i = 0; i < 16; i++){
+                unsigned x = 4*bx + i % 4, y = 4*by + i / 4;
+                if (x >= width || y >= height)
+                    continue;
+                const int *colour = colours[(bits >> (2*i)) & 3];
+                unsigned char *texel = rgb + 3 * ((size_t) y * width + x);
+                for (int c = 0; c < 3; c++)
+                    texel[c] = colour[c];
+            }
+        }
+    }
+}
+
+double psnrRgb(const unsigned char *a, const unsigned char *b, size_t texels){
+    double sum = 0;
+    for (size_t i = 0; i < 3*texels; i++){
+        double d = (double) a[i] - b[i];
+        sum += d*d;
+    }
+    if (sum == 0)
+        return numeric_limits<double>::infinity();
+    double mse = sum / (3*texels);
+    return 10 * log10(255.0*255.0 / mse);
+}
@@ -0,0 +1,39 @@
+/**
+ * BC1 (DXT1) texture compression
+ *
+ * Every 4x4 block of texels is stored in 8 bytes: two RGB 5:6:5 end points
+ * and a 2 bit index per texel into the end points and the two colours a third
+ * of the way between them -- 4 bits per texel against 24 for RGB8.
+ *
+ * The encoder fits the end points to the principal axis of the block's
+ * colours, insets them slightly and then refines them once by least squares
+ * against the chosen indices, keeping whichever has the smaller error. Blocks
+ * are always in four colour mode. Rows of blocks are encoded in parallel on
+ * the thread pool. Partial blocks at the edges of odd sized levels repeat
+ * their last row and column.
+ */
+
+#ifndef TEXTURECOMPRESSION_H_
+#define TEXTURECOMPRESSION_H_
+
+#include <cstddef>
+
+class ThreadPool;
+
+/*************** Macros *******************/
+#define BC1_BLOCK_BYTES 8
+
+/*************** Function Prototypes *******************/
+// Bytes of a width x height level in BC1
+size_t bc1Bytes(unsigned width, unsigned height);
+
+// Compress RGB texels, rows not padded, into bc1Bytes(width, height) bytes of blocks
+void encodeBc1(const unsigned char *rgb, unsigned width, unsigned height, unsigned char *blocks, ThreadPool &pool);
+
+// Expand blocks back into width x height RGB texels
+void decodeBc1(const unsigned char *blocks, unsigned width, unsigned height, unsigned char *rgb);
+
+// Peak signal to noise ratio in dB between two RGB images of the same size; infinite if equal
+double psnrRgb(const unsigned char *a, const unsigned char *b, size_t texels);
+
+#endif /* TEXTURECOMPRESSION_H_ */
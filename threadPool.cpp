@@ -0,0 +1,100 @@
+/**
+ * Fixed size pool of worker threads -- see threadPool.h
+ */
+
+/*************** Includes *******************/
+#include "threadPool.h"
+
+using namespace std;
+
+/******************** FUNCTIONS ***********************/
+ThreadPool::ThreadPool(unsigned threads): job(NULL), generation(0), active(0), stopping(false){
+    if (threads == 0)
+        threads = thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;    // hardware_concurrency() is allowed to be unknown
+
+    // The calling thread is the last member of the pool
+    for (unsigned i = 1; i < threads; i++)
+        workers.push_back(thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (vector<thread>::iterator it = workers.begin(); it < workers.end(); it++)
+        it->join();
+}
+
+ThreadPool &ThreadPool::global(){
+    static ThreadPool pool;
+    return pool;
+}
+
+// Claim and run iterations until the job runs out
+void ThreadPool::runJob(Job &job){
+    size_t i;
+    while ((i = job.next.fetch_add(1)) < job.count)
+        (*job.task)(i);
+}
+
+void ThreadPool::workerLoop(){
+    unsigned seen = 0;
+    for (;;){
+        Job *current;
+        {
+            unique_lock<std::mutex> lock(stateMutex);
+            while (!stopping && generation == seen)
+                wake.wait(lock);
+            if (stopping)
+                return;
+            seen = generation;
+            current = job;
+        }
+
+        runJob(*current);
+
+        {
+            lock_guard<std::mutex> lock(stateMutex);
+            if (--active == 0)
+                done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)> &task){
+    if (count == 0)
+        return;
+
+    // Nothing to share, or the pool is busy with an outer loop -- run in place
+    unique_lock<std::mutex> submit(submitMutex, try_to_lock);
+    if (workers.empty() || count == 1 || !submit.owns_lock()){
+        for (size_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    Job current;
+    current.task = &task;
+    current.count = count;
+    current.next = 0;
+
+    {
+        lock_guard<std::mutex> lock(stateMutex);
+        job = &current;
+        active = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    runJob(current);
+
+    // Wait for the workers to let go of the job before it goes out of scope
+    unique_lock<std::mutex> lock(stateMutex);
+    while (active != 0)
+        done.wait(lock);
+    job = NULL;
+}
@@ -0,0 +1,61 @@
+/**
+ * Fixed size pool of worker threads
+ *
+ * parallelFor() splits a loop over the workers and the calling thread and
+ * returns once every iteration has run.
+ */
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*************** Classes *******************/
+class ThreadPool{
+    // A loop handed out to the workers
+    struct Job{
+        const std::function<void(size_t)> *task;
+        size_t count;
+        std::atomic<size_t> next;       // next iteration to be claimed
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex stateMutex;
+    std::condition_variable wake, done;
+    Job *job;               // current job, NULL if idle
+    unsigned generation;    // bumped for every new job
+    unsigned active;        // workers still working on the current job
+    bool stopping;
+
+    std::mutex submitMutex; // one parallelFor() at a time
+
+    // Disallow copying
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void workerLoop();
+    static void runJob(Job &job);
+public:
+    // threads includes the calling thread; 0 uses one thread per core
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    // Number of threads taking part in parallelFor(), including the caller
+    unsigned size() const {
+        return workers.size() + 1;
+    }
+
+    // Run task(i) for every i in [0, count) and wait for all of them
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+    // Shared pool used by the loaders
+    static ThreadPool &global();
+};
+
+#endif /* THREADPOOL_H_ */
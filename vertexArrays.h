@@ -0,0 +1,95 @@
+/**
+ * Structure of arrays copy of the vertices
+ *
+ * Every attribute of the vertices lives in its own aligned float array, so
+ * that the batch kernels in meshKernels.h can stream over them with SIMD
+ * loads. The arrays are either owned (one aligned block) or borrowed from
+ * elsewhere, e.g. the mmap'd mesh cache.
+ */
+
+#ifndef VERTEXARRAYS_H_
+#define VERTEXARRAYS_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/*************** Macros *******************/
+// Alignment of each array, enough for AVX loads and a cache line
+#define VERTEX_ARRAY_ALIGNMENT 64
+
+/*************** Classes *******************/
+enum VertexArray{
+    VERTEX_X, VERTEX_Y, VERTEX_Z,       // position
+    VERTEX_U, VERTEX_V,                 // texture coordinates
+    VERTEX_NX, VERTEX_NY, VERTEX_NZ,    // normal
+    VERTEX_ARRAY_COUNT
+};
+
+class VertexArrays{
+    float *storage;     // owned block, NULL when the arrays are borrowed
+    float *arrays[VERTEX_ARRAY_COUNT];
+    size_t count;
+
+    // Disallow copying
+    VertexArrays(const VertexArrays &);
+    VertexArrays &operator=(const VertexArrays &);
+public:
+    VertexArrays(): storage(NULL), count(0){
+        memset(arrays, 0, sizeof(arrays));
+    }
+
+    ~VertexArrays(){
+        clear();
+    }
+
+    // Floats per array once padded to the alignment
+    static size_t paddedSize(size_t count){
+        const size_t floats = VERTEX_ARRAY_ALIGNMENT / sizeof(float);
+        return (count + floats - 1) / floats * floats;
+    }
+
+    // Allocate zeroed arrays for count vertices
+    void allocate(size_t newCount){
+        clear();
+        size_t stride = paddedSize(newCount);
+        void *block = NULL;
+        if (stride > 0 && posix_memalign(&block, VERTEX_ARRAY_ALIGNMENT, stride * VERTEX_ARRAY_COUNT * sizeof(float)) != 0)
+            throw std::bad_alloc();
+        storage = static_cast<float *>(block);
+        if (storage != NULL)
+            memset(storage, 0, stride * VERTEX_ARRAY_COUNT * sizeof(float));
+        for (int i = 0; i < VERTEX_ARRAY_COUNT; i++)
+            arrays[i] = storage == NULL ? NULL : storage + i*stride;
+        count = newCount;
+    }
+
+    // Refer to arrays owned elsewhere
+    void attach(float *const newArrays[VERTEX_ARRAY_COUNT], size_t newCount){
+        clear();
+        memcpy(arrays, newArrays, sizeof(arrays));
+        count = newCount;
+    }
+
+    void clear(){
+        free(storage);
+        storage = NULL;
+        memset(arrays, 0, sizeof(arrays));
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    float *get(VertexArray array){
+        return arrays[array];
+    }
+
+    const float *get(VertexArray array) const {
+        return arrays[array];
+    }
+};
+
+#endif /* VERTEXARRAYS_H_ */
@@ -0,0 +1,1356 @@
+/**
+ * Parallel parser for legacy VTK POLYDATA and VTK XML PolyData files -- see vtkParser.h
+ */
+
+/*************** Includes *******************/
+#include "vtkParser.h"
+#include "threadPool.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <locale.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Smallest chunk worth handing to a thread
+#define MIN_CHUNK_BYTES (256*1024)
+
+// Chunks per thread, so that uneven chunks still balance out
+#define CHUNKS_PER_THREAD 8
+
+// Values converted by one task when copying binary arrays
+#define CONVERT_CHUNK 65536
+
+// Bytes at the start of a file searched for an XML declaration or VTKFile element
+#define XML_SNIFF_BYTES 256
+
+/*************** Helpers *******************/
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start){
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+inline bool isSpace(char c){
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(char c){
+    return c >= '0' && c <= '9';
+}
+
+// Exact powers of ten in single precision
+const float powersOfTen[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+// Slow path: hand the token to the C library in the "C" locale
+bool parseFloatFallback(const char *begin, const char *end, float &out){
+    static locale_t cLocale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+
+    string token(begin, end);
+    char *stop;
+    out = strtof_l(token.c_str(), &stop, cLocale);
+    return stop == token.c_str() + token.size() && stop != token.c_str();
+}
+
+/**
+ * Parse the float in [begin, end).
+ *
+ * Decimals with at most 24 bits of mantissa and a power of ten within
+ * +/-10 are exact in single precision, so a single multiply or divide gives
+ * the correctly rounded result (Clinger's fast path) -- the same float that
+ * strtof() and "stream >> x" give. Everything else goes through strtof_l().
+ */
+bool parseFloat(const char *begin, const char *end, float &out){
+    const char *s = begin;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')){
+        negative = *s == '-';
+        s++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false, truncated = false;
+
+    for (; s < end && isDigit(*s); s++){
+        any = true;
+        int d = *s - '0';
+        if (mantissa == 0 && d == 0)
+            continue;   // leading zero
+        if (digits < 19){
+            mantissa = mantissa*10 + d;
+            digits++;
+        }
+        else{
+            exponent++;
+            truncated |= d != 0;
+        }
+    }
+
+    if (s < end && *s == '.'){
+        for (s++; s < end && isDigit(*s); s++){
+            any = true;
+            int d = *s - '0';
+            if (mantissa == 0 && d == 0){
+                exponent--;
+            }
+            else if (digits < 19){
+                mantissa = mantissa*10 + d;
+                digits++;
+                exponent--;
+            }
+            else{
+                truncated |= d != 0;
+            }
+        }
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')){
+        s++;
+        bool negativeExponent = false;
+        if (s < end && (*s == '-' || *s == '+')){
+            negativeExponent = *s == '-';
+            s++;
+        }
+        if (s == end || !isDigit(*s))
+            return parseFloatFallback(begin, end, out);
+        int e = 0;
+        for (; s < end && isDigit(*s); s++)
+            e = e < 100000 ? e*10 + (*s - '0') : e;
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if (!any || s != end || truncated)
+        return parseFloatFallback(begin, end, out);
+
+    if (mantissa == 0){
+        out = negative ? -0.f : 0.f;
+        return true;
+    }
+
+    if (mantissa > (1u << 24) || exponent < -10 || exponent > 10)
+        return parseFloatFallback(begin, end, out);
+
+    float value = (float) mantissa;
+    if (exponent < 0)
+        value /= powersOfTen[-exponent];
+    else
+        value *= powersOfTen[exponent];
+    out = negative ? -value : value;
+    return true;
+}
+
+// Parse the int in [begin, end)
+bool parseInt(const char *begin, const char *end, int &out){
+    const char *s = begin;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')){
+        negative = *s == '-';
+        s++;
+    }
+    if (s == end)
+        return false;
+
+    long long value = 0;
+    for (; s < end; s++){
+        if (!isDigit(*s))
+            return false;
+        value = value*10 + (*s - '0');
+        if (value > 2147483648LL)
+            return false;
+    }
+    if (negative)
+        value = -value;
+    if (value > 2147483647LL)
+        return false;
+    out = (int) value;
+    return true;
+}
+
+inline bool parseToken(const char *begin, const char *end, float &out){
+    return parseFloat(begin, end, out);
+}
+
+inline bool parseToken(const char *begin, const char *end, int &out){
+    return parseInt(begin, end, out);
+}
+
+// Count the whitespace separated tokens in [begin, end)
+size_t countTokens(const char *begin, const char *end){
+    size_t count = 0;
+    bool inToken = false;
+    for (const char *s = begin; s < end; s++){
+        bool space = isSpace(*s);
+        count += !space && !inToken;
+        inToken = !space;
+    }
+    return count;
+}
+
+// Split [begin, end) into line aligned chunks, a few per thread
+vector<const char *> splitLines(const char *begin, const char *end, unsigned threads){
+    size_t bytes = end - begin;
+    size_t chunkCount = bytes / MIN_CHUNK_BYTES;
+    if (chunkCount > (size_t) threads * CHUNKS_PER_THREAD)
+        chunkCount = threads * CHUNKS_PER_THREAD;
+    if (chunkCount == 0)
+        chunkCount = 1;
+
+    vector<const char *> boundaries;
+    boundaries.push_back(begin);
+    for (size_t k = 1; k < chunkCount; k++){
+        const char *split = begin + bytes * k / chunkCount;
+        if (split < boundaries.back())
+            split = boundaries.back();
+        const char *newline = static_cast<const char *>(memchr(split, '\n', end - split));
+        split = newline == NULL ? end : newline + 1;
+        if (split > boundaries.back() && split < end)
+            boundaries.push_back(split);
+    }
+    boundaries.push_back(end);
+    return boundaries;
+}
+
+/**
+ * Parse the first count tokens of [begin, end) into out.
+ *
+ * Pass one counts the tokens of every chunk so that each chunk knows where
+ * its values go; pass two parses the chunks straight into place.
+ */
+template <typename T> bool parseSection(const char *begin, const char *end, size_t count, T *out,
+        ThreadPool &pool, const char *name, string &error){
+    vector<const char *> boundaries = splitLines(begin, end, pool.size());
+    size_t chunks = boundaries.size() - 1;
+
+    vector<size_t> offsets(chunks + 1, 0);
+    pool.parallelFor(chunks, [&](size_t k){
+        offsets[k+1] = countTokens(boundaries[k], boundaries[k+1]);
+    });
+    for (size_t k = 0; k < chunks; k++)
+        offsets[k+1] += offsets[k];
+
+    if (offsets[chunks] < count){
+        error = string("File ended unexpectedly (") + name + ")";
+        return false;
+    }
+
+    atomic<bool> failed(false);
+    pool.parallelFor(chunks, [&](size_t k){
+        size_t index = offsets[k];
+        const char *s = boundaries[k], *chunkEnd = boundaries[k+1];
+        while (index < count && !failed.load(memory_order_relaxed)){
+            while (s < chunkEnd && isSpace(*s))
+                s++;
+            if (s == chunkEnd)
+                break;
+            const char *token = s;
+            while (s < chunkEnd && !isSpace(*s))
+                s++;
+            if (!parseToken(token, s, out[index++]))
+                failed = true;
+        }
+    });
+
+    if (failed){
+        error = string("Invalid number (") + name + ")";
+        return false;
+    }
+    return true;
+}
+
+// A line starting with a keyword, and the data lines following it
+struct Section{
+    string keyword;
+    const char *header;     // start of the keyword line
+    const char *data;       // start of the line after it
+    const char *end;        // start of the next keyword line
+};
+
+// Find every line starting with an upper case keyword in [begin, end)
+vector<Section> findSections(const char *begin, const char *end, ThreadPool &pool){
+    vector<const char *> boundaries = splitLines(begin, end, pool.size());
+    size_t chunks = boundaries.size() - 1;
+
+    // Data lines start with a digit, a sign, a dot or white space
+    vector< vector<const char *> > found(chunks);
+    pool.parallelFor(chunks, [&](size_t k){
+        const char *s = boundaries[k], *chunkEnd = boundaries[k+1];
+        while (s < chunkEnd){
+            if (*s >= 'A' && *s <= 'Z')
+                found[k].push_back(s);
+            const char *newline = static_cast<const char *>(memchr(s, '\n', chunkEnd - s));
+            s = newline == NULL ? chunkEnd : newline + 1;
+        }
+    });
+
+    vector<Section> sections;
+    for (size_t k = 0; k < chunks; k++){
+        for (vector<const char *>::iterator it = found[k].begin(); it < found[k].end(); it++){
+            Section section;
+            section.header = *it;
+            const char *s = *it;
+            while (s < end && !isSpace(*s))
+                s++;
+            section.keyword.assign(*it, s);
+            const char *newline = static_cast<const char *>(memchr(s, '\n', end - s));
+            section.data = newline == NULL ? end : newline + 1;
+            if (!sections.empty())
+                sections.back().end = section.header;
+            sections.push_back(section);
+        }
+    }
+    if (!sections.empty())
+        sections.back().end = end;
+    return sections;
+}
+
+// Index of the first section called keyword from index from, or -1
+int findSection(const vector<Section> &sections, const char *keyword, size_t from = 0){
+    for (size_t i = from; i < sections.size(); i++){
+        if (sections[i].keyword == keyword)
+            return i;
+    }
+    return -1;
+}
+
+// Header line of a section as a stream, positioned after the keyword
+void headerStream(const Section &section, istringstream &stream){
+    stream.clear();
+    stream.str(string(section.header, section.data));
+    string keyword;
+    stream >> keyword;
+}
+
+// Read the whole file into buffer; info is the file the bytes came from
+bool readFile(const string &path, vector<char> &buffer, struct stat &info){
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &info) != 0){
+        close(fd);
+        return false;
+    }
+
+    buffer.resize(info.st_size);
+    size_t done = 0;
+    while (done < buffer.size()){
+        ssize_t got = read(fd, &buffer[done], buffer.size() - done);
+        if (got <= 0)
+            break;
+        done += got;
+    }
+    close(fd);
+    buffer.resize(done);
+    return done == (size_t) info.st_size;
+}
+
+// Return the next line of [s, end) and move s past it
+string nextLine(const char *&s, const char *end){
+    const char *newline = static_cast<const char *>(memchr(s, '\n', end - s));
+    const char *lineEnd = newline == NULL ? end : newline;
+    string line(s, lineEnd);
+    s = newline == NULL ? end : newline + 1;
+    if (!line.empty() && line[line.size()-1] == '\r')
+        line.erase(line.size()-1);
+    return line;
+}
+
+/*************** Binary arrays *******************/
+enum ScalarType{
+    SCALAR_FLOAT32, SCALAR_FLOAT64,
+    SCALAR_INT32, SCALAR_UINT32, SCALAR_INT64, SCALAR_UINT64,
+    SCALAR_UNKNOWN
+};
+
+size_t scalarBytes(ScalarType type){
+    return type == SCALAR_FLOAT32 || type == SCALAR_INT32 || type == SCALAR_UINT32 ? 4 : 8;
+}
+
+// Data type names of legacy files; vtkIdType is written as a 32 bit int
+ScalarType legacyScalarType(const string &name){
+    if (name == "float")
+        return SCALAR_FLOAT32;
+    if (name == "double")
+        return SCALAR_FLOAT64;
+    if (name == "int" || name == "vtkIdType" || name == "vtktypeint32")
+        return SCALAR_INT32;
+    if (name == "unsigned_int" || name == "vtktypeuint32")
+        return SCALAR_UINT32;
+    if (name == "long" || name == "vtktypeint64")
+        return SCALAR_INT64;
+    if (name == "unsigned_long" || name == "vtktypeuint64")
+        return SCALAR_UINT64;
+    return SCALAR_UNKNOWN;
+}
+
+// Type attribute names of XML files
+ScalarType xmlScalarType(const string &name){
+    if (name == "Float32")
+        return SCALAR_FLOAT32;
+    if (name == "Float64")
+        return SCALAR_FLOAT64;
+    if (name == "Int32")
+        return SCALAR_INT32;
+    if (name == "UInt32")
+        return SCALAR_UINT32;
+    if (name == "Int64")
+        return SCALAR_INT64;
+    if (name == "UInt64")
+        return SCALAR_UINT64;
+    return SCALAR_UNKNOWN;
+}
+
+bool hostIsBigEndian(){
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const unsigned char *>(&probe) == 0;
+}
+
+inline uint32_t load32(const unsigned char *p, bool swap){
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return swap ? __builtin_bswap32(value) : value;
+}
+
+inline uint64_t load64(const unsigned char *p, bool swap){
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return swap ? __builtin_bswap64(value) : value;
+}
+
+/**
+ * Copy count values of type from in to out, swapping the bytes of each when
+ * swap is set. Runs in chunks on the pool; returns false if a value does
+ * not fit in T (integers only).
+ */
+template <typename T> bool convertArray(const unsigned char *in, ScalarType type, bool swap, size_t count, T *out,
+        ThreadPool &pool){
+    // Any float fits a float, NaN included; only integers can be out of range
+    const bool integer = numeric_limits<T>::is_integer;
+    atomic<bool> failed(false);
+    size_t chunks = (count + CONVERT_CHUNK - 1) / CONVERT_CHUNK;
+    pool.parallelFor(chunks, [&](size_t chunk){
+        size_t first = chunk * CONVERT_CHUNK, last = first + CONVERT_CHUNK < count ? first + CONVERT_CHUNK : count;
+        bool bad = false;
+        for (size_t i = first; i < last; i++){
+            switch (type){
+                case SCALAR_FLOAT32:{
+                    uint32_t bits = load32(in + 4*i, swap);
+                    float value;
+                    memcpy(&value, &bits, sizeof(value));
+                    out[i] = (T) value;
+                    bad |= integer && value != (T) value;
+                    break;
+                }
+                case SCALAR_FLOAT64:{
+                    uint64_t bits = load64(in + 8*i, swap);
+                    double value;
+                    memcpy(&value, &bits, sizeof(value));
+                    out[i] = (T) value;
+                    break;
+                }
+                case SCALAR_INT32:
+                    out[i] = (T) (int32_t) load32(in + 4*i, swap);
+                    break;
+                case SCALAR_UINT32:{
+                    uint32_t value = load32(in + 4*i, swap);
+                    out[i] = (T) value;
+                    bad |= integer && value > 2147483647u;
+                    break;
+                }
+                case SCALAR_INT64:{
+                    int64_t value = (int64_t) load64(in + 8*i, swap);
+                    out[i] = (T) value;
+                    bad |= integer && (value < -2147483647LL - 1 || value > 2147483647LL);
+                    break;
+                }
+                case SCALAR_UINT64:{
+                    uint64_t value = load64(in + 8*i, swap);
+                    out[i] = (T) value;
+                    bad |= integer && value > 2147483647u;
+                    break;
+                }
+                default:
+                    bad = true;
+            }
+        }
+        if (bad)
+            failed = true;
+    });
+    return !failed;
+}
+
+// Walk the cells to check that they add up to the declared size
+bool checkCells(const VtkPolyData &data, string &error){
+    size_t cellCount = 0;
+    for (size_t i = 0; i < data.polygonCount; i++){
+        if (cellCount >= data.cells.size() || data.cells[cellCount] < 0)
+            break;
+        cellCount += 1 + data.cells[cellCount];
+    }
+    if (cellCount != data.cells.size()){
+        ostringstream message;
+        message << "Cell count mismatch " << data.cells.size() << " vs " << cellCount;
+        error = message.str();
+        return false;
+    }
+    return true;
+}
+
+// Build VTK cells from XML or VTK 5.1 style connectivity and the offsets of each polygon, first 0 and last the total
+bool connectivityToCells(const vector<int> &offsets, const vector<int> &connectivity, VtkPolyData &data, string &error){
+    if (offsets.empty() || offsets[0] != 0 || (size_t) offsets.back() != connectivity.size()){
+        error = "Invalid polygon offsets";
+        return false;
+    }
+    data.polygonCount = offsets.size() - 1;
+    data.cells.resize(data.polygonCount + connectivity.size());
+    int *cell = data.cells.data();
+    for (size_t i = 0; i < data.polygonCount; i++){
+        int first = offsets[i], last = offsets[i+1];
+        if (last < first){
+            error = "Invalid polygon offsets";
+            return false;
+        }
+        *cell++ = last - first;
+        memcpy(cell, &connectivity[first], (last - first) * sizeof(int));
+        cell += last - first;
+    }
+    return true;
+}
+
+/*************** Binary legacy files *******************/
+// Skip the white space between a binary payload and the next keyword line
+void skipSpace(const char *&s, const char *end){
+    while (s < end && isSpace(*s))
+        s++;
+}
+
+// Convert the count values of type at s into out and move s past them
+template <typename T> bool readLegacyArray(const char *&s, const char *end, ScalarType type, size_t count,
+        vector<T> &out, ThreadPool &pool, const char *name, string &error){
+    if (type == SCALAR_UNKNOWN){
+        error = string("Unsupported data type (") + name + ")";
+        return false;
+    }
+    size_t bytes = count * scalarBytes(type);
+    if ((size_t) (end - s) < bytes){
+        error = string("File ended unexpectedly (") + name + ")";
+        return false;
+    }
+    out.resize(count);
+    if (!convertArray(reinterpret_cast<const unsigned char *>(s), type, !hostIsBigEndian(), count, out.data(), pool)){
+        error = string("Value out of range (") + name + ")";
+        return false;
+    }
+    s += bytes;
+    return true;
+}
+
+// Bytes of count values of a legacy data type, 0 if the type is unknown
+size_t legacyArrayBytes(const string &type, size_t count){
+    if (type == "bit")
+        return (count + 7) / 8;
+    if (type == "char" || type == "unsigned_char" || type == "vtktypeint8" || type == "vtktypeuint8")
+        return count;
+    if (type == "short" || type == "unsigned_short" || type == "vtktypeint16" || type == "vtktypeuint16")
+        return 2 * count;
+    ScalarType scalar = legacyScalarType(type);
+    return scalar == SCALAR_UNKNOWN ? 0 : count * scalarBytes(scalar);
+}
+
+// Move s past the count values of type at s, for arrays that are not used
+bool skipLegacyArray(const char *&s, const char *end, const string &type, size_t count, const char *name, string &error){
+    size_t bytes = legacyArrayBytes(type, count);
+    if (bytes == 0 && count > 0){
+        error = string("Unsupported data type (") + name + ")";
+        return false;
+    }
+    if ((size_t) (end - s) < bytes){
+        error = string("File ended unexpectedly (") + name + ")";
+        return false;
+    }
+    s += bytes;
+    return true;
+}
+
+// Move s past a METADATA block: text lines up to the first empty one
+void skipMetadata(const char *&s, const char *end){
+    while (s < end && !nextLine(s, end).empty())
+        ;
+}
+
+/**
+ * The sections of a BINARY legacy file from s on. Payloads are big endian
+ * and follow their keyword line directly; sections this program does not
+ * use are skipped by their size. Texture coordinates are optional.
+ */
+bool parseLegacyBinary(const char *s, const char *end, VtkPolyData &data, ThreadPool &pool, VtkParseStats &stats,
+        string &error){
+    bool points = false, polygons = false, pointData = false;
+    size_t attributeCount = 0;      // tuples in the current POINT_DATA or CELL_DATA section
+    for (skipSpace(s, end); s < end; skipSpace(s, end)){
+        Clock::time_point start = Clock::now();
+        const char *sectionStart = s;
+        istringstream header(nextLine(s, end));
+        string keyword, type;
+        long long count = -1, size = -1;
+        header >> keyword;
+
+        if (keyword == "POINTS"){
+            header >> count >> type;
+            if (count < 0){
+                error = "Invalid POINTS header";
+                return false;
+            }
+            data.pointCount = count;
+            if (!readLegacyArray(s, end, legacyScalarType(type), 3*data.pointCount, data.points, pool, "VERTICES", error))
+                return false;
+            points = true;
+            stats.pointsSeconds += secondsSince(start);
+            stats.pointsBytes += s - sectionStart;
+        }
+        else if (keyword == "POLYGONS"){
+            header >> count >> size;
+            if (count < 0 || size < 0){
+                error = "Invalid POLYGONS header";
+                return false;
+            }
+            const char *next = s;
+            istringstream layout(nextLine(next, end));
+            string arrayKeyword;
+            layout >> arrayKeyword >> type;
+            if (arrayKeyword == "OFFSETS"){
+                // VTK 5.1 layout: count+1 offsets, then size indices
+                vector<int> offsets, connectivity;
+                s = next;
+                if (!readLegacyArray(s, end, legacyScalarType(type), count, offsets, pool, "OFFSETS", error))
+                    return false;
+                skipSpace(s, end);
+                istringstream connectivityHeader(nextLine(s, end));
+                connectivityHeader >> arrayKeyword >> type;
+                if (arrayKeyword != "CONNECTIVITY"){
+                    error = "File ended unexpectedly (CONNECTIVITY)";
+                    return false;
+                }
+                if (!readLegacyArray(s, end, legacyScalarType(type), size, connectivity, pool, "CONNECTIVITY", error)
+                        || !connectivityToCells(offsets, connectivity, data, error))
+                    return false;
+            }
+            else{
+                if (size < count){
+                    error = "Invalid POLYGONS header";
+                    return false;
+                }
+                data.polygonCount = count;
+                if (!readLegacyArray(s, end, SCALAR_INT32, size, data.cells, pool, "POLYGONS", error)
+                        || !checkCells(data, error))
+                    return false;
+            }
+            polygons = true;
+            stats.polygonsSeconds += secondsSince(start);
+            stats.polygonsBytes += s - sectionStart;
+        }
+        else if (keyword == "VERTICES" || keyword == "LINES" || keyword == "TRIANGLE_STRIPS"){
+            header >> count >> size;
+            if (count < 0 || size < 0){
+                error = "Invalid " + keyword + " header";
+                return false;
+            }
+            const char *next = s;
+            istringstream layout(nextLine(next, end));
+            string arrayKeyword;
+            layout >> arrayKeyword >> type;
+            if (arrayKeyword == "OFFSETS"){
+                // VTK 5.1 layout, as for POLYGONS
+                s = next;
+                if (!skipLegacyArray(s, end, type, count, "OFFSETS", error))
+                    return false;
+                skipSpace(s, end);
+                istringstream connectivityHeader(nextLine(s, end));
+                connectivityHeader >> arrayKeyword >> type;
+                if (arrayKeyword != "CONNECTIVITY"){
+                    error = "File ended unexpectedly (CONNECTIVITY)";
+                    return false;
+                }
+                if (!skipLegacyArray(s, end, type, size, "CONNECTIVITY", error))
+                    return false;
+            }
+            else if (!skipLegacyArray(s, end, "int", size, keyword.c_str(), error)){
+                return false;
+            }
+        }
+        else if (keyword == "POINT_DATA" || keyword == "CELL_DATA"){
+            header >> count;
+            if (count < 0){
+                error = "Invalid " + keyword + " header";
+                return false;
+            }
+            pointData = keyword == "POINT_DATA";
+            attributeCount = count;
+        }
+        else if (keyword == "TEXTURE_COORDINATES" && pointData){
+            string name;
+            int dimension = -1;
+            header >> name >> dimension >> type;
+            if (dimension < 2){
+                error = "Invalid TEXTURE_COORDINATES header";
+                return false;
+            }
+            data.textureCount = attributeCount;
+            if (!readLegacyArray(s, end, legacyScalarType(type), dimension*attributeCount, data.textures, pool,
+                    "TEXTURE_COORDINATES", error))
+                return false;
+            if (dimension != 2){    // only u and v are used
+                for (size_t i = 0; i < data.textureCount; i++){
+                    data.textures[2*i] = data.textures[dimension*i];
+                    data.textures[2*i+1] = data.textures[dimension*i+1];
+                }
+                data.textures.resize(2*data.textureCount);
+            }
+            stats.texturesSeconds += secondsSince(start);
+            stats.texturesBytes += s - sectionStart;
+        }
+        else if (keyword == "TEXTURE_COORDINATES" || keyword == "NORMALS" || keyword == "SCALARS" || keyword == "VECTORS"
+                || keyword == "TENSORS" || keyword == "TENSORS6" || keyword == "GLOBAL_IDS" || keyword == "PEDIGREE_IDS"
+                || keyword == "COLOR_SCALARS"){
+            // Attributes that are not used: skip them by their size
+            string name;
+            long long components = keyword == "TENSORS" ? 9 : keyword == "TENSORS6" ? 6
+                    : keyword == "GLOBAL_IDS" || keyword == "PEDIGREE_IDS" ? 1 : 3;
+            header >> name;
+            if (keyword == "TEXTURE_COORDINATES" || keyword == "COLOR_SCALARS")
+                header >> components;
+            if (keyword == "COLOR_SCALARS")
+                type = "unsigned_char";     // binary colour scalars are always bytes
+            else
+                header >> type;
+            if (keyword == "SCALARS"){
+                if (!(header >> components))
+                    components = 1;
+                skipSpace(s, end);
+                nextLine(s, end);   // LOOKUP_TABLE
+            }
+            if (components < 1){
+                error = "Invalid " + keyword + " header";
+                return false;
+            }
+            if (!skipLegacyArray(s, end, type, components*attributeCount, keyword.c_str(), error))
+                return false;
+        }
+        else if (keyword == "LOOKUP_TABLE"){
+            // RGBA bytes per entry
+            string name;
+            header >> name >> count;
+            if (count < 0){
+                error = "Invalid LOOKUP_TABLE header";
+                return false;
+            }
+            if (!skipLegacyArray(s, end, "unsigned_char", 4*count, "LOOKUP_TABLE", error))
+                return false;
+        }
+        else if (keyword == "FIELD"){
+            // Named arrays, each with its own header line and tuple count
+            string name;
+            long long arrays = -1;
+            header >> name >> arrays;
+            if (arrays < 0){
+                error = "Invalid FIELD header";
+                return false;
+            }
+            for (long long i = 0; i < arrays; i++){
+                skipSpace(s, end);
+                istringstream arrayHeader(nextLine(s, end));
+                long long components = -1, tuples = -1;
+                arrayHeader >> name;
+                if (name == "NULL_ARRAY")
+                    continue;
+                arrayHeader >> components >> tuples >> type;
+                if (components < 0 || tuples < 0){
+                    error = "Invalid FIELD array header (" + name + ")";
+                    return false;
+                }
+                if (!skipLegacyArray(s, end, type, components*tuples, "FIELD", error))
+                    return false;
+
+                // An array may be followed by its METADATA
+                skipSpace(s, end);
+                const char *next = s;
+                if (nextLine(next, end) == "METADATA"){
+                    s = next;
+                    skipMetadata(s, end);
+                }
+            }
+        }
+        else if (keyword == "METADATA"){
+            skipMetadata(s, end);
+        }
+        else{
+            error = "Unsupported section in binary VTK file (" + keyword + ")";
+            return false;
+        }
+    }
+
+    if (!points){
+        error = "File ended unexpectedly (POINTS)";
+        return false;
+    }
+    if (!polygons){
+        error = "File ended unexpectedly (POLYGONS)";
+        return false;
+    }
+    return true;
+}
+
+/*************** XML files *******************/
+// An element's start tag: [start, close) with close at the '>'
+struct XmlTag{
+    const char *start, *close;
+};
+
+// The first start tag <name ...> in [begin, end)
+bool findTag(const char *begin, const char *end, const char *name, XmlTag &tag){
+    string open = string("<") + name;
+    for (const char *s = begin; s < end; s++){
+        s = static_cast<const char *>(memchr(s, '<', end - s));
+        if (s == NULL)
+            return false;
+        if ((size_t) (end - s) > open.size() && memcmp(s, open.data(), open.size()) == 0
+                && (isSpace(s[open.size()]) || s[open.size()] == '>' || s[open.size()] == '/')){
+            const char *close = static_cast<const char *>(memchr(s, '>', end - s));
+            if (close == NULL)
+                return false;
+            tag.start = s;
+            tag.close = close;
+            return true;
+        }
+    }
+    return false;
+}
+
+// End of the element a tag opens: the start of </name>, or end
+const char *elementEnd(const XmlTag &tag, const char *end, const char *name){
+    string closing = string("</") + name;
+    for (const char *s = tag.close; s < end; s++){
+        s = static_cast<const char *>(memchr(s, '<', end - s));
+        if (s == NULL)
+            break;
+        if ((size_t) (end - s) >= closing.size() && memcmp(s, closing.data(), closing.size()) == 0)
+            return s;
+    }
+    return end;
+}
+
+// Value of attribute name in a tag, empty if it has none
+string attribute(const XmlTag &tag, const char *name){
+    string key = string(name) + "=\"";
+    for (const char *s = tag.start; s < tag.close; s++){
+        s = static_cast<const char *>(memchr(s, key[0], tag.close - s));
+        if (s == NULL)
+            break;
+        if ((size_t) (tag.close - s) > key.size() && isSpace(s[-1]) && memcmp(s, key.data(), key.size()) == 0){
+            const char *value = s + key.size();
+            const char *quote = static_cast<const char *>(memchr(value, '"', tag.close - value));
+            return quote == NULL ? string() : string(value, quote);
+        }
+    }
+    return string();
+}
+
+// Where the payloads of a file are and how to read them
+struct XmlFile{
+    bool swap;              // byte order differs from the host's
+    size_t headerBytes;     // of the byte count before each payload
+    const char *appended;   // first byte after the '_' of AppendedData, or NULL
+    const char *appendedEnd;
+    bool appendedBase64;
+};
+
+// Value of each base64 character, -1 for anything else
+struct Base64Table{
+    signed char values[256];
+
+    Base64Table(){
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        memset(values, -1, sizeof(values));
+        for (int i = 0; i < 64; i++)
+            values[(unsigned char) alphabet[i]] = i;
+    }
+};
+const Base64Table base64Table;
+
+/**
+ * Decode base64 from s until out holds bytes, a group of four characters at
+ * a time, and move s past what was read. Padding only ends its group, so a
+ * byte count encoded apart from its payload decodes like one encoded with it.
+ */
+bool decodeBase64(const char *&s, const char *end, size_t bytes, vector<unsigned char> &out){
+    out.reserve(bytes + 2);
+    while (out.size() < bytes){
+        // Groups of four plain characters in a row, the common case
+        while (out.size() + 3 <= bytes && end - s >= 4){
+            int a = base64Table.values[(unsigned char) s[0]], b = base64Table.values[(unsigned char) s[1]];
+            int c = base64Table.values[(unsigned char) s[2]], d = base64Table.values[(unsigned char) s[3]];
+            if ((a | b | c | d) < 0)
+                break;
+            uint32_t group = a << 18 | b << 12 | c << 6 | d;
+            out.push_back(group >> 16);
+            out.push_back(group >> 8);
+            out.push_back(group);
+            s += 4;
+        }
+        if (out.size() >= bytes)
+            break;
+
+        // A group broken by white space or ended by padding
+        int values[4], got = 0, padding = 0;
+        while (got < 4){
+            skipSpace(s, end);
+            if (s == end)
+                return false;
+            char c = *s++;
+            if (c == '='){
+                padding++;
+                values[got++] = 0;
+                continue;
+            }
+            values[got] = base64Table.values[(unsigned char) c];
+            if (values[got++] < 0 || padding > 0)
+                return false;
+        }
+        if (padding > 2)
+            return false;
+        uint32_t group = values[0] << 18 | values[1] << 12 | values[2] << 6 | values[3];
+        out.push_back(group >> 16);
+        if (padding < 2)
+            out.push_back(group >> 8);
+        if (padding < 1)
+            out.push_back(group);
+    }
+    return true;
+}
+
+/**
+ * Read the DataArray tag into out: its payload, in the appended block or
+ * inline base64, starts with its size in bytes. storage holds decoded
+ * base64; payload points into it or straight into the file.
+ */
+template <typename T> bool readXmlArray(const XmlTag &tag, const char *end, const XmlFile &file, size_t count,
+        vector<T> &out, ThreadPool &pool, string &error){
+    string name = attribute(tag, "Name");
+    string label = name.empty() ? string("DataArray") : name;
+    ScalarType type = xmlScalarType(attribute(tag, "type"));
+    if (type == SCALAR_UNKNOWN){
+        error = "Unsupported data type (" + label + ")";
+        return false;
+    }
+
+    string format = attribute(tag, "format");
+    const char *s;
+    bool base64;
+    if (format == "appended"){
+        if (file.appended == NULL){
+            error = "No AppendedData for " + label;
+            return false;
+        }
+        size_t offset = strtoull(attribute(tag, "offset").c_str(), NULL, 10);
+        if (offset >= (size_t) (file.appendedEnd - file.appended)){
+            error = "File ended unexpectedly (" + label + ")";
+            return false;
+        }
+        s = file.appended + offset;
+        base64 = file.appendedBase64;
+    }
+    else if (format == "binary"){
+        s = tag.close + 1;
+        base64 = true;
+    }
+    else{
+        error = "Only binary and appended VTP arrays are supported (" + label + " is " + format + ")";
+        return false;
+    }
+
+    const char *limit = base64 && format == "binary" ? end : file.appendedEnd;
+    vector<unsigned char> storage;
+    const unsigned char *payload;
+    uint64_t bytes;
+    if (base64){
+        if (!decodeBase64(s, limit, file.headerBytes, storage)){
+            error = "Invalid base64 data (" + label + ")";
+            return false;
+        }
+        bytes = file.headerBytes == 4 ? load32(storage.data(), file.swap) : load64(storage.data(), file.swap);
+        if (bytes > (uint64_t) (limit - s) || !decodeBase64(s, limit, file.headerBytes + bytes, storage)){
+            error = "Invalid base64 data (" + label + ")";
+            return false;
+        }
+        payload = storage.data() + file.headerBytes;
+    }
+    else{
+        if ((size_t) (limit - s) < file.headerBytes){
+            error = "File ended unexpectedly (" + label + ")";
+            return false;
+        }
+        const unsigned char *raw = reinterpret_cast<const unsigned char *>(s);
+        bytes = file.headerBytes == 4 ? load32(raw, file.swap) : load64(raw, file.swap);
+        if (bytes > (uint64_t) (limit - s) - file.headerBytes){
+            error = "File ended unexpectedly (" + label + ")";
+            return false;
+        }
+        payload = raw + file.headerBytes;
+    }
+
+    if (bytes != count * scalarBytes(type)){
+        ostringstream message;
+        message << "Size mismatch " << bytes << " vs " << count * scalarBytes(type) << " bytes (" << label << ")";
+        error = message.str();
+        return false;
+    }
+    out.resize(count);
+    if (!convertArray(payload, type, file.swap, count, out.data(), pool)){
+        error = "Value out of range (" + label + ")";
+        return false;
+    }
+    return true;
+}
+
+// The DataArray in [begin, end) with attribute Name equal to name
+bool findNamedArray(const char *begin, const char *end, const string &name, XmlTag &tag){
+    for (const char *s = begin; findTag(s, end, "DataArray", tag); s = tag.close){
+        if (attribute(tag, "Name") == name)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * A VTKFile of type PolyData with one Piece: Points, Polys and, if the
+ * PointData names TCoords, texture coordinates. Arrays are appended (raw
+ * or base64) or inline base64; compressed files are rejected.
+ */
+bool parseVtp(const char *begin, const char *end, VtkPolyData &data, ThreadPool &pool, VtkParseStats &stats,
+        string &error){
+    Clock::time_point start = Clock::now();
+    XmlFile file;
+    XmlTag appendedTag;
+    file.appended = file.appendedEnd = NULL;
+    file.appendedBase64 = false;
+    const char *xmlEnd = end;
+    if (findTag(begin, end, "AppendedData", appendedTag)){
+        const char *underscore = static_cast<const char *>(memchr(appendedTag.close, '_', end - appendedTag.close));
+        if (underscore == NULL){
+            error = "File ended unexpectedly (AppendedData)";
+            return false;
+        }
+        file.appended = underscore + 1;
+        file.appendedEnd = end;
+        file.appendedBase64 = attribute(appendedTag, "encoding") == "base64";
+        xmlEnd = appendedTag.start;     // raw data may hold anything that looks like a tag
+    }
+
+    XmlTag root, piece;
+    if (!findTag(begin, xmlEnd, "VTKFile", root) || attribute(root, "type") != "PolyData"){
+        error = "Not a VTK PolyData XML file";
+        return false;
+    }
+    if (!attribute(root, "compressor").empty()){
+        error = "Compressed VTP files are not supported (" + attribute(root, "compressor") + ")";
+        return false;
+    }
+    file.swap = (attribute(root, "byte_order") == "BigEndian") != hostIsBigEndian();
+    file.headerBytes = attribute(root, "header_type") == "UInt64" ? 8 : 4;
+
+    if (!findTag(begin, xmlEnd, "Piece", piece)){
+        error = "File ended unexpectedly (Piece)";
+        return false;
+    }
+    XmlTag another;
+    if (findTag(piece.close, xmlEnd, "Piece", another)){
+        error = "Only single piece VTP files are supported";
+        return false;
+    }
+    long long pointCount = strtoll(attribute(piece, "NumberOfPoints").c_str(), NULL, 10);
+    long long polygonCount = strtoll(attribute(piece, "NumberOfPolys").c_str(), NULL, 10);
+    if (pointCount < 0 || polygonCount < 0){
+        error = "Invalid Piece header";
+        return false;
+    }
+    stats.scanSeconds = secondsSince(start);
+
+    // Points
+    start = Clock::now();
+    XmlTag section, array;
+    if (!findTag(piece.close, xmlEnd, "Points", section) || !findTag(section.close, xmlEnd, "DataArray", array)){
+        error = "File ended unexpectedly (Points)";
+        return false;
+    }
+    data.pointCount = pointCount;
+    if (!readXmlArray(array, xmlEnd, file, 3*data.pointCount, data.points, pool, error))
+        return false;
+    stats.pointsSeconds = secondsSince(start);
+    stats.pointsBytes = 3*data.pointCount*sizeof(float);
+
+    // Polys: connectivity, and the end of each polygon in it
+    start = Clock::now();
+    if (!findTag(piece.close, xmlEnd, "Polys", section)){
+        error = "File ended unexpectedly (Polys)";
+        return false;
+    }
+    const char *sectionEnd = elementEnd(section, xmlEnd, "Polys");
+    vector<int> offsets(1, 0), connectivity, ends;
+    if (!findNamedArray(section.close, sectionEnd, "offsets", array)){
+        error = "File ended unexpectedly (offsets)";
+        return false;
+    }
+    if (!readXmlArray(array, xmlEnd, file, polygonCount, ends, pool, error))
+        return false;
+    offsets.insert(offsets.end(), ends.begin(), ends.end());
+    size_t indexCount = ends.empty() ? 0 : (size_t) ends.back();
+    if (!findNamedArray(section.close, sectionEnd, "connectivity", array)){
+        error = "File ended unexpectedly (connectivity)";
+        return false;
+    }
+    if (!readXmlArray(array, xmlEnd, file, indexCount, connectivity, pool, error))
+        return false;
+    if (!connectivityToCells(offsets, connectivity, data, error))
+        return false;
+    stats.polygonsSeconds = secondsSince(start);
+    stats.polygonsBytes = (ends.size() + connectivity.size())*sizeof(int);
+
+    // Texture coordinates, if any
+    start = Clock::now();
+    XmlTag textures;
+    if (findTag(piece.close, xmlEnd, "PointData", section) && !attribute(section, "TCoords").empty()
+            && findNamedArray(section.close, elementEnd(section, xmlEnd, "PointData"), attribute(section, "TCoords"), textures)){
+        long long dimension = strtoll(attribute(textures, "NumberOfComponents").c_str(), NULL, 10);
+        if (dimension < 2){
+            error = "Invalid TCoords array";
+            return false;
+        }
+        data.textureCount = pointCount;
+        if (!readXmlArray(textures, xmlEnd, file, dimension*data.textureCount, data.textures, pool, error))
+            return false;
+        if (dimension != 2){    // only u and v are used
+            for (size_t i = 0; i < data.textureCount; i++){
+                data.textures[2*i] = data.textures[dimension*i];
+                data.textures[2*i+1] = data.textures[dimension*i+1];
+            }
+            data.textures.resize(2*data.textureCount);
+        }
+        stats.texturesBytes = dimension*data.textureCount*sizeof(float);
+    }
+    stats.texturesSeconds = secondsSince(start);
+    return true;
+}
+
+// An XML declaration or a VTKFile element near the start
+bool isXml(const char *begin, const char *end){
+    size_t bytes = end - begin < XML_SNIFF_BYTES ? end - begin : XML_SNIFF_BYTES;
+    string start(begin, bytes);
+    return start.find("<?xml") != string::npos || start.find("<VTKFile") != string::npos;
+}
+
+}
+
+/******************** FUNCTIONS ***********************/
+bool parseVtk(const string &path, VtkPolyData &data, ThreadPool &pool, VtkParseStats &stats, string &error){
+    stats = VtkParseStats();
+    stats.threads = pool.size();
+
+    Clock::time_point start = Clock::now();
+    vector<char> buffer;
+    struct stat info;
+    if (!readFile(path, buffer, info)){
+        error = "Unable to open VTK file";
+        return false;
+    }
+    data.fileSize = info.st_size;
+    data.fileMtime = info.st_mtim.tv_sec;
+    data.fileMtimeNsec = info.st_mtim.tv_nsec;
+    stats.fileBytes = buffer.size();
+    stats.readSeconds = secondsSince(start);
+
+    start = Clock::now();
+    const char *begin = buffer.data(), *end = begin + buffer.size();
+    if (isXml(begin, end))
+        return parseVtp(begin, end, data, pool, stats, error);
+
+    // The first four lines: version, title, format and dataset type
+    const char *s = begin;
+    string version = nextLine(s, end);
+    nextLine(s, end);   // title, free form
+    string format = nextLine(s, end);
+    string dataset = nextLine(s, end);
+    if (version.compare(0, 5, "# vtk") != 0){
+        error = "Not a legacy VTK file";
+        return false;
+    }
+    if (dataset.find("POLYDATA") == string::npos){
+        error = "Only POLYDATA VTK files are supported (" + dataset + ")";
+        return false;
+    }
+    if (format.compare(0, 6, "BINARY") == 0){
+        stats.scanSeconds = secondsSince(start);
+        return parseLegacyBinary(s, end, data, pool, stats, error);
+    }
+    if (format.compare(0, 5, "ASCII") != 0){
+        error = "Unknown VTK file format (" + format + ")";
+        return false;
+    }
+
+    vector<Section> sections = findSections(s, end, pool);
+    stats.scanSeconds = secondsSince(start);
+
+    int points = findSection(sections, "POINTS");
+    if (points < 0){
+        error = "File ended unexpectedly (POINTS)";
+        return false;
+    }
+    int polygons = findSection(sections, "POLYGONS", points + 1);
+    if (polygons < 0){
+        error = "File ended unexpectedly (POLYGONS)";
+        return false;
+    }
+    int pointData = findSection(sections, "POINT_DATA", polygons + 1);
+    if (pointData < 0){
+        error = "File ended unexpectedly (POINT_DATA)";
+        return false;
+    }
+    int textures = findSection(sections, "TEXTURE_COORDINATES", pointData + 1);
+    if (textures < 0){
+        error = "File ended unexpectedly (TEXTURE_COORDINATES)";
+        return false;
+    }
+
+    istringstream header;
+
+    // POINTS n dataType
+    long long pointCount = -1;
+    headerStream(sections[points], header);
+    header >> pointCount;
+    if (pointCount < 0){
+        error = "Invalid POINTS header";
+        return false;
+    }
+    data.pointCount = pointCount;
+    data.points.resize(3*data.pointCount);
+
+    start = Clock::now();
+    if (!parseSection(sections[points].data, sections[points].end, data.points.size(), data.points.data(), pool, "VERTICES", error))
+        return false;
+    stats.pointsSeconds = secondsSince(start);
+    stats.pointsBytes = sections[points].end - sections[points].data;
+
+    // POLYGONS n size
+    long long polygonCount = -1, cellSize = -1;
+    headerStream(sections[polygons], header);
+    header >> polygonCount >> cellSize;
+    if (polygonCount < 0 || cellSize < polygonCount){
+        error = "Invalid POLYGONS header";
+        return false;
+    }
+    data.polygonCount = polygonCount;
+    data.cells.resize(cellSize);
+
+    start = Clock::now();
+    if (!parseSection(sections[polygons].data, sections[polygons].end, data.cells.size(), data.cells.data(), pool, "POLYGONS", error)
+            || !checkCells(data, error))
+        return false;
+    stats.polygonsSeconds = secondsSince(start);
+    stats.polygonsBytes = sections[polygons].end - sections[polygons].data;
+
+    // POINT_DATA n, then TEXTURE_COORDINATES name dim dataType
+    long long textureCount = -1;
+    headerStream(sections[pointData], header);
+    header >> textureCount;
+    int dimension = -1;
+    string name;
+    headerStream(sections[textures], header);
+    header >> name >> dimension;
+    if (textureCount < 0 || dimension < 2){
+        error = "Invalid TEXTURE_COORDINATES header";
+        return false;
+    }
+    data.textureCount = textureCount;
+
+    start = Clock::now();
+    data.textures.resize(dimension*data.textureCount);
+    if (!parseSection(sections[textures].data, sections[textures].end, data.textures.size(), data.textures.data(), pool, "TEXTURE_COORDINATES", error))
+        return false;
+    if (dimension != 2){    // only u and v are used
+        for (size_t i = 0; i < data.textureCount; i++){
+            data.textures[2*i] = data.textures[dimension*i];
+            data.textures[2*i+1] = data.textures[dimension*i+1];
+        }
+        data.textures.resize(2*data.textureCount);
+    }
+    stats.texturesSeconds = secondsSince(start);
+    stats.texturesBytes = sections[textures].end - sections[textures].data;
+
+    return true;
+}
+
+uint64_t topologyHash(const VtkPolyData &data){
+    // FNV-1a over whole words
+    uint64_t hash = 14695981039346656037ull;
+    const uint64_t prime = 1099511628211ull;
+    uint64_t counts[2] = {data.pointCount, data.textureCount};
+    for (int i = 0; i < 2; i++)
+        hash = (hash ^ counts[i]) * prime;
+    for (size_t i = 0; i < data.cells.size(); i++)
+        hash = (hash ^ (uint32_t) data.cells[i]) * prime;
+    return hash;
+}
+
+bool checkPolyData(const VtkPolyData &data, bool degenerateAllowed, string &error){
+    ostringstream message;
+    for (size_t i = 0, polygon = 0; i < data.cells.size(); i += data.cells[i] + 1, polygon++){
+        if (data.cells[i] < 3 && !degenerateAllowed){
+            message << "Polygon " << polygon << " has fewer than 3 vertices";
+            error = message.str();
+            return false;
+        }
+        for (int j = 1; j <= data.cells[i]; j++){
+            int index = data.cells[i + j];
+            if (index < 0 || (size_t) index >= data.pointCount){
+                message << "Invalid vertex index " << index;
+                error = message.str();
+                return false;
+            }
+        }
+    }
+    if (data.textureCount > data.pointCount){
+        message << "More texture coordinates than vertices (" << data.textureCount << ")";
+        error = message.str();
+        return false;
+    }
+    return true;
+}
+
+void printVtkParseStats(const VtkParseStats &stats){
+    const double MB = 1024.*1024.;
+    cout << "Parsed " << stats.fileBytes/MB << " MB in " << stats.totalSeconds()*1000. << " ms ("
+            << stats.fileBytes/MB/stats.totalSeconds() << " MB/s, " << stats.threads << " threads)" << endl;
+    cout << "  read: " << stats.readSeconds*1000. << " ms, section scan: " << stats.scanSeconds*1000. << " ms" << endl;
+    // Only the sections the file had; texture coordinates are optional
+    const char *names[3] = {"POINTS", "POLYGONS", "TEXTURE_COORDINATES"};
+    size_t bytes[3] = {stats.pointsBytes, stats.polygonsBytes, stats.texturesBytes};
+    double seconds[3] = {stats.pointsSeconds, stats.polygonsSeconds, stats.texturesSeconds};
+    for (int i = 0; i < 3; i++){
+        if (bytes[i] > 0 && seconds[i] > 0)
+            cout << "  " << names[i] << ": " << bytes[i]/MB/seconds[i] << " MB/s" << endl;
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * Parallel parser for legacy VTK POLYDATA and VTK XML PolyData files
+ *
+ * The file is read in one go, the POINTS, POLYGONS and POINT_DATA
+ * TEXTURE_COORDINATES sections are located, and each section is split into
+ * line aligned chunks which are parsed on the thread pool. Numbers are parsed
+ * without going through iostreams or the locale, giving the same floats as
+ * "stream >> x" in the C locale.
+ *
+ * BINARY legacy files and .vtp files with appended (raw or base64) or
+ * inline base64 arrays are not tokenised at all: each array is copied out of
+ * the file in chunks on the thread pool, swapping its bytes when the file's
+ * byte order differs from the host's. Legacy binary payloads are big endian;
+ * .vtp files give theirs in byte_order. Texture coordinates are optional in
+ * both, and compressed .vtp files are not supported.
+ */
+
+#ifndef VTKPARSER_H_
+#define VTKPARSER_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+/*************** Classes *******************/
+// Raw arrays of a POLYDATA file
+struct VtkPolyData{
+    std::vector<float> points;      // x, y, z per point
+    std::vector<int> cells;         // POLYGONS section as is: n, i0, ..., i(n-1) per polygon
+    std::vector<float> textures;    // u, v per point
+    size_t pointCount, polygonCount, textureCount;
+
+    // The file as it was read, for stamping caches made from it
+    uint64_t fileSize;
+    int64_t fileMtime, fileMtimeNsec;
+
+    VtkPolyData(): pointCount(0), polygonCount(0), textureCount(0), fileSize(0), fileMtime(0), fileMtimeNsec(0){}
+};
+
+// Timings of a parse, for throughput reporting
+struct VtkParseStats{
+    size_t fileBytes, pointsBytes, polygonsBytes, texturesBytes;
+    double readSeconds, scanSeconds, pointsSeconds, polygonsSeconds, texturesSeconds;
+    unsigned threads;
+
+    VtkParseStats(): fileBytes(0), pointsBytes(0), polygonsBytes(0), texturesBytes(0),
+            readSeconds(0), scanSeconds(0), pointsSeconds(0), polygonsSeconds(0), texturesSeconds(0), threads(1){}
+
+    double totalSeconds() const {
+        return readSeconds + scanSeconds + pointsSeconds + polygonsSeconds + texturesSeconds;
+    }
+};
+
+// Parse path into data. On failure returns false and describes the problem in error.
+bool parseVtk(const std::string &path, VtkPolyData &data, ThreadPool &pool, VtkParseStats &stats, std::string &error);
+
+// Hash of the point counts and the polygons: equal for two files that differ only in point positions
+uint64_t topologyHash(const VtkPolyData &data);
+
+// Check that every polygon has at least three corners, unless degenerateAllowed, each a point of data,
+// and that there are no more texture coordinates than points. Parsing only checks the cell sizes.
+bool checkPolyData(const VtkPolyData &data, bool degenerateAllowed, std::string &error);
+
+// Print the throughput of each section in MB/s
+void printVtkParseStats(const VtkParseStats &stats);
+
+#endif /* VTKPARSER_H_ */
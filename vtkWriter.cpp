@@ -0,0 +1,56 @@
+/**
+ * Writer for ASCII legacy VTK POLYDATA files -- see vtkWriter.h
+ */
+
+/*************** Includes *******************/
+#include "vtkWriter.h"
+
+#include <cstdio>
+
+using namespace std;
+
+/*************** Macros *******************/
+// Numbers per line, as in the files we are given
+#define VALUES_PER_LINE 9
+
+/******************** FUNCTIONS ***********************/
+bool writeVtk(const string &path, const string &title, const VertexArrays &vertices,
+        const PolygonList &polygons, string &error){
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == NULL){
+        error = "Unable to open " + path + " for writing";
+        return false;
+    }
+
+    size_t n = vertices.size();
+    fprintf(out, "# vtk DataFile Version 3.0\n%s\nASCII\nDATASET POLYDATA\n", title.c_str());
+
+    fprintf(out, "POINTS %zu float\n", n);
+    const float *x = vertices.get(VERTEX_X), *y = vertices.get(VERTEX_Y), *z = vertices.get(VERTEX_Z);
+    for (size_t i = 0; i < n; i++)
+        fprintf(out, "%.9g %.9g %.9g%s", x[i], y[i], z[i], (i % (VALUES_PER_LINE/3) == VALUES_PER_LINE/3 - 1) ? " \n" : " ");
+    if (n % (VALUES_PER_LINE/3) != 0)
+        fprintf(out, "\n");
+
+    fprintf(out, "POLYGONS %zu %zu\n", polygons.size(), polygons.size() + polygons.getIndexCount());
+    for (size_t i = 0; i < polygons.size(); i++){
+        Polygon polygon = polygons[i];
+        fprintf(out, "%d ", polygon.size());
+        for (const int *j = polygon.begin(); j < polygon.end(); j++)
+            fprintf(out, "%d ", *j);
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "POINT_DATA %zu \nTEXTURE_COORDINATES texture 2 float\n", n);
+    const float *u = vertices.get(VERTEX_U), *v = vertices.get(VERTEX_V);
+    for (size_t i = 0; i < n; i++)
+        fprintf(out, "%.9g %.9g%s", u[i], v[i], (i % (VALUES_PER_LINE/2) == VALUES_PER_LINE/2 - 1) ? " \n" : " ");
+    fprintf(out, "\n");
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0 || !ok){
+        error = "Unable to write " + path;
+        return false;
+    }
+    return true;
+}
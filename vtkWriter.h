@@ -0,0 +1,22 @@
+/**
+ * Writer for ASCII legacy VTK POLYDATA files
+ *
+ * Writes the layout vtkParser.h reads: POINTS, POLYGONS and the
+ * TEXTURE_COORDINATES of POINT_DATA. Floats are written with enough digits
+ * to read back unchanged.
+ */
+
+#ifndef VTKWRITER_H_
+#define VTKWRITER_H_
+
+#include <string>
+
+#include "polygonList.h"
+#include "vertexArrays.h"
+
+/*************** Function Prototypes *******************/
+// Write the mesh to path. On failure returns false and describes the problem in error.
+bool writeVtk(const std::string &path, const std::string &title, const VertexArrays &vertices,
+        const PolygonList &polygons, std::string &error);
+
+#endif /* VTKWRITER_H_ */